@@ -0,0 +1,57 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+using UnrealBuildTool;
+
+public class CapsaBenchmark : ModuleRules
+{
+	public CapsaBenchmark(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+		
+		PublicIncludePaths.AddRange(
+			new string[]
+			{
+			}
+			);
+				
+		
+		PrivateIncludePaths.AddRange(
+			new string[]
+			{
+			}
+			);
+			
+		
+		PublicDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"Core",
+			}
+			);
+			
+		
+		PrivateDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"CapsaCore",
+				"CapsaLog",
+				"CoreUObject",
+				"Engine",
+				"HTTP",
+				"HTTPServer",
+				"Json",
+				"Projects",
+			}
+			);
+
+		// Used by the stub endpoint to inflate compressed chunks
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
+		
+		
+		DynamicallyLoadedModuleNames.AddRange(
+			new string[]
+			{
+			}
+			);
+	}
+}
@@ -0,0 +1,18 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaBenchmark.h"
+
+#define LOCTEXT_NAMESPACE "FCapsaBenchmarkModule"
+
+void FCapsaBenchmarkModule::StartupModule()
+{
+}
+
+void FCapsaBenchmarkModule::ShutdownModule()
+{
+}
+
+#undef LOCTEXT_NAMESPACE
+
+IMPLEMENT_MODULE(FCapsaBenchmarkModule, CapsaBenchmark)
+DEFINE_LOG_CATEGORY(LogCapsaBenchmark);
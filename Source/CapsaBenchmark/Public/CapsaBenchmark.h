@@ -0,0 +1,16 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Modules/ModuleManager.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogCapsaBenchmark, Log, All);
+
+class FCapsaBenchmarkModule : public IModuleInterface
+{
+public:
+	/** IModuleInterface implementation */
+	virtual void StartupModule() override;
+	virtual void ShutdownModule() override;
+};
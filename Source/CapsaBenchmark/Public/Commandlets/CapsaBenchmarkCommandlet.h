@@ -0,0 +1,87 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "CapsaBenchmarkCommandlet.generated.h"
+
+/// Headless benchmark for the Capsa log pipeline, intended to compare plugin versions on a CI machine without network access.
+///
+/// Replays a synthetic or recorded log workload through FCapsaOutputDevice, CapsaLogOperations and UCapsaCoreSubsystem::SendLog.
+/// Uploads go to a stub Capsa server hosted in-process on the loopback interface, which matches every received line to its capture time.
+/// Results are written as JSON to the log and, optionally, to a file.
+///
+/// Modes:
+///  Pipeline  Measures capture cost, format and compress throughput, and end-to-end latency. The default.
+///  Storm     Ticks a headless game world at a fixed frame rate while logging, and fails (returns 1) if the game-thread time attributable to Capsa
+///            per frame exceeds a budget. Intended as a regression gate for FCapsaOutputDevice and the async send path.
+///  Compress  Formats and compresses one large chunk with an increasing number of workers, and reports the speedup of segmented compression.
+///  Transcode Converts formatted logs to UTF-8 with CapsaUtf8 and with FPlatformString, with and without non-ASCII player names, and fails if
+///            the outputs differ.
+///  Redact    Redacts one chunk with a share of lines holding personal data, and fails if the throughput is below a target.
+///  JsonLines Encodes one chunk as JSON-lines for stdout with CapsaJsonLines and with a FJsonObject per line, and reports the speedup.
+///  Startup   Reports the time Capsa added to the startup of the process, and the time FCapsaOutputDevice takes to stage a synthetic startup
+///            backlog, to ingest and upload it in slices, and to capture it synchronously, with the number of chunks it was uploaded as.
+///  Attach    Spawns the AutoAddClass actors of joining players into a world holding other actors, and reports what adding the Capsa Component
+///            costs per player, compared to looking for AutoAddClass actors on every login. Fails if a player did not get exactly one component.
+///
+/// Usage: UnrealEditor-Cmd <Project> -run=CapsaBenchmark [options]
+///  -Mode=<Pipeline|Storm|Compress|Transcode|Redact|JsonLines|Startup|Attach> Which benchmark to run. Default Pipeline.
+///  -Duration=<seconds>           How long to generate lines for. Default 10.
+///  -LinesPerSecond=<n>           Total line rate across all threads. Default 20000.
+///  -Threads=<n>                  Number of threads generating lines. Default 4.
+///  -LineSizes=<size:weight,...>  Weighted distribution of message sizes in characters. Default 64:70,256:25,2048:5.
+///  -Categories=<name:weight,...> Weighted mix of log categories. Default LogTemp:50,LogNet:30,LogAI:15,LogPhysics:5.
+///  -ErrorPercent=<percent>       Percentage of lines logged as Error, the rest are logged as Log. Default 0.
+///  -Replay=<path>                Replay the messages and categories of a recorded log file instead of generating them.
+///  -Port=<port>                  Port for the stub endpoint. Default 8089.
+///  -Output=<path>                Also write the JSON report to this file.
+///  -Setting.<Property>=<value>   Override a UCapsaSettings property for the run, for example -Setting.bUseCompression=False.
+///
+/// Storm options:
+///  -FrameRate=<fps>              Game world tick rate. Default 30.
+///  -GameThreadLinesPerFrame=<n>  Lines logged from the game thread each frame, on top of the worker threads. Default 20.
+///  -BudgetMs=<ms>                Game-thread time Capsa may use per frame. Default 0.5.
+///  -BudgetPercentile=<percent>   Frame percentile compared against the budget. Default 99.
+///
+/// Compress options:
+///  -Lines=<n>                    Lines in the chunk. Default 200000.
+///  -Workers=<n,n,...>            Worker counts to measure, the first is the baseline for the speedup. Default 1,4,16.
+///  -Iterations=<n>               Runs per worker count, the best is reported. Default 3.
+///
+/// Transcode options:
+///  -Lines=<n>                    Lines in each corpus. Default 100000.
+///  -Iterations=<n>               Runs per corpus, the best is reported. Default 5.
+///
+/// Redact options:
+///  -Lines=<n>                    Lines in the chunk. Default 100000.
+///  -Iterations=<n>               Runs, the best is reported. Default 5.
+///  -SecretPercent=<percent>      Percentage of lines with an IP address, email address or token appended. Default 5.
+///  -TargetMBps=<n>               Minimum redaction throughput. Default 200.
+///
+/// JsonLines options:
+///  -Lines=<n>                    Lines in the chunk. Default 100000.
+///  -Iterations=<n>               Runs, the best is reported. Default 5.
+///  -WriteStdout                  Also measure writing the encoded chunk to stdout with FCapsaStdoutSink.
+///
+/// Startup options:
+///  -Lines=<n>                    Lines in the backlog, ingested in slices of -Setting.MaxLogLinesBetweenLogFlushes. Default 50000.
+///  -Timeout=<seconds>            How long to wait for the backlog to be ingested. Default 60.
+///
+/// Attach options:
+///  -Players=<n>                  Players that join, one AutoAddClass actor each. Default 200.
+///  -Actors=<n>                   Other actors in the world. Default 5000.
+///  -Travels=<n>                  Worlds loaded and cleaned up before the measured one. Default 3.
+UCLASS()
+class CAPSABENCHMARK_API UCapsaBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UCapsaBenchmarkCommandlet();
+
+	// Begin UCommandlet
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet
+};
@@ -41,6 +41,7 @@ public class CapsaCore : ModuleRules
 				"HTTP",
 				"Json",
 				"JsonUtilities",
+				"NetCore",
 			}
 			);
 		
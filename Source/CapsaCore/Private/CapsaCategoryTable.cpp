@@ -0,0 +1,45 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaCategoryTable.h"
+
+#include "CapsaCoreStats.h"
+
+FCapsaCategoryTable& FCapsaCategoryTable::Get()
+{
+	static FCapsaCategoryTable Table;
+	return Table;
+}
+
+void FCapsaCategoryTable::AppendCategory(FString& Log, const FName& Category)
+{
+	if (Category.GetNumber() != NAME_NO_NUMBER_INTERNAL)
+	{
+		// The comparison index does not include the number, categories with a number suffix are rare enough to format every time
+		Log.Append(FString::Printf(TEXT("[%s]: "), *Category.ToString()));
+		return;
+	}
+
+	const FNameEntryId Key = Category.GetComparisonIndex();
+	{
+		FReadScopeLock ReadLock(Lock);
+		if (const FString* Cached = Categories.Find(Key))
+		{
+			Log.Append(*Cached);
+			return;
+		}
+	}
+
+	LLM_SCOPE_BYTAG(Capsa);
+	const FString Formatted = FString::Printf(TEXT("[%s]: "), *Category.ToString());
+	{
+		FWriteScopeLock WriteLock(Lock);
+		Categories.Add(Key, Formatted);
+	}
+	Log.Append(Formatted);
+}
+
+int32 FCapsaCategoryTable::Num() const
+{
+	FReadScopeLock ReadLock(Lock);
+	return Categories.Num();
+}
@@ -0,0 +1,281 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaCoreStats.h"
+
+LLM_DEFINE_TAG(Capsa);
+
+DEFINE_STAT(STAT_CapsaLinesCaptured);
+DEFINE_STAT(STAT_CapsaBytesCaptured);
+DEFINE_STAT(STAT_CapsaLinesDropped);
+DEFINE_STAT(STAT_CapsaBufferHighWater);
+DEFINE_STAT(STAT_CapsaCompressionRatio);
+DEFINE_STAT(STAT_CapsaUploadLatency);
+DEFINE_STAT(STAT_CapsaUploadFailures);
+DEFINE_STAT(STAT_CapsaInFlightRequests);
+DEFINE_STAT(STAT_CapsaGameThreadTime);
+
+DEFINE_STAT(STAT_CapsaCapture);
+DEFINE_STAT(STAT_CapsaTick);
+DEFINE_STAT(STAT_CapsaRedact);
+DEFINE_STAT(STAT_CapsaFormat);
+DEFINE_STAT(STAT_CapsaCompress);
+DEFINE_STAT(STAT_CapsaDiskWrite);
+
+namespace
+{
+uint64 SecondsToMicros(double Seconds)
+{
+	return static_cast<uint64>(FMath::Max(Seconds, 0.0) * 1000000.0);
+}
+
+const TCHAR* MemoryStageNames[] = {
+	TEXT("Buffered"),
+	TEXT("Queued"),
+	TEXT("Formatted"),
+	TEXT("CompressionScratch"),
+	TEXT("Compressed"),
+	TEXT("HttpPayload"),
+	TEXT("History"),
+};
+static_assert(UE_ARRAY_COUNT(MemoryStageNames) == static_cast<uint8>(ECapsaMemoryStage::Num), "Missing ECapsaMemoryStage name");
+
+double AverageMillis(uint64 TotalMicros, uint64 Samples)
+{
+	return Samples > 0 ? static_cast<double>(TotalMicros) / static_cast<double>(Samples) / 1000.0 : 0.0;
+}
+}
+
+FCapsaPipelineStats& FCapsaPipelineStats::Get()
+{
+	static FCapsaPipelineStats Instance;
+	return Instance;
+}
+
+void FCapsaPipelineStats::RecordCapture(int64 Bytes)
+{
+	LinesCaptured.fetch_add(1, std::memory_order_relaxed);
+	BytesCaptured.fetch_add(Bytes, std::memory_order_relaxed);
+
+	INC_DWORD_STAT(STAT_CapsaLinesCaptured);
+	INC_DWORD_STAT_BY(STAT_CapsaBytesCaptured, Bytes);
+}
+
+void FCapsaPipelineStats::RecordDropped(int64 Lines)
+{
+	if (Lines <= 0)
+	{
+		return;
+	}
+
+	LinesDropped.fetch_add(Lines, std::memory_order_relaxed);
+
+	INC_DWORD_STAT_BY(STAT_CapsaLinesDropped, Lines);
+}
+
+void FCapsaPipelineStats::RecordBufferSize(int64 Lines)
+{
+	uint64 Current = BufferHighWater.load(std::memory_order_relaxed);
+	while (static_cast<uint64>(Lines) > Current)
+	{
+		if (BufferHighWater.compare_exchange_weak(Current, Lines, std::memory_order_relaxed))
+		{
+			SET_DWORD_STAT(STAT_CapsaBufferHighWater, Lines);
+			break;
+		}
+	}
+}
+
+void FCapsaPipelineStats::RecordRedact(double Seconds, int64 InputBytes, int64 Matches)
+{
+	ChunksRedacted.fetch_add(1, std::memory_order_relaxed);
+	RedactMicros.fetch_add(SecondsToMicros(Seconds), std::memory_order_relaxed);
+	RedactInputBytes.fetch_add(InputBytes, std::memory_order_relaxed);
+	RedactMatches.fetch_add(Matches, std::memory_order_relaxed);
+}
+
+void FCapsaPipelineStats::RecordFormat(double Seconds, int64 OutputBytes)
+{
+	ChunksFormatted.fetch_add(1, std::memory_order_relaxed);
+	FormatMicros.fetch_add(SecondsToMicros(Seconds), std::memory_order_relaxed);
+	FormattedBytes.fetch_add(OutputBytes, std::memory_order_relaxed);
+}
+
+void FCapsaPipelineStats::RecordCompress(double Seconds, int64 UncompressedBytes, int64 CompressedBytes)
+{
+	ChunksCompressed.fetch_add(1, std::memory_order_relaxed);
+	CompressMicros.fetch_add(SecondsToMicros(Seconds), std::memory_order_relaxed);
+	CompressInputBytes.fetch_add(UncompressedBytes, std::memory_order_relaxed);
+	CompressOutputBytes.fetch_add(CompressedBytes, std::memory_order_relaxed);
+
+	SET_FLOAT_STAT(STAT_CapsaCompressionRatio, UncompressedBytes > 0 ? static_cast<float>(CompressedBytes) / static_cast<float>(UncompressedBytes) : 0.f);
+}
+
+void FCapsaPipelineStats::RecordDiskWrite(double Seconds)
+{
+	DiskWrites.fetch_add(1, std::memory_order_relaxed);
+	DiskWriteMicros.fetch_add(SecondsToMicros(Seconds), std::memory_order_relaxed);
+}
+
+void FCapsaPipelineStats::RecordRequestStarted()
+{
+	RequestsSent.fetch_add(1, std::memory_order_relaxed);
+	RequestsInFlight.fetch_add(1, std::memory_order_relaxed);
+
+	INC_DWORD_STAT(STAT_CapsaInFlightRequests);
+}
+
+void FCapsaPipelineStats::RecordRequestFinished(double LatencySeconds, bool bFailed)
+{
+	RequestsInFlight.fetch_sub(1, std::memory_order_relaxed);
+	UploadLatencyMicros.fetch_add(SecondsToMicros(LatencySeconds), std::memory_order_relaxed);
+	UploadLatencySamples.fetch_add(1, std::memory_order_relaxed);
+
+	DEC_DWORD_STAT(STAT_CapsaInFlightRequests);
+	SET_FLOAT_STAT(STAT_CapsaUploadLatency, LatencySeconds * 1000.0);
+
+	if (bFailed)
+	{
+		RequestsFailed.fetch_add(1, std::memory_order_relaxed);
+		INC_DWORD_STAT(STAT_CapsaUploadFailures);
+	}
+}
+
+void FCapsaPipelineStats::RecordGameThreadCycles(uint64 Cycles)
+{
+	if (!IsInGameThread())
+	{
+		return;
+	}
+
+	GameThreadCycles.fetch_add(Cycles, std::memory_order_relaxed);
+
+	INC_FLOAT_STAT_BY(STAT_CapsaGameThreadTime, FPlatformTime::ToMilliseconds64(Cycles));
+}
+
+void FCapsaPipelineStats::RecordStartup(double Seconds, bool bDeferred)
+{
+	std::atomic<uint64>& Micros = bDeferred ? DeferredStartupMicros : StartupMicros;
+	Micros.fetch_add(static_cast<uint64>(Seconds * 1000000.0), std::memory_order_relaxed);
+}
+
+void FCapsaPipelineStats::AddLiveBytes(ECapsaMemoryStage Stage, int64 DeltaBytes)
+{
+	const uint8 StageIndex = static_cast<uint8>(Stage);
+	const int64 Current = LiveBytes[StageIndex].fetch_add(DeltaBytes, std::memory_order_relaxed) + DeltaBytes;
+
+	int64 Peak = PeakLiveBytes[StageIndex].load(std::memory_order_relaxed);
+	while (Current > Peak && !PeakLiveBytes[StageIndex].compare_exchange_weak(Peak, Current, std::memory_order_relaxed))
+	{
+	}
+}
+
+void FCapsaPipelineStats::Dump(FOutputDevice& Ar) const
+{
+	const uint64 CompressIn = CompressInputBytes.load();
+	const uint64 CompressOut = CompressOutputBytes.load();
+
+	Ar.Logf(TEXT("Capsa pipeline stats:"));
+	Ar.Logf(TEXT("  Capture:   %llu lines, %llu bytes, %llu dropped, high-water %llu lines"), LinesCaptured.load(), BytesCaptured.load(), LinesDropped.load(),
+		BufferHighWater.load());
+	Ar.Logf(TEXT("  Redact:    %llu chunks, %.3f ms/chunk, %llu bytes, %llu matches"), ChunksRedacted.load(),
+		AverageMillis(RedactMicros.load(), ChunksRedacted.load()), RedactInputBytes.load(), RedactMatches.load());
+	Ar.Logf(TEXT("  Format:    %llu chunks, %.3f ms/chunk, %llu bytes"), ChunksFormatted.load(), AverageMillis(FormatMicros.load(), ChunksFormatted.load()),
+		FormattedBytes.load());
+	Ar.Logf(TEXT("  Compress:  %llu chunks, %.3f ms/chunk, ratio %.3f"), ChunksCompressed.load(), AverageMillis(CompressMicros.load(), ChunksCompressed.load()),
+		CompressIn > 0 ? static_cast<double>(CompressOut) / static_cast<double>(CompressIn) : 0.0);
+	Ar.Logf(TEXT("  Disk:      %llu writes, %.3f ms/write"), DiskWrites.load(), AverageMillis(DiskWriteMicros.load(), DiskWrites.load()));
+	Ar.Logf(TEXT("  Uploads:   %llu sent, %llu failed, %lld in flight, %.3f ms average latency"), RequestsSent.load(), RequestsFailed.load(),
+		RequestsInFlight.load(), AverageMillis(UploadLatencyMicros.load(), UploadLatencySamples.load()));
+	Ar.Logf(TEXT("  Game:      %.3f ms total on the game thread"), FPlatformTime::ToMilliseconds64(GameThreadCycles.load()));
+	Ar.Logf(TEXT("  Startup:   %.3f ms on the startup path, %.3f ms deferred, %llu startup lines"), StartupMicros.load() / 1000.0,
+		DeferredStartupMicros.load() / 1000.0, StartupLines.load());
+}
+
+void FCapsaPipelineStats::DumpMemory(FOutputDevice& Ar) const
+{
+	int64 TotalLive = 0;
+	int64 TotalPeak = 0;
+
+	Ar.Logf(TEXT("Capsa live memory by pipeline stage:"));
+	for (uint8 StageIndex = 0; StageIndex < static_cast<uint8>(ECapsaMemoryStage::Num); ++StageIndex)
+	{
+		const int64 Live = LiveBytes[StageIndex].load();
+		const int64 Peak = PeakLiveBytes[StageIndex].load();
+		TotalLive += Live;
+		TotalPeak += Peak;
+
+		Ar.Logf(TEXT("  %-20s %10.1f KiB live, %10.1f KiB peak"), MemoryStageNames[StageIndex], Live / 1024.0, Peak / 1024.0);
+	}
+	// Stages peak at different times, so the sum of the peaks is an upper bound rather than the actual peak
+	Ar.Logf(TEXT("  %-20s %10.1f KiB live, %10.1f KiB peak (upper bound)"), TEXT("Total"), TotalLive / 1024.0, TotalPeak / 1024.0);
+}
+
+FCapsaLiveBytes::FCapsaLiveBytes(ECapsaMemoryStage InStage, int64 InBytes) :
+	Stage(InStage),
+	Bytes(InBytes)
+{
+	FCapsaPipelineStats::Get().AddLiveBytes(Stage, Bytes);
+}
+
+FCapsaLiveBytes::FCapsaLiveBytes(FCapsaLiveBytes&& Other) :
+	Stage(Other.Stage),
+	Bytes(Other.Bytes)
+{
+	Other.Bytes = 0;
+}
+
+FCapsaLiveBytes& FCapsaLiveBytes::operator=(FCapsaLiveBytes&& Other)
+{
+	if (this != &Other)
+	{
+		Release();
+		Stage = Other.Stage;
+		Bytes = Other.Bytes;
+		Other.Bytes = 0;
+	}
+	return *this;
+}
+
+FCapsaLiveBytes::~FCapsaLiveBytes()
+{
+	Release();
+}
+
+void FCapsaLiveBytes::MoveTo(ECapsaMemoryStage NewStage)
+{
+	if (NewStage == Stage)
+	{
+		return;
+	}
+
+	FCapsaPipelineStats::Get().AddLiveBytes(Stage, -Bytes);
+	FCapsaPipelineStats::Get().AddLiveBytes(NewStage, Bytes);
+	Stage = NewStage;
+}
+
+void FCapsaLiveBytes::Release()
+{
+	if (Bytes != 0)
+	{
+		FCapsaPipelineStats::Get().AddLiveBytes(Stage, -Bytes);
+		Bytes = 0;
+	}
+}
+
+static FAutoConsoleCommandWithOutputDevice CVarCapsaMemReport(
+	TEXT("Capsa.MemReport"),
+	TEXT("Prints the bytes Capsa currently holds, and has held at most, per pipeline stage: buffered and queued lines, formatted strings, ")
+	TEXT("compression scratch space, compressed chunks and in-flight HTTP payloads. Use LLM (-llm) and the Capsa tag for total heap usage."),
+	FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+	{
+		FCapsaPipelineStats::Get().DumpMemory(Ar);
+	}));
+
+static FAutoConsoleCommandWithOutputDevice CVarCapsaStats(
+	TEXT("Capsa.Stats"),
+	TEXT("Prints the Capsa log pipeline counters: captured and dropped lines, buffer high-water mark, ")
+	TEXT("format/compress/disk time per chunk, compression ratio and HTTP upload statistics."),
+	FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+	{
+		FCapsaPipelineStats::Get().Dump(Ar);
+	}));
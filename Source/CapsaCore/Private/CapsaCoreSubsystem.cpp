@@ -3,8 +3,12 @@
 #include "CapsaCoreSubsystem.h"
 
 #include "CapsaCore.h"
-#include "CapsaCoreAsync.h"
+#include "CapsaCoreStats.h"
+#include "CapsaCoreTrace.h"
 #include "CapsaCoreJson.h"
+#include "CapsaLogSinks.h"
+#include "CapsaLogStreams.h"
+#include "Components/CapsaGameStateComponent.h"
 #include "JsonObjectConverter.h"
 #include "FunctionLibrary/CapsaCoreFunctionLibrary.h"
 #include "Settings/CapsaSettings.h"
@@ -12,18 +16,62 @@
 #include "Interfaces/IHttpRequest.h"
 #include "Interfaces/IHttpResponse.h"
 
-#include "Kismet/GameplayStatics.h"
-#include "GameFramework/GameModeBase.h"
+#include "Engine/Engine.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameStateBase.h"
+#include "HAL/Event.h"
+#include "HAL/FileManager.h"
 #include "HttpManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#if PLATFORM_UNIX || PLATFORM_MAC
+#include <sys/stat.h>
+#endif
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaCoreSubsystem)
 
+namespace
+{
+/// How often TickUploads checks whether a token expires, in seconds.
+constexpr double RefreshCheckInterval = 10.0;
+
+/// The minimum time between two refreshes of a token, in seconds, so a server handing out short lived tokens, or failing, is not asked every tick.
+constexpr double MinRefreshInterval = 30.0;
+
+/// How long a blocking log chunk request, made at shutdown, waits for its response, in seconds.
+constexpr double BlockingRequestTimeout = 10.0;
+
+/// Ticks the HTTP module until a blocking request completes, as the game thread that usually ticks it is waiting. Cancels the request once it
+/// took BlockingRequestTimeout, so a server that does not respond cannot hang the process at exit.
+/// @param Request The request, already processing.
+/// @param CompletionEvent Triggered by the completion delegate of the request, which holds a reference to it.
+void WaitForBlockingRequest(IHttpRequest& Request, FEventRef& CompletionEvent)
+{
+	const double EndTime = FPlatformTime::Seconds() + BlockingRequestTimeout;
+	while (!CompletionEvent->Wait(0))
+	{
+		if (FPlatformTime::Seconds() >= EndTime)
+		{
+			UE_LOG(LogCapsaCore, Warning, TEXT("WaitForBlockingRequest | No response from %s within %.0f seconds, cancelling"), *Request.GetURL(),
+				BlockingRequestTimeout);
+			Request.CancelRequest();
+			return;
+		}
+
+		FHttpModule::Get().GetHttpManager().Tick(0.01f);
+		FPlatformProcess::Sleep(0.01f);
+	}
+}
+}
+
 UCapsaCoreSubsystem::UCapsaCoreSubsystem() :
-	Token(""),
-	LogID(""),
-	LinkWeb(""),
-	Expiry(""),
-	CapsaActorComponent(nullptr)
+	SessionSegment(0),
+	NextRefreshCheckTime(0.0),
+	bStartupPending(false),
+	bClientAuthPending(false),
+	DefaultSinksConfig(INDEX_NONE)
 {
 }
 
@@ -32,10 +80,30 @@ void UCapsaCoreSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	Super::Initialize(Collection);
 
 	UE_LOG(LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::Initialize | Starting Up..." ));
+	FCapsaStartupScope StartupScope(false);
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	UploadPipeline = MakeShared<FCapsaUploadPipeline, ESPMode::ThreadSafe>(CapsaSettings != nullptr ? CapsaSettings->GetMaxQueuedLogChunks() : 8);
+	UploadTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UCapsaCoreSubsystem::TickUploads));
 
-	RequestClientAuth();
+	if (CapsaSettings != nullptr && CapsaSettings->GetUseHostAgent())
+	{
+		if (FCapsaHostAgentClient::IsSupported())
+		{
+			HostAgent = MakeShared<FCapsaHostAgentClient, ESPMode::ThreadSafe>(CapsaSettings->GetHostAgentSocketPath());
+		}
+		else
+		{
+			UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::Initialize | The host agent is not supported on this platform, uploading directly"));
+		}
+	}
+
+	// Authenticating and compiling the redaction patterns wait for the first tick, so they do not add to the time the engine takes to start
+	bStartupPending = true;
 
 	OnPostWorldInitializationHandle = FWorldDelegates::OnPostWorldInitialization.AddUObject(this, &UCapsaCoreSubsystem::OnPostWorldInit);
+	OnWorldInitializedActorsHandle = FWorldDelegates::OnWorldInitializedActors.AddUObject(this, &UCapsaCoreSubsystem::OnWorldInitializedActors);
+	OnWorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddUObject(this, &UCapsaCoreSubsystem::OnWorldCleanup);
 }
 
 void UCapsaCoreSubsystem::Deinitialize()
@@ -45,42 +113,146 @@ void UCapsaCoreSubsystem::Deinitialize()
 		FWorldDelegates::OnPostWorldInitialization.Remove(OnPostWorldInitializationHandle);
 	}
 
-	FGameModeEvents::GameModePostLoginEvent.RemoveAll(this);
-	FGameModeEvents::GameModeLogoutEvent.RemoveAll(this);
+	FWorldDelegates::OnWorldInitializedActors.Remove(OnWorldInitializedActorsHandle);
+	FWorldDelegates::OnWorldCleanup.Remove(OnWorldCleanupHandle);
+	for (const TPair<TWeakObjectPtr<UWorld>, FDelegateHandle>& AutoAddWorld : AutoAddWorlds)
+	{
+		if (UWorld* World = AutoAddWorld.Key.Get())
+		{
+			World->RemoveOnActorSpawnedHandler(AutoAddWorld.Value);
+		}
+	}
+	AutoAddWorlds.Reset();
+
+	FWorldDelegates::OnWorldTickStart.RemoveAll(this);
+	FWorldDelegates::OnWorldTickEnd.RemoveAll(this);
+	WorldStreams.Reset();
+
+	FTSTicker::GetCoreTicker().RemoveTicker(UploadTickerHandle);
+	if (RedactorTask.IsValid())
+	{
+		RedactorTask.Wait();
+	}
+	if (UploadPipeline.IsValid())
+	{
+		// Chunks still in the pipeline were flushed during OnEnginePreExit, anything enqueued since is dropped
+		UploadPipeline->WaitUntilDelivered();
+		UploadPipeline.Reset();
+	}
+	DefaultSinks.Reset();
+	RegisteredSinks.Reset();
+	HostAgent.Reset();
 
 	Super::Deinitialize();
 }
 
-FCapsaSharedData UCapsaCoreSubsystem::GetServerCapsaData() const
+FCapsaSharedData UCapsaCoreSubsystem::GetServerCapsaData(const UObject* WorldContextObject) const
 {
-	if (!CapsaActorComponent.IsValid())
+	const UCapsaGameStateComponent* GameStateComponent = FindGameStateComponent(WorldContextObject);
+	if (GameStateComponent == nullptr)
 	{
-		UE_LOG(LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::GetServerCapsaData | No valid reference to CapsaActorComponent" ));
+		UE_LOG(LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::GetServerCapsaData | No GameStateComponent found" ));
 		return FCapsaSharedData{};
 	}
 
-	return CapsaActorComponent->CapsaServerData;
+	return GameStateComponent->CapsaServerData;
+}
+
+UCapsaGameStateComponent* UCapsaCoreSubsystem::FindGameStateComponent(const UObject* WorldContextObject)
+{
+	auto FindInWorld = [](const UWorld* World) -> UCapsaGameStateComponent*
+	{
+		const AGameStateBase* GameState = World != nullptr ? World->GetGameState() : nullptr;
+		return GameState != nullptr ? GameState->FindComponentByClass<UCapsaGameStateComponent>() : nullptr;
+	};
+
+	if (WorldContextObject != nullptr)
+	{
+		return FindInWorld(GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::ReturnNull));
+	}
+
+	// Only unambiguous when a single game World has one
+	UCapsaGameStateComponent* Found = nullptr;
+	for (const FWorldContext& WorldContext : GEngine->GetWorldContexts())
+	{
+		if (!WorldContext.World() || !WorldContext.World()->IsGameWorld())
+		{
+			continue;
+		}
+
+		if (UCapsaGameStateComponent* GameStateComponent = FindInWorld(WorldContext.World()))
+		{
+			if (Found != nullptr)
+			{
+				UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::FindGameStateComponent | Several game worlds have a GameStateComponent, pass a world"));
+				return nullptr;
+			}
+			Found = GameStateComponent;
+		}
+	}
+	return Found;
 }
 
 bool UCapsaCoreSubsystem::IsAuthenticated() const
 {
-	return (!Token.IsEmpty()) && (!LogID.IsEmpty());
+	return Session.IsAuthenticated();
+}
+
+bool UCapsaCoreSubsystem::IsAuthenticating() const
+{
+	return !Session.IsAuthenticated() && (bStartupPending || bClientAuthPending);
 }
 
 FString UCapsaCoreSubsystem::GetLogID() const
 {
-	return LogID;
+	return Session.LogID;
 }
 
 FString UCapsaCoreSubsystem::GetLogURL() const
 {
-	return LinkWeb;
+	return Session.LinkWeb;
+}
+
+const FCapsaSession* UCapsaCoreSubsystem::FindSession(uint16 Stream) const
+{
+	return Stream == CapsaLogStreams::DefaultStream ? &Session : StreamSessions.Find(Stream);
+}
+
+FCapsaSession* UCapsaCoreSubsystem::FindMutableSession(uint16 Stream)
+{
+	return Stream == CapsaLogStreams::DefaultStream ? &Session : StreamSessions.Find(Stream);
+}
+
+void UCapsaCoreSubsystem::AddWorldStream(UWorld* World)
+{
+	check(IsInGameThread());
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	const uint16 Stream = CapsaLogStreams::FindOrAdd(CapsaLogStreams::GetWorldStreamName(World));
+	if (Stream == CapsaLogStreams::DefaultStream)
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::AddWorldStream | No log stream left for %s, logging to the default stream"),
+			*World->GetName());
+		return;
+	}
+
+	if (WorldStreams.IsEmpty())
+	{
+		FWorldDelegates::OnWorldTickStart.AddUObject(this, &UCapsaCoreSubsystem::OnWorldTickStart);
+		FWorldDelegates::OnWorldTickEnd.AddUObject(this, &UCapsaCoreSubsystem::OnWorldTickEnd);
+	}
+	WorldStreams.Add(World, Stream);
+
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::AddWorldStream | Logging %s to stream %s"), *World->GetName(), *CapsaLogStreams::GetName(Stream));
 }
 
 bool UCapsaCoreSubsystem::RegisterLinkedLogID(const FString& LinkedLogID, const FString& Description)
 {
 	// Don't link with self.
-	if (LogID.Equals(LinkedLogID))
+	if (Session.LogID.Equals(LinkedLogID, ESearchCase::IgnoreCase))
 	{
 		return false;
 	}
@@ -111,112 +283,344 @@ void UCapsaCoreSubsystem::RegisterAdditionalMetadata(const FString& Key, const T
 	RequestSendMetadata();
 }
 
-void UCapsaCoreSubsystem::SendLog(TArray<FBufferedLine>& LogBuffer, bool bBlocking)
+bool UCapsaCoreSubsystem::SendLog(TArray<FBufferedLine>& LogBuffer, bool bBlocking, uint64 ChunkID)
 {
+	FCapsaLogChunk Chunk;
+	Chunk.ChunkID = ChunkID;
+	Chunk.Lines = MoveTemp(LogBuffer);
+	return SendLogChunk(MoveTemp(Chunk), bBlocking);
+}
+
+bool UCapsaCoreSubsystem::SendLogChunk(FCapsaLogChunk Chunk, bool bBlocking)
+{
+	LLM_SCOPE_BYTAG(Capsa);
+
+	if (Chunk.ChunkID == 0)
+	{
+		Chunk.ChunkID = CapsaTrace::AllocateChunkID();
+	}
+
 	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
 	if (CapsaSettings == nullptr || !CapsaSettings->IsValidLowLevelFast())
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::SendLog | Failed to load CapsaSettings." ));
-		return;
+		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::SendLogChunk | Failed to load CapsaSettings." ));
+		return false;
 	}
 
 	if (!FHttpModule::Get().IsHttpEnabled())
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::SendLog | FHttpModule::IsHttpEnabled() == false | returning" ));
-		return;
+		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::SendLogChunk | FHttpModule::IsHttpEnabled() == false | returning" ));
+		return false;
 	}
 
-	if (bBlocking) // During shutdown
+	if (!UploadPipeline.IsValid())
 	{
-		UE_LOG(LogCapsaCore, Display, TEXT("UCapsaCoreSubsystem::SendLog | bBlocking == true | starting blocking log sending procedure"))
-		if (CapsaSettings->GetUseCompression())
-		{
-			const FString UncompressedLog = CapsaLogOperations::MakeLogString(LogBuffer);
-			TArray<uint8> CompressedLog;
-			if (CapsaLogOperations::MakeCompressedLogBinary(UncompressedLog, CompressedLog))
-			{
-				UE_LOG(LogCapsaCore, Display, TEXT("UCapsaCoreSubsystem::SendLog | Sending blocking compressed log"))
-				RequestSendCompressedLog(CompressedLog, true);
-			}
-			else
-			{
-				UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::SendLog | Error compressing logs"))
-			}
+		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::SendLogChunk | Upload pipeline is not available | returning" ));
+		return false;
+	}
 
-			if (CapsaSettings->GetWriteToDiskPlain())
-			{
-				if (!CapsaLogOperations::SaveStringToFile(UncompressedLog, LogID, CapsaLogOperations::DefaultUncompressedLogExtension))
-				{
-					UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::SendLog | Error storing uncompressed log to disk"))
-				}
-			}
+	if (!bBlocking && UploadPipeline->IsFull())
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::SendLogChunk | Upload pipeline is full, dropping %d lines"), Chunk.Num());
+		FCapsaPipelineStats::Get().RecordDropped(Chunk.Num());
+		return false;
+	}
 
-			if (CapsaSettings->GetWriteToDiskCompressed())
+	FCapsaSession* ChunkSession = &Session;
+	if (Chunk.Stream != CapsaLogStreams::DefaultStream)
+	{
+		ChunkSession = &StreamSessions.FindOrAdd(Chunk.Stream);
+		if (!ChunkSession->IsAuthenticated())
+		{
+			// Kept until the session of the stream is authenticated, within the same bound as the upload pipeline
+			if (bBlocking || ChunkSession->PendingChunks.Num() >= CapsaSettings->GetMaxQueuedLogChunks())
 			{
-				if (!CapsaLogOperations::SaveBinaryToFile(CompressedLog, LogID, CapsaLogOperations::DefaultCompressedLogExtension))
-				{
-					UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::SendLog | Error storing compressed log to disk"))
-				};
+				UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::SendLogChunk | Stream %s is not authenticated, dropping %d lines"),
+					*CapsaLogStreams::GetName(Chunk.Stream), Chunk.Num());
+				FCapsaPipelineStats::Get().RecordDropped(Chunk.Num());
+				return false;
 			}
-		}
-		else // !bUseCompression
-		{
-			const FString UncompressedLog = CapsaLogOperations::MakeLogString(LogBuffer);
-			UE_LOG(LogCapsaCore, Display, TEXT("UCapsaCoreSubsystem::SendLog | Sending blocking uncompressed log"))
-			RequestSendLog(UncompressedLog, true);
 
-			if (CapsaSettings->GetWriteToDiskPlain())
+			if (!ChunkSession->bAuthRequested)
 			{
-				if (!CapsaLogOperations::SaveStringToFile(UncompressedLog, LogID, CapsaLogOperations::DefaultUncompressedLogExtension))
-				{
-					UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::SendLog | Error storing uncompressed log to disk"))
-				}
+				ChunkSession->bAuthRequested = RequestStreamAuth(Chunk.Stream);
 			}
+			ChunkSession->PendingChunks.Add(MoveTemp(Chunk));
+			return true;
 		}
 	}
-	else // !bBlocking
+
+	UpdateDefaultSinks(*CapsaSettings);
+
+	FCapsaUploadOptions UploadOptions;
+	UploadOptions.LogID = ChunkSession->LogID;
+	UploadOptions.Sinks = DefaultSinks;
+	UploadOptions.Sinks.Append(RegisteredSinks);
+
+	FCapsaLogFormatOptions& FormatOptions = UploadOptions.FormatOptions;
+	FormatOptions.bIncludeStructuredFields = CapsaSettings->GetCaptureStructuredLogs() && CapsaSettings->GetIncludeStructuredFields();
+	// The host agent concatenates chunks, which template encoded chunks do not support
+	if (CapsaSettings->GetUseTemplateEncoding() && !HostAgent.IsValid())
 	{
-		UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::SendLog | bBlocking == false | starting async log sending procedure"))
-		if (CapsaSettings->GetUseCompression())
+		if (!ChunkSession->TemplateDictionary.IsValid())
 		{
-			FAsyncBinaryFromBufferCallback CallbackFunc = [this](const TArray<uint8>& CompressedLog)
-			{
-				RequestSendCompressedLog(CompressedLog);
-			};
-			// Example AsyncTask to attempt to SAVE the file using the LogID (as filename), whether compressed or not, then fire the Callback.
-			// This requires a Binary Callback, not an FString
-			(new FAutoDeleteAsyncTask<FSaveCompressedStringFromBufferTask>(LogID, CapsaSettings->GetWriteToDiskPlain(),
-				CapsaSettings->GetWriteToDiskCompressed(),
-				MoveTemp(LogBuffer), CallbackFunc))->StartBackgroundTask();
+			ChunkSession->TemplateDictionary = MakeShared<FCapsaTemplateDictionary, ESPMode::ThreadSafe>();
 		}
-		else // !bUseCompression
+		FormatOptions.TemplateDictionary = ChunkSession->TemplateDictionary;
+	}
+	FormatOptions.CompressionSegmentLines = CapsaSettings->GetCompressionSegmentLines();
+	FormatOptions.MaxCompressionWorkers = CapsaSettings->GetMaxCompressionWorkers();
+
+	UploadOptions.Redactor = GetRedactor();
+
+	UploadPipeline->Enqueue(MoveTemp(Chunk), MoveTemp(UploadOptions));
+
+	if (bBlocking) // During shutdown
+	{
+		UE_LOG(LogCapsaCore, Display, TEXT("UCapsaCoreSubsystem::SendLogChunk | bBlocking == true | waiting for the upload pipeline"))
+		check(IsInGameThread());
+
+		// Earlier chunks still in the pipeline are uploaded first, so the blocking chunk does not overtake them
+		UploadPipeline->WaitUntilDelivered();
+		UploadPipeline->DispatchGameThreadSinks(true);
+	}
+
+	return true;
+}
+
+bool UCapsaCoreSubsystem::CanSendLog() const
+{
+	return UploadPipeline.IsValid() && !UploadPipeline->IsFull();
+}
+
+void UCapsaCoreSubsystem::RegisterSink(TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe> Sink)
+{
+	check(IsInGameThread());
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RegisterSink | Registering sink: %s"), Sink->GetName());
+	RegisteredSinks.AddUnique(MoveTemp(Sink));
+}
+
+void UCapsaCoreSubsystem::UnregisterSink(const TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>& Sink)
+{
+	check(IsInGameThread());
+	RegisteredSinks.Remove(Sink);
+}
+
+void UCapsaCoreSubsystem::UpdateDefaultSinks(const UCapsaSettings& CapsaSettings)
+{
+	// The host agent batches and compresses the chunks of every instance on the host
+	const bool bUseCompression = CapsaSettings.GetUseCompression() && !HostAgent.IsValid();
+	const bool bWriteToDiskPlain = CapsaSettings.GetWriteToDiskPlain();
+	const bool bWriteToDiskCompressed = bUseCompression && CapsaSettings.GetWriteToDiskCompressed();
+	const bool bWriteToStdout = CapsaSettings.GetWriteToStdout();
+	const bool bIncludeStructuredFields = CapsaSettings.GetCaptureStructuredLogs() && CapsaSettings.GetIncludeStructuredFields();
+
+	// Settings can change at runtime, fe. from the benchmark commandlet
+	const int32 Config = (bUseCompression ? 1 : 0) | (bWriteToDiskPlain ? 2 : 0) | (bWriteToDiskCompressed ? 4 : 0) | (bWriteToStdout ? 8 : 0)
+		| (bIncludeStructuredFields ? 16 : 0);
+	if (Config == DefaultSinksConfig)
+	{
+		return;
+	}
+	DefaultSinksConfig = Config;
+
+	DefaultSinks.Reset();
+	if (HostAgent.IsValid())
+	{
+		DefaultSinks.Add(MakeShared<FCapsaHostAgentSink, ESPMode::ThreadSafe>(HostAgent.ToSharedRef(), this));
+	}
+	else
+	{
+		DefaultSinks.Add(MakeShared<FCapsaHttpSink, ESPMode::ThreadSafe>(this, bUseCompression));
+	}
+	if (bWriteToDiskPlain || bWriteToDiskCompressed)
+	{
+		DefaultSinks.Add(MakeShared<FCapsaFileSink, ESPMode::ThreadSafe>(bWriteToDiskPlain, bWriteToDiskCompressed));
+	}
+	if (bWriteToStdout)
+	{
+		DefaultSinks.Add(MakeShared<FCapsaStdoutSink, ESPMode::ThreadSafe>(bIncludeStructuredFields));
+	}
+}
+
+void UCapsaCoreSubsystem::UploadLogSegment(const FCapsaEncodedChunk& Chunk, int32 Segment, bool bCompressed, bool bBlocking)
+{
+	// Only the first segment carries the line sequences of the chunk, the lines of the following segments continue them
+	const FString& LineSequences = Segment == 0 ? Chunk.LineSequences : FString();
+	if (bCompressed)
+	{
+		RequestSendCompressedLog(Chunk.CompressedSegments[Segment], bBlocking, Chunk.ChunkID, Chunk.Lane, LineSequences, Chunk.Stream,
+			Chunk.GetSegmentNumLines(Segment));
+	}
+	else
+	{
+		RequestSendLog(Chunk.Segments[Segment], bBlocking, Chunk.ChunkID, Chunk.Lane, LineSequences, Chunk.Stream, Chunk.GetSegmentNumLines(Segment));
+	}
+}
+
+void UCapsaCoreSubsystem::UploadUnsentHostAgentChunks(bool bBlocking)
+{
+	if (!HostAgent.IsValid())
+	{
+		return;
+	}
+
+	for (const FCapsaHostAgentClient::FUnsentChunk& Unsent : HostAgent->TakeUnsentChunks())
+	{
+		UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::UploadUnsentHostAgentChunks | Uploading chunk %llu, the host agent disconnected before receiving it"),
+			Unsent.ChunkID);
+		RequestSendLog(Unsent.Log, bBlocking, Unsent.ChunkID, Unsent.Lane, Unsent.LineSequences, Unsent.Stream, Unsent.NumLines);
+	}
+}
+
+bool UCapsaCoreSubsystem::TickUploads(float DeltaTime)
+{
+	if (bStartupPending)
+	{
+		bStartupPending = false;
+		CompleteStartup();
+	}
+
+	if (UploadPipeline.IsValid())
+	{
+		// Creating the HTTP requests, copying their payloads and writing to the host agent are part of what Capsa costs the game thread
+		FCapsaGameThreadCostScope GameThreadCostScope;
+		if (HostAgent.IsValid())
 		{
-			FAsyncStringFromBufferCallback CallbackFunc = [this](const FString& Log)
+			HostAgent->Tick();
+			UploadUnsentHostAgentChunks();
+		}
+		UploadPipeline->DispatchGameThreadSinks();
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (Now >= NextRefreshCheckTime)
+	{
+		NextRefreshCheckTime = Now + RefreshCheckInterval;
+		RefreshExpiringSessions();
+	}
+
+	return true;
+}
+
+void UCapsaCoreSubsystem::CompleteStartup()
+{
+	FCapsaStartupScope StartupScope(true);
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaSettings == nullptr || !CapsaSettings->GetPersistSession() || !RestorePersistedSession(*CapsaSettings))
+	{
+		RequestClientAuth();
+	}
+
+	if (CapsaSettings != nullptr && CapsaSettings->GetRedactLogs())
+	{
+		RedactorTask = UE::Tasks::Launch(UE_SOURCE_LOCATION,
+			[Patterns = CapsaSettings->GetRedactionPatterns(), bRedactEmailAddresses = CapsaSettings->GetRedactEmailAddresses(),
+				bRedactIPAddresses = CapsaSettings->GetRedactIPAddresses()]() -> TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe>
 			{
-				RequestSendLog(Log);
-			};
-			// These all require an FString Callback.
-			// Example AsyncTask to generate a Log and Optionally write it to Disk, then fire the Callback.
-			(new FAutoDeleteAsyncTask<FSaveStringFromBufferTask>(LogID, CapsaSettings->GetWriteToDiskPlain(), MoveTemp(LogBuffer), CallbackFunc))->
-				StartBackgroundTask();
+				FCapsaStartupScope StartupScope(true);
+				return MakeShared<const FCapsaRedactor, ESPMode::ThreadSafe>(Patterns, bRedactEmailAddresses, bRedactIPAddresses);
+			});
+	}
+}
+
+void UCapsaCoreSubsystem::RefreshExpiringSessions()
+{
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaSettings == nullptr)
+	{
+		return;
+	}
+
+	const FDateTime RefreshBefore = FDateTime::UtcNow() + FTimespan::FromSeconds(CapsaSettings->GetTokenRefreshMargin());
+	auto NeedsRefresh = [&RefreshBefore](const FCapsaSession& CheckedSession)
+	{
+		const bool bExpiring = CheckedSession.ExpiryTime.GetTicks() > 0 && CheckedSession.ExpiryTime <= RefreshBefore;
+		return CheckedSession.IsAuthenticated() && (bExpiring || !CheckedSession.RetryRequests.IsEmpty());
+	};
+
+	if (NeedsRefresh(Session))
+	{
+		RequestSessionRefresh(CapsaLogStreams::DefaultStream);
+	}
+	for (const TPair<uint16, FCapsaSession>& StreamSession : StreamSessions)
+	{
+		if (NeedsRefresh(StreamSession.Value))
+		{
+			RequestSessionRefresh(StreamSession.Key);
 		}
 	}
 }
 
+void UCapsaCoreSubsystem::RequestSessionRefresh(uint16 Stream)
+{
+	FCapsaSession* RefreshedSession = FindMutableSession(Stream);
+	if (RefreshedSession == nullptr || RefreshedSession->bRefreshRequested || FPlatformTime::Seconds() < RefreshedSession->NextRefreshTime)
+	{
+		return;
+	}
+
+	// Asks the server to keep the log, a server that starts a new one anyway is handled in RefreshAuthResponse
+	FHttpRequestPtr RefreshRequest = CreateAuthRequest(RefreshedSession->LogID);
+	if (!RefreshRequest.IsValid())
+	{
+		return;
+	}
+
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RequestSessionRefresh | Refreshing the token of log %s, which expires at %s"), *RefreshedSession->LogID,
+		*RefreshedSession->Expiry);
+
+	RefreshedSession->bRefreshRequested = true;
+	RefreshedSession->NextRefreshTime = FPlatformTime::Seconds() + MinRefreshInterval;
+	RefreshRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::RefreshAuthResponse, Stream);
+	RefreshRequest->ProcessRequest();
+}
+
 void UCapsaCoreSubsystem::RequestClientAuth()
 {
 	UE_LOG(LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::RequestClientAuth | Starting client authentication" ));
 
+	FHttpRequestPtr ClientAuthRequest = CreateAuthRequest();
+	if (!ClientAuthRequest.IsValid())
+	{
+		return;
+	}
+
+	ClientAuthRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::ClientAuthResponse);
+	ClientAuthRequest->ProcessRequest();
+	bClientAuthPending = true;
+
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RequestClientAuth | Authentication request sent"));
+}
+
+bool UCapsaCoreSubsystem::RequestStreamAuth(uint16 Stream)
+{
+	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RequestStreamAuth | Starting authentication of stream %s"), *CapsaLogStreams::GetName(Stream));
+
+	FHttpRequestPtr StreamAuthRequest = CreateAuthRequest();
+	if (!StreamAuthRequest.IsValid())
+	{
+		return false;
+	}
+
+	StreamAuthRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::StreamAuthResponse, Stream);
+	StreamAuthRequest->ProcessRequest();
+	return true;
+}
+
+FHttpRequestPtr UCapsaCoreSubsystem::CreateAuthRequest(const FString& RefreshedLogID) const
+{
 	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
 	if (CapsaSettings == nullptr || !CapsaSettings->IsValidLowLevelFast())
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestClientAuth | Failed to load CapsaSettings." ));
-		return;
+		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::CreateAuthRequest | Failed to load CapsaSettings." ));
+		return nullptr;
 	}
 	if (CapsaSettings->GetCapsaServerURL().IsEmpty())
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::RequestClientAuth | Base URL is Empty!"));
-		return;
+		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::CreateAuthRequest | Base URL is Empty!"));
+		return nullptr;
 	}
 
 	FCapsaAuthenticationRequest AuthenticationRequest = FCapsaAuthenticationRequest(
@@ -225,25 +629,33 @@ void UCapsaCoreSubsystem::RequestClientAuth()
 		UCapsaCoreFunctionLibrary::GetHostTypeString()
 		);
 
-	FString AuthContent;
-	if (!FJsonObjectConverter::UStructToJsonObjectString(AuthenticationRequest, AuthContent))
+	TSharedPtr<FJsonObject> JsonObject = FJsonObjectConverter::UStructToJsonObject(AuthenticationRequest);
+	if (!JsonObject.IsValid())
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestClientAuth | FJsonObjectConverter::UStructToJsonObjectString has failed" ));
+		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::CreateAuthRequest | FJsonObjectConverter::UStructToJsonObject has failed" ));
+		JsonObject = MakeShared<FJsonObject>();
+	}
+	if (!RefreshedLogID.IsEmpty())
+	{
+		JsonObject->SetStringField(TEXT("logId"), RefreshedLogID);
 	}
 
-	FHttpRequestRef ClientAuthRequest = FHttpModule::Get().CreateRequest();
-	ClientAuthRequest->SetURL(CapsaSettings->GetServerEndpointClientAuth());
-	ClientAuthRequest->SetVerb("POST");
-	ClientAuthRequest->SetHeader("Content-Type", "application/json");
-	ClientAuthRequest->SetContentAsString(AuthContent);
-	ClientAuthRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::ClientAuthResponse);
-	ClientAuthRequest->ProcessRequest();
+	FString AuthContent;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&AuthContent, 0);
+	FJsonSerializer::Serialize(JsonObject.ToSharedRef(), Writer);
 
-	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RequestClientAuth | Authentication request sent"));
+	FHttpRequestRef AuthRequest = FHttpModule::Get().CreateRequest();
+	AuthRequest->SetURL(CapsaSettings->GetServerEndpointClientAuth());
+	AuthRequest->SetVerb("POST");
+	AuthRequest->SetHeader("Content-Type", "application/json");
+	AuthRequest->SetContentAsString(AuthContent);
+	return AuthRequest;
 }
 
-void UCapsaCoreSubsystem::RequestSendLog(const FString& Log, bool bBlocking)
+void UCapsaCoreSubsystem::RequestSendLog(const FSharedBuffer& Log, bool bBlocking, uint64 ChunkID, ECapsaLogLane Lane, const FString& LineSequences,
+	uint16 Stream, int32 NumLines)
 {
+	LLM_SCOPE_BYTAG(Capsa);
 	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RequestSendLog | Sending log chunk without compression"));
 
 	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
@@ -253,37 +665,93 @@ void UCapsaCoreSubsystem::RequestSendLog(const FString& Log, bool bBlocking)
 		return;
 	}
 
+	FCapsaSession* ChunkSession = FindMutableSession(Stream);
+	if (ChunkSession == nullptr)
+	{
+		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::RequestSendLog | No session for stream %s"), *CapsaLogStreams::GetName(Stream));
+		return;
+	}
+
 	FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
 	LogRequest->SetURL(CapsaSettings->GetServerEndpointClientLogChunk());
 	LogRequest->SetVerb("POST");
-	LogRequest->SetHeader("Authorization", GetAuthHeader());
+	LogRequest->SetHeader("Authorization", ChunkSession->GetAuthHeader());
 	LogRequest->SetHeader("Content-Type", "text/plain");
-	LogRequest->SetContentAsString(Log);
+	SetLogChunkHeaders(*LogRequest, *ChunkSession, Lane, LineSequences);
+	// Converted to UTF-8 by the upload pipeline, off the game thread
+	LogRequest->SetContent(TArray<uint8>(static_cast<const uint8*>(Log.GetData()), static_cast<int32>(Log.GetSize())));
+
+	const uint64 SubmitCycle = FPlatformTime::Cycles64();
+	CapsaTrace::OutputStage(ChunkID, ECapsaTraceStage::HttpSubmit, SubmitCycle, SubmitCycle, Log.GetSize(), LogRequest->GetContentLength(), 0);
+	// Released in LogChunkResponse
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::HttpPayload, LogRequest->GetContentLength());
 
 	if (bBlocking)
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE(RequestSendLogBlocking);
-		FEvent* CompletionEvent = FPlatformProcess::GetSynchEventFromPool(true);
-		LogRequest->OnProcessRequestComplete().BindLambda([this, CompletionEvent](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess)
+		// Shared with the completion delegate, which still runs if the request is cancelled after the wait timed out
+		TSharedRef<FEventRef, ESPMode::ThreadSafe> CompletionEvent = MakeShared<FEventRef, ESPMode::ThreadSafe>(EEventMode::ManualReset);
+		LogRequest->OnProcessRequestComplete().BindLambda([this, CompletionEvent, ChunkID, Stream, NumLines](FHttpRequestPtr Request, FHttpResponsePtr Response,
+			bool bSuccess)
 		{
-			LogResponse(Request, Response, bSuccess);
-			CompletionEvent->Trigger();
+			LogChunkResponse(Request, Response, bSuccess, ChunkID, Stream, NumLines, false);
+			(*CompletionEvent)->Trigger();
 		});
+		FCapsaPipelineStats::Get().RecordRequestStarted();
 		LogRequest->ProcessRequest();
-		CompletionEvent->Wait();
-		FPlatformProcess::ReturnSynchEventToPool(CompletionEvent);
+		WaitForBlockingRequest(*LogRequest, *CompletionEvent);
 	}
 	else
 	{
-		LogRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::LogResponse);
+		LogRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::LogChunkResponse, ChunkID, Stream, NumLines, true);
+		FCapsaPipelineStats::Get().RecordRequestStarted();
 		LogRequest->ProcessRequest();
 	}
 
 	UE_LOG(LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::RequestSendLog | Log sent"));
 }
 
-void UCapsaCoreSubsystem::RequestSendCompressedLog(const TArray<uint8>& CompressedLog, bool bBlocking)
+TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> UCapsaCoreSubsystem::GetRedactor()
+{
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaSettings == nullptr || !CapsaSettings->GetRedactLogs())
+	{
+		return nullptr;
+	}
+
+	if (!Redactor.IsValid() && RedactorTask.IsValid())
+	{
+		// Usually compiled by the time the first chunk is sent
+		Redactor = RedactorTask.GetResult();
+	}
+	if (!Redactor.IsValid())
+	{
+		Redactor = MakeShared<const FCapsaRedactor, ESPMode::ThreadSafe>(CapsaSettings->GetRedactionPatterns(), CapsaSettings->GetRedactEmailAddresses(),
+			CapsaSettings->GetRedactIPAddresses());
+	}
+	return Redactor;
+}
+
+uint64 UCapsaCoreSubsystem::AllocateChunkSequence(uint16 Stream)
+{
+	FCapsaSession* ChunkSession = FindMutableSession(Stream);
+	return ChunkSession != nullptr ? ChunkSession->NextChunkSequence++ : 0;
+}
+
+void UCapsaCoreSubsystem::SetLogChunkHeaders(IHttpRequest& Request, FCapsaSession& ChunkSession, ECapsaLogLane Lane, const FString& LineSequences)
+{
+	Request.SetHeader("X-Capsa-Chunk-Sequence", LexToString(ChunkSession.NextChunkSequence++));
+	Request.SetHeader("X-Capsa-Lane", Lane == ECapsaLogLane::Priority ? TEXT("Priority") : TEXT("Bulk"));
+	if (!LineSequences.IsEmpty())
+	{
+		Request.SetHeader("X-Capsa-Line-Sequences", LineSequences);
+	}
+}
+
+void UCapsaCoreSubsystem::RequestSendCompressedLog(const FSharedBuffer& CompressedLog, bool bBlocking, uint64 ChunkID, ECapsaLogLane Lane,
+	const FString& LineSequences, uint16 Stream, int32 NumLines)
 {
+	LLM_SCOPE_BYTAG(Capsa);
 	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RequestSendCompressedLog | Sending log chunk with compression"));
 
 	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
@@ -293,37 +761,45 @@ void UCapsaCoreSubsystem::RequestSendCompressedLog(const TArray<uint8>& Compress
 		return;
 	}
 
+	FCapsaSession* ChunkSession = FindMutableSession(Stream);
+	if (ChunkSession == nullptr)
+	{
+		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::RequestSendCompressedLog | No session for stream %s"), *CapsaLogStreams::GetName(Stream));
+		return;
+	}
+
 	FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
 	LogRequest->SetURL(CapsaSettings->GetServerEndpointClientLogChunk());
 	LogRequest->SetVerb("POST");
-	LogRequest->SetHeader("Authorization", GetAuthHeader());
+	LogRequest->SetHeader("Authorization", ChunkSession->GetAuthHeader());
 	LogRequest->SetHeader("Content-Type", "application/zlib");
-	LogRequest->SetContent(CompressedLog);
+	SetLogChunkHeaders(*LogRequest, *ChunkSession, Lane, LineSequences);
+	LogRequest->SetContent(TArray<uint8>(static_cast<const uint8*>(CompressedLog.GetData()), static_cast<int32>(CompressedLog.GetSize())));
+
+	const uint64 SubmitCycle = FPlatformTime::Cycles64();
+	CapsaTrace::OutputStage(ChunkID, ECapsaTraceStage::HttpSubmit, SubmitCycle, SubmitCycle, CompressedLog.GetSize(), LogRequest->GetContentLength(), 0);
+	// Released in LogChunkResponse
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::HttpPayload, LogRequest->GetContentLength());
 
 	if (bBlocking)
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE(RequestSendCompressedLogBlocking);
-		FEvent* CompletionEvent = FPlatformProcess::GetSynchEventFromPool(true);
-		LogRequest->OnProcessRequestComplete().BindLambda([this, CompletionEvent](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess)
+		// Shared with the completion delegate, which still runs if the request is cancelled after the wait timed out
+		TSharedRef<FEventRef, ESPMode::ThreadSafe> CompletionEvent = MakeShared<FEventRef, ESPMode::ThreadSafe>(EEventMode::ManualReset);
+		LogRequest->OnProcessRequestComplete().BindLambda([this, CompletionEvent, ChunkID, Stream, NumLines](FHttpRequestPtr Request, FHttpResponsePtr Response,
+			bool bSuccess)
 		{
-			// Lambda never gets called?
-			LogResponse(Request, Response, bSuccess);
-			CompletionEvent->Trigger();
+			LogChunkResponse(Request, Response, bSuccess, ChunkID, Stream, NumLines, false);
+			(*CompletionEvent)->Trigger();
 		});
+		FCapsaPipelineStats::Get().RecordRequestStarted();
 		LogRequest->ProcessRequest();
-
-		// Manually tick HTTP module until the request completes
-		while (!CompletionEvent->Wait(0.01f))
-		{
-			FHttpModule::Get().GetHttpManager().Tick(0.01f);
-			FPlatformProcess::Sleep(0.01f);
-		}
-
-		FPlatformProcess::ReturnSynchEventToPool(CompletionEvent);
+		WaitForBlockingRequest(*LogRequest, *CompletionEvent);
 	}
 	else
 	{
-		LogRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::LogResponse);
+		LogRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::LogChunkResponse, ChunkID, Stream, NumLines, true);
+		FCapsaPipelineStats::Get().RecordRequestStarted();
 		LogRequest->ProcessRequest();
 	}
 
@@ -364,41 +840,333 @@ void UCapsaCoreSubsystem::RequestSendMetadata()
 void UCapsaCoreSubsystem::ClientAuthResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess)
 {
 	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::ClientAuthResponse | Authentication resonse received sent"));
-
-	TSharedPtr<FJsonObject> JsonObject = ProcessResponse(TEXT("UCapsaCoreSubsystem::ClientAuthResponse"), Request, Response, bSuccess);
-	if (JsonObject == nullptr || !JsonObject.IsValid())
-	{
-		UE_LOG(LogCapsaCore, Warning, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Invalid JSON object" ));
-		return;
-	}
+	bClientAuthPending = false;
 
 	FCapsaAuthenticationResponse AuthenticationResponse;
-	if (!FJsonObjectConverter::JsonObjectToUStruct(JsonObject.ToSharedRef(), &AuthenticationResponse))
+	if (!ParseAuthResponse(TEXT("UCapsaCoreSubsystem::ClientAuthResponse"), Request, Response, bSuccess, AuthenticationResponse))
 	{
-		UE_LOG(LogCapsaCore, Warning, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | FJsonObjectConverter::JsonObjectToUStruc failed" ));
 		return;
-	};
+	}
 
 	// Set the authentication data if the current data is empty
-	if (Token.IsEmpty() || LogID.IsEmpty() || LinkWeb.IsEmpty())
+	if (Session.Token.IsEmpty() || Session.LogID.IsEmpty() || Session.LinkWeb.IsEmpty())
 	{
 		UE_LOG(LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Authentication info not present, setting values" ));
-		Token = AuthenticationResponse.Token;
-		LogID = AuthenticationResponse.LogId;
-		LinkWeb = AuthenticationResponse.LinkWeb;
-		Expiry = AuthenticationResponse.Expiry;
-		UE_LOG(LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Capsa ID: %s | CapsaLogURL: %s" ), *LogID, *LinkWeb);
+		SetSessionAuthentication(Session, AuthenticationResponse);
+		SessionSegment = 0;
+		PersistSession();
+		if (HostAgent.IsValid())
+		{
+			const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+			HostAgent->SetSession(Session.LogID, Session.Token, CapsaSettings != nullptr ? CapsaSettings->GetServerEndpointClientLogChunk() : FString());
+		}
+		UE_LOG(LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Capsa ID: %s | CapsaLogURL: %s" ), *Session.LogID, *Session.LinkWeb);
 	}
 	else
 	{
 		UE_LOG(LogCapsaCore, Log,
 			TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Ignoring AuthenticationResponse (CapsaID: %s), as the authentication is already present" ),
-			*LogID);
+			*Session.LogID);
 	}
 
 	// Broadcast auth changed regardless whether it has changed or not
-	OnAuthChanged.Broadcast(LogID, LinkWeb);
-	OnAuthChangedDynamic.Broadcast(LogID, LinkWeb);
+	OnAuthChanged.Broadcast(Session.LogID, Session.LinkWeb);
+	OnAuthChangedDynamic.Broadcast(Session.LogID, Session.LinkWeb);
+}
+
+void UCapsaCoreSubsystem::StreamAuthResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint16 Stream)
+{
+	FCapsaSession* StreamSession = StreamSessions.Find(Stream);
+	if (StreamSession == nullptr)
+	{
+		return;
+	}
+	StreamSession->bAuthRequested = false;
+
+	FCapsaAuthenticationResponse AuthenticationResponse;
+	if (!ParseAuthResponse(TEXT("UCapsaCoreSubsystem::StreamAuthResponse"), Request, Response, bSuccess, AuthenticationResponse))
+	{
+		// The pending chunks are kept, the next chunk of the stream requests authentication again
+		return;
+	}
+
+	const FString StreamName = CapsaLogStreams::GetName(Stream);
+	if (StreamSession->IsAuthenticated())
+	{
+		UE_LOG(LogCapsaCore, Log,
+			TEXT("UCapsaCoreSubsystem::StreamAuthResponse | Ignoring AuthenticationResponse of stream %s, as the authentication is already present"), *StreamName);
+		return;
+	}
+
+	SetSessionAuthentication(*StreamSession, AuthenticationResponse);
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::StreamAuthResponse | Stream: %s | Capsa ID: %s | CapsaLogURL: %s"), *StreamName,
+		*StreamSession->LogID, *StreamSession->LinkWeb);
+
+	// Sending may add sessions, which moves the session of this stream
+	const FString StreamLogID = StreamSession->LogID;
+	TArray<FCapsaLogChunk> PendingChunks = MoveTemp(StreamSession->PendingChunks);
+	RegisterLinkedLogID(StreamLogID, FString::Printf(TEXT("Stream %s"), *StreamName));
+	for (FCapsaLogChunk& Chunk : PendingChunks)
+	{
+		SendLogChunk(MoveTemp(Chunk));
+	}
+}
+
+void UCapsaCoreSubsystem::RefreshAuthResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint16 Stream)
+{
+	FCapsaSession* RefreshedSession = FindMutableSession(Stream);
+	if (RefreshedSession == nullptr)
+	{
+		return;
+	}
+	RefreshedSession->bRefreshRequested = false;
+
+	FCapsaAuthenticationResponse AuthenticationResponse;
+	if (!ParseAuthResponse(TEXT("UCapsaCoreSubsystem::RefreshAuthResponse"), Request, Response, bSuccess, AuthenticationResponse))
+	{
+		// Uploads keep using the current token, refreshing is tried again after MinRefreshInterval
+		return;
+	}
+
+	const FString PreviousLogID = RefreshedSession->LogID;
+	const bool bNewLog = SetSessionAuthentication(*RefreshedSession, AuthenticationResponse);
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RefreshAuthResponse | Token refreshed | Capsa ID: %s | Expiry: %s"), *RefreshedSession->LogID,
+		*RefreshedSession->Expiry);
+
+	TArray<FCapsaRetryRequest> RetryRequests = MoveTemp(RefreshedSession->RetryRequests);
+	for (const FCapsaRetryRequest& RetryRequest : RetryRequests)
+	{
+		RetryLogChunk(RetryRequest, *RefreshedSession, Stream, bNewLog);
+	}
+
+	if (Stream != CapsaLogStreams::DefaultStream)
+	{
+		if (bNewLog)
+		{
+			RegisterLinkedLogID(RefreshedSession->LogID, FString::Printf(TEXT("Stream %s"), *CapsaLogStreams::GetName(Stream)));
+		}
+		return;
+	}
+
+	// The segment keeps counting when the server started a new log, like the chunk sequence, see SetSessionAuthentication()
+	PersistSession();
+
+	if (HostAgent.IsValid())
+	{
+		const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+		HostAgent->SetSession(Session.LogID, Session.Token, CapsaSettings != nullptr ? CapsaSettings->GetServerEndpointClientLogChunk() : FString());
+	}
+
+	if (bNewLog)
+	{
+		// The server started a new log, keep the logs of the process together
+		RegisterLinkedLogID(PreviousLogID, TEXT("Previous session"));
+		OnAuthChanged.Broadcast(Session.LogID, Session.LinkWeb);
+		OnAuthChangedDynamic.Broadcast(Session.LogID, Session.LinkWeb);
+	}
+}
+
+bool UCapsaCoreSubsystem::SetSessionAuthentication(FCapsaSession& TargetSession, const FCapsaAuthenticationResponse& AuthenticationResponse)
+{
+	const bool bNewLog = TargetSession.LogID != AuthenticationResponse.LogId;
+	TargetSession.Token = AuthenticationResponse.Token;
+	TargetSession.LogID = AuthenticationResponse.LogId;
+	TargetSession.LinkWeb = AuthenticationResponse.LinkWeb;
+	TargetSession.Expiry = AuthenticationResponse.Expiry;
+	if (!FDateTime::ParseIso8601(*TargetSession.Expiry, TargetSession.ExpiryTime))
+	{
+		// Only refreshed when a chunk is rejected
+		TargetSession.ExpiryTime = FDateTime();
+		UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::SetSessionAuthentication | Unable to parse expiry \"%s\""), *TargetSession.Expiry);
+	}
+
+	// The chunk sequence keeps counting when the server starts a new log for a refreshed token, so the logs chained in RefreshAuthResponse keep
+	// a single order
+	if (bNewLog)
+	{
+		if (TargetSession.TemplateDictionary.IsValid())
+		{
+			// Templates are defined per session
+			TargetSession.TemplateDictionary->Reset();
+		}
+	}
+	return bNewLog;
+}
+
+void UCapsaCoreSubsystem::RetryLogChunk(const FCapsaRetryRequest& RejectedRequest, FCapsaSession& ChunkSession, uint16 Stream, bool bNewLog)
+{
+	LLM_SCOPE_BYTAG(Capsa);
+	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RetryLogChunk | Sending log chunk again with the refreshed token"));
+
+	const FHttpRequestPtr& Request = RejectedRequest.Request;
+
+	FHttpRequestRef RetryRequest = FHttpModule::Get().CreateRequest();
+	RetryRequest->SetURL(Request->GetURL());
+	RetryRequest->SetVerb(Request->GetVerb());
+	for (const FString& Header : Request->GetAllHeaders())
+	{
+		FString Name;
+		FString Value;
+		if (Header.Split(TEXT(": "), &Name, &Value))
+		{
+			RetryRequest->SetHeader(Name, Value);
+		}
+	}
+	RetryRequest->SetHeader(TEXT("Authorization"), ChunkSession.GetAuthHeader());
+	if (bNewLog)
+	{
+		// The chunk sequence of the previous log means nothing to the new one
+		RetryRequest->SetHeader(TEXT("X-Capsa-Chunk-Sequence"), LexToString(ChunkSession.NextChunkSequence++));
+	}
+	RetryRequest->SetContent(CopyTemp(Request->GetContent()));
+
+	// Accounted when the chunk was rejected, released in LogChunkResponse
+	RetryRequest->OnProcessRequestComplete().BindUObject(this, &UCapsaCoreSubsystem::LogChunkResponse, RejectedRequest.ChunkID, Stream,
+		RejectedRequest.NumLines, false);
+	FCapsaPipelineStats::Get().RecordRequestStarted();
+	RetryRequest->ProcessRequest();
+}
+
+bool UCapsaCoreSubsystem::RestorePersistedSession(const UCapsaSettings& CapsaSettings)
+{
+	const FString Path = GetPersistedSessionPath();
+	FString Content;
+	if (!FFileHelper::LoadFileToString(Content, *Path))
+	{
+		return false;
+	}
+
+	FCapsaPersistedSession PersistedSession;
+	if (!FJsonObjectConverter::JsonObjectStringToUStruct(Content, &PersistedSession))
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::RestorePersistedSession | Unable to read the saved session from %s"), *Path);
+		return false;
+	}
+
+	if (PersistedSession.Token.IsEmpty() || PersistedSession.LogId.IsEmpty() || PersistedSession.Environment != GetEnvironmentHash(CapsaSettings))
+	{
+		UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RestorePersistedSession | The saved session is for another environment, authenticating"));
+		return false;
+	}
+
+	// A token that is about to be refreshed would start a new log right away
+	FDateTime ExpiryTime;
+	if (!FDateTime::ParseIso8601(*PersistedSession.Expiry, ExpiryTime)
+		|| ExpiryTime <= FDateTime::UtcNow() + FTimespan::FromSeconds(CapsaSettings.GetTokenRefreshMargin()))
+	{
+		UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RestorePersistedSession | The token of the saved session expires at %s, authenticating"),
+			*PersistedSession.Expiry);
+		return false;
+	}
+
+	FCapsaAuthenticationResponse AuthenticationResponse;
+	AuthenticationResponse.Token = PersistedSession.Token;
+	AuthenticationResponse.LogId = PersistedSession.LogId;
+	AuthenticationResponse.LinkWeb = PersistedSession.LinkWeb;
+	AuthenticationResponse.Expiry = PersistedSession.Expiry;
+	SetSessionAuthentication(Session, AuthenticationResponse);
+
+	// The chunk sequences of this process follow those of the previous ones, so the server keeps the segments in order
+	SessionSegment = PersistedSession.Segment + 1;
+	Session.NextChunkSequence = static_cast<uint64>(SessionSegment) << 32;
+	PersistSession();
+
+	if (HostAgent.IsValid())
+	{
+		HostAgent->SetSession(Session.LogID, Session.Token, CapsaSettings.GetServerEndpointClientLogChunk());
+	}
+
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RestorePersistedSession | Continuing log %s as segment %d | CapsaLogURL: %s"), *Session.LogID,
+		SessionSegment, *Session.LinkWeb);
+
+	OnAuthChanged.Broadcast(Session.LogID, Session.LinkWeb);
+	OnAuthChangedDynamic.Broadcast(Session.LogID, Session.LinkWeb);
+	return true;
+}
+
+void UCapsaCoreSubsystem::PersistSession() const
+{
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaSettings == nullptr || !CapsaSettings->GetPersistSession() || !Session.IsAuthenticated())
+	{
+		return;
+	}
+
+	FCapsaPersistedSession PersistedSession;
+	PersistedSession.Token = Session.Token;
+	PersistedSession.LogId = Session.LogID;
+	PersistedSession.LinkWeb = Session.LinkWeb;
+	PersistedSession.Expiry = Session.Expiry;
+	PersistedSession.Environment = GetEnvironmentHash(*CapsaSettings);
+	PersistedSession.Segment = SessionSegment;
+
+	FString Content;
+	if (!FJsonObjectConverter::UStructToJsonObjectString(PersistedSession, Content))
+	{
+		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::PersistSession | FJsonObjectConverter::UStructToJsonObjectString has failed"));
+		return;
+	}
+
+	// Written next to the file and moved over it, so a crash while saving does not leave half a session behind
+	const FString Path = GetPersistedSessionPath();
+	const FString TempPath = Path + TEXT(".tmp");
+	if (!FFileHelper::SaveStringToFile(Content, *TempPath))
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::PersistSession | Unable to save the session to %s"), *Path);
+		return;
+	}
+
+#if PLATFORM_UNIX || PLATFORM_MAC
+	// The file holds the bearer token of the log, only the user running the process may read it. The mode is kept by the move
+	const FString AbsoluteTempPath = IFileManager::Get().ConvertToAbsolutePathForExternalAppForWrite(*TempPath);
+	if (chmod(TCHAR_TO_UTF8(*AbsoluteTempPath), S_IRUSR | S_IWUSR) != 0)
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::PersistSession | Unable to restrict the permissions of %s, not saving the session"), *Path);
+		IFileManager::Get().Delete(*TempPath, false, true, true);
+		return;
+	}
+#endif
+
+	if (!IFileManager::Get().Move(*Path, *TempPath, true))
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::PersistSession | Unable to save the session to %s"), *Path);
+	}
+}
+
+FString UCapsaCoreSubsystem::GetPersistedSessionPath()
+{
+	FString FileName = FString::Printf(TEXT("Session-%s"), *UCapsaCoreFunctionLibrary::GetHostTypeString());
+	FString Instance;
+	if (FParse::Value(FCommandLine::Get(), TEXT("CapsaInstance="), Instance) && !Instance.IsEmpty())
+	{
+		FileName += TEXT("-") + FPaths::MakeValidFileName(Instance);
+	}
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Capsa"), FileName + TEXT(".json"));
+}
+
+FString UCapsaCoreSubsystem::GetEnvironmentHash(const UCapsaSettings& CapsaSettings)
+{
+	const FString Environment = CapsaSettings.GetCapsaServerURL() + TEXT("|") + CapsaSettings.GetCapsaEnvironmentKey();
+	return FString::Printf(TEXT("%08x"), FCrc::StrCrc32(*Environment));
+}
+
+bool UCapsaCoreSubsystem::ParseAuthResponse(const FString& RequestName, FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess,
+	FCapsaAuthenticationResponse& OutAuthenticationResponse)
+{
+	TSharedPtr<FJsonObject> JsonObject = ProcessResponse(RequestName, Request, Response, bSuccess);
+	if (JsonObject == nullptr || !JsonObject.IsValid())
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT( "%s | Invalid JSON object" ), *RequestName);
+		return false;
+	}
+
+	if (!FJsonObjectConverter::JsonObjectToUStruct(JsonObject.ToSharedRef(), &OutAuthenticationResponse))
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT( "%s | FJsonObjectConverter::JsonObjectToUStruc failed" ), *RequestName);
+		return false;
+	}
+
+	return true;
 }
 
 void UCapsaCoreSubsystem::LogResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess)
@@ -408,6 +1176,71 @@ void UCapsaCoreSubsystem::LogResponse(FHttpRequestPtr Request, FHttpResponsePtr
 	ProcessResponse(TEXT("UCapsaCoreSubsystem::LogResponse"), Request, Response, bSuccess);
 }
 
+void UCapsaCoreSubsystem::LogChunkResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint64 ChunkID, uint16 Stream, int32 NumLines,
+	bool bCanRetry)
+{
+	if (Request.IsValid())
+	{
+		FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::HttpPayload, -static_cast<int64>(Request->GetContentLength()));
+	}
+
+	const bool bFailed = !bSuccess || !Response.IsValid() || Response->GetResponseCode() > 299;
+	FCapsaPipelineStats::Get().RecordRequestFinished(Request.IsValid() ? Request->GetElapsedTime() : 0.0, bFailed);
+
+	FCapsaSession* ChunkSession = FindMutableSession(Stream);
+	bool bRetried = false;
+	if (bCanRetry && ChunkSession != nullptr && Request.IsValid() && Response.IsValid() && Response->GetResponseCode() == EHttpResponseCodes::Denied)
+	{
+		const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+		if (Request->GetHeader(TEXT("Authorization")) != ChunkSession->GetAuthHeader())
+		{
+			// The token was refreshed while the chunk was in flight
+			FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::HttpPayload, Request->GetContentLength());
+			RetryLogChunk(FCapsaRetryRequest{Request, ChunkID, NumLines}, *ChunkSession, Stream, false);
+			bRetried = true;
+		}
+		else if (CapsaSettings != nullptr && ChunkSession->RetryRequests.Num() < CapsaSettings->GetMaxQueuedLogChunks())
+		{
+			// Sent again once, after the token is refreshed. Chunks rejected while refreshing wait for the same refresh
+			FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::HttpPayload, Request->GetContentLength());
+			ChunkSession->RetryRequests.Add(FCapsaRetryRequest{Request, ChunkID, NumLines});
+			RequestSessionRefresh(Stream);
+			bRetried = true;
+		}
+		else
+		{
+			UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaCoreSubsystem::LogChunkResponse | Too many log chunks waiting for a refreshed token, dropping chunk of %d lines"),
+				NumLines);
+			FCapsaPipelineStats::Get().RecordDropped(NumLines);
+		}
+	}
+
+	if (ChunkSession != nullptr && ChunkSession->TemplateDictionary.IsValid())
+	{
+		if (!bFailed)
+		{
+			// Later chunks no longer define the templates this chunk defined
+			ChunkSession->TemplateDictionary->MarkDelivered(ChunkID);
+		}
+		else if (!bRetried)
+		{
+			// Its templates stay undelivered, so the next chunk using them defines them again. A retried chunk still carries its definitions
+			ChunkSession->TemplateDictionary->MarkFailed(ChunkID);
+		}
+	}
+
+	if (CapsaTrace::IsChannelEnabled())
+	{
+		const uint64 EndCycle = FPlatformTime::Cycles64();
+		const float ElapsedSeconds = Request.IsValid() ? Request->GetElapsedTime() : 0.f;
+		const uint64 StartCycle = EndCycle - static_cast<uint64>(ElapsedSeconds / FPlatformTime::GetSecondsPerCycle64());
+		CapsaTrace::OutputStage(ChunkID, ECapsaTraceStage::HttpResponse, StartCycle, EndCycle, Request.IsValid() ? Request->GetContentLength() : 0,
+			Response.IsValid() ? Response->GetContentLength() : 0, 0);
+	}
+
+	LogResponse(Request, Response, bSuccess);
+}
+
 void UCapsaCoreSubsystem::MetadataResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess)
 {
 	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::MetadataResponse | Metadata stored"));
@@ -481,65 +1314,125 @@ void UCapsaCoreSubsystem::OnPostWorldInit(UWorld* World, const UWorld::Initializ
 		return;
 	}
 
-	if (!CapsaSettings->GetShouldAutoAddCapsaComponent())
+	// Bound in every server World, whether or not the Capsa Component is auto-added, as the UCapsaGameStateComponent replicates the server data
+	// to the Capsa Components placed by hand as well
+	// Worlds can be initialized more than once, fe. when a Play In Editor World is reused, they are only bound once
+	if (AutoAddWorlds.Contains(World))
 	{
 		return;
 	}
 
-	if (CapsaSettings->GetAutoAddClass() == nullptr)
+	const FDelegateHandle Handle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &UCapsaCoreSubsystem::OnActorSpawned));
+	AutoAddWorlds.Add(World, Handle);
+
+	if (const UClass* AutoAddClass = GetAutoAddClass())
+	{
+		UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::OnPostWorldInit | Adding Capsa Components to Actors of class %s spawned in %s"),
+			*AutoAddClass->GetName(), *World->GetName());
+	}
+}
+
+void UCapsaCoreSubsystem::OnWorldInitializedActors(const FActorsInitializedParams& Params)
+{
+	if (Params.World == nullptr || !AutoAddWorlds.Contains(Params.World))
 	{
 		return;
 	}
 
-	FGameModeEvents::GameModePostLoginEvent.AddUObject(this, &UCapsaCoreSubsystem::OnPlayerLoggedIn);
-	FGameModeEvents::GameModeLogoutEvent.AddUObject(this, &UCapsaCoreSubsystem::OnPlayerLoggedOut);
+	if (AGameStateBase* GameState = Params.World->GetGameState())
+	{
+		AddCapsaComponent(GameState, UCapsaGameStateComponent::StaticClass());
+	}
 
-	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::OnPostWorldInit | GameModePostLoginEvent and GameModeLogoutEvent delegates added"));
+	const UClass* AutoAddClass = GetAutoAddClass();
+	if (AutoAddClass == nullptr)
+	{
+		return;
+	}
+
+	// Actors placed in the World were not spawned, they are only looked for once
+	for (TActorIterator<AActor> It(Params.World, AutoAddClass); It; ++It)
+	{
+		AddCapsaComponent(*It, UCapsaActorComponent::StaticClass());
+	}
 }
 
-void UCapsaCoreSubsystem::OnPlayerLoggedIn(AGameModeBase* GameMode, APlayerController* Player)
+void UCapsaCoreSubsystem::OnActorSpawned(AActor* Actor)
 {
-	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-	if (CapsaSettings == nullptr || !CapsaSettings->IsValidLowLevelFast())
+	if (Actor == nullptr)
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::OnPlayerLoggedIn | Failed to load CapsaSettings." ));
 		return;
 	}
 
-	TArray<AActor*> ActorsToAddComp;
-	UGameplayStatics::GetAllActorsOfClass(GameMode, CapsaSettings->GetAutoAddClass(), ActorsToAddComp);
+	// The server data is replicated once, from the GameState, rather than from every PlayerState
+	if (Actor->IsA<AGameStateBase>())
+	{
+		AddCapsaComponent(Actor, UCapsaGameStateComponent::StaticClass());
+	}
 
-	if (ActorsToAddComp.IsEmpty())
+	// Called for every Actor spawned in the World, the class checks are all most of them pay
+	const UClass* AutoAddClass = GetAutoAddClass();
+	if (AutoAddClass == nullptr || !Actor->IsA(AutoAddClass))
 	{
-		UE_LOG(LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::OnPlayerLoggedIn | Unable to add Capsa Component, no Actors of class %s found." ),
-			*CapsaSettings->GetAutoAddClass()->GetName());
 		return;
 	}
 
-	// Once we have a valid one, send OUR CapsaID via the RPC
-	for (AActor* Actor : ActorsToAddComp)
+	AddCapsaComponent(Actor, UCapsaActorComponent::StaticClass());
+}
+
+const UClass* UCapsaCoreSubsystem::GetAutoAddClass()
+{
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaSettings == nullptr || !CapsaSettings->GetShouldAutoAddCapsaComponent())
 	{
-		if (Actor->FindComponentByClass<UCapsaActorComponent>() != nullptr)
-		{
-			// Don't add again, if we already have a UCapsaActorComponent on this class.
-			continue;
-		}
+		return nullptr;
+	}
 
-		UActorComponent* ActorComponent = Actor->AddComponentByClass(UCapsaActorComponent::StaticClass(), false, FTransform(), false);
-		if (!CapsaActorComponent.IsValid())
-		{
-			// Store a Weak Reference to the first made Actor Component.
-			CapsaActorComponent = Cast<UCapsaActorComponent>(ActorComponent);
+	return CapsaSettings->GetAutoAddClass().Get();
+}
 
-			UE_LOG(LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::OnPlayerLoggedIn | UCapsaActorComponent reference stored"));
-		}
+void UCapsaCoreSubsystem::AddCapsaComponent(AActor* Actor, TSubclassOf<UActorComponent> ComponentClass)
+{
+	if (Actor->FindComponentByClass(ComponentClass) != nullptr)
+	{
+		// Don't add again, if we already have this Capsa Component on this class.
+		return;
 	}
 
-	UE_LOG(LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::OnPlayerLoggedIn | Finished"));
+	Actor->AddComponentByClass(ComponentClass, false, FTransform(), false);
 }
 
-void UCapsaCoreSubsystem::OnPlayerLoggedOut(AGameModeBase* GameMode, AController* Controller)
+void UCapsaCoreSubsystem::OnWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds)
 {
+	if (const uint16* Stream = WorldStreams.Find(World))
+	{
+		StreamBeforeWorldTick = CapsaLogStreams::SetScopedStream(*Stream);
+	}
+}
+
+void UCapsaCoreSubsystem::OnWorldTickEnd(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	// Restored even if the world was cleaned up during its tick
+	if (StreamBeforeWorldTick.IsSet())
+	{
+		CapsaLogStreams::SetScopedStream(StreamBeforeWorldTick.GetValue());
+		StreamBeforeWorldTick.Reset();
+	}
+}
+
+void UCapsaCoreSubsystem::OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+{
+	FDelegateHandle AutoAddHandle;
+	if (World != nullptr && AutoAddWorlds.RemoveAndCopyValue(World, AutoAddHandle))
+	{
+		World->RemoveOnActorSpawnedHandler(AutoAddHandle);
+	}
+
+	if (WorldStreams.Remove(World) > 0 && WorldStreams.IsEmpty())
+	{
+		FWorldDelegates::OnWorldTickStart.RemoveAll(this);
+		FWorldDelegates::OnWorldTickEnd.RemoveAll(this);
+	}
 }
 
 void UCapsaCoreSubsystem::OpenClientLogInBrowser()
@@ -554,10 +1447,10 @@ void UCapsaCoreSubsystem::OpenClientLogInBrowser()
 		return;
 	}
 
-	UCapsaCoreSubsystem::OpenBrowser(CapsaCore->LinkWeb);
+	UCapsaCoreSubsystem::OpenBrowser(CapsaCore->Session.LinkWeb);
 }
 
-void UCapsaCoreSubsystem::OpenServerLogInBrowser()
+void UCapsaCoreSubsystem::OpenServerLogInBrowser(UWorld* World)
 {
 	UCapsaCoreSubsystem* CapsaCore = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
 
@@ -569,19 +1462,20 @@ void UCapsaCoreSubsystem::OpenServerLogInBrowser()
 		return;
 	}
 
-	if (!CapsaCore->CapsaActorComponent.IsValid())
+	const UCapsaGameStateComponent* GameStateComponent = FindGameStateComponent(World);
+	if (GameStateComponent == nullptr)
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "Unable to open Server Log in Browser: CapsaActorComponent is not valid" ));
+		UE_LOG(LogCapsaCore, Error, TEXT( "Unable to open Server Log in Browser: GameStateComponent is not valid" ));
 		return;
 	}
 
-	if (CapsaCore->CapsaActorComponent->CapsaServerData.LogURL.IsEmpty())
+	if (GameStateComponent->CapsaServerData.LogURL.IsEmpty())
 	{
-		UE_LOG(LogCapsaCore, Error, TEXT( "Unable to open Server Log in Browser: CapsaActorComponent->CapsaServerData.LogURL is empty" ));
+		UE_LOG(LogCapsaCore, Error, TEXT( "Unable to open Server Log in Browser: GameStateComponent->CapsaServerData.LogURL is empty" ));
 		return;
 	}
 
-	FString LogURL = CapsaCore->CapsaActorComponent->CapsaServerData.LogURL;
+	FString LogURL = GameStateComponent->CapsaServerData.LogURL;
 	UCapsaCoreSubsystem::OpenBrowser(LogURL);
 }
 
@@ -597,9 +1491,9 @@ static FAutoConsoleCommand CVarCapsaViewClientLog(
 	FConsoleCommandDelegate::CreateStatic(UCapsaCoreSubsystem::OpenClientLogInBrowser),
 	ECVF_Cheat);
 
-static FAutoConsoleCommand CVarCapsaViewServerLog(
+static FAutoConsoleCommandWithWorld CVarCapsaViewServerLog(
 	TEXT("Capsa.ViewServerLog"),
 	TEXT("Requests the Operating System to open the default browser ")
-	TEXT("and open the Capsa Log URL for the connected server in the current session."),
-	FConsoleCommandDelegate::CreateStatic(UCapsaCoreSubsystem::OpenServerLogInBrowser),
+	TEXT("and open the Capsa Log URL for the server the world the command is run in is connected to."),
+	FConsoleCommandWithWorldDelegate::CreateStatic(UCapsaCoreSubsystem::OpenServerLogInBrowser),
 	ECVF_Cheat);
@@ -0,0 +1,53 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaCoreTrace.h"
+
+#include <atomic>
+
+#if CAPSA_TRACE_ENABLED
+UE_TRACE_CHANNEL_DEFINE(CapsaChannel)
+
+UE_TRACE_EVENT_BEGIN(Capsa, ChunkStage)
+	UE_TRACE_EVENT_FIELD(uint64, ChunkId)
+	UE_TRACE_EVENT_FIELD(uint64, StartCycle)
+	UE_TRACE_EVENT_FIELD(uint64, EndCycle)
+	UE_TRACE_EVENT_FIELD(uint64, InputBytes)
+	UE_TRACE_EVENT_FIELD(uint64, OutputBytes)
+	UE_TRACE_EVENT_FIELD(uint32, LineCount)
+	UE_TRACE_EVENT_FIELD(uint32, ThreadId)
+	UE_TRACE_EVENT_FIELD(uint8, Stage)
+UE_TRACE_EVENT_END()
+#endif
+
+namespace CapsaTrace
+{
+uint64 AllocateChunkID()
+{
+	static std::atomic<uint64> NextChunkID{1};
+	return NextChunkID.fetch_add(1, std::memory_order_relaxed);
+}
+
+void OutputStage(uint64 ChunkID, ECapsaTraceStage Stage, uint64 StartCycle, uint64 EndCycle, uint64 InputBytes, uint64 OutputBytes, uint32 LineCount)
+{
+#if CAPSA_TRACE_ENABLED
+	UE_TRACE_LOG(Capsa, ChunkStage, CapsaChannel)
+		<< ChunkStage.ChunkId(ChunkID)
+		<< ChunkStage.StartCycle(StartCycle)
+		<< ChunkStage.EndCycle(EndCycle)
+		<< ChunkStage.InputBytes(InputBytes)
+		<< ChunkStage.OutputBytes(OutputBytes)
+		<< ChunkStage.LineCount(LineCount)
+		<< ChunkStage.ThreadId(FPlatformTLS::GetCurrentThreadId())
+		<< ChunkStage.Stage(static_cast<uint8>(Stage));
+#endif
+}
+
+bool IsChannelEnabled()
+{
+#if CAPSA_TRACE_ENABLED
+	return UE_TRACE_CHANNELEXPR_IS_ENABLED(CapsaChannel);
+#else
+	return false;
+#endif
+}
+}
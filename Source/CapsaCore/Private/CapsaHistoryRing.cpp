@@ -0,0 +1,331 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaHistoryRing.h"
+
+#include "CapsaCore.h"
+#include "CapsaLogOperations.h"
+#include "CapsaRedactor.h"
+#include "CapsaUtf8.h"
+
+#include "HAL/FileManager.h"
+#include "Misc/Compression.h"
+#include "Tasks/Task.h"
+
+namespace
+{
+/// Rough size of the prefix of a formatted line in bytes, used to estimate the size of the staging block before it is formatted.
+constexpr int32 EstimatedPrefixSize = 48;
+
+/// The memory held by the block, estimated while it is being formatted.
+int64 GetHeldSize(const FCapsaHistoryBlock& Block)
+{
+	return Block.Data.IsNull() ? Block.UncompressedSize : static_cast<int64>(Block.Data.GetSize());
+}
+
+/// Formats the lines in the Capsa log format, as UTF-8, rendering the messages of structured lines.
+FSharedBuffer FormatBlock(const FCapsaLogChunk& Lines)
+{
+	FString Log;
+	TWideStringBuilder<512> MessageBuilder;
+	Lines.ForEachLine(
+		[&Log](const FBufferedLine& Line)
+		{
+			CapsaLogOperations::AppendLinePrefix(Log, Line.Time, Line.Verbosity, Line.Category.Resolve());
+			Log.Append(Line.Data.Get());
+			Log.Append(LINE_TERMINATOR_ANSI); // Use lf ending on all platforms
+		},
+		[&Log, &MessageBuilder](const FCapsaStructuredLine& Line)
+		{
+			CapsaLogOperations::AppendLinePrefix(Log, Line.Time, Line.Record.GetVerbosity(), Line.Record.GetCategory());
+			MessageBuilder.Reset();
+			Line.Record.FormatMessageTo(MessageBuilder);
+			Log.Append(MessageBuilder.GetData(), MessageBuilder.Len());
+			Log.Append(LINE_TERMINATOR_ANSI);
+		});
+	return MakeSharedBufferFromArray(CapsaUtf8::Convert(Log));
+}
+
+/// Compresses the block as a single gzip member.
+FSharedBuffer CompressBlock(const FSharedBuffer& Data)
+{
+	int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Gzip, static_cast<int32>(Data.GetSize()));
+	FUniqueBuffer Compressed = FUniqueBuffer::Alloc(CompressedSize);
+	if (!FCompression::CompressMemory(NAME_Gzip, Compressed.GetData(), CompressedSize, Data.GetData(), static_cast<int32>(Data.GetSize())))
+	{
+		return FSharedBuffer();
+	}
+
+	// Shrink to the compressed size, the bound is usually several times larger
+	return FSharedBuffer::Clone(Compressed.GetData(), CompressedSize);
+}
+
+/// Appends the lines of the block to Log, decompressing it if needed.
+/// @return bool False if the block could not be decompressed.
+bool AppendBlock(const FCapsaHistoryBlock& Block, FString& Log, TArray<uint8>& Uncompressed)
+{
+	const uint8* Utf8 = static_cast<const uint8*>(Block.Data.GetData());
+	if (Block.bCompressed)
+	{
+		Uncompressed.SetNumUninitialized(Block.UncompressedSize);
+		if (!FCompression::UncompressMemory(NAME_Gzip, Uncompressed.GetData(), Block.UncompressedSize, Block.Data.GetData(),
+			static_cast<int32>(Block.Data.GetSize())))
+		{
+			return false;
+		}
+		Utf8 = Uncompressed.GetData();
+	}
+
+	const FUTF8ToTCHAR Converted(reinterpret_cast<const UTF8CHAR*>(Utf8), Block.UncompressedSize);
+	Log.Append(Converted.Get(), Converted.Length());
+	return true;
+}
+}
+
+bool FCapsaHistorySnapshot::IsEmpty() const
+{
+	return Blocks.IsEmpty();
+}
+
+int64 FCapsaHistorySnapshot::GetSize() const
+{
+	int64 Size = 0;
+	for (const FCapsaHistoryBlock& Block : Blocks)
+	{
+		Size += Block.Data.GetSize();
+	}
+	return Size;
+}
+
+int32 FCapsaHistorySnapshot::GetNumLines() const
+{
+	int32 NumLines = 0;
+	for (const FCapsaHistoryBlock& Block : Blocks)
+	{
+		NumLines += Block.NumLines;
+	}
+	return NumLines;
+}
+
+FString FCapsaHistorySnapshot::ToString() const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaHistorySnapshot::ToString);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	FString Log;
+	TArray<uint8> Uncompressed;
+	for (const FCapsaHistoryBlock& Block : Blocks)
+	{
+		if (!AppendBlock(Block, Log, Uncompressed))
+		{
+			UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHistorySnapshot::ToString | Failed to decompress a history block, skipping %d lines"), Block.NumLines);
+		}
+	}
+
+	if (Redactor.IsValid())
+	{
+		// Patterns do not match across line breaks, so the lines can be redacted at once
+		Redactor->Redact(Log);
+	}
+	return Log;
+}
+
+bool FCapsaHistorySnapshot::SaveToFile(const FString& FilePath) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaHistorySnapshot::SaveToFile);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*FilePath));
+	if (!Writer.IsValid())
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHistorySnapshot::SaveToFile | Failed to open %s"), *FilePath);
+		return false;
+	}
+
+	FString Log;
+	TArray<uint8> Uncompressed;
+	TArray<uint8> Redacted;
+	for (const FCapsaHistoryBlock& Block : Blocks)
+	{
+		FSharedBuffer Compressed;
+		if (Redactor.IsValid())
+		{
+			Log.Reset();
+			if (!AppendBlock(Block, Log, Uncompressed))
+			{
+				UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHistorySnapshot::SaveToFile | Failed to decompress a history block, skipping %d lines"), Block.NumLines);
+				continue;
+			}
+			Redactor->Redact(Log);
+			Redacted.Reset();
+			CapsaUtf8::Append(Redacted, *Log, Log.Len());
+			Compressed = CompressBlock(FSharedBuffer::MakeView(Redacted.GetData(), Redacted.Num()));
+		}
+		else
+		{
+			// Blocks that were not compressed yet, including the staging block, are compressed here to keep the file a valid gzip stream
+			Compressed = Block.bCompressed ? Block.Data : CompressBlock(Block.Data);
+		}
+		Writer->Serialize(const_cast<void*>(Compressed.GetData()), static_cast<int64>(Compressed.GetSize()));
+	}
+
+	return Writer->Close();
+}
+
+FCapsaHistoryRing::FCapsaHistoryRing(int64 InCapacity, int32 InBlockSize) :
+	Capacity(FMath::Max<int64>(InCapacity, 1)),
+	BlockSize(FMath::Max(InBlockSize, 1024))
+{
+}
+
+FCapsaHistoryRing::~FCapsaHistoryRing()
+{
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::History, -BlocksSize);
+}
+
+void FCapsaHistoryRing::AddLine(const TCHAR* Data, ELogVerbosity::Type Verbosity, const FName& Category, double Time)
+{
+	LLM_SCOPE_BYTAG(Capsa);
+
+	FBufferedLine Line(Data, Category, Verbosity, Time);
+	const int32 EstimatedSize = FCString::Strlen(Data) + EstimatedPrefixSize;
+
+	FScopeLock ScopeLock(&Lock);
+	Staging.Lines.Add(MoveTemp(Line));
+	OnLineAdded(EstimatedSize, Time);
+}
+
+void FCapsaHistoryRing::AddRecord(const UE::FLogRecord& Record, double Time)
+{
+	LLM_SCOPE_BYTAG(Capsa);
+
+	FCapsaStructuredLine Line(Record, 0, Time);
+	const TCHAR* Format = Record.GetFormat();
+	const int32 EstimatedSize = (Format != nullptr ? FCString::Strlen(Format) : 0) + static_cast<int32>(Line.GetFieldsSize()) + EstimatedPrefixSize;
+
+	FScopeLock ScopeLock(&Lock);
+	Line.LineIndex = Staging.Lines.Num();
+	Staging.StructuredLines.Add(MoveTemp(Line));
+	OnLineAdded(EstimatedSize, Time);
+}
+
+FCapsaHistorySnapshot FCapsaHistoryRing::Snapshot()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaHistoryRing::Snapshot);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	FCapsaHistorySnapshot Snapshot;
+	{
+		FScopeLock ScopeLock(&Lock);
+		SealStaging();
+
+		Snapshot.Blocks.Reserve(Blocks.Num());
+		for (const FCapsaHistoryBlock& Block : Blocks)
+		{
+			Snapshot.Blocks.Add(Block);
+		}
+		Snapshot.Redactor = Redactor;
+	}
+
+	// Blocks the task graph did not get to yet are formatted here rather than waited for, the ring keeps the lines until its task finishes
+	for (FCapsaHistoryBlock& Block : Snapshot.Blocks)
+	{
+		if (Block.Data.IsNull())
+		{
+			Block.Data = FormatBlock(*Block.PendingLines);
+			Block.UncompressedSize = static_cast<int32>(Block.Data.GetSize());
+		}
+		Block.PendingLines.Reset();
+	}
+	return Snapshot;
+}
+
+void FCapsaHistoryRing::SetRedactor(TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> InRedactor)
+{
+	FScopeLock ScopeLock(&Lock);
+	Redactor = MoveTemp(InRedactor);
+}
+
+void FCapsaHistoryRing::OnLineAdded(int32 EstimatedSize, double Time)
+{
+	if (StagingBlock.NumLines++ == 0)
+	{
+		StagingBlock.FirstTime = Time;
+	}
+	StagingBlock.LastTime = Time;
+	StagingBlock.UncompressedSize += EstimatedSize;
+
+	if (StagingBlock.UncompressedSize >= BlockSize)
+	{
+		SealStaging();
+	}
+}
+
+void FCapsaHistoryRing::SealStaging()
+{
+	if (StagingBlock.NumLines == 0)
+	{
+		return;
+	}
+
+	TSharedPtr<FCapsaLogChunk, ESPMode::ThreadSafe> Lines = MakeShared<FCapsaLogChunk, ESPMode::ThreadSafe>(MoveTemp(Staging));
+	Staging = FCapsaLogChunk();
+
+	FCapsaHistoryBlock& Block = Blocks.EmplaceLast(MoveTemp(StagingBlock));
+	Block.PendingLines = Lines;
+	StagingBlock = FCapsaHistoryBlock();
+
+	BlocksSize += GetHeldSize(Block);
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::History, GetHeldSize(Block));
+
+	// Formatting renders the messages of structured lines as well, so none of it runs on the logging thread
+	const uint64 Sequence = FrontSequence + Blocks.Num() - 1;
+	UE::Tasks::Launch(UE_SOURCE_LOCATION, [Self = AsShared(), Sequence, Lines = MoveTemp(Lines)]()
+	{
+		LLM_SCOPE_BYTAG(Capsa);
+		FSharedBuffer Data = FormatBlock(*Lines);
+		FSharedBuffer CompressedData = CompressBlock(Data);
+		Self->OnBlockFormatted(Sequence, MoveTemp(Data), MoveTemp(CompressedData));
+	});
+
+	Evict();
+}
+
+void FCapsaHistoryRing::OnBlockFormatted(uint64 Sequence, FSharedBuffer Data, FSharedBuffer CompressedData)
+{
+	if (CompressedData.IsNull())
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHistoryRing::OnBlockFormatted | Failed to compress history block %llu, keeping it uncompressed"), Sequence);
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	if (Sequence < FrontSequence)
+	{
+		// Evicted while it was formatted
+		return;
+	}
+
+	FCapsaHistoryBlock& Block = Blocks[static_cast<int32>(Sequence - FrontSequence)];
+	const int64 PreviousSize = GetHeldSize(Block);
+	Block.UncompressedSize = static_cast<int32>(Data.GetSize());
+	Block.bCompressed = !CompressedData.IsNull();
+	Block.Data = Block.bCompressed ? MoveTemp(CompressedData) : MoveTemp(Data);
+	Block.PendingLines.Reset();
+
+	const int64 Delta = GetHeldSize(Block) - PreviousSize;
+	BlocksSize += Delta;
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::History, Delta);
+}
+
+void FCapsaHistoryRing::Evict()
+{
+	// Always keep the newest block, even if it alone exceeds the capacity
+	while (BlocksSize > Capacity && Blocks.Num() > 1)
+	{
+		const int64 EvictedSize = GetHeldSize(Blocks.First());
+		Blocks.PopFirst();
+		++FrontSequence;
+
+		BlocksSize -= EvictedSize;
+		FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::History, -EvictedSize);
+	}
+}
@@ -0,0 +1,337 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaHostAgent.h"
+
+#include "CapsaCore.h"
+#include "CapsaCoreStats.h"
+#include "CapsaLogSink.h"
+#include "CapsaUtf8.h"
+
+#if PLATFORM_LINUX
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace CapsaHostAgent
+{
+void BeginFrame(TArray<uint8>& Frame, EFrameType Type)
+{
+	Frame.Reset();
+	Frame.AddZeroed(FrameHeaderSize);
+	Frame[sizeof(uint32)] = static_cast<uint8>(Type);
+}
+
+void EndFrame(TArray<uint8>& Frame)
+{
+	const uint32 PayloadSize = Frame.Num() - FrameHeaderSize;
+	FMemory::Memcpy(Frame.GetData(), &PayloadSize, sizeof(PayloadSize));
+}
+
+void AppendString(TArray<uint8>& Frame, FStringView String)
+{
+	const int32 SizeOffset = Frame.AddUninitialized(sizeof(uint32));
+	const uint32 Size = CapsaUtf8::Append(Frame, String.GetData(), String.Len());
+	FMemory::Memcpy(Frame.GetData() + SizeOffset, &Size, sizeof(Size));
+}
+
+bool ReadString(const uint8*& Data, const uint8* End, FString& OutString)
+{
+	uint32 Size = 0;
+	if (End - Data < static_cast<int64>(sizeof(Size)))
+	{
+		return false;
+	}
+	FMemory::Memcpy(&Size, Data, sizeof(Size));
+	Data += sizeof(Size);
+
+	if (End - Data < static_cast<int64>(Size))
+	{
+		return false;
+	}
+	const FUTF8ToTCHAR Converted(reinterpret_cast<const UTF8CHAR*>(Data), Size);
+	OutString = FString(Converted.Length(), Converted.Get());
+	Data += Size;
+	return true;
+}
+}
+
+FCapsaHostAgentClient::FCapsaHostAgentClient(const FString& InSocketPath) :
+	SocketPath(InSocketPath)
+{
+}
+
+FCapsaHostAgentClient::~FCapsaHostAgentClient()
+{
+	Disconnect();
+
+	for (const FUnsentChunk& Unsent : UnsentChunks)
+	{
+		FCapsaPipelineStats::Get().RecordDropped(Unsent.NumLines);
+	}
+	if (!UnsentChunks.IsEmpty())
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHostAgentClient::~FCapsaHostAgentClient | Dropping %d chunks the host agent did not receive"),
+			UnsentChunks.Num());
+	}
+}
+
+bool FCapsaHostAgentClient::IsSupported()
+{
+	return PLATFORM_LINUX;
+}
+
+void FCapsaHostAgentClient::SetSession(const FString& LogID, const FString& Token, const FString& ChunkEndpoint)
+{
+	TArray<uint8> NewSessionFrame;
+	CapsaHostAgent::BeginFrame(NewSessionFrame, CapsaHostAgent::EFrameType::Session);
+	CapsaHostAgent::AppendString(NewSessionFrame, LogID);
+	CapsaHostAgent::AppendString(NewSessionFrame, Token);
+	CapsaHostAgent::AppendString(NewSessionFrame, ChunkEndpoint);
+	CapsaHostAgent::EndFrame(NewSessionFrame);
+
+	if (NewSessionFrame == SessionFrame && Socket >= 0)
+	{
+		// Chunks of log streams set their session before every chunk, it only changes when the stream does
+		return;
+	}
+	SessionFrame = MoveTemp(NewSessionFrame);
+
+	if (Socket >= 0)
+	{
+		// Queued if the agent is behind, the chunks of the new session must follow it
+		int64 Queued = 0;
+		Write(SessionFrame, false, true, Queued);
+	}
+	else
+	{
+		// Connect for the new session right away
+		NextConnectTime = 0.0;
+		Connect();
+	}
+}
+
+bool FCapsaHostAgentClient::SendChunk(const FCapsaEncodedChunk& Chunk, int32 Segment, uint64 ChunkSequence, bool bBlocking)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaHostAgentClient::SendChunk);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	if (SessionFrame.IsEmpty() || (Socket < 0 && !Connect()))
+	{
+		return false;
+	}
+
+	// Only the first segment carries the line sequences of the chunk, the lines of the following segments continue them
+	const FString& LineSequences = Segment == 0 ? Chunk.LineSequences : FString();
+	const FSharedBuffer& Log = Chunk.Segments[Segment];
+
+	CapsaHostAgent::BeginFrame(Scratch, CapsaHostAgent::EFrameType::Chunk);
+	Scratch.Add(static_cast<uint8>(Chunk.Lane));
+	Scratch.Append(reinterpret_cast<const uint8*>(&ChunkSequence), sizeof(ChunkSequence));
+	CapsaHostAgent::AppendString(Scratch, LineSequences);
+	Scratch.Append(static_cast<const uint8*>(Log.GetData()), static_cast<int32>(Log.GetSize()));
+	if (Scratch.Num() > CapsaHostAgent::MaxFrameSize)
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHostAgentClient::SendChunk | Chunk of %d bytes is too large for the host agent"), Scratch.Num());
+		return false;
+	}
+	CapsaHostAgent::EndFrame(Scratch);
+
+	int64 Queued = 0;
+	const bool bWritten = Write(Scratch, bBlocking, false, Queued);
+	if (bWritten && Queued > 0)
+	{
+		// Shares the segment with the chunk, so it can be uploaded if the connection closes before the frame is written
+		FPendingChunk& Pending = PendingChunks.AddDefaulted_GetRef();
+		Pending.End = PendingWrite.Num();
+		Pending.Chunk.ChunkID = Chunk.ChunkID;
+		Pending.Chunk.Lane = Chunk.Lane;
+		Pending.Chunk.Stream = Chunk.Stream;
+		Pending.Chunk.LineSequences = LineSequences;
+		Pending.Chunk.Log = Log;
+		Pending.Chunk.NumLines = Chunk.GetSegmentNumLines(Segment);
+	}
+	if (Scratch.Max() > 1024 * 1024)
+	{
+		// Large chunks, fe. at shutdown, should not keep their buffer alive
+		Scratch.Empty();
+	}
+	return bWritten;
+}
+
+void FCapsaHostAgentClient::Tick()
+{
+	FlushPendingWrite(false);
+}
+
+TArray<FCapsaHostAgentClient::FUnsentChunk> FCapsaHostAgentClient::TakeUnsentChunks()
+{
+	return MoveTemp(UnsentChunks);
+}
+
+bool FCapsaHostAgentClient::Connect()
+{
+#if PLATFORM_LINUX
+	const double Now = FPlatformTime::Seconds();
+	if (Now < NextConnectTime)
+	{
+		return false;
+	}
+	NextConnectTime = Now + 1.0;
+
+	sockaddr_un Address = {};
+	Address.sun_family = AF_UNIX;
+	const FTCHARToUTF8 Path(*SocketPath);
+	if (Path.Length() >= static_cast<int32>(sizeof(Address.sun_path)))
+	{
+		UE_LOG(LogCapsaCore, Error, TEXT("FCapsaHostAgentClient::Connect | Socket path %s is too long"), *SocketPath);
+		return false;
+	}
+	FMemory::Memcpy(Address.sun_path, Path.Get(), Path.Length());
+
+	Socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (Socket < 0)
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHostAgentClient::Connect | Failed to create socket, errno %d"), errno);
+		return false;
+	}
+
+	// Only blocking writes at shutdown wait for the socket, those that take longer close the connection instead
+	timeval SendTimeout = {};
+	SendTimeout.tv_usec = 100 * 1000;
+	setsockopt(Socket, SOL_SOCKET, SO_SNDTIMEO, &SendTimeout, sizeof(SendTimeout));
+
+	if (connect(Socket, reinterpret_cast<const sockaddr*>(&Address), sizeof(Address)) != 0)
+	{
+		UE_LOG(LogCapsaCore, Verbose, TEXT("FCapsaHostAgentClient::Connect | No host agent at %s, errno %d"), *SocketPath, errno);
+		Disconnect();
+		return false;
+	}
+
+	UE_LOG(LogCapsaCore, Log, TEXT("FCapsaHostAgentClient::Connect | Connected to the host agent at %s"), *SocketPath);
+	int64 Queued = 0;
+	return SessionFrame.IsEmpty() || Write(SessionFrame, false, true, Queued);
+#else
+	return false;
+#endif
+}
+
+void FCapsaHostAgentClient::Disconnect()
+{
+#if PLATFORM_LINUX
+	if (Socket >= 0)
+	{
+		close(Socket);
+		Socket = -1;
+	}
+	PendingWrite.Empty();
+#endif
+
+	// The agent discards the frame it was receiving, the caller uploads the chunks it did not receive whole
+	for (FPendingChunk& Pending : PendingChunks)
+	{
+		UnsentChunks.Add(MoveTemp(Pending.Chunk));
+	}
+	PendingChunks.Reset();
+}
+
+bool FCapsaHostAgentClient::Write(TConstArrayView<uint8> Frame, bool bBlocking, bool bQueueIfFull, int64& OutQueued)
+{
+	OutQueued = 0;
+
+	// Frames must reach the agent whole and in order, the rest of a frame the socket only took part of goes first
+	if (!FlushPendingWrite(bBlocking))
+	{
+		if (Socket >= 0 && bQueueIfFull)
+		{
+			PendingWrite.Append(Frame.GetData(), Frame.Num());
+			OutQueued = Frame.Num();
+			return true;
+		}
+		return false;
+	}
+
+	int64 Written = 0;
+	if (!Send(Frame.GetData(), Frame.Num(), bBlocking, Written))
+	{
+		return false;
+	}
+	if (Written == 0 && !bQueueIfFull)
+	{
+		// The agent is behind, the caller uploads the chunk itself rather than waiting for it
+		return false;
+	}
+
+	OutQueued = Frame.Num() - Written;
+	PendingWrite.Append(Frame.GetData() + Written, OutQueued);
+	return true;
+}
+
+bool FCapsaHostAgentClient::FlushPendingWrite(bool bBlocking)
+{
+	if (PendingWrite.IsEmpty())
+	{
+		return true;
+	}
+
+	int64 Written = 0;
+	if (!Send(PendingWrite.GetData(), PendingWrite.Num(), bBlocking, Written))
+	{
+		return false;
+	}
+
+	PendingWrite.RemoveAt(0, static_cast<int32>(Written), false);
+
+	// Chunks whose frame was written whole are delivered
+	int32 NumDelivered = 0;
+	for (FPendingChunk& Pending : PendingChunks)
+	{
+		Pending.End -= Written;
+		NumDelivered += Pending.End <= 0 ? 1 : 0;
+	}
+	PendingChunks.RemoveAt(0, NumDelivered, false);
+
+	if (PendingWrite.IsEmpty() && PendingWrite.Max() > 1024 * 1024)
+	{
+		PendingWrite.Empty();
+	}
+	return PendingWrite.IsEmpty();
+}
+
+bool FCapsaHostAgentClient::Send(const uint8* Data, int64 Num, bool bBlocking, int64& OutWritten)
+{
+	OutWritten = 0;
+#if PLATFORM_LINUX
+	if (Socket < 0)
+	{
+		return false;
+	}
+
+	const int32 Flags = MSG_NOSIGNAL | (bBlocking ? 0 : MSG_DONTWAIT);
+	while (OutWritten < Num)
+	{
+		const ssize_t Written = send(Socket, Data + OutWritten, Num - OutWritten, Flags);
+		if (Written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (Written < 0 && !bBlocking && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			// The socket is full, the rest is written later
+			return true;
+		}
+		if (Written <= 0)
+		{
+			// A partial frame cannot be resumed on another connection, the agent discards it with this one
+			UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaHostAgentClient::Send | Failed to write to the host agent, errno %d, disconnecting"), errno);
+			Disconnect();
+			return false;
+		}
+		OutWritten += Written;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
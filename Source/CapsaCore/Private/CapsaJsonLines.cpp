@@ -0,0 +1,223 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaJsonLines.h"
+
+#include "CapsaCore.h"
+#include "CapsaLogChunk.h"
+#include "CapsaUtf8.h"
+#include "Serialization/CompactBinary.h"
+
+namespace
+{
+template<int32 N>
+void AppendLiteral(TArray<uint8>& Dest, const ANSICHAR (&Literal)[N])
+{
+	Dest.Append(reinterpret_cast<const uint8*>(Literal), N - 1);
+}
+
+/// Appends Value as decimal, zero padded to NumDigits.
+void AppendDigits(TArray<uint8>& Dest, int32 Value, int32 NumDigits)
+{
+	uint8* Digits = Dest.GetData() + Dest.AddUninitialized(NumDigits);
+	for (int32 Digit = NumDigits - 1; Digit >= 0; --Digit)
+	{
+		Digits[Digit] = static_cast<uint8>('0' + Value % 10);
+		Value /= 10;
+	}
+}
+
+/// Appends the capture time as an ISO 8601 UTC timestamp with milliseconds, fe. 2024-01-31T12:00:00.123Z.
+void AppendTime(TArray<uint8>& Dest, double LineTime)
+{
+	const FDateTime Time = FDateTime::FromUnixTimestampDecimal(LineTime);
+	int32 Year, Month, Day;
+	Time.GetDate(Year, Month, Day);
+
+	AppendDigits(Dest, Year, 4);
+	Dest.Add('-');
+	AppendDigits(Dest, Month, 2);
+	Dest.Add('-');
+	AppendDigits(Dest, Day, 2);
+	Dest.Add('T');
+	AppendDigits(Dest, Time.GetHour(), 2);
+	Dest.Add(':');
+	AppendDigits(Dest, Time.GetMinute(), 2);
+	Dest.Add(':');
+	AppendDigits(Dest, Time.GetSecond(), 2);
+	Dest.Add('.');
+	AppendDigits(Dest, Time.GetMillisecond(), 3);
+	Dest.Add('Z');
+}
+
+/// Writes the lines of one chunk. Caches the escaped category names, a chunk only has a handful.
+class FJsonLinesWriter
+{
+public:
+	FJsonLinesWriter(TArray<uint8>& InDest, bool bInIncludeStructuredFields, FStringView LogID) :
+		Dest(InDest),
+		bIncludeStructuredFields(bInIncludeStructuredFields)
+	{
+		if (!LogID.IsEmpty())
+		{
+			AppendLiteral(LogIDSuffix, ",\"logId\":\"");
+			CapsaJsonLines::AppendEscaped(LogIDSuffix, LogID.GetData(), LogID.Len());
+			LogIDSuffix.Add('"');
+		}
+	}
+
+	void AppendLine(const FBufferedLine& Line)
+	{
+		AppendPrefix(Line.Time, Line.Verbosity, Line.Category.Resolve());
+		const TCHAR* Message = Line.Data.Get();
+		CapsaJsonLines::AppendEscaped(Dest, Message, FCString::Strlen(Message));
+		AppendSuffix();
+	}
+
+	void AppendLine(const FCapsaStructuredLine& Line)
+	{
+		AppendPrefix(Line.Time, Line.Record.GetVerbosity(), Line.Record.GetCategory());
+
+		if (!Line.RedactedText.IsEmpty())
+		{
+			// Already rendered, including the fields if they are included
+			CapsaJsonLines::AppendEscaped(Dest, *Line.RedactedText, Line.RedactedText.Len());
+			AppendSuffix();
+			return;
+		}
+
+		MessageBuilder.Reset();
+		Line.Record.FormatMessageTo(MessageBuilder);
+		CapsaJsonLines::AppendEscaped(Dest, MessageBuilder.GetData(), MessageBuilder.Len());
+
+		if (bIncludeStructuredFields && Line.Record.GetFields().CreateViewIterator())
+		{
+			// Compact binary writes JSON itself, as UTF-8
+			FieldsBuilder.Reset();
+			CompactBinaryToCompactJson(Line.Record.GetFields(), FieldsBuilder);
+			AppendLiteral(Dest, "\",\"fields\":");
+			Dest.Append(reinterpret_cast<const uint8*>(FieldsBuilder.GetData()), FieldsBuilder.Len());
+			Dest.Append(LogIDSuffix);
+			AppendLiteral(Dest, "}\n");
+			return;
+		}
+
+		AppendSuffix();
+	}
+
+private:
+	void AppendPrefix(double Time, ELogVerbosity::Type Verbosity, FName Category)
+	{
+		AppendLiteral(Dest, "{\"time\":\"");
+		AppendTime(Dest, Time);
+		AppendLiteral(Dest, "\",\"level\":\"");
+		const TCHAR* Level = ToString(Verbosity);
+		CapsaUtf8::Append(Dest, Level, FCString::Strlen(Level));
+		AppendLiteral(Dest, "\",\"category\":\"");
+		Dest.Append(GetEscapedCategory(Category));
+		AppendLiteral(Dest, "\",\"message\":\"");
+	}
+
+	void AppendSuffix()
+	{
+		Dest.Add('"');
+		Dest.Append(LogIDSuffix);
+		AppendLiteral(Dest, "}\n");
+	}
+
+	const TArray<uint8>& GetEscapedCategory(FName Category)
+	{
+		if (const TArray<uint8>* Escaped = EscapedCategories.Find(Category))
+		{
+			return *Escaped;
+		}
+
+		TStringBuilder<64> CategoryBuilder;
+		Category.AppendString(CategoryBuilder);
+		TArray<uint8>& Escaped = EscapedCategories.Add(Category);
+		CapsaJsonLines::AppendEscaped(Escaped, CategoryBuilder.GetData(), CategoryBuilder.Len());
+		return Escaped;
+	}
+
+	TArray<uint8>& Dest;
+	const bool bIncludeStructuredFields;
+	TArray<uint8> LogIDSuffix;
+	TMap<FName, TArray<uint8>, TInlineSetAllocator<32>> EscapedCategories;
+	TWideStringBuilder<512> MessageBuilder;
+	TUtf8StringBuilder<256> FieldsBuilder;
+};
+}
+
+namespace CapsaJsonLines
+{
+void AppendEscaped(TArray<uint8>& Dest, const TCHAR* Text, int32 TextLen)
+{
+	// Runs that need no escaping, almost all of a message, are converted in one go
+	const TCHAR* RunStart = Text;
+	const TCHAR* const End = Text + TextLen;
+	for (const TCHAR* Char = Text; Char < End; ++Char)
+	{
+		const TCHAR Code = *Char;
+		if (Code >= 0x20 && Code != TEXT('"') && Code != TEXT('\\'))
+		{
+			continue;
+		}
+
+		CapsaUtf8::Append(Dest, RunStart, static_cast<int32>(Char - RunStart));
+		RunStart = Char + 1;
+
+		switch (Code)
+		{
+		case TEXT('"'):
+			AppendLiteral(Dest, "\\\"");
+			break;
+		case TEXT('\\'):
+			AppendLiteral(Dest, "\\\\");
+			break;
+		case TEXT('\n'):
+			AppendLiteral(Dest, "\\n");
+			break;
+		case TEXT('\r'):
+			AppendLiteral(Dest, "\\r");
+			break;
+		case TEXT('\t'):
+			AppendLiteral(Dest, "\\t");
+			break;
+		case TEXT('\b'):
+			AppendLiteral(Dest, "\\b");
+			break;
+		case TEXT('\f'):
+			AppendLiteral(Dest, "\\f");
+			break;
+		default:
+		{
+			static constexpr ANSICHAR HexDigits[] = "0123456789abcdef";
+			AppendLiteral(Dest, "\\u00");
+			Dest.Add(HexDigits[(Code >> 4) & 0xF]);
+			Dest.Add(HexDigits[Code & 0xF]);
+			break;
+		}
+		}
+	}
+
+	CapsaUtf8::Append(Dest, RunStart, static_cast<int32>(End - RunStart));
+}
+
+int32 AppendChunk(TArray<uint8>& Dest, const FCapsaLogChunk& Chunk, bool bIncludeStructuredFields, FStringView LogID)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(CapsaJsonLines::AppendChunk);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	FJsonLinesWriter Writer(Dest, bIncludeStructuredFields, LogID);
+	Chunk.ForEachLine(
+		[&Writer](const FBufferedLine& Line)
+		{
+			Writer.AppendLine(Line);
+		},
+		[&Writer](const FCapsaStructuredLine& Line)
+		{
+			Writer.AppendLine(Line);
+		});
+
+	return Chunk.Num();
+}
+}
@@ -0,0 +1,159 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaLogChunk.h"
+
+#include "CapsaCoreTrace.h"
+
+FCapsaStructuredLine::FCapsaStructuredLine(const UE::FLogRecord& InRecord, int32 InLineIndex, double InTime) :
+	Record(InRecord),
+	LineIndex(InLineIndex),
+	Time(InTime)
+{
+	Record.SetFields(FCbObject::Clone(InRecord.GetFields()));
+}
+
+int64 FCapsaStructuredLine::GetFieldsSize() const
+{
+	return Record.GetFields().GetSize();
+}
+
+void FCapsaLineSequences::Add(uint64 Sequence)
+{
+	if (Ranges.Num() > 0 && Ranges.Last().Value + 1 == Sequence)
+	{
+		Ranges.Last().Value = Sequence;
+		return;
+	}
+	Ranges.Emplace(Sequence, Sequence);
+}
+
+void FCapsaLineSequences::RemoveFirst(int32 Num)
+{
+	uint64 NumToRemove = FMath::Max(Num, 0);
+	int32 NumRanges = 0;
+	for (; NumRanges < Ranges.Num() && NumToRemove > 0; ++NumRanges)
+	{
+		TPair<uint64, uint64>& Range = Ranges[NumRanges];
+		const uint64 RangeNum = Range.Value - Range.Key + 1;
+		if (RangeNum > NumToRemove)
+		{
+			// Partially removed, kept
+			Range.Key += NumToRemove;
+			break;
+		}
+		NumToRemove -= RangeNum;
+	}
+	Ranges.RemoveAt(0, NumRanges);
+}
+
+bool FCapsaLineSequences::IsEmpty() const
+{
+	return Ranges.IsEmpty();
+}
+
+FString FCapsaLineSequences::ToString() const
+{
+	TStringBuilder<128> Builder;
+	for (const TPair<uint64, uint64>& Range : Ranges)
+	{
+		if (Builder.Len() > 0)
+		{
+			Builder << TEXT(',');
+		}
+		Builder << Range.Key;
+		if (Range.Value != Range.Key)
+		{
+			Builder << TEXT('-') << Range.Value;
+		}
+	}
+	return FString(Builder.ToView());
+}
+
+int32 FCapsaLogChunk::Num() const
+{
+	return Lines.Num() + StructuredLines.Num();
+}
+
+bool FCapsaLogChunk::IsEmpty() const
+{
+	return Lines.IsEmpty() && StructuredLines.IsEmpty();
+}
+
+void FCapsaLogChunk::SplitStreams(TArray<FCapsaLogChunk>& OutStreamChunks)
+{
+	const bool bMixedText = LineStreams.ContainsByPredicate([this](uint16 LineStream) { return LineStream != Stream; });
+	const bool bMixedStructured = StructuredLines.ContainsByPredicate([this](const FCapsaStructuredLine& Line) { return Line.Stream != Stream; });
+	if (!bMixedText && !bMixedStructured)
+	{
+		LineStreams.Reset();
+		return;
+	}
+
+	// One sequence number per line, in capture order, so every line takes its own along
+	TArray<uint64> Sequences;
+	for (const TPair<uint64, uint64>& Range : LineSequences.Ranges)
+	{
+		for (uint64 Sequence = Range.Key; Sequence <= Range.Value; ++Sequence)
+		{
+			Sequences.Add(Sequence);
+		}
+	}
+
+	FCapsaLogChunk Kept;
+	Kept.ChunkID = ChunkID;
+	Kept.Lane = Lane;
+	Kept.Stream = Stream;
+	Kept.Bytes = MoveTemp(Bytes);
+
+	TMap<uint16, int32, TInlineSetAllocator<4>> StreamChunkIndices;
+	auto GetTarget = [this, &Kept, &OutStreamChunks, &StreamChunkIndices](uint16 LineStream) -> FCapsaLogChunk&
+	{
+		if (LineStream == Stream)
+		{
+			return Kept;
+		}
+		if (const int32* ChunkIndex = StreamChunkIndices.Find(LineStream))
+		{
+			return OutStreamChunks[*ChunkIndex];
+		}
+
+		StreamChunkIndices.Add(LineStream, OutStreamChunks.Num());
+		FCapsaLogChunk& StreamChunk = OutStreamChunks.AddDefaulted_GetRef();
+		StreamChunk.ChunkID = CapsaTrace::AllocateChunkID();
+		StreamChunk.Lane = Lane;
+		StreamChunk.Stream = LineStream;
+		return StreamChunk;
+	};
+
+	int32 SequenceIndex = 0;
+	auto AddSequence = [&Sequences, &SequenceIndex](FCapsaLogChunk& Target)
+	{
+		if (Sequences.IsValidIndex(SequenceIndex))
+		{
+			Target.LineSequences.Add(Sequences[SequenceIndex++]);
+		}
+	};
+
+	// Same order as ForEachLine(), moving the lines instead of visiting them
+	int32 StructuredIndex = 0;
+	for (int32 LineIndex = 0; LineIndex <= Lines.Num(); ++LineIndex)
+	{
+		for (; StructuredIndex < StructuredLines.Num() && StructuredLines[StructuredIndex].LineIndex <= LineIndex; ++StructuredIndex)
+		{
+			FCapsaStructuredLine& Line = StructuredLines[StructuredIndex];
+			FCapsaLogChunk& Target = GetTarget(Line.Stream);
+			AddSequence(Target);
+			Line.LineIndex = Target.Lines.Num();
+			Target.StructuredLines.Add(MoveTemp(Line));
+		}
+
+		if (LineIndex < Lines.Num())
+		{
+			FCapsaLogChunk& Target = GetTarget(LineStreams.IsValidIndex(LineIndex) ? LineStreams[LineIndex] : Stream);
+			AddSequence(Target);
+			Target.Lines.Add(MoveTemp(Lines[LineIndex]));
+		}
+	}
+
+	*this = MoveTemp(Kept);
+}
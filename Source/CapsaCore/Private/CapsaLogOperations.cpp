@@ -2,83 +2,328 @@
 
 #include "CapsaLogOperations.h"
 
+#include "CapsaCategoryTable.h"
 #include "CapsaCore.h"
+#include "CapsaCoreStats.h"
+#include "CapsaLogChunk.h"
+#include "CapsaCoreTrace.h"
+#include "CapsaTemplateEncoder.h"
+#include "CapsaUtf8.h"
 
 #include "CoreMinimal.h"
 #include "FunctionLibrary/CapsaCoreFunctionLibrary.h"
+#include "Serialization/CompactBinary.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+
+namespace
+{
+/// Appends a structured line, rendering its message from the format and fields of the record.
+void AppendStructuredLine(FString& Log, const FCapsaStructuredLine& Line, bool bIncludeStructuredFields, TWideStringBuilder<512>& MessageBuilder)
+{
+	CapsaLogOperations::AppendLinePrefix(Log, Line.Time, Line.Record.GetVerbosity(), Line.Record.GetCategory());
+
+	if (!Line.RedactedText.IsEmpty())
+	{
+		// Already rendered, including the fields if they are included
+		Log.Append(Line.RedactedText);
+		Log.Append(LINE_TERMINATOR_ANSI);
+		return;
+	}
+
+	MessageBuilder.Reset();
+	Line.Record.FormatMessageTo(MessageBuilder);
+	Log.Append(MessageBuilder.GetData(), MessageBuilder.Len());
+
+	if (bIncludeStructuredFields && Line.Record.GetFields().CreateViewIterator())
+	{
+		Log.AppendChar(TEXT(' '));
+		CapsaLogOperations::AppendStructuredFields(Log, Line.Record.GetFields());
+	}
+
+	Log.Append(LINE_TERMINATOR_ANSI); // Use lf ending on all platforms
+}
+}
 
 namespace CapsaLogOperations
 {
-FString MakeLogString(const TArray<FBufferedLine>& Buffer)
+void AppendLinePrefix(FString& Log, double LineTime, ELogVerbosity::Type Verbosity, const FName& Category)
+{
+	AppendLineTimeAndVerbosity(Log, LineTime, Verbosity);
+	FCapsaCategoryTable::Get().AppendCategory(Log, Category);
+}
+
+void AppendLineTimeAndVerbosity(FString& Log, double LineTime, ELogVerbosity::Type Verbosity)
+{
+	// Construct the Time from the Seconds when the Line was added
+	FDateTime Time = FDateTime::FromUnixTimestampDecimal(LineTime);
+	// format: yyyy.mm.dd-hh.mm.ss:mil
+	Log.Append(FString::Printf(TEXT("[%s]"), *Time.ToString(TEXT("%Y.%m.%d-%H.%M.%S.%s"))));
+	Log.Append(FString::Printf(TEXT("[%s]"), *UCapsaCoreFunctionLibrary::GetLogVerbosityString(Verbosity)));
+}
+
+void AppendStructuredFields(FString& Log, const FCbObject& Fields)
+{
+	TUtf8StringBuilder<256> FieldsBuilder;
+	CompactBinaryToCompactJson(Fields, FieldsBuilder);
+	Log.Append(FUTF8ToTCHAR(FieldsBuilder.GetData(), FieldsBuilder.Len()));
+}
+
+FString MakeLogString(const TArray<FBufferedLine>& Buffer, uint64 ChunkID)
 {
 	TRACE_CPUPROFILER_EVENT_SCOPE(MakeLogString);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaFormat);
+	FCapsaTraceStageScope TraceScope(ChunkID, ECapsaTraceStage::Format, 0, Buffer.Num());
+	const double StartTime = FPlatformTime::Seconds();
 
 	FString Log;
 	for (const FBufferedLine& Line : Buffer)
 	{
-		// Construct the Time from the Seconds when the Line was added
-		FDateTime Time = FDateTime::FromUnixTimestampDecimal(Line.Time);
-		FWideStringBuilderBase TimeStamp;
-		// format: yyyy.mm.dd-hh.mm.ss:mil
-		Log.Append(FString::Printf(TEXT("[%s]"), *Time.ToString(TEXT("%Y.%m.%d-%H.%M.%S.%s"))));
-		Log.Append(FString::Printf(TEXT("[%s]"), *UCapsaCoreFunctionLibrary::GetLogVerbosityString(Line.Verbosity)));
-		Log.Append(FString::Printf(TEXT("[%s]: "), *Line.Category.Resolve().ToString()));
+		AppendLinePrefix(Log, Line.Time, Line.Verbosity, Line.Category.Resolve());
 		Log.Append(Line.Data.Get());
 		Log.Append(LINE_TERMINATOR_ANSI); // Use lf ending on all platforms
 	}
 
+	FCapsaPipelineStats::Get().RecordFormat(FPlatformTime::Seconds() - StartTime, Log.Len() * sizeof(TCHAR));
+	TraceScope.OutputBytes = Log.Len() * sizeof(TCHAR);
+
 	return Log;
 }
 
-bool MakeCompressedLogBinary(const FString& UncompressedLog, TArray<uint8>& BinaryData)
+FString MakeLogString(const FCapsaLogChunk& Chunk, bool bIncludeStructuredFields)
+{
+	return MakeLogString(Chunk, bIncludeStructuredFields, 0, Chunk.Lines.Num());
+}
+
+FString MakeLogString(const FCapsaLogChunk& Chunk, bool bIncludeStructuredFields, int32 BeginLine, int32 EndLine)
+{
+	if (Chunk.StructuredLines.IsEmpty() && BeginLine == 0 && EndLine == Chunk.Lines.Num())
+	{
+		return MakeLogString(Chunk.Lines, Chunk.ChunkID);
+	}
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(MakeLogString);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaFormat);
+	FCapsaTraceStageScope TraceScope(Chunk.ChunkID, ECapsaTraceStage::Format, 0, EndLine - BeginLine);
+	const double StartTime = FPlatformTime::Seconds();
+
+	FString Log;
+	TWideStringBuilder<512> MessageBuilder;
+	Chunk.ForEachLineInRange(BeginLine, EndLine,
+		[&Log](const FBufferedLine& Line)
+		{
+			AppendLinePrefix(Log, Line.Time, Line.Verbosity, Line.Category.Resolve());
+			Log.Append(Line.Data.Get());
+			Log.Append(LINE_TERMINATOR_ANSI); // Use lf ending on all platforms
+		},
+		[&Log, &MessageBuilder, bIncludeStructuredFields](const FCapsaStructuredLine& Line)
+		{
+			AppendStructuredLine(Log, Line, bIncludeStructuredFields, MessageBuilder);
+		});
+
+	FCapsaPipelineStats::Get().RecordFormat(FPlatformTime::Seconds() - StartTime, Log.Len() * sizeof(TCHAR));
+	TraceScope.OutputBytes = Log.Len() * sizeof(TCHAR);
+
+	return Log;
+}
+
+bool MakeCompressedLogBinary(const FString& UncompressedLog, TArray<uint8>& BinaryData, uint64 ChunkID)
 {
 	TRACE_CPUPROFILER_EVENT_SCOPE(MakeCompressedLogBinary);
+	LLM_SCOPE_BYTAG(Capsa);
 
-	TArray<uint8> UncompressedLogBytes;
-	uint64 Utf8Length = FPlatformString::ConvertedLength<UTF8CHAR>(*UncompressedLog, UncompressedLog.Len());
-	UncompressedLogBytes.SetNumUninitialized(Utf8Length);
-	FPlatformString::Convert((UTF8CHAR*)UncompressedLogBytes.GetData(), UncompressedLogBytes.Num(), *UncompressedLog, UncompressedLog.Len());
+	// Single pass conversion with an ASCII fast path, see CapsaUtf8
+	const TArray<uint8> UncompressedLogBytes = CapsaUtf8::Convert(UncompressedLog);
+	const FCapsaLiveBytes ScratchBytes(ECapsaMemoryStage::CompressionScratch, UncompressedLogBytes.GetAllocatedSize());
+	return CompressUtf8Log(UncompressedLogBytes, BinaryData, ChunkID);
+}
 
-	// Reserve memory for compressed data, setting 4/3 in case compressed turns out longer
-	BinaryData.SetNumUninitialized(UncompressedLog.Len() * 4 / 3);
+bool CompressUtf8Log(TConstArrayView<uint8> Utf8Log, TArray<uint8>& BinaryData, uint64 ChunkID)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(CompressUtf8Log);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaCompress);
+	FCapsaTraceStageScope TraceScope(ChunkID, ECapsaTraceStage::Compress, Utf8Log.Num());
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Reserve memory for compressed data. The bound is based on the UTF-8 size, which exceeds the number of characters for non-ASCII text
+	BinaryData.SetNumUninitialized(FCompression::CompressMemoryBound(NAME_Zlib, Utf8Log.Num()));
 	int32 CompressedSize = BinaryData.Num();
-	UE_LOG(LogCapsaCore, VeryVerbose, TEXT("FCapsaAsyncTask::FCapsaAsyncTask | Utf8Length: %llu"), Utf8Length)
+	UE_LOG(LogCapsaCore, VeryVerbose, TEXT("CapsaLogOperations::CompressUtf8Log | Utf8Length: %d"), Utf8Log.Num())
+	const FCapsaLiveBytes ScratchBytes(ECapsaMemoryStage::CompressionScratch, BinaryData.GetAllocatedSize());
 
 	// Compress data
 	const bool bSuccess = FCompression::CompressMemory(
 		NAME_Zlib,
 		BinaryData.GetData(),
 		CompressedSize,
-		UncompressedLogBytes.GetData(),
-		UncompressedLogBytes.Num()
+		Utf8Log.GetData(),
+		Utf8Log.Num()
 		);
 
-	UE_LOG(LogCapsaCore, Verbose, TEXT( "FCapsaAsyncTask::MakeCompressedLogBinary | Success: %d, compressed size: %d" ), bSuccess, CompressedSize);
+	if (bSuccess)
+	{
+		// Trim the reserved slack so callers only see the compressed payload
+		BinaryData.SetNumUninitialized(CompressedSize);
+	}
+
+	FCapsaPipelineStats::Get().RecordCompress(FPlatformTime::Seconds() - StartTime, Utf8Log.Num(), CompressedSize);
+	TraceScope.OutputBytes = CompressedSize;
+
+	UE_LOG(LogCapsaCore, Verbose, TEXT( "CapsaLogOperations::CompressUtf8Log | Success: %d, compressed size: %d" ), bSuccess, CompressedSize);
 
 	return bSuccess;
 }
 
-bool SaveStringToFile(const FString& LogToSave, const FString& FileName, const FString& FileExtension)
+bool EncodeLogSegments(const FCapsaLogChunk& Chunk, const FCapsaLogFormatOptions& FormatOptions, bool bCompress, TArray<FSharedBuffer>& OutLogs,
+	TArray<FSharedBuffer>& OutCompressedLogs)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(EncodeLogSegments);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	// Formats, converts and compresses a segment. The Log is converted to UTF-8 once, and shared by the upload, the files and every other sink
+	auto EncodeSegment = [&Chunk, bCompress](const FString& Log, FSharedBuffer& OutLog, FSharedBuffer& OutCompressedLog)
+	{
+		OutLog = MakeSharedBufferFromArray(CapsaUtf8::Convert(Log));
+		if (!bCompress)
+		{
+			return true;
+		}
+
+		TArray<uint8> CompressedLog;
+		if (!CompressUtf8Log(MakeArrayView(static_cast<const uint8*>(OutLog.GetData()), static_cast<int32>(OutLog.GetSize())), CompressedLog, Chunk.ChunkID))
+		{
+			return false;
+		}
+		OutCompressedLog = MakeSharedBufferFromArray(MoveTemp(CompressedLog));
+		return true;
+	};
+
+	if (FormatOptions.TemplateDictionary.IsValid())
+	{
+		OutLogs.SetNum(1);
+		OutCompressedLogs.SetNum(bCompress ? 1 : 0);
+		FSharedBuffer CompressedLog;
+		const bool bSuccess = EncodeSegment(CapsaTemplateEncoder::MakeLogString(Chunk, *FormatOptions.TemplateDictionary), OutLogs[0], CompressedLog);
+		if (bCompress)
+		{
+			OutCompressedLogs[0] = MoveTemp(CompressedLog);
+		}
+		return bSuccess;
+	}
+
+	// Uncompressed chunks are not split, there is nothing to parallelize but formatting
+	const int32 SegmentLines = bCompress ? FormatOptions.CompressionSegmentLines : 0;
+	const int32 NumSegments = SegmentLines > 0 ? FMath::Max(1, FMath::DivideAndRoundUp(Chunk.Lines.Num(), SegmentLines)) : 1;
+	TArray<FSharedBuffer> CompressedLogs;
+	OutLogs.SetNum(NumSegments);
+	CompressedLogs.SetNum(NumSegments);
+
+	// Every worker takes the next segment until all are done, so uneven segments do not leave workers idle
+	std::atomic<int32> NextSegment{0};
+	std::atomic<bool> bAllCompressed{true};
+	auto ProcessSegments = [&]()
+	{
+		LLM_SCOPE_BYTAG(Capsa);
+		for (int32 Segment = NextSegment++; Segment < NumSegments; Segment = NextSegment++)
+		{
+			const int32 BeginLine = NumSegments > 1 ? Segment * SegmentLines : 0;
+			const int32 EndLine = Segment < NumSegments - 1 ? BeginLine + SegmentLines : Chunk.Lines.Num();
+			if (!EncodeSegment(MakeLogString(Chunk, FormatOptions.bIncludeStructuredFields, BeginLine, EndLine), OutLogs[Segment], CompressedLogs[Segment]))
+			{
+				bAllCompressed = false;
+			}
+		}
+	};
+
+	const int32 MaxWorkers = FormatOptions.MaxCompressionWorkers > 0
+		? FormatOptions.MaxCompressionWorkers
+		: FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	const int32 NumWorkers = FMath::Min(NumSegments, MaxWorkers);
+
+	// The calling thread is one of the workers
+	TArray<UE::Tasks::FTask> Workers;
+	for (int32 Worker = 1; Worker < NumWorkers; ++Worker)
+	{
+		Workers.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, ProcessSegments));
+	}
+	ProcessSegments();
+	UE::Tasks::Wait(Workers);
+
+	if (bCompress)
+	{
+		OutCompressedLogs = MoveTemp(CompressedLogs);
+	}
+	else
+	{
+		OutCompressedLogs.Reset();
+	}
+
+	UE_LOG(LogCapsaCore, Verbose, TEXT("CapsaLogOperations::EncodeLogSegments | Segments: %d, workers: %d, compressed: %d"), NumSegments, NumWorkers,
+		bCompress);
+
+	return bAllCompressed;
+}
+
+bool SaveStringToFile(const FString& LogToSave, const FString& FileName, const FString& FileExtension, uint64 ChunkID)
 {
 	TRACE_CPUPROFILER_EVENT_SCOPE(SaveStringToFile);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaDiskWrite);
+	FCapsaTraceStageScope TraceScope(ChunkID, ECapsaTraceStage::DiskWrite, LogToSave.Len() * sizeof(TCHAR));
+	const double StartTime = FPlatformTime::Seconds();
 
 	FString FilePath = FPaths::ProjectLogDir() + FileName + FileExtension;
 
 	UE_LOG(LogCapsaCore, Verbose, TEXT( "FCapsaAsyncTask::SaveStringToFile | Attempting to write/append to: %s" ), *FilePath);
 
-	return FFileHelper::SaveStringToFile(LogToSave, *FilePath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(),
+	const bool bSuccess = FFileHelper::SaveStringToFile(LogToSave, *FilePath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(),
 		EFileWrite::FILEWRITE_Append);
+
+	FCapsaPipelineStats::Get().RecordDiskWrite(FPlatformTime::Seconds() - StartTime);
+
+	return bSuccess;
 }
 
-bool SaveBinaryToFile(TArray<uint8> BinaryData, const FString& FileName, const FString& FileExtension)
+bool AppendUtf8ToFile(TConstArrayView<uint8> Utf8Log, const FString& FileName, const FString& FileExtension, uint64 ChunkID)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(AppendUtf8ToFile);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaDiskWrite);
+	FCapsaTraceStageScope TraceScope(ChunkID, ECapsaTraceStage::DiskWrite, Utf8Log.Num());
+	const double StartTime = FPlatformTime::Seconds();
+
+	FString FilePath = FPaths::ProjectLogDir() + FileName + FileExtension;
+
+	UE_LOG(LogCapsaCore, Verbose, TEXT( "CapsaLogOperations::AppendUtf8ToFile | Attempting to append to: %s" ), *FilePath);
+
+	const bool bSuccess = FFileHelper::SaveArrayToFile(Utf8Log, *FilePath, &IFileManager::Get(), EFileWrite::FILEWRITE_Append);
+
+	FCapsaPipelineStats::Get().RecordDiskWrite(FPlatformTime::Seconds() - StartTime);
+
+	return bSuccess;
+}
+
+bool SaveBinaryToFile(TConstArrayView<uint8> BinaryData, const FString& FileName, const FString& FileExtension, uint64 ChunkID)
 {
 	TRACE_CPUPROFILER_EVENT_SCOPE(SaveBinaryToFile);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaDiskWrite);
+	FCapsaTraceStageScope TraceScope(ChunkID, ECapsaTraceStage::DiskWrite, BinaryData.Num());
+	const double StartTime = FPlatformTime::Seconds();
 
 	FString CapsaCompressedDirectory = TEXT("CapsaCompressedChunks/") + FileName + TEXT("/");
 	FString FilePath = FPaths::ProjectLogDir() + CapsaCompressedDirectory + FDateTime::Now().ToString(TEXT("%Y-%m-%dT%H.%M.%S.%s")) + FileExtension;
 
 	UE_LOG(LogCapsaCore, Verbose, TEXT( "FCapsaAsyncTask::SaveBinaryToFile | Attempting to write to: %s" ), *FilePath);
 
-	return FFileHelper::SaveArrayToFile(BinaryData, *FilePath, &IFileManager::Get(), EFileWrite::FILEWRITE_Append);
+	const bool bSuccess = FFileHelper::SaveArrayToFile(BinaryData, *FilePath, &IFileManager::Get(), EFileWrite::FILEWRITE_Append);
+
+	FCapsaPipelineStats::Get().RecordDiskWrite(FPlatformTime::Seconds() - StartTime);
+
+	return bSuccess;
 }
 }
@@ -0,0 +1,22 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaLogSink.h"
+
+TConstArrayView<FSharedBuffer> FCapsaEncodedChunk::GetReadableSegments() const
+{
+	if (Readable)
+	{
+		return MakeArrayView(&Readable, 1);
+	}
+	return Segments;
+}
+
+int32 FCapsaEncodedChunk::GetNumSegments() const
+{
+	return CompressedSegments.IsEmpty() ? Segments.Num() : CompressedSegments.Num();
+}
+
+int32 FCapsaEncodedChunk::GetSegmentNumLines(int32 Segment) const
+{
+	return SegmentNumLines.IsValidIndex(Segment) ? SegmentNumLines[Segment] : 0;
+}
@@ -0,0 +1,239 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaLogSinks.h"
+
+#include "CapsaCore.h"
+#include "CapsaCoreSubsystem.h"
+#include "CapsaHostAgent.h"
+#include "CapsaJsonLines.h"
+#include "CapsaLogOperations.h"
+#include "Settings/CapsaSettings.h"
+
+#if PLATFORM_UNIX
+#include <errno.h>
+#include <unistd.h>
+#else
+#include <stdio.h>
+#endif
+
+namespace
+{
+TConstArrayView<uint8> MakeBufferView(const FSharedBuffer& Buffer)
+{
+	return MakeArrayView(static_cast<const uint8*>(Buffer.GetData()), static_cast<int32>(Buffer.GetSize()));
+}
+}
+
+FCapsaHttpSink::FCapsaHttpSink(UCapsaCoreSubsystem* InSubsystem, bool bInCompressed) :
+	Subsystem(InSubsystem),
+	bCompressed(bInCompressed)
+{
+}
+
+const TCHAR* FCapsaHttpSink::GetName() const
+{
+	return TEXT("Http");
+}
+
+ECapsaSinkInputs FCapsaHttpSink::GetInputs() const
+{
+	return bCompressed ? ECapsaSinkInputs::Compressed : ECapsaSinkInputs::Log;
+}
+
+bool FCapsaHttpSink::IsGameThreadSink() const
+{
+	return true;
+}
+
+void FCapsaHttpSink::Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking)
+{
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = Subsystem.Get();
+	if (CapsaCoreSubsystem == nullptr)
+	{
+		return;
+	}
+
+	const int32 NumSegments = bCompressed ? Chunk.CompressedSegments.Num() : Chunk.Segments.Num();
+	for (int32 Segment = 0; Segment < NumSegments; ++Segment)
+	{
+		CapsaCoreSubsystem->UploadLogSegment(Chunk, Segment, bCompressed, bBlocking);
+	}
+}
+
+FCapsaFileSink::FCapsaFileSink(bool bInWritePlain, bool bInWriteCompressed) :
+	bWritePlain(bInWritePlain),
+	bWriteCompressed(bInWriteCompressed)
+{
+}
+
+const TCHAR* FCapsaFileSink::GetName() const
+{
+	return TEXT("File");
+}
+
+ECapsaSinkInputs FCapsaFileSink::GetInputs() const
+{
+	ECapsaSinkInputs Inputs = ECapsaSinkInputs::None;
+	if (bWritePlain)
+	{
+		Inputs |= ECapsaSinkInputs::Readable;
+	}
+	if (bWriteCompressed)
+	{
+		Inputs |= ECapsaSinkInputs::Compressed;
+	}
+	return Inputs;
+}
+
+void FCapsaFileSink::Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaFileSink::Consume);
+
+	if (bWritePlain)
+	{
+		// Appending the segments in order gives the same file as a single Log
+		for (const FSharedBuffer& Log : Chunk.GetReadableSegments())
+		{
+			if (!CapsaLogOperations::AppendUtf8ToFile(MakeBufferView(Log), Chunk.LogID, CapsaLogOperations::DefaultUncompressedLogExtension, Chunk.ChunkID))
+			{
+				UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaFileSink::Consume | Failed to write plain text file to disk"));
+			}
+		}
+	}
+
+	if (bWriteCompressed)
+	{
+		for (int32 Segment = 0; Segment < Chunk.CompressedSegments.Num(); ++Segment)
+		{
+			const FString Extension = Chunk.CompressedSegments.Num() > 1
+				? FString::Printf(TEXT(".%d%s"), Segment, *CapsaLogOperations::DefaultCompressedLogExtension)
+				: CapsaLogOperations::DefaultCompressedLogExtension;
+			if (!CapsaLogOperations::SaveBinaryToFile(MakeBufferView(Chunk.CompressedSegments[Segment]), Chunk.LogID, Extension, Chunk.ChunkID))
+			{
+				UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaFileSink::Consume | Failed to write compressed file to disk"));
+			}
+		}
+	}
+}
+
+FCapsaStdoutSink::FCapsaStdoutSink(bool bInIncludeStructuredFields) :
+	bIncludeStructuredFields(bInIncludeStructuredFields)
+{
+}
+
+const TCHAR* FCapsaStdoutSink::GetName() const
+{
+	return TEXT("Stdout");
+}
+
+ECapsaSinkInputs FCapsaStdoutSink::GetInputs() const
+{
+	return ECapsaSinkInputs::Lines;
+}
+
+void FCapsaStdoutSink::Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaStdoutSink::Consume);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	if (!Chunk.Lines.IsValid())
+	{
+		return;
+	}
+
+	Scratch.Reset();
+	CapsaJsonLines::AppendChunk(Scratch, *Chunk.Lines, bIncludeStructuredFields, Chunk.LogID);
+	if (!Write(Scratch))
+	{
+		UE_LOG(LogCapsaCore, Verbose, TEXT("FCapsaStdoutSink::Consume | Failed to write %d bytes to stdout"), Scratch.Num());
+	}
+
+	if (Scratch.Max() > 1024 * 1024)
+	{
+		// Large chunks, fe. at shutdown, should not keep their buffer alive
+		Scratch.Empty();
+	}
+}
+
+bool FCapsaStdoutSink::Write(TConstArrayView<uint8> Data)
+{
+#if PLATFORM_UNIX
+	// Straight to the file descriptor, so the chunk is not split by the stdio buffer
+	const uint8* Remaining = Data.GetData();
+	int64 NumRemaining = Data.Num();
+	while (NumRemaining > 0)
+	{
+		const ssize_t Written = write(STDOUT_FILENO, Remaining, NumRemaining);
+		if (Written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (Written <= 0)
+		{
+			return false;
+		}
+		Remaining += Written;
+		NumRemaining -= Written;
+	}
+	return true;
+#else
+	const bool bWritten = fwrite(Data.GetData(), 1, Data.Num(), stdout) == static_cast<size_t>(Data.Num());
+	return fflush(stdout) == 0 && bWritten;
+#endif
+}
+
+FCapsaHostAgentSink::FCapsaHostAgentSink(TSharedRef<FCapsaHostAgentClient, ESPMode::ThreadSafe> InClient, UCapsaCoreSubsystem* InSubsystem) :
+	Client(MoveTemp(InClient)),
+	Subsystem(InSubsystem)
+{
+}
+
+const TCHAR* FCapsaHostAgentSink::GetName() const
+{
+	return TEXT("HostAgent");
+}
+
+ECapsaSinkInputs FCapsaHostAgentSink::GetInputs() const
+{
+	return ECapsaSinkInputs::Log;
+}
+
+bool FCapsaHostAgentSink::IsGameThreadSink() const
+{
+	return true;
+}
+
+void FCapsaHostAgentSink::Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking)
+{
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = Subsystem.Get();
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaCoreSubsystem != nullptr && CapsaSettings != nullptr && CapsaSettings->GetUseWorldStreams())
+	{
+		// The log streams share the connection, the agent uploads chunks to the session sent before them. Only sent when the stream changes
+		if (const FCapsaSession* Session = CapsaCoreSubsystem->FindSession(Chunk.Stream))
+		{
+			Client->SetSession(Session->LogID, Session->Token, CapsaSettings->GetServerEndpointClientLogChunk());
+		}
+	}
+
+	for (int32 Segment = 0; Segment < Chunk.Segments.Num(); ++Segment)
+	{
+		// Segments the agent does not take are uploaded with a sequence of their own, leaving a gap, which the server does not wait for
+		const uint64 ChunkSequence = CapsaCoreSubsystem != nullptr ? CapsaCoreSubsystem->AllocateChunkSequence(Chunk.Stream) : 0;
+		if (Client->SendChunk(Chunk, Segment, ChunkSequence, bBlocking))
+		{
+			continue;
+		}
+
+		if (CapsaCoreSubsystem != nullptr)
+		{
+			CapsaCoreSubsystem->UploadLogSegment(Chunk, Segment, false, bBlocking);
+		}
+	}
+
+	if (CapsaCoreSubsystem != nullptr)
+	{
+		// Writing may have found the connection closed, with earlier chunks the agent did not receive whole
+		CapsaCoreSubsystem->UploadUnsentHostAgentChunks(bBlocking);
+	}
+}
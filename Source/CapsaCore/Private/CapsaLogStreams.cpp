@@ -0,0 +1,156 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaLogStreams.h"
+
+#include "Engine/World.h"
+#include "Runtime/Launch/Resources/Version.h"
+#include "UObject/Package.h"
+
+namespace
+{
+/// The names of the streams, indexed by stream.
+struct FStreamRegistry
+{
+	FStreamRegistry()
+	{
+		Names.Add(FString());
+	}
+
+	FRWLock Lock;
+	TArray<FString> Names;
+	TMap<FString, uint16> Streams;
+};
+
+FStreamRegistry& GetRegistry()
+{
+	static FStreamRegistry Registry;
+	return Registry;
+}
+
+/// The stream set by the innermost FCapsaLogStreamScope of the thread, INDEX_NONE if none.
+thread_local int32 ScopedStream = INDEX_NONE;
+
+#if WITH_EDITOR
+/// The stream of the Play In Editor instance the game thread is ticking, if any. Game thread only.
+uint16 GetPlayInEditorStream()
+{
+#if ENGINE_MAJOR_VERSION <= 5 && ENGINE_MINOR_VERSION < 5
+	const int32 PlayInEditorID = GPlayInEditorID;
+#else
+	const int32 PlayInEditorID = UE::GetPlayInEditorID();
+#endif
+	if (PlayInEditorID < 0)
+	{
+		return CapsaLogStreams::DefaultStream;
+	}
+
+	// Every line logged during PIE gets here, only look the name up once per instance
+	static TArray<uint16> InstanceStreams;
+	if (!InstanceStreams.IsValidIndex(PlayInEditorID))
+	{
+		InstanceStreams.SetNumZeroed(PlayInEditorID + 1);
+	}
+	if (InstanceStreams[PlayInEditorID] == CapsaLogStreams::DefaultStream)
+	{
+		InstanceStreams[PlayInEditorID] = CapsaLogStreams::FindOrAdd(FString::Printf(TEXT("PIE-%d"), PlayInEditorID));
+	}
+	return InstanceStreams[PlayInEditorID];
+}
+#endif
+}
+
+namespace CapsaLogStreams
+{
+uint16 FindOrAdd(const FString& Name)
+{
+	if (Name.IsEmpty())
+	{
+		return DefaultStream;
+	}
+
+	FStreamRegistry& Registry = GetRegistry();
+	{
+		FReadScopeLock ReadLock(Registry.Lock);
+		if (const uint16* Stream = Registry.Streams.Find(Name))
+		{
+			return *Stream;
+		}
+	}
+
+	FWriteScopeLock WriteLock(Registry.Lock);
+	if (const uint16* Stream = Registry.Streams.Find(Name))
+	{
+		return *Stream;
+	}
+	if (Registry.Names.Num() >= MaxStreams)
+	{
+		return DefaultStream;
+	}
+
+	const uint16 Stream = static_cast<uint16>(Registry.Names.Add(Name));
+	Registry.Streams.Add(Name, Stream);
+	return Stream;
+}
+
+FString GetName(uint16 Stream)
+{
+	FStreamRegistry& Registry = GetRegistry();
+	FReadScopeLock ReadLock(Registry.Lock);
+	return Registry.Names.IsValidIndex(Stream) ? Registry.Names[Stream] : FString();
+}
+
+uint16 GetCurrent()
+{
+	if (ScopedStream != INDEX_NONE)
+	{
+		return static_cast<uint16>(ScopedStream);
+	}
+
+#if WITH_EDITOR
+	// The PIE instance is only set while the game thread ticks its world, lines of other threads go to the default stream
+	if (GIsEditor && IsInGameThread())
+	{
+		return GetPlayInEditorStream();
+	}
+#endif
+
+	return DefaultStream;
+}
+
+int32 SetScopedStream(int32 Stream)
+{
+	const int32 PreviousStream = ScopedStream;
+	ScopedStream = Stream;
+	return PreviousStream;
+}
+
+FString GetWorldStreamName(const UWorld* World)
+{
+	if (World == nullptr)
+	{
+		return FString();
+	}
+
+	if (World->WorldType == EWorldType::PIE)
+	{
+		return FString::Printf(TEXT("PIE-%d"), World->GetOutermost()->GetPIEInstanceID());
+	}
+
+	return World->GetOutermost()->GetName();
+}
+}
+
+FCapsaLogStreamScope::FCapsaLogStreamScope(const FString& StreamName) :
+	PreviousStream(CapsaLogStreams::SetScopedStream(CapsaLogStreams::FindOrAdd(StreamName)))
+{
+}
+
+FCapsaLogStreamScope::FCapsaLogStreamScope(const UWorld* World) :
+	FCapsaLogStreamScope(CapsaLogStreams::GetWorldStreamName(World))
+{
+}
+
+FCapsaLogStreamScope::~FCapsaLogStreamScope()
+{
+	CapsaLogStreams::SetScopedStream(PreviousStream);
+}
@@ -0,0 +1,520 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaRedactor.h"
+
+#include "CapsaCore.h"
+#include "CapsaCoreStats.h"
+#include "CapsaLogChunk.h"
+#include "CapsaLogOperations.h"
+
+#if PLATFORM_CPU_X86_FAMILY
+#include <emmintrin.h>
+#define CAPSA_REDACT_SSE2 1
+#elif PLATFORM_CPU_ARM_FAMILY && PLATFORM_64BITS
+#include <arm_neon.h>
+#define CAPSA_REDACT_NEON 1
+#endif
+
+namespace
+{
+/// Code units compared per iteration of the vectorized prefilter.
+constexpr int32 BlockSize = 8;
+
+/// The number of distinct first characters the vectorized prefilter compares, more fall back to the DFA start state.
+constexpr int32 MaxPrefilterChars = 8;
+
+FORCEINLINE bool IsAsciiAlnum(TCHAR Char)
+{
+	return (Char >= TEXT('a') && Char <= TEXT('z')) || (Char >= TEXT('A') && Char <= TEXT('Z')) || (Char >= TEXT('0') && Char <= TEXT('9'));
+}
+
+FORCEINLINE bool IsAsciiDigit(TCHAR Char)
+{
+	return Char >= TEXT('0') && Char <= TEXT('9');
+}
+
+FORCEINLINE bool IsEmailLocalChar(TCHAR Char)
+{
+	return IsAsciiAlnum(Char) || Char == TEXT('.') || Char == TEXT('_') || Char == TEXT('%') || Char == TEXT('+') || Char == TEXT('-');
+}
+
+FORCEINLINE bool IsDomainChar(TCHAR Char)
+{
+	return IsAsciiAlnum(Char) || Char == TEXT('.') || Char == TEXT('-');
+}
+
+FORCEINLINE bool IsTokenChar(TCHAR Char)
+{
+	switch (Char)
+	{
+	case TEXT(' '):
+	case TEXT('\t'):
+	case TEXT('\r'):
+	case TEXT('\n'):
+	case TEXT('"'):
+	case TEXT('\''):
+	case TEXT(','):
+	case TEXT(';'):
+	case TEXT('&'):
+	case TEXT('('):
+	case TEXT(')'):
+	case TEXT('['):
+	case TEXT(']'):
+	case TEXT('{'):
+	case TEXT('}'):
+	case TEXT('<'):
+	case TEXT('>'):
+		return false;
+	default:
+		return true;
+	}
+}
+
+/// Whether [Begin, End) is a dotted quad of decimal octets, without leading zeros.
+bool IsIPv4Address(const TCHAR* Text, int32 Begin, int32 End)
+{
+	int32 NumOctets = 0;
+	int32 Index = Begin;
+	while (Index < End)
+	{
+		const int32 OctetBegin = Index;
+		int32 Value = 0;
+		for (; Index < End && IsAsciiDigit(Text[Index]); ++Index)
+		{
+			Value = Value * 10 + (Text[Index] - TEXT('0'));
+		}
+
+		const int32 OctetLen = Index - OctetBegin;
+		if (OctetLen == 0 || OctetLen > 3 || Value > 255 || (OctetLen > 1 && Text[OctetBegin] == TEXT('0')) || ++NumOctets > 4)
+		{
+			return false;
+		}
+
+		if (Index < End)
+		{
+			// Skip the dot, a trailing one leaves an empty octet
+			if (++Index == End)
+			{
+				return false;
+			}
+		}
+	}
+	return NumOctets == 4;
+}
+}
+
+FCapsaRedactor::FCapsaRedactor(const TArray<FString>& InPatterns, bool bRedactEmailAddresses, bool bRedactIPAddresses)
+{
+	TArray<TMap<uint16, int32>> Trie;
+	Trie.AddDefaulted();
+
+	for (const FString& Pattern : InPatterns)
+	{
+		FStringView Text(Pattern);
+		const bool bToken = !Text.IsEmpty() && Text[Text.Len() - 1] == TEXT('*');
+		if (bToken)
+		{
+			Text.RemoveSuffix(1);
+		}
+
+		if (Text.Len() < MinPatternLen)
+		{
+			UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaRedactor::FCapsaRedactor | Ignoring pattern '%s', shorter than %d characters"), *Pattern, MinPatternLen);
+			continue;
+		}
+
+		// Tokens after a separator, fe. "token=", keep the separator and key readable
+		const bool bRedactText = !bToken || IsAsciiAlnum(Text[Text.Len() - 1]);
+		AddPattern(Text, bToken ? EPatternKind::Token : EPatternKind::Literal, bRedactText, Trie);
+	}
+
+	if (bRedactEmailAddresses)
+	{
+		AddPattern(TEXTVIEW("@"), EPatternKind::Email, true, Trie);
+	}
+	if (bRedactIPAddresses)
+	{
+		AddPattern(TEXTVIEW("."), EPatternKind::IPv4, true, Trie);
+	}
+
+	// Resolve the trie into a DFA breadth first, so the failure state of every state is resolved before the state itself
+	const int32 NumStates = Trie.Num();
+	Transitions.SetNumZeroed(NumStates * NumClasses);
+	Failures.SetNumZeroed(NumStates);
+	OutputLinks.SetNumUninitialized(NumStates);
+	OutputLinks[0] = INDEX_NONE;
+
+	TArray<int32> Queue;
+	Queue.Reserve(NumStates);
+	for (const TPair<uint16, int32>& Child : Trie[0])
+	{
+		Transitions[Child.Key] = Child.Value;
+		Queue.Add(Child.Value);
+	}
+
+	for (int32 QueueIndex = 0; QueueIndex < Queue.Num(); ++QueueIndex)
+	{
+		const int32 State = Queue[QueueIndex];
+		const int32 Failure = Failures[State];
+		OutputLinks[State] = Outputs[State] != INDEX_NONE ? State : OutputLinks[Failure];
+
+		for (int32 Class = 0; Class < NumClasses; ++Class)
+		{
+			if (const int32* Child = Trie[State].Find(static_cast<uint16>(Class)))
+			{
+				Failures[*Child] = Transitions[Failure * NumClasses + Class];
+				Transitions[State * NumClasses + Class] = *Child;
+				Queue.Add(*Child);
+			}
+			else
+			{
+				Transitions[State * NumClasses + Class] = Transitions[Failure * NumClasses + Class];
+			}
+		}
+	}
+
+#if CAPSA_REDACT_SSE2 || CAPSA_REDACT_NEON
+	bVectorPrefilter = sizeof(TCHAR) == sizeof(uint16) && FirstChars.Num() <= MaxPrefilterChars;
+#endif
+}
+
+bool FCapsaRedactor::IsEmpty() const
+{
+	return Patterns.IsEmpty();
+}
+
+void FCapsaRedactor::AddPattern(FStringView Text, EPatternKind Kind, bool bRedactText, TArray<TMap<uint16, int32>>& Trie)
+{
+	int32 State = 0;
+	for (const TCHAR Char : Text)
+	{
+		uint16 Class = GetClass(Char);
+		if (Class == 0)
+		{
+			Class = static_cast<uint16>(NumClasses++);
+			if (static_cast<uint32>(Char) < 128)
+			{
+				AsciiClasses[Char] = Class;
+			}
+			else
+			{
+				OtherClasses.Add(Char, Class);
+			}
+		}
+
+		if (State == 0)
+		{
+			FirstChars.AddUnique(Char);
+		}
+
+		if (const int32* Next = Trie[State].Find(Class))
+		{
+			State = *Next;
+		}
+		else
+		{
+			const int32 NewState = Trie.Num();
+			Trie[State].Add(Class, NewState);
+			Trie.AddDefaulted();
+			State = NewState;
+		}
+	}
+
+	while (Outputs.Num() < Trie.Num())
+	{
+		Outputs.Add(INDEX_NONE);
+	}
+
+	if (Outputs[State] == INDEX_NONE)
+	{
+		Outputs[State] = Patterns.Add(FPattern{Kind, Text.Len(), bRedactText});
+	}
+}
+
+int32 FCapsaRedactor::FindCandidate(const TCHAR* Text, int32 Len, int32 Index) const
+{
+	if (bVectorPrefilter)
+	{
+		const uint16* Source = reinterpret_cast<const uint16*>(Text);
+#if CAPSA_REDACT_SSE2
+		__m128i Needles[MaxPrefilterChars];
+		for (int32 CharIndex = 0; CharIndex < FirstChars.Num(); ++CharIndex)
+		{
+			Needles[CharIndex] = _mm_set1_epi16(static_cast<int16>(FirstChars[CharIndex]));
+		}
+
+		for (; Index + BlockSize <= Len; Index += BlockSize)
+		{
+			const __m128i Block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + Index));
+			__m128i Hits = _mm_setzero_si128();
+			for (int32 CharIndex = 0; CharIndex < FirstChars.Num(); ++CharIndex)
+			{
+				Hits = _mm_or_si128(Hits, _mm_cmpeq_epi16(Block, Needles[CharIndex]));
+			}
+
+			if (const uint32 Mask = static_cast<uint32>(_mm_movemask_epi8(Hits)))
+			{
+				// Two mask bits per code unit
+				return Index + static_cast<int32>(FMath::CountTrailingZeros(Mask)) / 2;
+			}
+		}
+#elif CAPSA_REDACT_NEON
+		uint16x8_t Needles[MaxPrefilterChars];
+		for (int32 CharIndex = 0; CharIndex < FirstChars.Num(); ++CharIndex)
+		{
+			Needles[CharIndex] = vdupq_n_u16(static_cast<uint16>(FirstChars[CharIndex]));
+		}
+
+		for (; Index + BlockSize <= Len; Index += BlockSize)
+		{
+			const uint16x8_t Block = vld1q_u16(Source + Index);
+			uint16x8_t Hits = vdupq_n_u16(0);
+			for (int32 CharIndex = 0; CharIndex < FirstChars.Num(); ++CharIndex)
+			{
+				Hits = vorrq_u16(Hits, vceqq_u16(Block, Needles[CharIndex]));
+			}
+
+			if (vmaxvq_u16(Hits) != 0)
+			{
+				// The scalar loop below finds the position within the block
+				break;
+			}
+		}
+#endif
+	}
+
+	// Characters that leave the start state start a pattern
+	for (; Index < Len; ++Index)
+	{
+		if (Transitions[GetClass(Text[Index])] != 0)
+		{
+			return Index;
+		}
+	}
+	return Len;
+}
+
+void FCapsaRedactor::AddMatch(const TCHAR* Text, int32 Len, int32 EndIndex, const FPattern& Pattern,
+	TArray<TPair<int32, int32>, TInlineAllocator<16>>& Spans) const
+{
+	if (Pattern.Kind != EPatternKind::Literal && !Spans.IsEmpty() && EndIndex >= Spans.Last().Key && EndIndex < Spans.Last().Value)
+	{
+		// Already part of the last match, fe. the other dots of an IPv4 address
+		return;
+	}
+
+	const int32 TextBegin = EndIndex - Pattern.Len + 1;
+	switch (Pattern.Kind)
+	{
+	case EPatternKind::Literal:
+		Spans.Emplace(TextBegin, EndIndex + 1);
+		break;
+
+	case EPatternKind::Token:
+	{
+		if (Pattern.bRedactText && TextBegin > 0 && IsAsciiAlnum(Text[TextBegin - 1]))
+		{
+			// Must start a token, fe. not match in the middle of a longer number
+			return;
+		}
+
+		int32 End = EndIndex + 1;
+		for (; End < Len && IsTokenChar(Text[End]); ++End)
+		{
+		}
+
+		const int32 Begin = Pattern.bRedactText ? TextBegin : EndIndex + 1;
+		if (End > Begin)
+		{
+			Spans.Emplace(Begin, End);
+		}
+		break;
+	}
+
+	case EPatternKind::Email:
+	{
+		int32 Begin = EndIndex;
+		for (; Begin > 0 && IsEmailLocalChar(Text[Begin - 1]); --Begin)
+		{
+		}
+
+		int32 End = EndIndex + 1;
+		for (; End < Len && IsDomainChar(Text[End]); ++End)
+		{
+		}
+		// A dot ending a sentence is not part of the domain
+		for (; End > EndIndex + 1 && Text[End - 1] == TEXT('.'); --End)
+		{
+		}
+
+		int32 LastDot = End - 1;
+		for (; LastDot > EndIndex && Text[LastDot] != TEXT('.'); --LastDot)
+		{
+		}
+
+		if (Begin < EndIndex && LastDot > EndIndex + 1 && LastDot < End - 1)
+		{
+			Spans.Emplace(Begin, End);
+		}
+		break;
+	}
+
+	case EPatternKind::IPv4:
+	{
+		if (EndIndex == 0 || !IsAsciiDigit(Text[EndIndex - 1]))
+		{
+			return;
+		}
+
+		int32 Begin = EndIndex;
+		for (; Begin > 0 && (IsAsciiDigit(Text[Begin - 1]) || Text[Begin - 1] == TEXT('.')); --Begin)
+		{
+		}
+
+		int32 End = EndIndex + 1;
+		for (; End < Len && (IsAsciiDigit(Text[End]) || Text[End] == TEXT('.')); ++End)
+		{
+		}
+		for (; End > EndIndex + 1 && Text[End - 1] == TEXT('.'); --End)
+		{
+		}
+
+		// Reject versions and identifiers, fe. "v1.2.3.4"
+		const bool bBounded = (Begin == 0 || !IsAsciiAlnum(Text[Begin - 1])) && (End == Len || !IsAsciiAlnum(Text[End]));
+		if (bBounded && IsIPv4Address(Text, Begin, End))
+		{
+			Spans.Emplace(Begin, End);
+		}
+		break;
+	}
+	}
+}
+
+int32 FCapsaRedactor::Redact(TCHAR* Text, int32& Len) const
+{
+	if (Patterns.IsEmpty())
+	{
+		return 0;
+	}
+
+	TArray<TPair<int32, int32>, TInlineAllocator<16>> Spans;
+	int32 State = 0;
+	for (int32 Index = 0; Index < Len; ++Index)
+	{
+		if (State == 0)
+		{
+			Index = FindCandidate(Text, Len, Index);
+			if (Index == Len)
+			{
+				break;
+			}
+		}
+
+		State = Transitions[State * NumClasses + GetClass(Text[Index])];
+		for (int32 MatchState = OutputLinks[State]; MatchState != INDEX_NONE; MatchState = OutputLinks[Failures[MatchState]])
+		{
+			AddMatch(Text, Len, Index, Patterns[Outputs[MatchState]], Spans);
+		}
+	}
+
+	if (Spans.IsEmpty())
+	{
+		return 0;
+	}
+
+	// Email addresses extend backwards, before earlier matches
+	Spans.Sort([](const TPair<int32, int32>& A, const TPair<int32, int32>& B)
+	{
+		return A.Key < B.Key;
+	});
+
+	const int32 MarkerLen = FCString::Strlen(Marker);
+	int32 NumMatches = 0;
+	int32 Read = 0;
+	int32 Write = 0;
+	for (int32 SpanIndex = 0; SpanIndex < Spans.Num(); ++NumMatches)
+	{
+		const int32 Begin = Spans[SpanIndex].Key;
+		int32 End = Spans[SpanIndex].Value;
+		for (++SpanIndex; SpanIndex < Spans.Num() && Spans[SpanIndex].Key <= End; ++SpanIndex)
+		{
+			End = FMath::Max(End, Spans[SpanIndex].Value);
+		}
+
+		if (Read < Begin && Write != Read)
+		{
+			FMemory::Memmove(Text + Write, Text + Read, (Begin - Read) * sizeof(TCHAR));
+		}
+		Write += Begin - Read;
+
+		const int32 ReplacementLen = FMath::Min(MarkerLen, End - Begin);
+		for (int32 MarkerIndex = 0; MarkerIndex < ReplacementLen; ++MarkerIndex)
+		{
+			Text[Write++] = Marker[MarkerIndex];
+		}
+		Read = End;
+	}
+
+	if (Write != Read)
+	{
+		FMemory::Memmove(Text + Write, Text + Read, (Len - Read) * sizeof(TCHAR));
+	}
+	Len = Write + Len - Read;
+	Text[Len] = TEXT('\0');
+
+	return NumMatches;
+}
+
+int32 FCapsaRedactor::Redact(FString& Text) const
+{
+	int32 Len = Text.Len();
+	if (Len == 0)
+	{
+		return 0;
+	}
+
+	const int32 NumMatches = Redact(Text.GetCharArray().GetData(), Len);
+	if (Len != Text.Len())
+	{
+		Text.LeftInline(Len);
+	}
+	return NumMatches;
+}
+
+int32 FCapsaRedactor::RedactChunk(FCapsaLogChunk& Chunk, bool bIncludeStructuredFields) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaRedactor::RedactChunk);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaRedact);
+	const double StartTime = FPlatformTime::Seconds();
+
+	int32 NumMatches = 0;
+	int64 InputBytes = 0;
+	for (FBufferedLine& Line : Chunk.Lines)
+	{
+		// Data is owned by the chunk, the line length only ever shrinks
+		int32 Len = FCString::Strlen(Line.Data.Get());
+		InputBytes += Len * sizeof(TCHAR);
+		NumMatches += Redact(Line.Data.Get(), Len);
+	}
+
+	TWideStringBuilder<512> MessageBuilder;
+	for (FCapsaStructuredLine& Line : Chunk.StructuredLines)
+	{
+		MessageBuilder.Reset();
+		Line.Record.FormatMessageTo(MessageBuilder);
+		Line.RedactedText = MessageBuilder.ToString();
+		if (bIncludeStructuredFields && Line.Record.GetFields().CreateViewIterator())
+		{
+			Line.RedactedText.AppendChar(TEXT(' '));
+			CapsaLogOperations::AppendStructuredFields(Line.RedactedText, Line.Record.GetFields());
+		}
+
+		InputBytes += Line.RedactedText.Len() * sizeof(TCHAR);
+		NumMatches += Redact(Line.RedactedText);
+	}
+
+	FCapsaPipelineStats::Get().RecordRedact(FPlatformTime::Seconds() - StartTime, InputBytes, NumMatches);
+
+	return NumMatches;
+}
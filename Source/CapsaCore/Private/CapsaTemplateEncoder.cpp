@@ -0,0 +1,351 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaTemplateEncoder.h"
+
+#include "CapsaCoreStats.h"
+#include "CapsaCoreTrace.h"
+#include "CapsaLogChunk.h"
+#include "CapsaLogOperations.h"
+
+#include "String/Find.h"
+
+uint32 FCapsaTemplateDictionary::ResolveTemplates(uint64 ChunkID, const TArray<FString>& Templates, TArray<uint32>& OutIDs, TBitArray<>& OutIsNew)
+{
+	OutIDs.SetNumUninitialized(Templates.Num());
+	OutIsNew.Init(false, Templates.Num());
+
+	FScopeLock ScopeLock(&Lock);
+	TArray<uint32>* Definitions = nullptr;
+	for (int32 Index = 0; Index < Templates.Num(); ++Index)
+	{
+		if (const uint32* ExistingID = TemplateIDs.Find(Templates[Index]))
+		{
+			OutIDs[Index] = *ExistingID;
+		}
+		else if (TemplateIDs.Num() < MaxTemplates)
+		{
+			OutIDs[Index] = TemplateIDs.Add(Templates[Index], NextID++);
+			Delivered.Add(false);
+		}
+		else
+		{
+			OutIDs[Index] = InvalidID;
+			continue;
+		}
+
+		if (!Delivered[OutIDs[Index]])
+		{
+			// Defined by every chunk until one of them is uploaded, the chunks defining it before may still fail
+			OutIsNew[Index] = true;
+			if (Definitions == nullptr)
+			{
+				Definitions = &ChunkDefinitions.FindOrAdd(ChunkID);
+			}
+			Definitions->Add(OutIDs[Index]);
+		}
+	}
+
+	return Generation;
+}
+
+void FCapsaTemplateDictionary::MarkDelivered(uint64 ChunkID)
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<uint32> Definitions;
+	if (ChunkDefinitions.RemoveAndCopyValue(ChunkID, Definitions))
+	{
+		for (const uint32 ID : Definitions)
+		{
+			Delivered[ID] = true;
+		}
+	}
+}
+
+void FCapsaTemplateDictionary::MarkFailed(uint64 ChunkID)
+{
+	FScopeLock ScopeLock(&Lock);
+	ChunkDefinitions.Remove(ChunkID);
+}
+
+void FCapsaTemplateDictionary::Reset()
+{
+	FScopeLock ScopeLock(&Lock);
+	TemplateIDs.Reset();
+	Delivered.Reset();
+	ChunkDefinitions.Reset();
+	NextID = 0;
+	++Generation;
+}
+
+int32 FCapsaTemplateDictionary::Num() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return TemplateIDs.Num();
+}
+
+namespace
+{
+bool IsDelimiter(TCHAR Char)
+{
+	switch (Char)
+	{
+	case TEXT(' '):
+	case TEXT('\t'):
+	case TEXT(','):
+	case TEXT(';'):
+	case TEXT(':'):
+	case TEXT('='):
+	case TEXT('('):
+	case TEXT(')'):
+	case TEXT('['):
+	case TEXT(']'):
+	case TEXT('{'):
+	case TEXT('}'):
+	case TEXT('"'):
+	case TEXT('\''):
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// Appends a plain text message, escaping the characters that would break the line based format.
+void AppendEscapedMessage(FString& Log, const TCHAR* Message, int32 Len)
+{
+	Log.Reserve(Log.Len() + Len);
+	for (int32 Index = 0; Index < Len; ++Index)
+	{
+		switch (Message[Index])
+		{
+		case TEXT('\\'):
+			Log.Append(TEXT("\\\\"));
+			break;
+		case TEXT('\r'):
+			Log.Append(TEXT("\\r"));
+			break;
+		case TEXT('\n'):
+			Log.Append(TEXT("\\n"));
+			break;
+		default:
+			Log.AppendChar(Message[Index]);
+			break;
+		}
+	}
+}
+
+/// A line of the chunk after tokenizing, pointing into the chunk or into its own storage.
+struct FEncodedLine
+{
+	double Time;
+	ELogVerbosity::Type Verbosity;
+	int32 CategoryIndex; ///< Index into the categories of the chunk
+	FStringView Message; ///< Plain text message, used when TemplateIndex is INDEX_NONE
+	int32 TemplateIndex = INDEX_NONE; ///< Index into the unique templates of the chunk
+	TArray<FStringView> Params;
+	FString StructuredParam; ///< Storage for the fields of a structured line
+	const FCapsaStructuredLine* StructuredLine = nullptr; ///< Rendered when the line cannot use its template
+};
+}
+
+namespace CapsaTemplateEncoder
+{
+bool Tokenize(FStringView Message, FString& OutTemplate, TArray<FStringView>& OutParams)
+{
+	OutTemplate.Reset();
+	OutParams.Reset();
+
+	const TCHAR* Data = Message.GetData();
+	const int32 Len = Message.Len();
+
+	int32 Index = 0;
+	while (Index < Len)
+	{
+		if (IsDelimiter(Data[Index]))
+		{
+			OutTemplate.AppendChar(Data[Index]);
+			++Index;
+			continue;
+		}
+
+		int32 End = Index;
+		bool bHasDigit = false;
+		for (; End < Len && !IsDelimiter(Data[End]); ++End)
+		{
+			const TCHAR Char = Data[End];
+			if (Char == TEXT('\n') || Char == TEXT('\r') || Char == ParamSeparator)
+			{
+				// Would break the line based format
+				return false;
+			}
+			bHasDigit |= FChar::IsDigit(Char);
+		}
+
+		const FStringView Token(Data + Index, End - Index);
+		if (UE::String::FindFirst(Token, Wildcard) != INDEX_NONE)
+		{
+			// A literal wildcard would be indistinguishable from a parameter
+			return false;
+		}
+
+		if (bHasDigit)
+		{
+			OutTemplate.Append(Wildcard);
+			OutParams.Add(Token);
+		}
+		else
+		{
+			OutTemplate.Append(Token.GetData(), Token.Len());
+		}
+		Index = End;
+	}
+
+	return true;
+}
+
+FString MakeLogString(const FCapsaLogChunk& Chunk, FCapsaTemplateDictionary& Dictionary)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(CapsaTemplateEncoder::MakeLogString);
+	LLM_SCOPE_BYTAG(Capsa);
+	SCOPE_CYCLE_COUNTER(STAT_CapsaFormat);
+	FCapsaTraceStageScope TraceScope(Chunk.ChunkID, ECapsaTraceStage::Format, 0, Chunk.Num());
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Tokenize every line, collecting the unique templates of the chunk so the dictionary is only locked once
+	TArray<FEncodedLine> EncodedLines;
+	EncodedLines.Reserve(Chunk.Num());
+	TArray<FString> Templates;
+	TMap<FString, int32> TemplateIndices;
+	TArray<FName> Categories;
+	TMap<FName, int32> CategoryIndices;
+	FString Template;
+	TWideStringBuilder<512> MessageBuilder;
+
+	auto AddTemplate = [&Templates, &TemplateIndices](const FString& NewTemplate)
+	{
+		if (const int32* ExistingIndex = TemplateIndices.Find(NewTemplate))
+		{
+			return *ExistingIndex;
+		}
+		return TemplateIndices.Add(NewTemplate, Templates.Add(NewTemplate));
+	};
+
+	auto AddCategory = [&Categories, &CategoryIndices](const FName& Category)
+	{
+		if (const int32* ExistingIndex = CategoryIndices.Find(Category))
+		{
+			return *ExistingIndex;
+		}
+		return CategoryIndices.Add(Category, Categories.Add(Category));
+	};
+
+	Chunk.ForEachLine(
+		[&](const FBufferedLine& Line)
+		{
+			FEncodedLine& EncodedLine = EncodedLines.AddDefaulted_GetRef();
+			EncodedLine.Time = Line.Time;
+			EncodedLine.Verbosity = Line.Verbosity;
+			EncodedLine.CategoryIndex = AddCategory(Line.Category.Resolve());
+			EncodedLine.Message = FStringView(Line.Data.Get());
+			if (Tokenize(EncodedLine.Message, Template, EncodedLine.Params))
+			{
+				EncodedLine.TemplateIndex = AddTemplate(Template);
+			}
+		},
+		[&](const FCapsaStructuredLine& Line)
+		{
+			FEncodedLine& EncodedLine = EncodedLines.AddDefaulted_GetRef();
+			EncodedLine.Time = Line.Time;
+			EncodedLine.Verbosity = Line.Record.GetVerbosity();
+			EncodedLine.CategoryIndex = AddCategory(Line.Record.GetCategory());
+			if (!Line.RedactedText.IsEmpty())
+			{
+				// The record may hold the data that was redacted, encode the redacted text like a text line
+				EncodedLine.Message = Line.RedactedText;
+				if (Tokenize(EncodedLine.Message, Template, EncodedLine.Params))
+				{
+					EncodedLine.TemplateIndex = AddTemplate(Template);
+				}
+				return;
+			}
+
+			EncodedLine.StructuredLine = &Line;
+			CapsaLogOperations::AppendStructuredFields(EncodedLine.StructuredParam, Line.Record.GetFields());
+
+			const FStringView Format(Line.Record.GetFormat());
+			if (UE::String::FindFirstChar(Format, TEXT('\n')) != INDEX_NONE || EncodedLine.StructuredParam.Contains(TEXT("\n")))
+			{
+				// Multi-line formats and field values would break the line based format, render the message instead, it is escaped as plain text
+				MessageBuilder.Reset();
+				Line.Record.FormatMessageTo(MessageBuilder);
+				EncodedLine.StructuredParam = MessageBuilder.ToString();
+				EncodedLine.Message = EncodedLine.StructuredParam;
+				return;
+			}
+
+			EncodedLine.Params.Add(EncodedLine.StructuredParam);
+			EncodedLine.TemplateIndex = AddTemplate(FString(Format));
+		});
+
+	TArray<uint32> TemplateIDs;
+	TBitArray<> TemplateIsNew;
+	const uint32 Generation = Dictionary.ResolveTemplates(Chunk.ChunkID, Templates, TemplateIDs, TemplateIsNew);
+
+	FString Log;
+	Log.Appendf(TEXT("#CapsaTemplate %d %u"), FormatVersion, Generation);
+	Log.Append(LINE_TERMINATOR_ANSI);
+
+	for (int32 CategoryIndex = 0; CategoryIndex < Categories.Num(); ++CategoryIndex)
+	{
+		Log.Appendf(TEXT("#C%d "), CategoryIndex);
+		Categories[CategoryIndex].AppendString(Log);
+		Log.Append(LINE_TERMINATOR_ANSI);
+	}
+
+	for (int32 TemplateIndex = 0; TemplateIndex < Templates.Num(); ++TemplateIndex)
+	{
+		if (TemplateIsNew[TemplateIndex])
+		{
+			Log.Appendf(TEXT("#T%u "), TemplateIDs[TemplateIndex]);
+			Log.Append(Templates[TemplateIndex]);
+			Log.Append(LINE_TERMINATOR_ANSI);
+		}
+	}
+
+	for (const FEncodedLine& EncodedLine : EncodedLines)
+	{
+		CapsaLogOperations::AppendLineTimeAndVerbosity(Log, EncodedLine.Time, EncodedLine.Verbosity);
+		Log.Appendf(TEXT("[#%d]: "), EncodedLine.CategoryIndex);
+
+		const uint32 TemplateID = EncodedLine.TemplateIndex != INDEX_NONE ? TemplateIDs[EncodedLine.TemplateIndex] : FCapsaTemplateDictionary::InvalidID;
+		if (TemplateID != FCapsaTemplateDictionary::InvalidID)
+		{
+			Log.Appendf(TEXT("@%u"), TemplateID);
+			for (const FStringView& Param : EncodedLine.Params)
+			{
+				Log.AppendChar(ParamSeparator);
+				Log.Append(Param.GetData(), Param.Len());
+			}
+		}
+		else if (EncodedLine.StructuredLine != nullptr && EncodedLine.Message.IsEmpty())
+		{
+			// The dictionary is full
+			MessageBuilder.Reset();
+			EncodedLine.StructuredLine->Record.FormatMessageTo(MessageBuilder);
+			Log.AppendChar(TEXT('='));
+			AppendEscapedMessage(Log, MessageBuilder.GetData(), MessageBuilder.Len());
+		}
+		else
+		{
+			Log.AppendChar(TEXT('='));
+			AppendEscapedMessage(Log, EncodedLine.Message.GetData(), EncodedLine.Message.Len());
+		}
+
+		Log.Append(LINE_TERMINATOR_ANSI); // Use lf ending on all platforms
+	}
+
+	FCapsaPipelineStats::Get().RecordFormat(FPlatformTime::Seconds() - StartTime, Log.Len() * sizeof(TCHAR));
+	TraceScope.OutputBytes = Log.Len() * sizeof(TCHAR);
+
+	return Log;
+}
+}
@@ -0,0 +1,211 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaUploadPipeline.h"
+
+#include "CapsaCore.h"
+#include "CapsaLogOperations.h"
+#include "CapsaUtf8.h"
+
+namespace
+{
+/// Counts the lines of every segment CapsaLogOperations::EncodeLogSegments() split the chunk into.
+TArray<int32> CountSegmentLines(const FCapsaLogChunk& Chunk, int32 NumSegments, int32 SegmentLines)
+{
+	TArray<int32> NumLines;
+	if (NumSegments <= 1 || SegmentLines <= 0)
+	{
+		NumLines.Add(Chunk.Num());
+		return NumLines;
+	}
+
+	NumLines.Reserve(NumSegments);
+	for (int32 Segment = 0; Segment < NumSegments; ++Segment)
+	{
+		const int32 BeginLine = Segment * SegmentLines;
+		const int32 EndLine = Segment < NumSegments - 1 ? BeginLine + SegmentLines : Chunk.Lines.Num();
+		int32 Count = 0;
+		Chunk.ForEachLineInRange(BeginLine, EndLine, [&Count](const FBufferedLine&) { ++Count; }, [&Count](const FCapsaStructuredLine&) { ++Count; });
+		NumLines.Add(Count);
+	}
+	return NumLines;
+}
+}
+
+FCapsaUploadPipeline::FCapsaUploadPipeline(int32 InMaxQueuedChunks) :
+	MaxQueuedChunks(FMath::Max(InMaxQueuedChunks, 1))
+{
+}
+
+void FCapsaUploadPipeline::Enqueue(FCapsaLogChunk Chunk, FCapsaUploadOptions Options)
+{
+	++NumQueued;
+
+	FormatPipe.Launch(UE_SOURCE_LOCATION, [Self = AsShared(), Chunk = MoveTemp(Chunk), Options = MoveTemp(Options)]() mutable
+	{
+		LLM_SCOPE_BYTAG(Capsa);
+		TUniquePtr<FCapsaEncodedChunk> Encoded = Format(Chunk, Options);
+
+		// The lines are no longer needed once formatted
+		Chunk = FCapsaLogChunk();
+
+		Self->DeliverPipe.Launch(UE_SOURCE_LOCATION, [Self, Encoded = MoveTemp(Encoded), Options = MoveTemp(Options)]() mutable
+		{
+			LLM_SCOPE_BYTAG(Capsa);
+			Self->DeliveredChunks.Enqueue(Deliver(MoveTemp(Encoded), Options));
+		});
+	});
+}
+
+void FCapsaUploadPipeline::DispatchGameThreadSinks(bool bBlocking)
+{
+	check(IsInGameThread());
+
+	FDeliveredChunk Delivered;
+	while (DeliveredChunks.Dequeue(Delivered))
+	{
+		if (!Delivered.Chunk->bFailed)
+		{
+			for (const TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>& Sink : Delivered.GameThreadSinks)
+			{
+				Sink->Consume(*Delivered.Chunk, bBlocking);
+			}
+		}
+		Delivered = FDeliveredChunk();
+		--NumQueued;
+	}
+}
+
+void FCapsaUploadPipeline::WaitUntilDelivered()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaUploadPipeline::WaitUntilDelivered);
+
+	// Format tasks launch their Deliver task before completing, so once FormatPipe is empty every Deliver task has been launched
+	FormatPipe.WaitUntilEmpty();
+	DeliverPipe.WaitUntilEmpty();
+}
+
+bool FCapsaUploadPipeline::IsFull() const
+{
+	return NumQueued >= MaxQueuedChunks;
+}
+
+int32 FCapsaUploadPipeline::GetNumQueued() const
+{
+	return NumQueued;
+}
+
+namespace
+{
+int64 GetBuffersSize(TConstArrayView<FSharedBuffer> Buffers)
+{
+	int64 Size = 0;
+	for (const FSharedBuffer& Buffer : Buffers)
+	{
+		Size += static_cast<int64>(Buffer.GetSize());
+	}
+	return Size;
+}
+
+/// Attributes the buffers of the Chunk to the Formatted and Compressed stages.
+void UpdateLiveBytes(FCapsaEncodedChunk& Chunk)
+{
+	Chunk.FormattedBytes = FCapsaLiveBytes(ECapsaMemoryStage::Formatted, GetBuffersSize(Chunk.Segments) + static_cast<int64>(Chunk.Readable.GetSize()));
+	Chunk.CompressedBytes = FCapsaLiveBytes(ECapsaMemoryStage::Compressed, GetBuffersSize(Chunk.CompressedSegments));
+}
+}
+
+TUniquePtr<FCapsaEncodedChunk> FCapsaUploadPipeline::Format(FCapsaLogChunk& Chunk, const FCapsaUploadOptions& Options)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaUploadPipeline::Format);
+
+	TUniquePtr<FCapsaEncodedChunk> Encoded = MakeUnique<FCapsaEncodedChunk>();
+	Encoded->ChunkID = Chunk.ChunkID;
+	Encoded->LogID = Options.LogID;
+	Encoded->Lane = Chunk.Lane;
+	Encoded->Stream = Chunk.Stream;
+	Encoded->LineSequences = Chunk.LineSequences.ToString();
+
+	ECapsaSinkInputs Inputs = ECapsaSinkInputs::None;
+	for (const TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>& Sink : Options.Sinks)
+	{
+		Inputs |= Sink->GetInputs();
+	}
+
+	const FCapsaLogFormatOptions& FormatOptions = Options.FormatOptions;
+	if (Options.Redactor.IsValid())
+	{
+		// Before anything is formatted, so no sink receives unredacted data
+		Options.Redactor->RedactChunk(Chunk, FormatOptions.bIncludeStructuredFields);
+	}
+
+	// The Log is also the readable Log, unless it is template encoded
+	const bool bTemplateEncoded = FormatOptions.TemplateDictionary.IsValid();
+	const bool bCompress = EnumHasAnyFlags(Inputs, ECapsaSinkInputs::Compressed);
+	if (EnumHasAnyFlags(Inputs, ECapsaSinkInputs::Log | ECapsaSinkInputs::Compressed)
+		|| (EnumHasAnyFlags(Inputs, ECapsaSinkInputs::Readable) && !bTemplateEncoded))
+	{
+		if (!CapsaLogOperations::EncodeLogSegments(Chunk, FormatOptions, bCompress, Encoded->Segments, Encoded->CompressedSegments))
+		{
+			UE_LOG(LogCapsaCore, Warning, TEXT("FCapsaUploadPipeline::Format | Failed to compress log binary"));
+			Encoded->bFailed = true;
+		}
+		Encoded->SegmentNumLines = CountSegmentLines(Chunk, Encoded->GetNumSegments(), FormatOptions.CompressionSegmentLines);
+	}
+
+	if (EnumHasAnyFlags(Inputs, ECapsaSinkInputs::Readable) && bTemplateEncoded)
+	{
+		Encoded->Readable = MakeSharedBufferFromArray(CapsaUtf8::Convert(CapsaLogOperations::MakeLogString(Chunk, FormatOptions.bIncludeStructuredFields)));
+	}
+
+	if (EnumHasAnyFlags(Inputs, ECapsaSinkInputs::Lines))
+	{
+		Encoded->Lines = MakeShared<const FCapsaLogChunk, ESPMode::ThreadSafe>(MoveTemp(Chunk));
+	}
+
+	UpdateLiveBytes(*Encoded);
+	return Encoded;
+}
+
+FCapsaUploadPipeline::FDeliveredChunk FCapsaUploadPipeline::Deliver(TUniquePtr<FCapsaEncodedChunk> Chunk, const FCapsaUploadOptions& Options)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaUploadPipeline::Deliver);
+
+	FDeliveredChunk Delivered;
+	ECapsaSinkInputs GameThreadInputs = ECapsaSinkInputs::None;
+	for (const TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>& Sink : Options.Sinks)
+	{
+		if (Sink->IsGameThreadSink())
+		{
+			Delivered.GameThreadSinks.Add(Sink);
+			GameThreadInputs |= Sink->GetInputs();
+		}
+		else if (!Chunk->bFailed)
+		{
+			Sink->Consume(*Chunk, false);
+		}
+	}
+
+	// Free what no game thread sink consumes before the chunk waits for the game thread
+	const bool bReadableInSegments = Chunk->Readable.IsNull();
+	if (!EnumHasAnyFlags(GameThreadInputs, ECapsaSinkInputs::Log)
+		&& !(EnumHasAnyFlags(GameThreadInputs, ECapsaSinkInputs::Readable) && bReadableInSegments))
+	{
+		Chunk->Segments.Empty();
+	}
+	if (!EnumHasAnyFlags(GameThreadInputs, ECapsaSinkInputs::Readable))
+	{
+		Chunk->Readable.Reset();
+	}
+	if (!EnumHasAnyFlags(GameThreadInputs, ECapsaSinkInputs::Compressed))
+	{
+		Chunk->CompressedSegments.Empty();
+	}
+	if (!EnumHasAnyFlags(GameThreadInputs, ECapsaSinkInputs::Lines))
+	{
+		Chunk->Lines.Reset();
+	}
+	UpdateLiveBytes(*Chunk);
+
+	Delivered.Chunk = MoveTemp(Chunk);
+	return Delivered;
+}
@@ -0,0 +1,148 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "CapsaUtf8.h"
+
+#if PLATFORM_CPU_X86_FAMILY
+#include <emmintrin.h>
+#define CAPSA_UTF8_SSE2 1
+#elif PLATFORM_CPU_ARM_FAMILY && PLATFORM_64BITS
+#include <arm_neon.h>
+#define CAPSA_UTF8_NEON 1
+#endif
+
+namespace
+{
+/// Code units handled per iteration of the vectorized ASCII loop.
+constexpr int32 BlockSize = 16;
+
+/// Worst case UTF-8 bytes per UTF-16 code unit, for a code point in the basic multilingual plane outside ASCII.
+constexpr int32 MaxBytesPerCodeUnit = 3;
+
+/// Converts the ASCII code units at the start of Source, a block at a time, and returns how many were converted.
+/// Stops at the first block that contains a code unit outside ASCII, which the caller converts one code point at a time.
+FORCEINLINE int32 ConvertAsciiBlocks(uint8* Dest, const UTF16CHAR* Source, int32 SourceLen)
+{
+	int32 Index = 0;
+#if CAPSA_UTF8_SSE2
+	const __m128i NonAsciiMask = _mm_set1_epi16(static_cast<int16>(0xFF80));
+	for (; Index + BlockSize <= SourceLen; Index += BlockSize)
+	{
+		const __m128i Low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + Index));
+		const __m128i High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + Index + 8));
+		const __m128i NonAscii = _mm_and_si128(_mm_or_si128(Low, High), NonAsciiMask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(NonAscii, _mm_setzero_si128())) != 0xFFFF)
+		{
+			break;
+		}
+		// Every code unit is below 0x80, so saturating to 8 bits keeps the value
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Dest + Index), _mm_packus_epi16(Low, High));
+	}
+#elif CAPSA_UTF8_NEON
+	for (; Index + BlockSize <= SourceLen; Index += BlockSize)
+	{
+		const uint16x8_t Low = vld1q_u16(reinterpret_cast<const uint16*>(Source + Index));
+		const uint16x8_t High = vld1q_u16(reinterpret_cast<const uint16*>(Source + Index + 8));
+		if (vmaxvq_u16(vorrq_u16(Low, High)) >= 0x80)
+		{
+			break;
+		}
+		vst1q_u8(Dest + Index, vcombine_u8(vmovn_u16(Low), vmovn_u16(High)));
+	}
+#endif
+	return Index;
+}
+
+/// Converts one code point, which may take two code units, and returns the number of code units consumed.
+FORCEINLINE int32 ConvertCodePoint(uint8*& Dest, const UTF16CHAR* Source, int32 Remaining)
+{
+	const uint32 CodeUnit = Source[0];
+	if (CodeUnit < 0x80)
+	{
+		*Dest++ = static_cast<uint8>(CodeUnit);
+		return 1;
+	}
+	if (CodeUnit < 0x800)
+	{
+		*Dest++ = static_cast<uint8>(0xC0 | (CodeUnit >> 6));
+		*Dest++ = static_cast<uint8>(0x80 | (CodeUnit & 0x3F));
+		return 1;
+	}
+	if (StringConv::IsHighSurrogate(CodeUnit) && Remaining > 1 && StringConv::IsLowSurrogate(Source[1]))
+	{
+		const uint32 CodePoint = StringConv::EncodeSurrogate(static_cast<uint16>(CodeUnit), Source[1]);
+		*Dest++ = static_cast<uint8>(0xF0 | (CodePoint >> 18));
+		*Dest++ = static_cast<uint8>(0x80 | ((CodePoint >> 12) & 0x3F));
+		*Dest++ = static_cast<uint8>(0x80 | ((CodePoint >> 6) & 0x3F));
+		*Dest++ = static_cast<uint8>(0x80 | (CodePoint & 0x3F));
+		return 2;
+	}
+	if (StringConv::IsHighSurrogate(CodeUnit) || StringConv::IsLowSurrogate(CodeUnit))
+	{
+		// Unpaired surrogate
+		*Dest++ = static_cast<uint8>('?');
+		return 1;
+	}
+	*Dest++ = static_cast<uint8>(0xE0 | (CodeUnit >> 12));
+	*Dest++ = static_cast<uint8>(0x80 | ((CodeUnit >> 6) & 0x3F));
+	*Dest++ = static_cast<uint8>(0x80 | (CodeUnit & 0x3F));
+	return 1;
+}
+}
+
+namespace CapsaUtf8
+{
+int32 Append(TArray<uint8>& Dest, const TCHAR* Source, int32 SourceLen)
+{
+	if constexpr (sizeof(TCHAR) != sizeof(UTF16CHAR))
+	{
+		const int32 StartNum = Dest.Num();
+		const int32 Utf8Len = FPlatformString::ConvertedLength<UTF8CHAR>(Source, SourceLen);
+		Dest.AddUninitialized(Utf8Len);
+		FPlatformString::Convert(reinterpret_cast<UTF8CHAR*>(Dest.GetData() + StartNum), Utf8Len, Source, SourceLen);
+		return Utf8Len;
+	}
+	else
+	{
+		const UTF16CHAR* Utf16Source = reinterpret_cast<const UTF16CHAR*>(Source);
+		const int32 StartNum = Dest.Num();
+
+		// Sized for ASCII, grown when code points outside ASCII need more room
+		Dest.AddUninitialized(SourceLen);
+		uint8* Write = Dest.GetData() + StartNum;
+
+		int32 Index = 0;
+		while (Index < SourceLen)
+		{
+			const int32 NumAscii = ConvertAsciiBlocks(Write, Utf16Source + Index, SourceLen - Index);
+			Write += NumAscii;
+			Index += NumAscii;
+
+			// Convert a block one code point at a time, then go back to the fast path
+			const int32 BlockEnd = FMath::Min(Index + BlockSize, SourceLen);
+			const int64 Written = Write - Dest.GetData();
+			const int64 Needed = Written + (BlockEnd - Index) * MaxBytesPerCodeUnit + (SourceLen - BlockEnd);
+			if (Needed > Dest.Num())
+			{
+				Dest.SetNumUninitialized(static_cast<int32>(FMath::Max<int64>(Needed, Dest.Num() + Dest.Num() / 2)));
+				Write = Dest.GetData() + Written;
+			}
+
+			while (Index < BlockEnd)
+			{
+				Index += ConvertCodePoint(Write, Utf16Source + Index, SourceLen - Index);
+			}
+		}
+
+		const int32 Written = static_cast<int32>(Write - Dest.GetData());
+		Dest.SetNumUninitialized(Written);
+		return Written - StartNum;
+	}
+}
+
+TArray<uint8> Convert(FStringView Source)
+{
+	TArray<uint8> Utf8;
+	Append(Utf8, Source.GetData(), Source.Len());
+	return Utf8;
+}
+}
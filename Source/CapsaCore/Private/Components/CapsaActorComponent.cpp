@@ -4,37 +4,39 @@
 
 #include "CapsaCore.h"
 #include "CapsaCoreSubsystem.h"
-
-#include "Net/UnrealNetwork.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "TimerManager.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaActorComponent)
 
-FString GetDefaultDescription(bool bIsServer)
+FString LexToString(ECapsaHostType HostType)
 {
-#if UE_SERVER
-	return TEXT("DedicatedServer");
-#elif UE_EDITOR
-	return TEXT("Editor");
-#else
-	return bIsServer ? TEXT("ListenServer") : TEXT("Player");
-#endif
+	switch (HostType)
+	{
+	case ECapsaHostType::Player:
+		return TEXT("Player");
+	case ECapsaHostType::ListenServer:
+		return TEXT("ListenServer");
+	case ECapsaHostType::DedicatedServer:
+		return TEXT("DedicatedServer");
+	case ECapsaHostType::Editor:
+		return TEXT("Editor");
+	default:
+		return TEXT("Unknown");
+	}
 }
 
 UCapsaActorComponent::UCapsaActorComponent() :
-	CapsaServerData(FCapsaSharedData{}),
 	CapsaData(FCapsaSharedData{})
 {
+	// Replicated without properties, so the client's component exists on the server to receive its RPCs
 	SetIsReplicatedByDefault(true);
 	SetAutoActivate(true);
 }
 
-void UCapsaActorComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
-{
-	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
-
-	DOREPLIFETIME(UCapsaActorComponent, CapsaServerData);
-}
-
 void UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation(const FCapsaSharedData& ClientCapsaData)
 {
 	FString OldCapsaId = CapsaData.LogID;
@@ -58,19 +60,10 @@ void UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation(const FCa
 	CapsaCoreSubsystem->RegisterLinkedLogID(ClientCapsaData.LogID, ClientCapsaData.Description);
 }
 
-void UCapsaActorComponent::OnRep_CapsaServerData()
+void UCapsaActorComponent::ServerLinkCapsaLog_Implementation(const FGuid& LogID, ECapsaHostType HostType, const FString& LogURL)
 {
-	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
-	if (CapsaCoreSubsystem == nullptr)
-	{
-		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaActorComponent::OnCapsaServerDataUpdated | CapsaCoreSubsystem is nullptr"));
-		return;
-	}
-
-	CapsaCoreSubsystem->RegisterLinkedLogID(CapsaServerData.LogID, CapsaServerData.Description);
-	CapsaCoreSubsystem->OnServerCapsaDataChangedDynamic.Broadcast(CapsaServerData.LogID, CapsaServerData.LogURL);
-
-	UE_LOG(LogCapsaCore, Verbose, TEXT( "UCapsaActorComponent::OnCapsaServerDataUpdated | CapsaServerId Updated: %s" ), *CapsaServerData.ToString());
+	// Log IDs are lower case UUIDs
+	ServerRegisterLinkedCapsaLog_Implementation(FCapsaSharedData(LogID.ToString(EGuidFormats::DigitsWithHyphensLower), LogURL, LexToString(HostType)));
 }
 
 void UCapsaActorComponent::BeginPlay()
@@ -79,6 +72,12 @@ void UCapsaActorComponent::BeginPlay()
 
 	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaActorComponent::BeginPlay | Start procedure"));
 
+	// The server has nothing to send, clients link their log once they own the PlayerState, see TryLinkCapsaLog()
+	if (GetIsServer())
+	{
+		return;
+	}
+
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
 	if (CapsaCoreSubsystem == nullptr)
 	{
@@ -93,33 +92,132 @@ void UCapsaActorComponent::BeginPlay()
 	FString CapsaLogId = CapsaCoreSubsystem->GetLogID();
 	FString CapsaLogURL = CapsaCoreSubsystem->GetLogURL();
 
-	bool bIsServer = GetIsServer();
-
-	CapsaData = FCapsaSharedData(CapsaLogId, CapsaLogURL, GetDefaultDescription(bIsServer));
+	CapsaData = FCapsaSharedData(CapsaLogId, CapsaLogURL, LexToString(GetHostType(false)));
 
 	UE_LOG(LogCapsaCore, VeryVerbose, TEXT("UCapsaActorComponent::BeginPlay | CapsaData: %s"), *CapsaData.ToString())
 
 	if (CapsaData.IsEmpty())
 	{
-		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaActorComponent::BeginPlay | CapsaData.IsEmpty() == true, not sending data"));
+		UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaActorComponent::BeginPlay | CapsaData.IsEmpty() == true, sending data once authenticated"));
 		return;
 	}
 
 	// We have authentication, manually call replication logic
 	OnAuthenticationDelegate(CapsaLogId, CapsaLogURL);
+}
+
+void UCapsaActorComponent::TryLinkCapsaLog()
+{
+	if (CapsaData.IsEmpty())
+	{
+		return;
+	}
+
+	// Only the client that owns the PlayerState can send RPCs through it. The owner is replicated after the PlayerState begins play on joining
+	// clients, so the link is retried until it is. The components of other players stop retrying once they are known to be someone else's
+	const AActor* Owner = GetOwner();
+	UWorld* World = GetWorld();
+	if (Owner == nullptr || Owner->GetNetConnection() == nullptr)
+	{
+		if (World == nullptr)
+		{
+			return;
+		}
+
+		if (!MayBeLocallyOwned())
+		{
+			World->GetTimerManager().ClearTimer(LinkRetryTimerHandle);
+			return;
+		}
+
+		if (!World->GetTimerManager().IsTimerActive(LinkRetryTimerHandle))
+		{
+			World->GetTimerManager().SetTimer(LinkRetryTimerHandle, this, &UCapsaActorComponent::TryLinkCapsaLog, LinkRetryInterval, true);
+		}
+		return;
+	}
+
+	if (World != nullptr)
+	{
+		World->GetTimerManager().ClearTimer(LinkRetryTimerHandle);
+	}
+
+	// Will only reach the server on connections we are authorized to do so.
+	// This will trigger the server to add a log link to the joined client
+	FGuid LogGuid;
+	if (FGuid::Parse(CapsaData.LogID, LogGuid))
+	{
+		ServerLinkCapsaLog(LogGuid, GetHostType(false), CapsaData.LogURL);
+		return;
+	}
+
+	ServerRegisterLinkedCapsaLog(CapsaData);
+}
+
+bool UCapsaActorComponent::MayBeLocallyOwned() const
+{
+	const AActor* Owner = GetOwner();
+	const UWorld* World = GetWorld();
+	if (Owner == nullptr || World == nullptr)
+	{
+		return false;
+	}
 
-	if (bIsServer)
+	if (const APlayerController* PlayerController = Cast<APlayerController>(Owner))
 	{
-		// When the server receives authentication data, manually broadcast.
-		// Without this, PIE does not correctly display the server UUID.
-		CapsaCoreSubsystem->OnServerCapsaDataChangedDynamic.Broadcast(CapsaServerData.LogID, CapsaServerData.LogURL);
+		return PlayerController->IsLocalController();
+	}
+
+	const APlayerState* PlayerState = Cast<APlayerState>(Owner);
+	if (const APawn* Pawn = Cast<APawn>(Owner))
+	{
+		if (Pawn->IsLocallyControlled())
+		{
+			return true;
+		}
+		// The controllers of other players do not exist on this client, their Pawns are told apart by their PlayerState
+		PlayerState = Pawn->GetPlayerState();
+		if (PlayerState == nullptr)
+		{
+			return true;
+		}
+	}
+
+	if (PlayerState != nullptr)
+	{
+		// The PlayerState of a local PlayerController, and the controller itself, are replicated after the PlayerState begins play. Until they
+		// are, any PlayerState may be the local one
+		bool bHasLocalController = false;
+		for (FConstPlayerControllerIterator Iterator = World->GetPlayerControllerIterator(); Iterator; ++Iterator)
+		{
+			const APlayerController* PlayerController = Iterator->Get();
+			if (PlayerController == nullptr || !PlayerController->IsLocalController())
+			{
+				continue;
+			}
+
+			bHasLocalController = true;
+			if (PlayerController->PlayerState == nullptr || PlayerController->PlayerState == PlayerState)
+			{
+				return true;
+			}
+		}
+		return !bHasLocalController;
 	}
+
+	// Other Actors are linked once their owner is known, which may be a local player
+	return true;
 }
 
 void UCapsaActorComponent::EndPlay(EEndPlayReason::Type EndPlayReason)
 {
 	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaActorComponent::EndPlay | End Play"));
 
+	if (UWorld* World = GetWorld())
+	{
+		World->GetTimerManager().ClearTimer(LinkRetryTimerHandle);
+	}
+
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
 	if (CapsaCoreSubsystem == nullptr)
 	{
@@ -127,6 +225,8 @@ void UCapsaActorComponent::EndPlay(EEndPlayReason::Type EndPlayReason)
 		return;
 	}
 
+	CapsaCoreSubsystem->OnAuthChanged.RemoveAll(this);
+
 	Super::EndPlay(EndPlayReason);
 }
 
@@ -137,31 +237,18 @@ void UCapsaActorComponent::OnAuthenticationDelegate(const FString& LogId, const
 
 	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaActorComponent::OnAuthenticationDelegate | After updating authentication data: %s"), *CapsaData.ToString());
 
-	bool bIsServer = GetIsServer();
-
-	if (bIsServer)
-	{
-		CapsaServerData = CapsaData;
-		OnRep_CapsaServerData(); // OnRep's do not run ON the Server. Manually trigger so processing is in one place.
-
-		UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
-		if (CapsaCoreSubsystem == nullptr)
-		{
-			UE_LOG(LogCapsaCore, Error, TEXT("UCapsaActorComponent::OnAuthenticationDelegate | CapsaCoreSubsystem is nullptr"));
-		}
-		else
-		{
-			// When the server receives authentication data, manually broadcast.
-			// Without this, PIE does not correctly display the server UUID.
-			CapsaCoreSubsystem->OnServerCapsaDataChangedDynamic.Broadcast(CapsaServerData.LogID, CapsaServerData.LogURL);
-		}
-
-		UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaActorComponent::OnAuthenticationDelegate | OnRep_CapsaServerData called"));
-	}
+	TryLinkCapsaLog();
+}
 
-	// Will only reach the server on connections we are authorized to do so.
-	// This will trigger the server to add a log link to the joined client
-	ServerRegisterLinkedCapsaLog(CapsaData);
+ECapsaHostType UCapsaActorComponent::GetHostType(bool bIsServer)
+{
+#if UE_SERVER
+	return ECapsaHostType::DedicatedServer;
+#elif UE_EDITOR
+	return ECapsaHostType::Editor;
+#else
+	return bIsServer ? ECapsaHostType::ListenServer : ECapsaHostType::Player;
+#endif
 }
 
 bool UCapsaActorComponent::GetIsServer() const
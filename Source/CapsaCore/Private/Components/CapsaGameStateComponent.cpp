@@ -0,0 +1,115 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "Components/CapsaGameStateComponent.h"
+
+#include "CapsaCore.h"
+#include "CapsaCoreSubsystem.h"
+
+#include "Net/Core/PushModel/PushModel.h"
+#include "Net/UnrealNetwork.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaGameStateComponent)
+
+UCapsaGameStateComponent::UCapsaGameStateComponent() :
+	CapsaServerData(FCapsaSharedData{})
+{
+	SetIsReplicatedByDefault(true);
+	SetAutoActivate(true);
+}
+
+void UCapsaGameStateComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+	DOREPLIFETIME_WITH_PARAMS_FAST(UCapsaGameStateComponent, CapsaServerData, Params);
+}
+
+void UCapsaGameStateComponent::OnRep_CapsaServerData()
+{
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+	if (CapsaCoreSubsystem == nullptr)
+	{
+		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaGameStateComponent::OnRep_CapsaServerData | CapsaCoreSubsystem is nullptr"));
+		return;
+	}
+
+	CapsaCoreSubsystem->RegisterLinkedLogID(CapsaServerData.LogID, CapsaServerData.Description);
+	CapsaCoreSubsystem->OnServerCapsaDataChangedDynamic.Broadcast(CapsaServerData.LogID, CapsaServerData.LogURL);
+
+	UE_LOG(LogCapsaCore, Verbose, TEXT( "UCapsaGameStateComponent::OnRep_CapsaServerData | CapsaServerId Updated: %s" ), *CapsaServerData.ToString());
+}
+
+void UCapsaGameStateComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaGameStateComponent::BeginPlay | Start procedure"));
+
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+	if (CapsaCoreSubsystem == nullptr)
+	{
+		UE_LOG(LogCapsaCore, Error, TEXT("UCapsaGameStateComponent::BeginPlay | CapsaCoreSubsystem is nullptr"));
+		return;
+	}
+
+	// Clients receive the server's data through replication, see OnRep_CapsaServerData(). UCapsaCoreSubsystem::GetServerCapsaData() finds the
+	// component through the GameState of its World
+	if (!GetIsServer())
+	{
+		return;
+	}
+
+	if (!IS_PUSH_MODEL_ENABLED())
+	{
+		UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaGameStateComponent::BeginPlay | Push model is disabled, CapsaServerData is compared on every replication"));
+	}
+
+	// Add a callback for whenever the authentication changes
+	CapsaCoreSubsystem->OnAuthChanged.AddUObject(this, &UCapsaGameStateComponent::OnAuthenticationDelegate);
+
+	const FString CapsaLogId = CapsaCoreSubsystem->GetLogID();
+	const FString CapsaLogURL = CapsaCoreSubsystem->GetLogURL();
+	if (CapsaLogId.IsEmpty() || CapsaLogURL.IsEmpty())
+	{
+		UE_LOG(LogCapsaCore, Warning, TEXT("UCapsaGameStateComponent::BeginPlay | Not authenticated yet, not sending data"));
+		return;
+	}
+
+	// We have authentication, manually call replication logic
+	OnAuthenticationDelegate(CapsaLogId, CapsaLogURL);
+}
+
+void UCapsaGameStateComponent::EndPlay(EEndPlayReason::Type EndPlayReason)
+{
+	UE_LOG(LogCapsaCore, Verbose, TEXT("UCapsaGameStateComponent::EndPlay | End Play"));
+
+	if (UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>())
+	{
+		CapsaCoreSubsystem->OnAuthChanged.RemoveAll(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UCapsaGameStateComponent::OnAuthenticationDelegate(const FString& LogId, const FString& LogURL)
+{
+	CapsaServerData = FCapsaSharedData(LogId, LogURL, LexToString(UCapsaActorComponent::GetHostType(true)));
+	MARK_PROPERTY_DIRTY_FROM_NAME(UCapsaGameStateComponent, CapsaServerData, this);
+
+	UE_LOG(LogCapsaCore, Log, TEXT("UCapsaGameStateComponent::OnAuthenticationDelegate | After updating authentication data: %s"), *CapsaServerData.ToString());
+
+	// OnRep's do not run ON the Server. Manually trigger so processing is in one place.
+	// Without this, PIE does not correctly display the server UUID.
+	OnRep_CapsaServerData();
+}
+
+bool UCapsaGameStateComponent::GetIsServer() const
+{
+#if !WITH_SERVER_CODE
+	return false;
+#else
+	return GetNetMode() == NM_DedicatedServer || GetNetMode() == NM_ListenServer;
+#endif
+}
@@ -21,6 +21,31 @@ UCapsaSettings::UCapsaSettings() :
 	bUseCompression(true),
 	bWriteToDiskPlain(true),
 	bWriteToDiskCompressed(false),
+	bCaptureStructuredLogs(true),
+	bIncludeStructuredFields(false),
+	bUseTemplateEncoding(false),
+	CompressionSegmentLines(10000),
+	MaxCompressionWorkers(0),
+	MaxQueuedLogChunks(8),
+	bRedactLogs(false),
+	RedactionPatterns({TEXT("Bearer *"), TEXT("token=*"), TEXT("password=*")}),
+	bRedactEmailAddresses(true),
+	bRedactIPAddresses(true),
+	HistorySizeMB(0),
+	HistoryBlockSizeKB(256),
+	UploadMode(ECapsaUploadMode::Stream),
+	TriggerLinesBefore(2000),
+	TriggerLinesAfter(200),
+	TriggerMaxDelay(5.f),
+	bUsePriorityLane(true),
+	PriorityVerbosity(ECapsaLogVerbosity::Error),
+	PriorityFlushDeadline(2.f),
+	bUseHostAgent(false),
+	HostAgentSocketPath(TEXT("/tmp/capsa-host-agent.sock")),
+	bWriteToStdout(false),
+	bUseWorldStreams(false),
+	TokenRefreshMargin(600.f),
+	bPersistSession(false),
 	bAutoAddCapsaComponent(true),
 	AutoAddClass(APlayerState::StaticClass())
 {
@@ -95,6 +120,131 @@ bool UCapsaSettings::GetWriteToDiskCompressed() const
 	return bWriteToDiskCompressed;
 }
 
+bool UCapsaSettings::GetCaptureStructuredLogs() const
+{
+	return bCaptureStructuredLogs;
+}
+
+bool UCapsaSettings::GetIncludeStructuredFields() const
+{
+	return bIncludeStructuredFields;
+}
+
+bool UCapsaSettings::GetUseTemplateEncoding() const
+{
+	return bUseTemplateEncoding;
+}
+
+int32 UCapsaSettings::GetCompressionSegmentLines() const
+{
+	return CompressionSegmentLines;
+}
+
+int32 UCapsaSettings::GetMaxCompressionWorkers() const
+{
+	return MaxCompressionWorkers;
+}
+
+int32 UCapsaSettings::GetMaxQueuedLogChunks() const
+{
+	return MaxQueuedLogChunks;
+}
+
+bool UCapsaSettings::GetRedactLogs() const
+{
+	return bRedactLogs;
+}
+
+const TArray<FString>& UCapsaSettings::GetRedactionPatterns() const
+{
+	return RedactionPatterns;
+}
+
+bool UCapsaSettings::GetRedactEmailAddresses() const
+{
+	return bRedactEmailAddresses;
+}
+
+bool UCapsaSettings::GetRedactIPAddresses() const
+{
+	return bRedactIPAddresses;
+}
+
+int32 UCapsaSettings::GetHistorySizeMB() const
+{
+	return HistorySizeMB;
+}
+
+int32 UCapsaSettings::GetHistoryBlockSizeKB() const
+{
+	return HistoryBlockSizeKB;
+}
+
+ECapsaUploadMode UCapsaSettings::GetUploadMode() const
+{
+	return UploadMode;
+}
+
+int32 UCapsaSettings::GetTriggerLinesBefore() const
+{
+	return TriggerLinesBefore;
+}
+
+int32 UCapsaSettings::GetTriggerLinesAfter() const
+{
+	return TriggerLinesAfter;
+}
+
+float UCapsaSettings::GetTriggerMaxDelay() const
+{
+	return TriggerMaxDelay;
+}
+
+bool UCapsaSettings::GetUsePriorityLane() const
+{
+	return bUsePriorityLane;
+}
+
+ELogVerbosity::Type UCapsaSettings::GetPriorityVerbosity() const
+{
+	return static_cast<ELogVerbosity::Type>(PriorityVerbosity);
+}
+
+float UCapsaSettings::GetPriorityFlushDeadline() const
+{
+	return PriorityFlushDeadline;
+}
+
+bool UCapsaSettings::GetUseHostAgent() const
+{
+	return bUseHostAgent;
+}
+
+FString UCapsaSettings::GetHostAgentSocketPath() const
+{
+	return HostAgentSocketPath;
+}
+
+bool UCapsaSettings::GetWriteToStdout() const
+{
+	return bWriteToStdout;
+}
+
+bool UCapsaSettings::GetUseWorldStreams() const
+{
+	return bUseWorldStreams;
+}
+
+float UCapsaSettings::GetTokenRefreshMargin() const
+{
+	return TokenRefreshMargin;
+}
+
+bool UCapsaSettings::GetPersistSession() const
+{
+	return bPersistSession;
+}
+
 bool UCapsaSettings::GetShouldAutoAddCapsaComponent() const
 {
 	return bAutoAddCapsaComponent;
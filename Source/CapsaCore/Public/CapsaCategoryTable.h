@@ -0,0 +1,29 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/// Process wide cache of the category part of a formatted line, "[Category]: ", keyed by the comparison index of the category FName.
+/// Log categories are a small, fixed set, so every category is converted to a string once instead of for every line. Like FName comparison,
+/// categories that only differ in case share an entry. All functions are thread-safe.
+class CAPSACORE_API FCapsaCategoryTable
+{
+public:
+	/// Access the process wide table.
+	/// @return FCapsaCategoryTable& The table.
+	static FCapsaCategoryTable& Get();
+
+	/// Appends "[Category]: " to the Log, adding the category to the table the first time it is seen.
+	/// @param Log The Log to append to.
+	/// @param Category The category of the line.
+	void AppendCategory(FString& Log, const FName& Category);
+
+	/// The number of categories in the table.
+	/// @return int32 The number of categories.
+	int32 Num() const;
+
+private:
+	mutable FRWLock Lock;
+	TMap<FNameEntryId, FString> Categories;
+};
@@ -3,30 +3,50 @@
 #pragma once
 
 #include "CapsaCore.h"
+#include "CapsaCoreStats.h"
+#include "CapsaLogChunk.h"
 #include "CapsaLogOperations.h"
+#include "CapsaTemplateEncoder.h"
 
 typedef TFunction<void(const FString&)> FAsyncStringFromBufferCallback;
 typedef TFunction<void(const TArray<uint8>&)> FAsyncBinaryFromBufferCallback;
 
 
-/// Base Capsa Async Task. Stores the Buffer and Callback function. Also contains base helper methods like those to construct a single Log String from the Buffer.
+/// Base Capsa Async Task. Stores the Chunk and Callback function. Also contains base helper methods like those to construct a single Log String from the Chunk.
 template<typename CallbackType>
 class FCapsaAsyncTask : public FNonAbandonableTask
 {
 public:
 	friend class FAutoDeleteAsyncTask<FCapsaAsyncTask>;
 
-	FCapsaAsyncTask(TArray<FBufferedLine> InBuffer, CallbackType InCallbackFunction) :
-		Buffer(MoveTemp(InBuffer)),
+	FCapsaAsyncTask(FCapsaLogChunk InChunk, CallbackType InCallbackFunction, FCapsaLogFormatOptions InFormatOptions = FCapsaLogFormatOptions()) :
+		Chunk(MoveTemp(InChunk)),
 		CallbackFunction(InCallbackFunction),
+		FormatOptions(MoveTemp(InFormatOptions)),
 		LogExtension(CapsaLogOperations::DefaultUncompressedLogExtension),
 		CompressedExtension(CapsaLogOperations::DefaultCompressedLogExtension)
 	{
 	}
 
+	/// Builds the human readable Log, as written to disk.
 	FString MakeLogString() const
 	{
-		return CapsaLogOperations::MakeLogString(Buffer);
+		return CapsaLogOperations::MakeLogString(Chunk, FormatOptions.bIncludeStructuredFields);
+	}
+
+	/// Builds the Log to upload, which is template encoded if FormatOptions has a dictionary.
+	FString MakeUploadLogString() const
+	{
+		if (IsTemplateEncoded())
+		{
+			return CapsaTemplateEncoder::MakeLogString(Chunk, *FormatOptions.TemplateDictionary);
+		}
+		return MakeLogString();
+	}
+
+	bool IsTemplateEncoded() const
+	{
+		return FormatOptions.TemplateDictionary.IsValid();
 	}
 
 	bool MakeCompressedLogBinary(FString& UncompressedLog, TArray<uint8>& BinaryData) const
@@ -34,21 +54,27 @@ public:
 		UE_LOG(LogCapsaCore, VeryVerbose, TEXT("FCapsaAsyncTask::MakeCompressedLogBinary | Start compression"))
 
 		// Get log string, uncompressed
-		UncompressedLog = MakeLogString();
+		UncompressedLog = MakeUploadLogString();
 		UE_LOG(LogCapsaCore, VeryVerbose, TEXT("FCapsaAsyncTask::MakeCompressedLogBinary | Uncompressed log length: %d"), UncompressedLog.Len());
 
 		// Convert log string to uint8*
-		return CapsaLogOperations::MakeCompressedLogBinary(UncompressedLog, BinaryData);
+		return CapsaLogOperations::MakeCompressedLogBinary(UncompressedLog, BinaryData, Chunk.ChunkID);
+	}
+
+	/// Formats and compresses the Log to upload, split into segments if the Chunk is large, see CapsaLogOperations::EncodeLogSegments().
+	bool MakeCompressedLogSegments(TArray<FSharedBuffer>& UncompressedLogs, TArray<FSharedBuffer>& BinaryData) const
+	{
+		return CapsaLogOperations::EncodeLogSegments(Chunk, FormatOptions, true, UncompressedLogs, BinaryData);
 	}
 
 	bool SaveStringToFile(const FString& LogToSave, const FString& FileName) const
 	{
-		return CapsaLogOperations::SaveStringToFile(LogToSave, FileName, LogExtension);
+		return CapsaLogOperations::SaveStringToFile(LogToSave, FileName, LogExtension, Chunk.ChunkID);
 	}
 
 	bool SaveBinaryToFile(const TArray<uint8>& BinaryData, const FString& FileName) const
 	{
-		return CapsaLogOperations::SaveBinaryToFile(BinaryData, FileName, CompressedExtension);
+		return CapsaLogOperations::SaveBinaryToFile(BinaryData, FileName, CompressedExtension, Chunk.ChunkID);
 	}
 
 	void DoWork() const
@@ -62,20 +88,22 @@ public:
 	}
 
 protected:
-	TArray<FBufferedLine> Buffer;
+	FCapsaLogChunk Chunk; ///< The lines to send. Its memory accounting is released with the task.
 	CallbackType CallbackFunction;
+	FCapsaLogFormatOptions FormatOptions;
 	const FString LogExtension;
 	const FString CompressedExtension;
 };
 
-/// Async task to create a FString that we can send over HTTP from a FBufferredLine TArray and then save this Raw String to File.
+/// Async task to create a FString that we can send over HTTP from a FCapsaLogChunk and then save this Raw String to File.
 class FSaveStringFromBufferTask : public FCapsaAsyncTask<FAsyncStringFromBufferCallback>
 {
 public:
 	friend class FAutoDeleteAsyncTask<FSaveStringFromBufferTask>;
 
-	FSaveStringFromBufferTask(FString InLogID, bool bInWriteToDisk, TArray<FBufferedLine> InBuffer, FAsyncStringFromBufferCallback InCallbackFunction) :
-		FCapsaAsyncTask<FAsyncStringFromBufferCallback>(MoveTemp(InBuffer), InCallbackFunction),
+	FSaveStringFromBufferTask(FString InLogID, bool bInWriteToDisk, FCapsaLogChunk InChunk, FAsyncStringFromBufferCallback InCallbackFunction,
+		FCapsaLogFormatOptions InFormatOptions = FCapsaLogFormatOptions()) :
+		FCapsaAsyncTask<FAsyncStringFromBufferCallback>(MoveTemp(InChunk), InCallbackFunction, MoveTemp(InFormatOptions)),
 		LogID(InLogID),
 		bWriteToDiskPlain(bInWriteToDisk)
 	{
@@ -83,10 +111,13 @@ public:
 
 	void DoWork() const
 	{
-		FString Log = MakeLogString();
+		LLM_SCOPE_BYTAG(Capsa);
+
+		FString Log = MakeUploadLogString();
+		const FCapsaLiveBytes LogBytes(ECapsaMemoryStage::Formatted, Log.GetAllocatedSize());
 		if (bWriteToDiskPlain)
 		{
-			if (!SaveStringToFile(Log, LogID))
+			if (!SaveStringToFile(IsTemplateEncoded() ? MakeLogString() : Log, LogID))
 			{
 				UE_LOG(LogCapsaCore, Warning, TEXT( "Failed to write plain text file to disk" ))
 			}
@@ -104,15 +135,15 @@ protected:
 	bool bWriteToDiskPlain;
 };
 
-/// Async task to create a Binary Array that we can send over HTTP from a FBufferredLine TArray and then save this compressed Binary Array to File.
+/// Async task to create a Binary Array that we can send over HTTP from a FCapsaLogChunk and then save this compressed Binary Array to File.
 class FSaveCompressedStringFromBufferTask : public FCapsaAsyncTask<FAsyncBinaryFromBufferCallback>
 {
 public:
 	friend class FAutoDeleteAsyncTask<FSaveCompressedStringFromBufferTask>;
 
-	FSaveCompressedStringFromBufferTask(FString InLogID, bool bInWriteToDiskPlain, bool bInWriteToDiskCompressed, TArray<FBufferedLine> InBuffer,
-		FAsyncBinaryFromBufferCallback InCallbackFunction) :
-		FCapsaAsyncTask(MoveTemp(InBuffer), InCallbackFunction),
+	FSaveCompressedStringFromBufferTask(FString InLogID, bool bInWriteToDiskPlain, bool bInWriteToDiskCompressed, FCapsaLogChunk InChunk,
+		FAsyncBinaryFromBufferCallback InCallbackFunction, FCapsaLogFormatOptions InFormatOptions = FCapsaLogFormatOptions()) :
+		FCapsaAsyncTask(MoveTemp(InChunk), InCallbackFunction, MoveTemp(InFormatOptions)),
 		LogID(InLogID),
 		bWriteToDiskPlain(bInWriteToDiskPlain),
 		bWriteToDiskCompressed(bInWriteToDiskCompressed)
@@ -121,38 +152,73 @@ public:
 
 	void DoWork() const
 	{
-		FString Log;
-		TArray<uint8> CompressedLog;
+		LLM_SCOPE_BYTAG(Capsa);
+
+		TArray<FSharedBuffer> Logs;
+		TArray<FSharedBuffer> CompressedLogs;
 
 		// Compress data
-		if (!MakeCompressedLogBinary(Log, CompressedLog))
+		const bool bCompressed = MakeCompressedLogSegments(Logs, CompressedLogs);
+		int64 LogsSize = 0;
+		int64 CompressedLogsSize = 0;
+		for (int32 Segment = 0; Segment < Logs.Num(); ++Segment)
+		{
+			LogsSize += Logs[Segment].GetSize();
+			CompressedLogsSize += CompressedLogs[Segment].GetSize();
+		}
+		const FCapsaLiveBytes LogBytes(ECapsaMemoryStage::Formatted, LogsSize);
+		const FCapsaLiveBytes CompressedLogBytes(ECapsaMemoryStage::Compressed, CompressedLogsSize);
+		if (!bCompressed)
 		{
 			UE_LOG(LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to compress log binary" ));
 		}
 		else
 		{
-			UE_LOG(LogCapsaCore, VeryVerbose, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Compressed log binary, length: %d" ), CompressedLog.Num())
+			UE_LOG(LogCapsaCore, VeryVerbose, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Compressed log binary, segments: %d, length: %lld" ),
+				CompressedLogs.Num(), CompressedLogsSize)
 
-			// Save compressed file to disk
+			// Save compressed file to disk, one file per segment as every segment is a separate zlib stream
 			if (bWriteToDiskCompressed)
 			{
-				if (!SaveBinaryToFile(CompressedLog, LogID))
+				for (int32 Segment = 0; Segment < CompressedLogs.Num(); ++Segment)
 				{
-					UE_LOG(LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write compressed file to disk" ));
+					const FString SegmentExtension = CompressedLogs.Num() > 1 ? FString::Printf(TEXT(".%d%s"), Segment, *CompressedExtension) : CompressedExtension;
+					if (!CapsaLogOperations::SaveBinaryToFile(MakeArrayView(static_cast<const uint8*>(CompressedLogs[Segment].GetData()),
+						static_cast<int32>(CompressedLogs[Segment].GetSize())), LogID, SegmentExtension, Chunk.ChunkID))
+					{
+						UE_LOG(LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write compressed file to disk" ));
+					}
 				}
 			}
 		}
 
-		// Save plain text to disk
+		// Save plain text to disk, appending the segments in order
 		if (bWriteToDiskPlain)
 		{
-			if (!SaveStringToFile(Log, LogID))
+			if (IsTemplateEncoded())
 			{
-				UE_LOG(LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write plain text file to disk" ));
+				if (!SaveStringToFile(MakeLogString(), LogID))
+				{
+					UE_LOG(LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write plain text file to disk" ));
+				}
+			}
+			else
+			{
+				for (const FSharedBuffer& Log : Logs)
+				{
+					if (!CapsaLogOperations::AppendUtf8ToFile(MakeArrayView(static_cast<const uint8*>(Log.GetData()), static_cast<int32>(Log.GetSize())), LogID,
+						LogExtension, Chunk.ChunkID))
+					{
+						UE_LOG(LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write plain text file to disk" ));
+					}
+				}
 			}
 		}
 
-		CallbackFunction(CompressedLog);
+		for (const FSharedBuffer& CompressedLog : CompressedLogs)
+		{
+			CallbackFunction(TArray<uint8>(static_cast<const uint8*>(CompressedLog.GetData()), static_cast<int32>(CompressedLog.GetSize())));
+		}
 	}
 
 	FORCEINLINE TStatId GetStatId() const
@@ -70,3 +70,40 @@ public:
 	UPROPERTY()
 	FString Expiry; ///< Timestamp of when the Token will expire, should be longer than any expected game session
 };
+
+/// The session of the process, saved to disk when bPersistSession is enabled, so a restart continues the same log. Only holds what is needed to
+/// continue the log, but that includes the bearer token, see UCapsaSettings::bPersistSession
+USTRUCT()
+struct FCapsaPersistedSession
+{
+	GENERATED_BODY()
+
+	FCapsaPersistedSession() :
+		Token(TEXT("")),
+		LogId(TEXT("")),
+		LinkWeb(TEXT("")),
+		Expiry(TEXT("")),
+		Environment(TEXT("")),
+		Segment(0)
+	{
+	};
+
+public:
+	UPROPERTY()
+	FString Token; ///< JWT of the session
+
+	UPROPERTY()
+	FString LogId; ///< UUID of the log
+
+	UPROPERTY()
+	FString LinkWeb; ///< Direct link to view the log in the Capsa web app
+
+	UPROPERTY()
+	FString Expiry; ///< Timestamp of when the Token will expire
+
+	UPROPERTY()
+	FString Environment; ///< Hash of the server URL and environment key the session was created with, a session is not reused for another
+
+	UPROPERTY()
+	int32 Segment; ///< The number of processes that continued the log, the chunk sequences of every segment follow those of the previous one
+};
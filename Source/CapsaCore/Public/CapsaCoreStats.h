@@ -0,0 +1,227 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Stats/Stats.h"
+
+#include <atomic>
+
+/// Low Level Memory tracker tag for all Capsa allocations, in both CapsaCore and CapsaLog.
+LLM_DECLARE_TAG_API(Capsa, CAPSACORE_API);
+
+DECLARE_STATS_GROUP(TEXT("Capsa"), STATGROUP_Capsa, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lines Captured"), STAT_CapsaLinesCaptured, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Captured"), STAT_CapsaBytesCaptured, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Lines Dropped"), STAT_CapsaLinesDropped, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Buffer High-Water Mark"), STAT_CapsaBufferHighWater, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Compression Ratio"), STAT_CapsaCompressionRatio, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Upload Latency (ms)"), STAT_CapsaUploadLatency, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Upload Failures"), STAT_CapsaUploadFailures, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("In-Flight Requests"), STAT_CapsaInFlightRequests, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Game Thread Time (ms)"), STAT_CapsaGameThreadTime, STATGROUP_Capsa, CAPSACORE_API);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Capture"), STAT_CapsaCapture, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick"), STAT_CapsaTick, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Redact Chunk"), STAT_CapsaRedact, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Format Chunk"), STAT_CapsaFormat, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Compress Chunk"), STAT_CapsaCompress, STATGROUP_Capsa, CAPSACORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Write Chunk To Disk"), STAT_CapsaDiskWrite, STATGROUP_Capsa, CAPSACORE_API);
+
+/// Stages of the Capsa pipeline that hold memory, reported by Capsa.MemReport.
+enum class ECapsaMemoryStage : uint8
+{
+	Buffered, ///< Lines captured by the output device, waiting for the next flush
+	Queued, ///< Flushed lines waiting for, or being processed by, an async task
+	Formatted, ///< Formatted log strings
+	CompressionScratch, ///< UTF-8 conversion and output reservation while compressing
+	Compressed, ///< Compressed chunks waiting to be uploaded
+	HttpPayload, ///< Request bodies of log chunk uploads that have not completed yet
+	History, ///< Blocks of the in-memory log history, see FCapsaHistoryRing
+
+	Num
+};
+
+/// Process-wide counters for the Capsa log pipeline.
+/// Unlike the STATGROUP_Capsa stats, these are always compiled in, so they can be inspected with Capsa.Stats in builds without STATS.
+/// All Record functions are thread-safe and also update the matching STATGROUP_Capsa stat.
+struct CAPSACORE_API FCapsaPipelineStats
+{
+public:
+	/// Access the process-wide instance.
+	/// @return FCapsaPipelineStats& The singleton.
+	static FCapsaPipelineStats& Get();
+
+	/// Record a single line being captured by the output device.
+	/// @param Bytes The size of the captured line data in bytes.
+	void RecordCapture(int64 Bytes);
+
+	/// Record lines that were discarded without being sent, for example because there is no authenticated session.
+	/// @param Lines The number of discarded lines.
+	void RecordDropped(int64 Lines);
+
+	/// Record the current number of lines held in the capture buffer, updating the high-water mark.
+	/// @param Lines The number of lines currently buffered.
+	void RecordBufferSize(int64 Lines);
+
+	/// Record the redaction of a chunk, see FCapsaRedactor.
+	/// @param Seconds Time spent redacting.
+	/// @param InputBytes Size of the scanned text in bytes.
+	/// @param Matches The number of redacted matches.
+	void RecordRedact(double Seconds, int64 InputBytes, int64 Matches);
+
+	/// Record the formatting of a chunk.
+	/// @param Seconds Time spent formatting.
+	/// @param OutputBytes Size of the formatted chunk in bytes.
+	void RecordFormat(double Seconds, int64 OutputBytes);
+
+	/// Record the compression of a chunk.
+	/// @param Seconds Time spent compressing.
+	/// @param UncompressedBytes Size of the input in bytes.
+	/// @param CompressedBytes Size of the output in bytes.
+	void RecordCompress(double Seconds, int64 UncompressedBytes, int64 CompressedBytes);
+
+	/// Record a chunk being written to disk.
+	/// @param Seconds Time spent writing.
+	void RecordDiskWrite(double Seconds);
+
+	/// Record a log chunk upload being sent. Authentication and metadata requests are not recorded, so the counts and latency describe uploads only.
+	void RecordRequestStarted();
+
+	/// Record a log chunk upload completing.
+	/// @param LatencySeconds Time between sending the request and receiving the response.
+	/// @param bFailed Whether the request failed or returned a non-2xx response code.
+	void RecordRequestFinished(double LatencySeconds, bool bFailed);
+
+	/// Record time the game thread spent inside Capsa, either in the output device tick or capturing a line.
+	/// Does nothing when called from any other thread.
+	/// @param Cycles The time spent, in FPlatformTime::Cycles64() units.
+	void RecordGameThreadCycles(uint64 Cycles);
+
+	/// Record time Capsa spent starting up, see FCapsaStartupScope.
+	/// @param Seconds Time spent.
+	/// @param bDeferred Whether the time was spent after the engine started, fe. ingesting the startup backlog, rather than on the startup path.
+	void RecordStartup(double Seconds, bool bDeferred);
+
+	/// Record memory being acquired or released by a pipeline stage. Prefer FCapsaLiveBytes where the owner has a clear lifetime.
+	/// @param Stage The stage holding the memory.
+	/// @param DeltaBytes Positive when memory is acquired, negative when it is released.
+	void AddLiveBytes(ECapsaMemoryStage Stage, int64 DeltaBytes);
+
+	/// Write a human readable summary of all counters to the provided output device.
+	/// @param Ar The output device to write to.
+	void Dump(FOutputDevice& Ar) const;
+
+	/// Write the live and peak bytes held by each pipeline stage to the provided output device.
+	/// @param Ar The output device to write to.
+	void DumpMemory(FOutputDevice& Ar) const;
+
+	std::atomic<uint64> LinesCaptured{0};
+	std::atomic<uint64> BytesCaptured{0};
+	std::atomic<uint64> LinesDropped{0};
+	std::atomic<uint64> BufferHighWater{0};
+
+	std::atomic<uint64> ChunksRedacted{0};
+	std::atomic<uint64> RedactMicros{0};
+	std::atomic<uint64> RedactInputBytes{0};
+	std::atomic<uint64> RedactMatches{0};
+
+	std::atomic<uint64> ChunksFormatted{0};
+	std::atomic<uint64> FormatMicros{0};
+	std::atomic<uint64> FormattedBytes{0};
+
+	std::atomic<uint64> ChunksCompressed{0};
+	std::atomic<uint64> CompressMicros{0};
+	std::atomic<uint64> CompressInputBytes{0};
+	std::atomic<uint64> CompressOutputBytes{0};
+
+	std::atomic<uint64> DiskWrites{0};
+	std::atomic<uint64> DiskWriteMicros{0};
+
+	std::atomic<uint64> RequestsSent{0};
+	std::atomic<uint64> RequestsFailed{0};
+	std::atomic<int64> RequestsInFlight{0};
+	std::atomic<uint64> UploadLatencyMicros{0};
+	std::atomic<uint64> UploadLatencySamples{0};
+
+	/// Total game-thread time attributable to Capsa, in FPlatformTime::Cycles64() units.
+	std::atomic<uint64> GameThreadCycles{0};
+
+	/// Time Capsa added to engine startup, and time spent on work deferred until after it, in microseconds.
+	std::atomic<uint64> StartupMicros{0};
+	std::atomic<uint64> DeferredStartupMicros{0};
+
+	/// Lines captured before the output device finished starting up, fe. the engine startup backlog.
+	std::atomic<uint64> StartupLines{0};
+
+	std::atomic<int64> LiveBytes[static_cast<uint8>(ECapsaMemoryStage::Num)] = {};
+	std::atomic<int64> PeakLiveBytes[static_cast<uint8>(ECapsaMemoryStage::Num)] = {};
+};
+
+/// Live bytes attributed to a pipeline stage, released when this is destroyed.
+/// Move-only, so the accounting can follow a buffer from the output device into an async task.
+struct CAPSACORE_API FCapsaLiveBytes
+{
+public:
+	FCapsaLiveBytes() = default;
+	FCapsaLiveBytes(ECapsaMemoryStage InStage, int64 InBytes);
+	FCapsaLiveBytes(FCapsaLiveBytes&& Other);
+	FCapsaLiveBytes& operator=(FCapsaLiveBytes&& Other);
+	FCapsaLiveBytes(const FCapsaLiveBytes&) = delete;
+	FCapsaLiveBytes& operator=(const FCapsaLiveBytes&) = delete;
+	~FCapsaLiveBytes();
+
+	/// Attributes the bytes to another stage, for example when a buffer is handed from one stage to the next.
+	/// @param NewStage The stage now holding the memory.
+	void MoveTo(ECapsaMemoryStage NewStage);
+
+	/// Releases the bytes early, before this is destroyed.
+	void Release();
+
+private:
+	ECapsaMemoryStage Stage = ECapsaMemoryStage::Buffered;
+	int64 Bytes = 0;
+};
+
+/// Adds the time spent in the scope to FCapsaPipelineStats::GameThreadCycles, if the scope is entered on the game thread.
+struct FCapsaGameThreadCostScope
+{
+public:
+	FCapsaGameThreadCostScope() :
+		bGameThread(IsInGameThread()),
+		StartCycle(bGameThread ? FPlatformTime::Cycles64() : 0)
+	{
+	}
+
+	~FCapsaGameThreadCostScope()
+	{
+		if (bGameThread)
+		{
+			FCapsaPipelineStats::Get().RecordGameThreadCycles(FPlatformTime::Cycles64() - StartCycle);
+		}
+	}
+
+	const bool bGameThread;
+	const uint64 StartCycle;
+};
+
+/// Adds the time spent in the scope to FCapsaPipelineStats::StartupMicros, or to DeferredStartupMicros.
+struct FCapsaStartupScope
+{
+public:
+	explicit FCapsaStartupScope(bool bInDeferred) :
+		bDeferred(bInDeferred),
+		StartSeconds(FPlatformTime::Seconds())
+	{
+	}
+
+	~FCapsaStartupScope()
+	{
+		FCapsaPipelineStats::Get().RecordStartup(FPlatformTime::Seconds() - StartSeconds, bDeferred);
+	}
+
+	const bool bDeferred;
+	const double StartSeconds;
+};
@@ -3,20 +3,84 @@
 #pragma once
 
 #include "Components/CapsaActorComponent.h"
+#include "CapsaHostAgent.h"
+#include "CapsaLogChunk.h"
+#include "CapsaLogSink.h"
+#include "CapsaTemplateEncoder.h"
+#include "CapsaUploadPipeline.h"
 
 #include "CoreMinimal.h"
 #include "Subsystems/EngineSubsystem.h"
+#include "Containers/Ticker.h"
 #include "HttpModule.h"
+#include "Tasks/Task.h"
 
 #include "CapsaCoreSubsystem.generated.h"
 
 // Forward Declarations
 class UCapsaActorComponent;
+class UCapsaGameStateComponent;
+class UCapsaSettings;
+struct FCapsaAuthenticationResponse;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FCapsaCoreDataChangedDynamicDelegate, const FString&, CapsaLogId, const FString&, CapsaLogURL);
 
 DECLARE_MULTICAST_DELEGATE_TwoParams(FCapsaCoreOnAuthChangedDelegate, const FString& /* CapsaLogId */, const FString& /* CapsaLogURL */);
 
+/// A log chunk request rejected with 401, sent again once the token of its session is refreshed.
+struct FCapsaRetryRequest
+{
+	FHttpRequestPtr Request;
+	uint64 ChunkID = 0; ///< Identifies the chunk in Capsa trace events
+	int32 NumLines = 0; ///< Counted as dropped if the chunk is not sent again
+};
+
+/// A Capsa log session. The process uploads to a session of its own, and to one more per log stream, see CapsaLogStreams.
+struct FCapsaSession
+{
+public:
+	/// Whether the session has been authenticated.
+	/// @return bool True if the Token and LogID are set.
+	bool IsAuthenticated() const
+	{
+		return !Token.IsEmpty() && !LogID.IsEmpty();
+	}
+
+	/// Use the Token to generate the Authentication header value
+	/// @return FString header value for Authentication header
+	FString GetAuthHeader() const
+	{
+		return TEXT("Bearer ") + Token;
+	}
+
+	FString Token;
+	FString LogID;
+	FString LinkWeb;
+	FString Expiry;
+
+	/// Expiry as a UTC time, the default value if the server sent none, or it could not be parsed.
+	FDateTime ExpiryTime;
+
+	/// Whether the token is being refreshed, while uploads keep using the current one, and when to try again if refreshing failed. Game thread only.
+	bool bRefreshRequested = false;
+	double NextRefreshTime = 0.0;
+
+	/// Log chunk requests rejected with 401, sent again once the token is refreshed. Game thread only.
+	TArray<FCapsaRetryRequest> RetryRequests;
+
+	/// Sent with every log chunk request, so the server can restore capture order if requests overtake each other. Game thread only.
+	uint64 NextChunkSequence = 0;
+
+	/// Templates sent in this session, when bUseTemplateEncoding is enabled. Shared with the async tasks that encode chunks.
+	TSharedPtr<FCapsaTemplateDictionary, ESPMode::ThreadSafe> TemplateDictionary;
+
+	/// Whether authentication of a stream session is in flight, so it is only requested once. Game thread only.
+	bool bAuthRequested = false;
+
+	/// Chunks of a stream, sent once its session is authenticated. Game thread only.
+	TArray<FCapsaLogChunk> PendingChunks;
+};
+
 /// UCapsaCoreSubsystem contains most logic related to Capsa, including HTTP and authentication logic. Most functionality is available in both C++ and Blueprints.
 UCLASS()
 class CAPSACORE_API UCapsaCoreSubsystem : public UEngineSubsystem
@@ -45,16 +109,27 @@ public:
 	/// Delegate that will be called whenever the authentication changes, for example whenever a log session has been created. This delegate should be used in C++.
 	FCapsaCoreOnAuthChangedDelegate OnAuthChanged;
 
-	/// Access the FCapsaSharedData as replicated on the CapsaActorComponent.
-	/// @return FCapsaSharedData server data, or empty in case the CapsaActorComponent is not found.
-	UFUNCTION(BlueprintPure, Category = "Capsa|Log|CapsaCoreSubsystem|SessionData")
-	FCapsaSharedData GetServerCapsaData() const;
+	/// Access the FCapsaSharedData as replicated on the UCapsaGameStateComponent of the GameState of a World.
+	/// @param WorldContextObject An object in the World to read the server data of. When null, the only game World is used, as a process may run
+	/// several, fe. multiple Play In Editor instances or matches.
+	/// @return FCapsaSharedData server data, or empty in case the UCapsaGameStateComponent is not found.
+	UFUNCTION(BlueprintPure, Category = "Capsa|Log|CapsaCoreSubsystem|SessionData", meta = (WorldContext = "WorldContextObject"))
+	FCapsaSharedData GetServerCapsaData(const UObject* WorldContextObject = nullptr) const;
+
+	/// Finds the UCapsaGameStateComponent of the GameState of a World.
+	/// @param WorldContextObject An object in the World. When null, the component of the only game World that has one.
+	/// @return UCapsaGameStateComponent* The component, or nullptr if there is none, or several game Worlds have one and no World was given.
+	static UCapsaGameStateComponent* FindGameStateComponent(const UObject* WorldContextObject);
 
 #pragma region GETTERS
 	/// Whether we have been Authenticated with the Services.
 	/// @return bool True if authenticated, otherwise false.
 	bool IsAuthenticated() const;
 
+	/// Whether the session of the process is still being authenticated: authentication waits for the first tick after startup, or the request is in flight.
+	/// @return bool True while lines should be kept for the session, rather than dropped for lack of one.
+	bool IsAuthenticating() const;
+
 	/// Returns the LogID of the currently active connection.
 	/// @return FString The LogID.
 	UFUNCTION(BlueprintPure, Category = "Capsa|Log|CapsaCoreSubsystem|SessionData")
@@ -64,14 +139,71 @@ public:
 	/// @return FString The LogURL.
 	UFUNCTION(BlueprintPure, Category = "Capsa|Log|CapsaCoreSubsystem|SessionData")
 	FString GetLogURL() const;
+
+	/// Returns the session chunks of a log stream are uploaded to. Game thread only.
+	/// @param Stream The log stream, see CapsaLogStreams.
+	/// @return const FCapsaSession* The session of the process for CapsaLogStreams::DefaultStream, nullptr for streams that did not send a chunk yet.
+	const FCapsaSession* FindSession(uint16 Stream) const;
 #pragma endregion GETTERS
 
 #pragma region APICALLSPUBLIC
 	/// Attempts to send the provided Log Buffer to the Capsa Server.
-	/// This is performed asynchronously, converted the TArray of BufferedLine's into a single FString Log. If successful, calls RequestSendLog().
+	/// This is performed asynchronously by the upload pipeline, which converts the TArray of BufferedLine's into a single FString Log, compresses it
+	/// and uploads it from the game thread, in the order SendLog() was called. See FCapsaUploadPipeline.
 	/// @param LogBuffer The Log buffer to parse and send.
 	/// @param bBlocking Make sending the log a blocking operation, should only be used during shutdown, default=false
-	void SendLog(TArray<FBufferedLine>& LogBuffer, bool bBlocking = false);
+	/// @param ChunkID Identifies the chunk in Capsa trace events. When 0, a new ID is allocated. See CapsaTrace::AllocateChunkID().
+	/// @return bool True if the log was accepted, false if it was dropped, fe. because the upload pipeline is full. See CanSendLog().
+	bool SendLog(TArray<FBufferedLine>& LogBuffer, bool bBlocking = false, uint64 ChunkID = 0);
+
+	/// Attempts to send the provided Log Chunk, which may contain structured lines, to the Capsa Server. Behaves like SendLog().
+	/// @param Chunk The chunk to format and send. When its ChunkID is 0, a new ID is allocated.
+	/// @param bBlocking Make sending the log a blocking operation, should only be used during shutdown, default=false
+	/// @return bool True if the chunk was accepted, false if it was dropped, fe. because the upload pipeline is full. See CanSendLog().
+	bool SendLogChunk(FCapsaLogChunk Chunk, bool bBlocking = false);
+
+	/// Whether a non-blocking SendLog() would be accepted. False while the upload pipeline holds UCapsaSettings::GetMaxQueuedLogChunks() chunks,
+	/// in which case callers should keep their lines buffered and try again later.
+	/// @return bool True if the upload pipeline has room for another chunk.
+	bool CanSendLog() const;
+
+	/// Registers a sink that receives every log chunk sent from now on, in addition to the sinks configured in UCapsaSettings.
+	/// Chunks are encoded once for all sinks, see FCapsaUploadPipeline. Must be called on the game thread.
+	/// @param Sink The sink to register.
+	void RegisterSink(TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe> Sink);
+
+	/// Unregisters a sink registered with RegisterSink(). Chunks that were already sent are still handed to it.
+	/// @param Sink The sink to unregister.
+	void UnregisterSink(const TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>& Sink);
+
+	/// Uploads a segment of an encoded chunk to the Capsa server as a log chunk request, see FCapsaHttpSink. Must be called on the game thread.
+	/// @param Chunk The encoded chunk.
+	/// @param Segment The index of the segment to upload.
+	/// @param bCompressed Whether to upload the compressed segment, rather than the Log.
+	/// @param bBlocking make the request blocking, should only be used during shutdown, default=false
+	void UploadLogSegment(const FCapsaEncodedChunk& Chunk, int32 Segment, bool bCompressed, bool bBlocking = false);
+
+	/// Uploads the chunks the host agent accepted, but did not receive whole before its connection closed, see FCapsaHostAgentClient::TakeUnsentChunks().
+	/// Must be called on the game thread.
+	/// @param bBlocking make the requests blocking, should only be used during shutdown, default=false
+	void UploadUnsentHostAgentChunks(bool bBlocking = false);
+
+	/// The redactor chunks are redacted with before they are handed to the sinks, compiled from the redaction settings. Waits for, or runs, the
+	/// compilation if it is not done yet. Must be called on the game thread.
+	/// @return TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> The redactor, null if UCapsaSettings::GetRedactLogs() is disabled.
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> GetRedactor();
+
+	/// Allocates the X-Capsa-Chunk-Sequence of a log chunk segment uploaded on behalf of this process, fe. by the host agent, from the same counter
+	/// as the segments this process uploads itself. Must be called on the game thread.
+	/// @param Stream The log stream of the chunk, whose session the segment is uploaded to.
+	/// @return uint64 The chunk sequence, 0 if the stream has no session.
+	uint64 AllocateChunkSequence(uint16 Stream);
+
+	/// Logs every line logged while World ticks to a log stream of its own, fe. for every match of a multi-match dedicated server, which is uploaded
+	/// to its own session and linked to the session of the process. Only used when UCapsaSettings::GetUseWorldStreams() is enabled, Play In Editor
+	/// instances get a stream without being added. The world is removed when it is cleaned up.
+	/// @param World The world to add.
+	void AddWorldStream(UWorld* World);
 
 	/// Attempts to Register the provided Log ID as a Linked Log ID.
 	/// @param LinkedLogID The LinkedLogID to try and register.
@@ -97,26 +229,38 @@ public:
 	static void OpenClientLogInBrowser();
 
 	/// Gets the URL for the Server Log and requests the Operating System launch a Browser with the corresponding URL.
-	static void OpenServerLogInBrowser();
+	/// @param World The World connected to the server, see GetServerCapsaData().
+	static void OpenServerLogInBrowser(UWorld* World = nullptr);
 #pragma endregion BROWSERMETHODS
 
 protected:
 #pragma region APICALLSPROTECTED
 
-	/// Use the Token to generate the Authentication header value
+	/// Use the Token of the session of the process to generate the Authentication header value
 	/// @return FString header value for Authentication header
 	FString GetAuthHeader() const
 	{
-		return TEXT("Bearer ") + Token;
+		return Session.GetAuthHeader();
 	};
 
 	/// Generates Capsa supported Metadata and requests to send to the Capsa Server. Internally constructs the URL from the Config settings and uses the metadata stored on memory */
 	void RequestSendMetadata();
 
 	/// Requests to Send a raw Log to the Capsa Server. Internally constructs the URL from the Config settings and uses the Auth token acquired from RequestClientAuth().
-	/// @param Log The FString log to attempt to send.
+	/// @param Log The UTF-8 log to attempt to send.
 	/// @param bBlocking make request blocking, should only be used during shutdown, default=false
-	void RequestSendLog(const FString& Log, bool bBlocking = false);
+	/// @param ChunkID Identifies the chunk in Capsa trace events.
+	/// @param Lane The lane the chunk was flushed from.
+	/// @param LineSequences The capture sequence numbers of the lines, see FCapsaLineSequences::ToString(). Empty if the lines continue the previous segment.
+	/// @param Stream The log stream of the chunk, whose session the log is sent to.
+	/// @param NumLines The number of lines in the Log, counted as dropped if the request cannot be sent again.
+	void RequestSendLog(const FSharedBuffer& Log, bool bBlocking = false, uint64 ChunkID = 0, ECapsaLogLane Lane = ECapsaLogLane::Bulk,
+		const FString& LineSequences = FString(), uint16 Stream = 0, int32 NumLines = 0);
+
+	/// Hands the chunks that finished the upload pipeline since the last tick to the game thread sinks. Bound to the core ticker.
+	/// @param DeltaTime The time since the last tick.
+	/// @return bool Always true, to keep ticking.
+	bool TickUploads(float DeltaTime);
 #pragma endregion APICALLSPROTECTED
 
 #pragma region APIRESPONSES
@@ -134,10 +278,39 @@ protected:
 	/// @param bSuccess Whether the HTTP response was successful (true) or not (false).
 	virtual void ClientAuthResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess);
 
+	/// Callback after the ClientAuth request of a log stream. Sends the chunks the stream sent while it was not authenticated, and links its log to
+	/// the log of the process.
+	/// @param Request The FHttpRequestPtr that made the Request.
+	/// @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
+	/// @param bSuccess Whether the HTTP response was successful (true) or not (false).
+	/// @param Stream The log stream that requested authentication.
+	void StreamAuthResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint16 Stream);
+
+	/// Callback after the ClientAuth request that refreshes the token of a session. Sends the log chunks that were rejected with 401 again.
+	/// If the server started a new log, the new log is linked to the previous one.
+	/// @param Request The FHttpRequestPtr that made the Request.
+	/// @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
+	/// @param bSuccess Whether the HTTP response was successful (true) or not (false).
+	/// @param Stream The log stream of the session.
+	void RefreshAuthResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint16 Stream);
+
 	/// Requests to Send a Compressed Log to the Capsa Server. Internally constructs the URL from the Config settings and uses the Auth token acquired from RequestClientAuth().
-	/// @param CompressedLog The TArray<uint8> binary log to attempt to send.
+	/// @param CompressedLog The binary log to attempt to send.
 	/// @param bBlocking make request blocking, should only be used during shutdown, default=false
-	void RequestSendCompressedLog(const TArray<uint8>& CompressedLog, bool bBlocking = false);
+	/// @param ChunkID Identifies the chunk in Capsa trace events.
+	/// @param Lane The lane the chunk was flushed from.
+	/// @param LineSequences The capture sequence numbers of the lines, see FCapsaLineSequences::ToString(). Empty if the lines continue the previous segment.
+	/// @param Stream The log stream of the chunk, whose session the log is sent to.
+	/// @param NumLines The number of lines in the Log, counted as dropped if the request cannot be sent again.
+	void RequestSendCompressedLog(const FSharedBuffer& CompressedLog, bool bBlocking = false, uint64 ChunkID = 0, ECapsaLogLane Lane = ECapsaLogLane::Bulk,
+		const FString& LineSequences = FString(), uint16 Stream = 0, int32 NumLines = 0);
+
+	/// Sets the headers that order a log chunk segment within the session: its chunk sequence, lane, and line sequences if set.
+	/// @param Request The log chunk request.
+	/// @param ChunkSession The session the chunk is sent to.
+	/// @param Lane The lane the chunk was flushed from.
+	/// @param LineSequences The capture sequence numbers of the lines.
+	void SetLogChunkHeaders(IHttpRequest& Request, FCapsaSession& ChunkSession, ECapsaLogLane Lane, const FString& LineSequences);
 
 	/// Callback after a SendLog request.
 	/// @param Request The FHttpRequestPtr that made the Request.
@@ -145,6 +318,16 @@ protected:
 	/// @param bSuccess Whether the HTTP response was successful (true) or not (false).
 	virtual void LogResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess);
 
+	/// Callback after a log chunk request. Emits the HttpResponse trace event for the chunk and forwards to LogResponse.
+	/// @param Request The FHttpRequestPtr that made the Request.
+	/// @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
+	/// @param bSuccess Whether the HTTP response was successful (true) or not (false).
+	/// @param ChunkID Identifies the chunk in Capsa trace events.
+	/// @param Stream The log stream of the chunk.
+	/// @param NumLines The number of lines in the chunk, counted as dropped if it is rejected and cannot be sent again.
+	/// @param bCanRetry Whether a chunk rejected with 401 is sent again after refreshing the token. False for retries and blocking requests.
+	void LogChunkResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint64 ChunkID, uint16 Stream, int32 NumLines, bool bCanRetry);
+
 	/// Callback after a SendMetadata request. Empties the in-memory metadata in case of a success response.
 	/// @param Request The FHttpRequestPtr that made the Request.
 	/// @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
@@ -158,28 +341,172 @@ protected:
 	/// @param World The UWorld associated with the Map that has loaded.
 	virtual void OnPostWorldInit(UWorld* World, const UWorld::InitializationValues);
 
-	/// Called after a Player has been successfully Logged in. Only bound in OnPostWorldInit and only if bAutoAddCapsaComponent is true.
-	/// @param GameMode The GameMode the player joined.
-	/// @param Player The PlayerController for the player that has just joined.
-	virtual void OnPlayerLoggedIn(AGameModeBase* GameMode, APlayerController* Player);
-
-	/// Called after a Player has been successfully Logged out. Only bound in OnPostWorldInit and only if bAutoAddCapsaComponent is true.
-	/// @param GameMode The GameMode the player left.
-	/// @param Player The Controller for the player that has just left.
-	virtual void OnPlayerLoggedOut(AGameModeBase* GameMode, AController* Controller);
+	/// Called after the Actors of a World were initialized. Adds the Capsa Component to the Actors of AutoAddClass placed in the World, once per World,
+	/// and the UCapsaGameStateComponent to the GameState if it was not spawned after OnPostWorldInit. Only does so for the Worlds bound in OnPostWorldInit.
+	/// @param Params The World and its initialization parameters.
+	virtual void OnWorldInitializedActors(const FActorsInitializedParams& Params);
+
+	/// Called when an Actor is spawned in a server World bound in OnPostWorldInit, fe. the PlayerState of a Player that logs in. Adds the Capsa Component
+	/// if the Actor is of AutoAddClass, so joining Players cost the same regardless of the number of Actors in the World, and the UCapsaGameStateComponent
+	/// if the Actor is the GameState. The UCapsaGameStateComponent is added even if auto-adding the Capsa Component is turned off.
+	/// @param Actor The Actor that was spawned.
+	virtual void OnActorSpawned(AActor* Actor);
+
+	/// The class the Capsa Component is auto-added to, see UCapsaSettings::GetAutoAddClass().
+	/// @return const UClass* The class, or nullptr if auto-adding is turned off or no class is set.
+	static const UClass* GetAutoAddClass();
+
+	/// Adds a Capsa Component to an Actor, unless it has one already.
+	/// @param Actor The Actor to add the Capsa Component to.
+	/// @param ComponentClass The class of the Capsa Component, UCapsaActorComponent or UCapsaGameStateComponent.
+	void AddCapsaComponent(AActor* Actor, TSubclassOf<UActorComponent> ComponentClass);
+
+	/// Called before a World ticks. Logs the tick to the stream of the world, if it was added with AddWorldStream().
+	/// @param World The World about to tick.
+	/// @param TickType The kind of tick.
+	/// @param DeltaSeconds The time since the last tick.
+	void OnWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	/// Called after a World ticked. Restores the stream of the game thread.
+	/// @param World The World that ticked.
+	/// @param TickType The kind of tick.
+	/// @param DeltaSeconds The time since the last tick.
+	void OnWorldTickEnd(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	/// Called when a World is cleaned up. Removes it from the worlds added with AddWorldStream(), and stops adding the Capsa Component to its Actors.
+	/// @param World The World being cleaned up.
+	/// @param bSessionEnded Whether the gameplay session ended.
+	/// @param bCleanupResources Whether the resources of the World are released.
+	void OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources);
 #pragma endregion UNREAL
 
 private:
 	static void OpenBrowser(const FString& URL);
 
+	/// Recreates the sinks configured in UCapsaSettings if the relevant settings changed since they were created.
+	/// @param CapsaSettings The settings.
+	void UpdateDefaultSinks(const UCapsaSettings& CapsaSettings);
+
+	/// Creates a ClientAuth request from the details in CapsaSettings, without binding its response.
+	/// @param RefreshedLogID When refreshing the token of a session, its LogID, sent as "logId" so the server continues the log rather than starting
+	/// a new one. Empty to start a new log.
+	/// @return FHttpRequestPtr The request, null if the settings are invalid.
+	FHttpRequestPtr CreateAuthRequest(const FString& RefreshedLogID = FString()) const;
+
+	/// Requests authentication of the session of a log stream. Will call StreamAuthResponse.
+	/// @param Stream The log stream.
+	/// @return bool True if the request was sent.
+	bool RequestStreamAuth(uint16 Stream);
+
+	/// Does the work Initialize defers until the engine ticks: restores or authenticates the session, and compiles the redaction patterns on a
+	/// background task. Called from the first TickUploads.
+	void CompleteStartup();
+
+	/// Refreshes the tokens that expire within UCapsaSettings::GetTokenRefreshMargin(), see RequestSessionRefresh(). Called from TickUploads.
+	void RefreshExpiringSessions();
+
+	/// Requests a new token for a session, unless a request is in flight already. Will call RefreshAuthResponse.
+	/// @param Stream The log stream of the session.
+	void RequestSessionRefresh(uint16 Stream);
+
+	/// Sets the authentication data of a session. Starts a new chunk sequence and template generation if the LogID changed.
+	/// @param TargetSession The session to set.
+	/// @param AuthenticationResponse The authentication data.
+	/// @return bool True if the LogID changed.
+	bool SetSessionAuthentication(FCapsaSession& TargetSession, const FCapsaAuthenticationResponse& AuthenticationResponse);
+
+	/// Sends a log chunk request rejected with 401 again, with the current token of its session. Its payload must be accounted already.
+	/// @param RetryRequest The rejected request.
+	/// @param ChunkSession The session of the chunk.
+	/// @param Stream The log stream of the session.
+	/// @param bNewLog Whether the session has a new LogID since the request was made, in which case the chunk gets a new chunk sequence.
+	void RetryLogChunk(const FCapsaRetryRequest& RetryRequest, FCapsaSession& ChunkSession, uint16 Stream, bool bNewLog);
+
+	/// Restores the session saved by a previous process, if its token is valid for longer than UCapsaSettings::GetTokenRefreshMargin(), and it was
+	/// created for the same server and environment. The log is continued as a new segment. See UCapsaSettings::GetPersistSession().
+	/// @param CapsaSettings The settings.
+	/// @return bool True if the session was restored, and authenticating is not needed.
+	bool RestorePersistedSession(const UCapsaSettings& CapsaSettings);
+
+	/// Saves the session of the process, if UCapsaSettings::GetPersistSession() is enabled.
+	void PersistSession() const;
+
+	/// The file the session of the process is saved to: Saved/Capsa/Session-<HostType>[-<Instance>].json, with the -CapsaInstance= command line value.
+	/// @return FString The path of the file.
+	static FString GetPersistedSessionPath();
+
+	/// Identifies the server and environment a session was created for.
+	/// @param CapsaSettings The settings.
+	/// @return FString A hash of the server URL and environment key.
+	static FString GetEnvironmentHash(const UCapsaSettings& CapsaSettings);
+
+	/// Reads an authentication response, see ClientAuthResponse.
+	/// @param RequestName The request name to prepend to Log Outputs.
+	/// @param Request The FHttpRequestPtr that made the Request.
+	/// @param Response The FHttpResponsePtr with response information.
+	/// @param bSuccess Whether the HTTP response was successful.
+	/// @param OutAuthenticationResponse Receives the authentication data.
+	/// @return bool True if the response held authentication data.
+	bool ParseAuthResponse(const FString& RequestName, FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess,
+		FCapsaAuthenticationResponse& OutAuthenticationResponse);
+
+	/// The session a log stream uploads to, see FindSession().
+	/// @param Stream The log stream.
+	/// @return FCapsaSession* The session, nullptr for streams without one.
+	FCapsaSession* FindMutableSession(uint16 Stream);
+
 	FDelegateHandle OnPostWorldInitializationHandle;
+	FDelegateHandle OnWorldInitializedActorsHandle;
+	FDelegateHandle OnWorldCleanupHandle;
+
+	/// The server worlds the Capsa Components are added in, and their OnActorSpawned handler. Bound once per World, see OnPostWorldInit(). Game thread only.
+	TMap<TWeakObjectPtr<UWorld>, FDelegateHandle> AutoAddWorlds;
+
+	/// The session of the process, which every line outside of a log stream is uploaded to.
+	FCapsaSession Session;
+
+	/// The number of processes before this one that logged to the log of Session, see UCapsaSettings::GetPersistSession().
+	int32 SessionSegment;
+
+	/// The session of every log stream that sent a chunk, see UCapsaSettings::GetUseWorldStreams(). Game thread only.
+	TMap<uint16, FCapsaSession> StreamSessions;
+
+	/// The worlds added with AddWorldStream(), and their log stream. Game thread only.
+	TMap<TWeakObjectPtr<UWorld>, uint16> WorldStreams;
+
+	/// The stream of the game thread before the ticking world set its own, see OnWorldTickStart(). Unset while no added world ticks.
+	TOptional<int32> StreamBeforeWorldTick;
 
-	FString Token;
-	FString LogID;
-	FString LinkWeb;
-	FString Expiry;
 	TMap<FString, FString> LinkedLogIDs;
 	TMap<FString, TSharedPtr<FJsonValue>> AdditionalMetadata;
 
-	TWeakObjectPtr<UCapsaActorComponent> CapsaActorComponent;
+	/// Formats and compresses chunks, and hands them to their sinks in order. Created in Initialize, shared with its tasks.
+	TSharedPtr<FCapsaUploadPipeline, ESPMode::ThreadSafe> UploadPipeline;
+
+	FTSTicker::FDelegateHandle UploadTickerHandle;
+
+	/// When TickUploads next checks whether a token expires, in FPlatformTime::Seconds().
+	double NextRefreshCheckTime;
+
+	/// Whether CompleteStartup() has yet to run. Game thread only.
+	bool bStartupPending;
+
+	/// Whether the authentication request of RequestClientAuth() is in flight. Game thread only.
+	bool bClientAuthPending;
+
+	/// Compiled from the redaction settings the first time a chunk is sent with bRedactLogs enabled. Shared with the upload pipeline tasks.
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> Redactor;
+
+	/// Compiles Redactor in the background, launched by CompleteStartup() when bRedactLogs is enabled.
+	UE::Tasks::TTask<TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe>> RedactorTask;
+
+	/// Receives the formatted log chunks when bUseHostAgent is enabled, through FCapsaHostAgentSink. Game thread only.
+	TSharedPtr<FCapsaHostAgentClient, ESPMode::ThreadSafe> HostAgent;
+
+	/// The sinks configured in UCapsaSettings, fe. FCapsaHttpSink and FCapsaFileSink, and the settings they were created from.
+	TArray<TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>> DefaultSinks;
+	int32 DefaultSinksConfig;
+
+	/// Sinks registered with RegisterSink(). Every chunk is handed to the DefaultSinks first.
+	TArray<TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>> RegisteredSinks;
 };
@@ -0,0 +1,75 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Trace/Trace.h"
+
+#ifndef CAPSA_TRACE_ENABLED
+#define CAPSA_TRACE_ENABLED UE_TRACE_ENABLED
+#endif
+
+#if CAPSA_TRACE_ENABLED
+UE_TRACE_CHANNEL_EXTERN(CapsaChannel, CAPSACORE_API);
+#endif
+
+/// Stages of the Capsa pipeline that emit a Capsa.ChunkStage trace event.
+enum class ECapsaTraceStage : uint8
+{
+	Capture, ///< A single line was captured by the output device
+	Flush, ///< The output device handed its buffer to the subsystem
+	Format, ///< The buffer was formatted into a log string
+	Compress, ///< The log string was compressed
+	DiskWrite, ///< The chunk was written to disk
+	HttpSubmit, ///< The chunk was submitted to the HTTP module
+	HttpResponse, ///< The HTTP response for the chunk was received
+};
+
+namespace CapsaTrace
+{
+/// Allocates a new process-unique chunk ID, used to follow a chunk through the pipeline in Unreal Insights. Never returns 0.
+/// @return uint64 The new chunk ID.
+CAPSACORE_API uint64 AllocateChunkID();
+
+/// Emits a Capsa.ChunkStage event on the CapsaChannel. Does nothing if the channel is disabled.
+/// @param ChunkID The chunk the stage belongs to.
+/// @param Stage The pipeline stage.
+/// @param StartCycle FPlatformTime::Cycles64() when the stage started.
+/// @param EndCycle FPlatformTime::Cycles64() when the stage ended.
+/// @param InputBytes The number of bytes the stage consumed.
+/// @param OutputBytes The number of bytes the stage produced.
+/// @param LineCount The number of lines the stage processed.
+CAPSACORE_API void OutputStage(uint64 ChunkID, ECapsaTraceStage Stage, uint64 StartCycle, uint64 EndCycle, uint64 InputBytes, uint64 OutputBytes,
+	uint32 LineCount);
+
+/// Whether the CapsaChannel is currently enabled. Use to skip gathering data for high-frequency events.
+/// @return bool True if the channel is enabled.
+CAPSACORE_API bool IsChannelEnabled();
+}
+
+/// Emits a Capsa.ChunkStage event covering the lifetime of the scope.
+struct FCapsaTraceStageScope
+{
+public:
+	FCapsaTraceStageScope(uint64 InChunkID, ECapsaTraceStage InStage, uint64 InInputBytes = 0, uint32 InLineCount = 0) :
+		ChunkID(InChunkID),
+		Stage(InStage),
+		StartCycle(FPlatformTime::Cycles64()),
+		InputBytes(InInputBytes),
+		OutputBytes(0),
+		LineCount(InLineCount)
+	{
+	}
+
+	~FCapsaTraceStageScope()
+	{
+		CapsaTrace::OutputStage(ChunkID, Stage, StartCycle, FPlatformTime::Cycles64(), InputBytes, OutputBytes, LineCount);
+	}
+
+	uint64 ChunkID;
+	ECapsaTraceStage Stage;
+	uint64 StartCycle;
+	uint64 InputBytes;
+	uint64 OutputBytes;
+	uint32 LineCount;
+};
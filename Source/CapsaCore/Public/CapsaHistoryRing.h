@@ -0,0 +1,122 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CapsaLogChunk.h"
+#include "Containers/Deque.h"
+#include "Memory/SharedBuffer.h"
+
+class FCapsaRedactor;
+
+/// A block of the log history: the UTF-8 lines in the Capsa log format, as a gzip member once compressed.
+struct FCapsaHistoryBlock
+{
+	FSharedBuffer Data; ///< Immutable, shared between the ring and every snapshot that contains the block. Null while the block is being formatted
+	TSharedPtr<const FCapsaLogChunk, ESPMode::ThreadSafe> PendingLines; ///< The lines as they were logged, until the block is formatted
+	int32 UncompressedSize = 0; ///< Size of the UTF-8 lines in bytes, estimated until the block is formatted
+	int32 NumLines = 0;
+	double FirstTime = 0.0; ///< Capture time of the first line, as a Unix timestamp
+	double LastTime = 0.0; ///< Capture time of the last line, as a Unix timestamp
+	bool bCompressed = false; ///< Whether Data is gzip compressed, false for blocks that are still waiting for, or being, compressed
+};
+
+/// The contents of a FCapsaHistoryRing at the time of the snapshot, oldest block first. Every block is formatted.
+struct CAPSACORE_API FCapsaHistorySnapshot
+{
+public:
+	/// Whether the snapshot contains no lines.
+	/// @return bool True if there are no blocks.
+	bool IsEmpty() const;
+
+	/// The total size of the blocks as held in memory.
+	/// @return int64 The size in bytes.
+	int64 GetSize() const;
+
+	/// The total number of lines in the snapshot.
+	/// @return int32 The number of lines.
+	int32 GetNumLines() const;
+
+	/// Decompresses the snapshot into a single string, fe. to show it in a bug reporter. Redacted if Redactor is set.
+	/// @return FString The lines, in the Capsa log format.
+	FString ToString() const;
+
+	/// Writes the snapshot as a gzip file. Compressed blocks are written as they are, gzip members can be concatenated. If Redactor is set, every
+	/// block is decompressed, redacted and compressed again instead.
+	/// @param FilePath The file to write, conventionally ending in .log.gz.
+	/// @return bool True if the file was written.
+	bool SaveToFile(const FString& FilePath) const;
+
+	TArray<FCapsaHistoryBlock> Blocks;
+
+	/// The history keeps the lines as they were logged, when set they are redacted as they are exported, see FCapsaHistoryRing::SetRedactor().
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> Redactor;
+};
+
+/// Keeps the most recent lines in memory as compressed blocks, independent of uploading, so the context of a bug or ensure is available instantly.
+///
+/// Lines are appended to a staging block as they were logged, structured records without rendering their message. Once the staging block reaches
+/// the block size it is sealed, then formatted in the Capsa log format and compressed on the task graph, so logging threads only pay for a copy.
+/// The oldest blocks are evicted while the ring holds more than its capacity. Snapshots share the sealed blocks instead of copying them.
+/// All functions are thread-safe.
+class CAPSACORE_API FCapsaHistoryRing : public TSharedFromThis<FCapsaHistoryRing, ESPMode::ThreadSafe>
+{
+public:
+	/// @param InCapacity The maximum size of the sealed blocks in bytes, see UCapsaSettings::GetHistorySizeMB().
+	/// @param InBlockSize The uncompressed size at which the staging block is sealed, see UCapsaSettings::GetHistoryBlockSizeKB().
+	FCapsaHistoryRing(int64 InCapacity, int32 InBlockSize);
+	~FCapsaHistoryRing();
+
+	/// Appends a line in the Capsa log format.
+	/// @param Data The message.
+	/// @param Verbosity The verbosity of the line.
+	/// @param Category The category of the line.
+	/// @param Time The capture time, as a Unix timestamp.
+	void AddLine(const TCHAR* Data, ELogVerbosity::Type Verbosity, const FName& Category, double Time);
+
+	/// Appends a structured record (UE_LOGFMT). Its message is rendered when the block is formatted.
+	/// @param Record The record, its fields are copied.
+	/// @param Time The capture time, as a Unix timestamp.
+	void AddRecord(const UE::FLogRecord& Record, double Time);
+
+	/// Takes a snapshot of the ring. Seals the staging block first, and formats the blocks that are still waiting for the task graph on the calling
+	/// thread, outside the lock.
+	/// @return FCapsaHistorySnapshot The snapshot.
+	FCapsaHistorySnapshot Snapshot();
+
+	/// Sets the redactor that snapshots redact their lines with when they are exported, see UCapsaSettings::GetRedactLogs().
+	/// @param InRedactor The redactor, null to export the lines as they were logged.
+	void SetRedactor(TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> InRedactor);
+
+private:
+	/// Counts a line appended to the staging block, and seals it once it reaches the block size. Must be called with Lock held.
+	/// @param EstimatedSize The estimated size of the formatted line in bytes.
+	/// @param Time The capture time, as a Unix timestamp.
+	void OnLineAdded(int32 EstimatedSize, double Time);
+
+	/// Seals the staging block and starts formatting and compressing it. Must be called with Lock held.
+	void SealStaging();
+
+	/// Replaces the lines of the block with their formatted and compressed version, if it was not evicted yet.
+	/// @param Sequence The sequence number of the block.
+	/// @param Data The formatted lines, as UTF-8.
+	/// @param CompressedData Data as a gzip member, null if compression failed.
+	void OnBlockFormatted(uint64 Sequence, FSharedBuffer Data, FSharedBuffer CompressedData);
+
+	/// Evicts the oldest blocks while the ring is over capacity. Must be called with Lock held.
+	void Evict();
+
+	const int64 Capacity;
+	const int32 BlockSize;
+
+	mutable FCriticalSection Lock;
+
+	/// Sealed blocks, oldest first. The front block has sequence number FrontSequence.
+	TDeque<FCapsaHistoryBlock> Blocks;
+	uint64 FrontSequence = 0;
+	int64 BlocksSize = 0; ///< Attributed to ECapsaMemoryStage::History
+
+	FCapsaLogChunk Staging; ///< The lines of the staging block as they were logged
+	FCapsaHistoryBlock StagingBlock; ///< Line count, times and estimated size of the staging block
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> Redactor; ///< Handed to every snapshot
+};
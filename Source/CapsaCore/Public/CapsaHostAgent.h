@@ -0,0 +1,150 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CapsaLogChunk.h"
+#include "Memory/SharedBuffer.h"
+
+struct FCapsaEncodedChunk;
+
+/// Framing between game instances and the Capsa host agent (see UCapsaHostAgentCommandlet), over a Unix domain socket.
+///
+/// Every frame is a header, the payload size as uint32 and the frame type as uint8, followed by the payload. Both ends run on the same host,
+/// so integers are in native byte order. Strings are a uint32 byte count followed by UTF-8.
+///   Session  <LogID><Token><ChunkEndpoint>             Sent after connecting and whenever the instance authenticates. Chunks that follow belong to it.
+///   Chunk    <uint8 Lane><uint64 ChunkSequence><LineSequences><UTF-8 Log>
+///            A formatted, uncompressed log chunk, see FCapsaEncodedChunk. The Log is the rest of the payload. The chunk sequence is allocated by the
+///            instance from the session, so chunks uploaded by the agent and by the instance itself share a single sequence.
+namespace CapsaHostAgent
+{
+enum class EFrameType : uint8
+{
+	Session = 1,
+	Chunk = 2,
+};
+
+inline constexpr int32 FrameHeaderSize = sizeof(uint32) + sizeof(uint8);
+inline constexpr int32 MaxFrameSize = 64 * 1024 * 1024; ///< Larger frames close the connection, the stream is assumed corrupt
+
+/// Starts a frame, leaving room for the header.
+/// @param Frame The buffer to write the frame to, emptied first.
+/// @param Type The frame type.
+CAPSACORE_API void BeginFrame(TArray<uint8>& Frame, EFrameType Type);
+
+/// Completes the header of a frame started with BeginFrame().
+/// @param Frame The frame.
+CAPSACORE_API void EndFrame(TArray<uint8>& Frame);
+
+/// Appends a string to a frame.
+/// @param Frame The frame.
+/// @param String The string to append.
+CAPSACORE_API void AppendString(TArray<uint8>& Frame, FStringView String);
+
+/// Reads a string from a frame payload.
+/// @param Data The read position, advanced past the string.
+/// @param End The end of the payload.
+/// @param OutString Receives the string.
+/// @return bool False if the payload ends within the string.
+CAPSACORE_API bool ReadString(const uint8*& Data, const uint8* End, FString& OutString);
+}
+
+/// Hands formatted log chunks to the Capsa host agent, which batches, compresses and uploads them for every instance on the host, instead of every
+/// instance compressing and holding its own HTTP connections. See UCapsaSettings::GetUseHostAgent() and FCapsaHostAgentSink.
+///
+/// The instance still authenticates itself and sends its metadata, so its LogID is preserved, and tells the agent which session its chunks belong to.
+/// Writes never block the game thread: if the agent is not running or falls behind, SendChunk() returns false, so the caller can upload the chunk
+/// itself. A frame the socket only takes part of is finished by later writes or Tick(), before any other frame. Only blocking writes, at shutdown,
+/// wait for the socket, bounded by a short send timeout. Connecting is retried at most once per second.
+/// The agent discards a frame it did not receive whole. Chunks whose frame was not written whole when the connection closes are kept, and handed
+/// back through TakeUnsentChunks() so the caller can upload them itself.
+///
+/// Only supported on Linux. Must only be used from the game thread.
+class CAPSACORE_API FCapsaHostAgentClient
+{
+public:
+	/// A chunk the agent did not receive before the connection closed.
+	struct FUnsentChunk
+	{
+		uint64 ChunkID = 0;
+		ECapsaLogLane Lane = ECapsaLogLane::Bulk;
+		uint16 Stream = 0;
+		FString LineSequences;
+		FSharedBuffer Log; ///< The UTF-8 Log of the segment
+		int32 NumLines = 0; ///< The number of lines in Log
+	};
+
+	/// @param InSocketPath The path of the agent's Unix domain socket, see UCapsaSettings::GetHostAgentSocketPath().
+	explicit FCapsaHostAgentClient(const FString& InSocketPath);
+	~FCapsaHostAgentClient();
+
+	/// Whether the host agent can be used on this platform.
+	/// @return bool True on Linux.
+	static bool IsSupported();
+
+	/// Sets the session chunks are uploaded to, and sends it to the agent unless it is the current session already.
+	/// @param LogID The LogID of the instance.
+	/// @param Token The auth token of the session.
+	/// @param ChunkEndpoint The URL log chunks are posted to.
+	void SetSession(const FString& LogID, const FString& Token, const FString& ChunkEndpoint);
+
+	/// Sends a segment of a formatted log chunk to the agent. If only part of it is written, the segment is kept until it is, see TakeUnsentChunks().
+	/// @param Chunk The chunk.
+	/// @param Segment The index of the segment in FCapsaEncodedChunk::Segments.
+	/// @param ChunkSequence The X-Capsa-Chunk-Sequence of the segment, see UCapsaCoreSubsystem::AllocateChunkSequence().
+	/// @param bBlocking Whether to wait for the socket, bounded by the send timeout. Only used at shutdown.
+	/// @return bool False if there is no session, or the agent could not take the chunk without blocking, in which case the caller should upload it.
+	bool SendChunk(const FCapsaEncodedChunk& Chunk, int32 Segment, uint64 ChunkSequence, bool bBlocking = false);
+
+	/// Continues writing a frame the socket only took part of, without blocking. Called every tick.
+	void Tick();
+
+	/// Takes the chunks SendChunk() accepted, but whose frame was not written whole before the connection closed. The caller should upload them.
+	/// Chunks that are still unsent when the client is destroyed are counted as dropped.
+	/// @return TArray<FUnsentChunk> The chunks, in the order they were sent.
+	TArray<FUnsentChunk> TakeUnsentChunks();
+
+private:
+	/// Connects to the agent and sends the session, unless a connection attempt failed within the last second.
+	bool Connect();
+
+	void Disconnect();
+
+	/// Writes a frame after PendingWrite, keeping the part the socket does not take in PendingWrite.
+	/// @param Frame The frame to write.
+	/// @param bBlocking Whether to wait for the socket, bounded by the send timeout.
+	/// @param bQueueIfFull Whether to queue the whole frame in PendingWrite if the socket takes none of it, rather than failing.
+	/// @param OutQueued Receives the number of bytes of the frame left in PendingWrite.
+	/// @return bool False if the frame was not written or queued, or the connection failed.
+	bool Write(TConstArrayView<uint8> Frame, bool bBlocking, bool bQueueIfFull, int64& OutQueued);
+
+	/// Writes as much of PendingWrite as the socket takes.
+	/// @param bBlocking Whether to wait for the socket, bounded by the send timeout.
+	/// @return bool True if nothing is pending anymore.
+	bool FlushPendingWrite(bool bBlocking);
+
+	/// Sends bytes until the socket is full, or disconnects if the connection failed.
+	/// @param Data The bytes to send.
+	/// @param Num The number of bytes.
+	/// @param bBlocking Whether to wait for the socket, bounded by the send timeout.
+	/// @param OutWritten Receives the number of bytes the socket took.
+	/// @return bool False if the connection failed and was closed.
+	bool Send(const uint8* Data, int64 Num, bool bBlocking, int64& OutWritten);
+
+	const FString SocketPath;
+	int32 Socket = -1;
+	double NextConnectTime = 0.0;
+
+	TArray<uint8> SessionFrame; ///< Sent on every connect, empty until SetSession()
+	TArray<uint8> Scratch; ///< Reused to build chunk frames
+	TArray<uint8> PendingWrite; ///< The rest of the frames the socket did not take yet, lost if the connection closes before it is written
+
+	/// A chunk whose frame is partly in PendingWrite.
+	struct FPendingChunk
+	{
+		int64 End = 0; ///< The offset in PendingWrite the frame ends at
+		FUnsentChunk Chunk;
+	};
+	TArray<FPendingChunk> PendingChunks; ///< In the order of their frames in PendingWrite
+	TArray<FUnsentChunk> UnsentChunks; ///< The pending chunks of closed connections, see TakeUnsentChunks()
+};
@@ -0,0 +1,29 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCapsaLogChunk;
+
+/// Writes log lines as JSON-lines, one object per line, fe. for a container log collector:
+///   {"time":"2024-01-31T12:00:00.123Z","level":"Error","category":"LogNet","message":"Connection lost","logId":"..."}
+/// Structured lines also carry their fields as "fields", when fields are included.
+///
+/// Encodes straight from the captured lines to UTF-8, with a hand-rolled escaper, instead of building a FJsonObject per line.
+namespace CapsaJsonLines
+{
+/// Appends Text as the contents of a JSON string, escaping quotes, backslashes and control characters, and encoding the rest as UTF-8.
+/// @param Dest The array to append to.
+/// @param Text The text to escape.
+/// @param TextLen The number of code units in Text.
+CAPSACORE_API void AppendEscaped(TArray<uint8>& Dest, const TCHAR* Text, int32 TextLen);
+
+/// Appends every line of the Chunk, in the order they were captured.
+/// @param Dest The array to append to.
+/// @param Chunk The lines to append.
+/// @param bIncludeStructuredFields Whether to add the fields of structured lines.
+/// @param LogID The LogID added to every line, omitted if empty.
+/// @return int32 The number of lines appended.
+CAPSACORE_API int32 AppendChunk(TArray<uint8>& Dest, const FCapsaLogChunk& Chunk, bool bIncludeStructuredFields, FStringView LogID);
+}
@@ -0,0 +1,143 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/BinarySearch.h"
+#include "CapsaCoreStats.h"
+#include "Logging/StructuredLog.h"
+#include "Misc/BufferedOutputDevice.h"
+
+/// A structured log record (UE_LOGFMT) captured without rendering its message.
+struct CAPSACORE_API FCapsaStructuredLine
+{
+public:
+	/// Copies the record, taking ownership of its fields, which usually live on the logging thread's stack.
+	/// @param InRecord The record to copy.
+	/// @param InLineIndex The number of text lines captured before this record, in the same chunk.
+	/// @param InTime The capture time, as a Unix timestamp.
+	FCapsaStructuredLine(const UE::FLogRecord& InRecord, int32 InLineIndex, double InTime);
+
+	/// The size of the copied fields in bytes.
+	/// @return int64 The size of the fields.
+	int64 GetFieldsSize() const;
+
+	UE::FLogRecord Record; ///< The record, with owned fields. The format and text key point to static data of the log point.
+	int32 LineIndex; ///< Position in FCapsaLogChunk::Lines this record was captured before, used to keep capture order when formatting
+	double Time; ///< Capture time as a Unix timestamp, matching FBufferedLine::Time
+	FString RedactedText; ///< When set, formatted as the message of the line instead of the record, see FCapsaRedactor::RedactChunk()
+	uint16 Stream = 0; ///< The log stream the record was logged from, see CapsaLogStreams
+};
+
+/// The lane a chunk was flushed from by the output device, see UCapsaSettings::GetUsePriorityLane().
+enum class ECapsaLogLane : uint8
+{
+	Bulk, ///< Large chunks, flushed every MaxLogLinesBetweenLogFlushes lines or MaxTimeBetweenLogFlushes seconds
+	Priority, ///< Small chunks of lines at or above PriorityVerbosity, flushed within PriorityFlushDeadline seconds
+};
+
+/// The capture sequence numbers of the lines in a chunk, as inclusive ranges in capture order.
+/// Both lanes draw from the same counter, so a bulk chunk has a gap wherever a line went to the priority lane, and the lanes can be merged back into
+/// capture order by sequence number.
+struct CAPSACORE_API FCapsaLineSequences
+{
+public:
+	/// Appends the sequence number of the next line. Sequence numbers must increase.
+	/// @param Sequence The sequence number of the line.
+	void Add(uint64 Sequence);
+
+	/// Removes the sequence numbers of the oldest lines.
+	/// @param Num The number of lines to remove.
+	void RemoveFirst(int32 Num);
+
+	/// Whether no line was added.
+	/// @return bool True if there are no ranges.
+	bool IsEmpty() const;
+
+	/// Formats the ranges, fe. "100-340,342-500".
+	/// @return FString The comma separated ranges.
+	FString ToString() const;
+
+	TArray<TPair<uint64, uint64>, TInlineAllocator<4>> Ranges; ///< First and last sequence number of every run of consecutive lines
+};
+
+class FCapsaTemplateDictionary;
+
+/// Options for turning a FCapsaLogChunk into the log that is uploaded.
+struct FCapsaLogFormatOptions
+{
+	/// Append the fields of structured lines as a JSON object, see UCapsaSettings::GetIncludeStructuredFields().
+	bool bIncludeStructuredFields = false;
+
+	/// When set, the uploaded log is template encoded against this session dictionary, see CapsaTemplateEncoder.
+	TSharedPtr<FCapsaTemplateDictionary, ESPMode::ThreadSafe> TemplateDictionary;
+
+	/// Chunks with more text lines are split into segments of this many lines, which are compressed in parallel, see UCapsaSettings::GetCompressionSegmentLines().
+	/// 0 never splits.
+	int32 CompressionSegmentLines = 0;
+
+	/// The maximum number of segments compressed at the same time, including the calling thread. 0 uses all task graph workers.
+	int32 MaxCompressionWorkers = 0;
+};
+
+/// The lines flushed from the output device in one go, which are formatted, compressed and sent as a single log chunk.
+struct CAPSACORE_API FCapsaLogChunk
+{
+public:
+	/// Total number of lines in the chunk, text and structured.
+	/// @return int32 The number of lines.
+	int32 Num() const;
+
+	/// Whether the chunk contains no lines at all.
+	/// @return bool True if there are no lines.
+	bool IsEmpty() const;
+
+	/// Moves the lines of every other stream than Stream out into chunks of their own, keeping capture order and sequence numbers.
+	/// The memory accounting stays with this chunk. Does nothing if all lines belong to Stream.
+	/// @param OutStreamChunks Receives a chunk per other stream, with a newly allocated ChunkID.
+	void SplitStreams(TArray<FCapsaLogChunk>& OutStreamChunks);
+
+	/// Visits all lines in the order they were captured.
+	/// @param TextFunc Called as TextFunc(const FBufferedLine&) for every text line.
+	/// @param StructuredFunc Called as StructuredFunc(const FCapsaStructuredLine&) for every structured line.
+	template<typename TextFuncType, typename StructuredFuncType>
+	void ForEachLine(TextFuncType&& TextFunc, StructuredFuncType&& StructuredFunc) const
+	{
+		ForEachLineInRange(0, Lines.Num(), Forward<TextFuncType>(TextFunc), Forward<StructuredFuncType>(StructuredFunc));
+	}
+
+	/// Visits the text lines in [BeginLine, EndLine), and the structured lines captured between them, in the order they were captured.
+	/// Structured lines captured after the last text line are visited when EndLine is Lines.Num().
+	/// @param BeginLine Index of the first text line.
+	/// @param EndLine Index after the last text line.
+	/// @param TextFunc Called as TextFunc(const FBufferedLine&) for every text line.
+	/// @param StructuredFunc Called as StructuredFunc(const FCapsaStructuredLine&) for every structured line.
+	template<typename TextFuncType, typename StructuredFuncType>
+	void ForEachLineInRange(int32 BeginLine, int32 EndLine, TextFuncType&& TextFunc, StructuredFuncType&& StructuredFunc) const
+	{
+		int32 StructuredIndex = Algo::LowerBoundBy(StructuredLines, BeginLine, &FCapsaStructuredLine::LineIndex);
+		const int32 LastLine = EndLine == Lines.Num() ? EndLine : EndLine - 1;
+		for (int32 LineIndex = BeginLine; LineIndex <= LastLine; ++LineIndex)
+		{
+			// Structured lines captured before this text line
+			for (; StructuredIndex < StructuredLines.Num() && StructuredLines[StructuredIndex].LineIndex <= LineIndex; ++StructuredIndex)
+			{
+				StructuredFunc(StructuredLines[StructuredIndex]);
+			}
+
+			if (LineIndex < EndLine)
+			{
+				TextFunc(Lines[LineIndex]);
+			}
+		}
+	}
+
+	uint64 ChunkID = 0; ///< Identifies the chunk in Capsa trace events, see CapsaTrace::AllocateChunkID()
+	ECapsaLogLane Lane = ECapsaLogLane::Bulk;
+	uint16 Stream = 0; ///< The log stream, which decides the session the chunk is uploaded to, see CapsaLogStreams
+	FCapsaLineSequences LineSequences; ///< Capture sequence numbers of the lines, empty for chunks that were not captured by the output device
+	TArray<FBufferedLine> Lines; ///< Lines captured as text
+	TArray<uint16> LineStreams; ///< The stream of every text line, until SplitStreams(). Empty if every line belongs to Stream
+	TArray<FCapsaStructuredLine> StructuredLines; ///< Lines captured as structured records, sorted by LineIndex
+	FCapsaLiveBytes Bytes; ///< Memory held by the lines, see Capsa.MemReport
+};
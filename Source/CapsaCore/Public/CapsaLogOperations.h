@@ -3,35 +3,108 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Memory/SharedBuffer.h"
+
+class FCbObject;
+struct FCapsaLogChunk;
+struct FCapsaLogFormatOptions;
 
 namespace CapsaLogOperations
 {
 inline FString DefaultUncompressedLogExtension = TEXT(".capsa.log"); ///< Default log extension for uncompressed logs
 inline FString DefaultCompressedLogExtension = TEXT(".capsa.log.zlib"); ///< Default log extension for compressed logs
 
+/// Appends the prefix of a log line, with the format:
+/// [Timestamp][LogVerbosity][LogCategory]: 
+/// @param Log The Log to append to.
+/// @param LineTime The time the line was captured, as a Unix timestamp.
+/// @param Verbosity The verbosity of the line.
+/// @param Category The category of the line.
+void AppendLinePrefix(FString& Log, double LineTime, ELogVerbosity::Type Verbosity, const FName& Category);
+
+/// Appends the time and verbosity part of a log line prefix, with the format:
+/// [Timestamp][LogVerbosity]
+/// @param Log The Log to append to.
+/// @param LineTime The time the line was captured, as a Unix timestamp.
+/// @param Verbosity The verbosity of the line.
+void AppendLineTimeAndVerbosity(FString& Log, double LineTime, ELogVerbosity::Type Verbosity);
+
+/// Appends the fields of a structured log record as a compact JSON object, fe. {"Field":1}.
+/// @param Log The Log to append to.
+/// @param Fields The fields of the record.
+void AppendStructuredFields(FString& Log, const FCbObject& Fields);
+
 /// Builds a Log string from the Buffer, with the format:
 /// [Timestamp][LogVerbosity][LogCategory]: LogData\n
+/// @param Buffer The lines to format.
+/// @param ChunkID The chunk the Buffer belongs to, used for tracing. See CapsaTrace::AllocateChunkID().
 /// @return FString The generated Log from the Buffer.
-FString MakeLogString (const TArray<FBufferedLine>& Buffer);
+FString MakeLogString (const TArray<FBufferedLine>& Buffer, uint64 ChunkID = 0);
+
+/// Builds a Log string from all lines in the Chunk, in the order they were captured, with the same format as MakeLogString(Buffer).
+/// Messages of structured lines are rendered here, rather than when they were logged.
+/// @param Chunk The chunk to format.
+/// @param bIncludeStructuredFields Whether to append the fields of structured lines as a JSON object, fe. "Message {"Field":1}".
+/// @return FString The generated Log from the Chunk.
+FString MakeLogString(const FCapsaLogChunk& Chunk, bool bIncludeStructuredFields = false);
+
+/// Builds a Log string from a range of the Chunk, see FCapsaLogChunk::ForEachLineInRange().
+/// @param Chunk The chunk to format.
+/// @param bIncludeStructuredFields Whether to append the fields of structured lines as a JSON object.
+/// @param BeginLine Index of the first text line.
+/// @param EndLine Index after the last text line.
+/// @return FString The generated Log from the range.
+FString MakeLogString(const FCapsaLogChunk& Chunk, bool bIncludeStructuredFields, int32 BeginLine, int32 EndLine);
 
 /// Uses MakeLogString() to generate the Log. Then compresses said log using GZip, ZLib or Oodle compression.
 /// @param UncompressedLog The reference to the Uncompressed Log FString to write to.
 /// @param BinaryData The reference to the Binary Array to write to.
+/// @param ChunkID The chunk the log belongs to, used for tracing. See CapsaTrace::AllocateChunkID().
 /// @return bool True if compression was successful.
-bool MakeCompressedLogBinary(const FString& UncompressedLog, TArray<uint8>& BinaryData);
+bool MakeCompressedLogBinary(const FString& UncompressedLog, TArray<uint8>& BinaryData, uint64 ChunkID = 0);
+
+/// Compresses an already UTF-8 encoded Log with ZLib.
+/// @param Utf8Log The Log to compress.
+/// @param BinaryData Receives the compressed Log.
+/// @param ChunkID The chunk the log belongs to, used for tracing. See CapsaTrace::AllocateChunkID().
+/// @return bool True if compression was successful.
+bool CompressUtf8Log(TConstArrayView<uint8> Utf8Log, TArray<uint8>& BinaryData, uint64 ChunkID = 0);
+
+/// Formats the Chunk as the UTF-8 Log to upload, and compresses it if requested. When compressing, chunks with more than
+/// FormatOptions.CompressionSegmentLines text lines are split into segments, which are formatted and compressed in parallel on the task graph.
+/// Every segment is a complete zlib stream, and is uploaded as its own log chunk, in order. Template encoded chunks are never split, as their
+/// template definitions must arrive before the lines using them.
+/// @param Chunk The chunk to format.
+/// @param FormatOptions How to format the Chunk, and how to split it.
+/// @param bCompress Whether to compress the segments.
+/// @param OutLogs Receives the UTF-8 Log of every segment.
+/// @param OutCompressedLogs Receives the compressed Log of every segment, if bCompress.
+/// @return bool True if every segment was compressed successfully.
+CAPSACORE_API bool EncodeLogSegments(const FCapsaLogChunk& Chunk, const FCapsaLogFormatOptions& FormatOptions, bool bCompress, TArray<FSharedBuffer>& OutLogs,
+	TArray<FSharedBuffer>& OutCompressedLogs);
 
 /// Attempts to save the provided Log String to a file with the provided FileName.
 /// Uses the ProjectLogDir folder to output the file to.
 /// @param LogToSave The Source FString Log to save to file.
 /// @param FileName The name of the file to save.
 /// @param FileExtension The file extension to use for the file including leading comma.
+/// @param ChunkID The chunk the log belongs to, used for tracing. See CapsaTrace::AllocateChunkID().
+/// @return bool True if successfully written to file, otherwise false.
+bool SaveStringToFile(const FString& LogToSave, const FString& FileName, const FString& FileExtension, uint64 ChunkID = 0);
+
+/// Appends an already UTF-8 encoded Log to the file SaveStringToFile() writes to.
+/// @param Utf8Log The Log to append.
+/// @param FileName The name of the file to append to.
+/// @param FileExtension The file extension to use for the file including leading comma.
+/// @param ChunkID The chunk the log belongs to, used for tracing. See CapsaTrace::AllocateChunkID().
 /// @return bool True if successfully written to file, otherwise false.
-bool SaveStringToFile(const FString& LogToSave, const FString& FileName, const FString& FileExtension);
+bool AppendUtf8ToFile(TConstArrayView<uint8> Utf8Log, const FString& FileName, const FString& FileExtension, uint64 ChunkID = 0);
 
 /// Attempts to save the provided BinaryData to a file with the provided FileName. Uses the ProjectLogDir folder to output the file to.
 /// @param BinaryData The Source Binary Array to save to file.
 /// @param FileName The name of the file to save.
 /// @param FileExtension The file extension to use for the file including leading comma.
+/// @param ChunkID The chunk the log belongs to, used for tracing. See CapsaTrace::AllocateChunkID().
 /// @return bool True if successfully written to file, otherwise false.
-bool SaveBinaryToFile(TArray<uint8> BinaryData, const FString& FileName, const FString& FileExtension);
+bool SaveBinaryToFile(TConstArrayView<uint8> BinaryData, const FString& FileName, const FString& FileExtension, uint64 ChunkID = 0);
 }
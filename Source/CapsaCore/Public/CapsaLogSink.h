@@ -0,0 +1,87 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CapsaCoreStats.h"
+#include "CapsaLogChunk.h"
+#include "Memory/SharedBuffer.h"
+
+/// The representations of a chunk a sink consumes. The upload pipeline only produces what at least one sink of the chunk asks for.
+enum class ECapsaSinkInputs : uint8
+{
+	None = 0,
+	Log = 1 << 0, ///< The UTF-8 Log in the upload format, template encoded if enabled. See FCapsaEncodedChunk::Segments.
+	Compressed = 1 << 1, ///< The zlib compressed segments of the Log. See FCapsaEncodedChunk::CompressedSegments.
+	Readable = 1 << 2, ///< The UTF-8 Log in the readable format. See FCapsaEncodedChunk::GetReadableSegments().
+	Lines = 1 << 3, ///< The redacted lines of the chunk. See FCapsaEncodedChunk::Lines.
+};
+ENUM_CLASS_FLAGS(ECapsaSinkInputs);
+
+/// A chunk after the Format stage of the FCapsaUploadPipeline: encoded once, and handed to every sink of the chunk.
+///
+/// The buffers are immutable and shared, sinks that hand them on, fe. as a request body, keep a reference instead of copying them.
+/// Only the inputs requested by the sinks of the chunk are set.
+struct CAPSACORE_API FCapsaEncodedChunk
+{
+public:
+	/// The readable Log, which is the Log itself unless it is template encoded.
+	/// @return TConstArrayView<FSharedBuffer> The readable segments, appending them in order gives the whole Log.
+	TConstArrayView<FSharedBuffer> GetReadableSegments() const;
+
+	/// The number of segments that are uploaded as separate log chunks.
+	/// @return int32 The number of compressed segments if the chunk was compressed, otherwise the number of Log segments.
+	int32 GetNumSegments() const;
+
+	/// The number of lines in a segment, fe. to count them as dropped if the segment cannot be delivered.
+	/// @param Segment The index of the segment.
+	/// @return int32 The number of lines, 0 if the chunk was not formatted.
+	int32 GetSegmentNumLines(int32 Segment) const;
+
+	uint64 ChunkID = 0; ///< Identifies the chunk in Capsa trace events
+	FString LogID; ///< The LogID of the session when the chunk was enqueued, names the files the chunk is written to
+	ECapsaLogLane Lane = ECapsaLogLane::Bulk;
+	uint16 Stream = 0; ///< The log stream of the chunk, which decides the session it is uploaded to, see CapsaLogStreams
+	FString LineSequences; ///< The capture sequence numbers of the lines, see FCapsaLineSequences::ToString()
+	bool bFailed = false; ///< Whether formatting or compressing failed, in which case no sink is called
+
+	TArray<FSharedBuffer> Segments; ///< The UTF-8 Log of every segment, see CapsaLogOperations::EncodeLogSegments()
+	TArray<FSharedBuffer> CompressedSegments; ///< The compressed Log of every segment, every segment is a complete zlib stream
+	TArray<int32> SegmentNumLines; ///< The number of lines in every segment, set whenever Segments were encoded
+	FSharedBuffer Readable; ///< The readable UTF-8 Log, only set when Segments are template encoded
+	TSharedPtr<const FCapsaLogChunk, ESPMode::ThreadSafe> Lines; ///< The lines, after redaction
+
+	FCapsaLiveBytes FormattedBytes;
+	FCapsaLiveBytes CompressedBytes;
+};
+
+/// A destination for log chunks, fe. the Capsa server, a file or a local agent. Register sinks with UCapsaCoreSubsystem::RegisterSink().
+///
+/// Every sink of a chunk is handed the same FCapsaEncodedChunk, in the order the chunks were enqueued. Sinks run on the Deliver stage of the
+/// FCapsaUploadPipeline, one chunk at a time, unless IsGameThreadSink() returns true. Consume() should not block for long, it holds up every
+/// chunk that follows.
+class ICapsaLogSink
+{
+public:
+	virtual ~ICapsaLogSink() = default;
+
+	/// The name of the sink, used in log messages.
+	/// @return const TCHAR* The name.
+	virtual const TCHAR* GetName() const = 0;
+
+	/// The representations of a chunk the sink consumes.
+	/// @return ECapsaSinkInputs The inputs, the pipeline skips everything no sink asks for.
+	virtual ECapsaSinkInputs GetInputs() const = 0;
+
+	/// Whether Consume() must be called on the game thread, fe. to start HTTP requests.
+	/// @return bool True to be called from UCapsaCoreSubsystem's upload tick, false to be called on the Deliver stage.
+	virtual bool IsGameThreadSink() const
+	{
+		return false;
+	}
+
+	/// Consumes a chunk.
+	/// @param Chunk The chunk. Must not be kept, keep references to its buffers instead.
+	/// @param bBlocking Whether the chunk must be delivered before returning, during shutdown. Always false for sinks that are not game thread sinks.
+	virtual void Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking) = 0;
+};
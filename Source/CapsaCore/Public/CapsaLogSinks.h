@@ -0,0 +1,95 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CapsaLogSink.h"
+
+class FCapsaHostAgentClient;
+class UCapsaCoreSubsystem;
+
+/// Uploads every segment of a chunk to the Capsa server, see UCapsaCoreSubsystem::UploadLogSegment().
+class CAPSACORE_API FCapsaHttpSink : public ICapsaLogSink
+{
+public:
+	/// @param InSubsystem The subsystem whose session the chunks are uploaded to.
+	/// @param bInCompressed Whether to upload the compressed segments, see UCapsaSettings::GetUseCompression().
+	FCapsaHttpSink(UCapsaCoreSubsystem* InSubsystem, bool bInCompressed);
+
+	// Begin ICapsaLogSink
+	virtual const TCHAR* GetName() const override;
+	virtual ECapsaSinkInputs GetInputs() const override;
+	virtual bool IsGameThreadSink() const override;
+	virtual void Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking) override;
+	// End ICapsaLogSink
+
+private:
+	TWeakObjectPtr<UCapsaCoreSubsystem> Subsystem;
+	const bool bCompressed;
+};
+
+/// Writes chunks to the project log directory, see UCapsaSettings::GetWriteToDiskPlain() and UCapsaSettings::GetWriteToDiskCompressed().
+/// The readable Log is appended to <LogID>.capsa.log, every compressed segment is written to its own file, as every segment is a separate zlib stream.
+class CAPSACORE_API FCapsaFileSink : public ICapsaLogSink
+{
+public:
+	/// @param bInWritePlain Whether to append the readable Log.
+	/// @param bInWriteCompressed Whether to write the compressed segments.
+	FCapsaFileSink(bool bInWritePlain, bool bInWriteCompressed);
+
+	// Begin ICapsaLogSink
+	virtual const TCHAR* GetName() const override;
+	virtual ECapsaSinkInputs GetInputs() const override;
+	virtual void Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking) override;
+	// End ICapsaLogSink
+
+private:
+	const bool bWritePlain;
+	const bool bWriteCompressed;
+};
+
+/// Writes chunks to stdout as JSON-lines, fe. for the log collector of a container cluster, see CapsaJsonLines and UCapsaSettings::GetWriteToStdout().
+/// The lines are encoded straight from the captured lines, and every chunk is written with a single write.
+class CAPSACORE_API FCapsaStdoutSink : public ICapsaLogSink
+{
+public:
+	/// @param bInIncludeStructuredFields Whether to add the fields of structured lines, see UCapsaSettings::GetIncludeStructuredFields().
+	explicit FCapsaStdoutSink(bool bInIncludeStructuredFields);
+
+	// Begin ICapsaLogSink
+	virtual const TCHAR* GetName() const override;
+	virtual ECapsaSinkInputs GetInputs() const override;
+	virtual void Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking) override;
+	// End ICapsaLogSink
+
+	/// Writes to stdout, retrying partial writes.
+	/// @param Data The bytes to write.
+	/// @return bool False if stdout is closed or failed.
+	static bool Write(TConstArrayView<uint8> Data);
+
+private:
+	const bool bIncludeStructuredFields;
+	TArray<uint8> Scratch; ///< Reused to encode chunks, sinks consume one chunk at a time
+};
+
+/// Hands chunks to the host agent over its Unix domain socket, see FCapsaHostAgentClient. Segments the agent does not accept, fe. because it fell
+/// behind and writing would block the game thread, are uploaded uncompressed by the subsystem instead, as are those it did not receive whole before
+/// the connection closed.
+class CAPSACORE_API FCapsaHostAgentSink : public ICapsaLogSink
+{
+public:
+	/// @param InClient The connection to the agent.
+	/// @param InSubsystem The subsystem that uploads the segments the agent does not accept.
+	FCapsaHostAgentSink(TSharedRef<FCapsaHostAgentClient, ESPMode::ThreadSafe> InClient, UCapsaCoreSubsystem* InSubsystem);
+
+	// Begin ICapsaLogSink
+	virtual const TCHAR* GetName() const override;
+	virtual ECapsaSinkInputs GetInputs() const override;
+	virtual bool IsGameThreadSink() const override;
+	virtual void Consume(const FCapsaEncodedChunk& Chunk, bool bBlocking) override;
+	// End ICapsaLogSink
+
+private:
+	TSharedRef<FCapsaHostAgentClient, ESPMode::ThreadSafe> Client;
+	TWeakObjectPtr<UCapsaCoreSubsystem> Subsystem;
+};
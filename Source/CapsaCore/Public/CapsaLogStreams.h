@@ -0,0 +1,63 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+
+/// Log streams split the lines of one process into several Capsa sessions, fe. one per Play In Editor instance, or one per match of a multi-match
+/// dedicated server. Lines are tagged with the stream of the thread that logged them, see UCapsaSettings::GetUseWorldStreams().
+///
+/// Streams are identified by a small ID, so tagging a line does not copy its name. IDs are never reused within a process.
+namespace CapsaLogStreams
+{
+/// The stream of lines that are not logged from a world with a stream of its own, uploaded to the session of the process.
+constexpr uint16 DefaultStream = 0;
+
+/// The maximum number of streams in a process, including DefaultStream. Further streams are logged to DefaultStream.
+constexpr int32 MaxStreams = 256;
+
+/// Finds the stream with the given name, or adds it. Thread safe.
+/// @param Name The name of the stream, fe. "PIE-1". Empty for DefaultStream.
+/// @return uint16 The stream, DefaultStream if there are MaxStreams streams already.
+CAPSACORE_API uint16 FindOrAdd(const FString& Name);
+
+/// The name a stream was added with. Thread safe.
+/// @param Stream The stream.
+/// @return FString The name, empty for DefaultStream and unknown streams.
+CAPSACORE_API FString GetName(uint16 Stream);
+
+/// The stream lines logged from the calling thread belong to: the stream of the innermost FCapsaLogStreamScope, or the Play In Editor instance
+/// the game thread is ticking.
+/// @return uint16 The stream, DefaultStream if there is none.
+CAPSACORE_API uint16 GetCurrent();
+
+/// Sets the stream of the calling thread, see FCapsaLogStreamScope.
+/// @param Stream The stream, or INDEX_NONE to fall back to the Play In Editor instance.
+/// @return int32 The previous stream of the calling thread, to restore it with.
+CAPSACORE_API int32 SetScopedStream(int32 Stream);
+
+/// The name of the stream of a world: "PIE-<Instance>" for Play In Editor worlds, otherwise the name of its package, which is unique per loaded world.
+/// @param World The world.
+/// @return FString The name, empty if World is null.
+CAPSACORE_API FString GetWorldStreamName(const UWorld* World);
+}
+
+/// Tags every line logged from the calling thread with a stream while in scope, fe. while a match of a multi-match server processes its packets.
+class CAPSACORE_API FCapsaLogStreamScope
+{
+public:
+	/// @param StreamName The name of the stream, see CapsaLogStreams::FindOrAdd().
+	explicit FCapsaLogStreamScope(const FString& StreamName);
+
+	/// @param World The world whose stream to use, see CapsaLogStreams::GetWorldStreamName().
+	explicit FCapsaLogStreamScope(const UWorld* World);
+
+	~FCapsaLogStreamScope();
+
+	UE_NONCOPYABLE(FCapsaLogStreamScope);
+
+private:
+	int32 PreviousStream;
+};
@@ -0,0 +1,110 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCapsaLogChunk;
+
+/// Scrubs personal data, fe. email addresses, IP addresses, auth tokens and player identifiers, from log chunks before they are formatted.
+///
+/// All patterns are compiled into a single Aho-Corasick automaton, stored as a dense DFA, so every line is scanned once however many patterns there are.
+/// The DFA only runs from positions that can start a pattern: while it is in its start state, a vectorized prefilter (SSE2 on x86, NEON on 64-bit
+/// ARM) skips 8 code units at a time that contain none of the first characters of the patterns.
+///
+/// Supported patterns:
+///   Literal       "hunter2"   Every occurrence of the text.
+///   Token         "token=*"   The token following the text, up to the next whitespace, quote or separator. When the text ends with a letter or
+///                             digit, fe. "7656119*" for Steam IDs, it must start a token and is redacted with it, otherwise, fe. "token=*", it is kept.
+///   Email address             Anchored on '@', expanded to the local part and domain around it.
+///   IPv4 address              Anchored on '.', expanded to the dotted quad around it.
+/// Matches are replaced by Marker, or by as many '*' as the match is long if that is shorter, in place, so redacting never grows a line.
+///
+/// Immutable once constructed, so a single instance can be shared by all upload pipeline tasks.
+class CAPSACORE_API FCapsaRedactor
+{
+public:
+	/// Compiles the patterns.
+	/// @param InPatterns Literal and token patterns, see above. Patterns shorter than MinPatternLen are ignored.
+	/// @param bRedactEmailAddresses Whether email addresses are redacted.
+	/// @param bRedactIPAddresses Whether IPv4 addresses are redacted.
+	FCapsaRedactor(const TArray<FString>& InPatterns, bool bRedactEmailAddresses, bool bRedactIPAddresses);
+
+	/// Whether no pattern was compiled, in which case redacting does nothing.
+	/// @return bool True if there is nothing to redact.
+	bool IsEmpty() const;
+
+	/// Redacts Text in place and writes a new terminator if it got shorter.
+	/// @param Text The text to redact, null terminated at Len.
+	/// @param Len The length of Text, updated to the length after redacting.
+	/// @return int32 The number of redacted matches, after merging overlapping ones.
+	int32 Redact(TCHAR* Text, int32& Len) const;
+
+	/// Redacts Text in place.
+	/// @param Text The text to redact.
+	/// @return int32 The number of redacted matches.
+	int32 Redact(FString& Text) const;
+
+	/// Redacts every line of the Chunk. Text lines are redacted in place. Structured lines are rendered into FCapsaStructuredLine::RedactedText,
+	/// which is redacted and formatted instead of the record.
+	/// @param Chunk The chunk to redact.
+	/// @param bIncludeStructuredFields Whether the fields of structured lines are rendered, and redacted, with their message.
+	/// @return int32 The number of redacted matches.
+	int32 RedactChunk(FCapsaLogChunk& Chunk, bool bIncludeStructuredFields) const;
+
+	/// Replaces every match.
+	static constexpr const TCHAR* Marker = TEXT("***");
+
+	/// Shorter literal and token patterns would match too much of a typical log.
+	static constexpr int32 MinPatternLen = 3;
+
+private:
+	enum class EPatternKind : uint8
+	{
+		Literal,
+		Token,
+		Email,
+		IPv4,
+	};
+
+	struct FPattern
+	{
+		EPatternKind Kind;
+		int32 Len; ///< The length of the text the DFA matches
+		bool bRedactText; ///< Whether the matched text itself is redacted, only false for tokens following a separator
+	};
+
+	/// Adds a pattern to the trie, before the DFA is built.
+	void AddPattern(FStringView Text, EPatternKind Kind, bool bRedactText, TArray<TMap<uint16, int32>>& Trie);
+
+	/// Adds the span a match of Pattern that ends at EndIndex redacts, if the text around it is a match.
+	void AddMatch(const TCHAR* Text, int32 Len, int32 EndIndex, const FPattern& Pattern, TArray<TPair<int32, int32>, TInlineAllocator<16>>& Spans) const;
+
+	/// The index of the first position at or after Index that can start a match, or Len if there is none.
+	int32 FindCandidate(const TCHAR* Text, int32 Len, int32 Index) const;
+
+	/// The input class of a character, 0 for characters that appear in no pattern.
+	FORCEINLINE uint16 GetClass(TCHAR Char) const
+	{
+		if (static_cast<uint32>(Char) < 128)
+		{
+			return AsciiClasses[Char];
+		}
+		const uint16* Class = OtherClasses.Find(Char);
+		return Class != nullptr ? *Class : 0;
+	}
+
+	TArray<FPattern> Patterns;
+
+	uint16 AsciiClasses[128] = {};
+	TMap<TCHAR, uint16> OtherClasses;
+	int32 NumClasses = 1;
+
+	TArray<int32> Transitions; ///< The DFA, NumClasses entries per state, state 0 is the start state
+	TArray<int32> Failures; ///< The longest proper suffix of every state that is also a state
+	TArray<int32> Outputs; ///< The pattern every state completes, INDEX_NONE if none
+	TArray<int32> OutputLinks; ///< The state itself or the nearest failure state that completes a pattern, INDEX_NONE if none
+
+	TArray<TCHAR> FirstChars; ///< The distinct first characters of all patterns, used by the prefilter
+	bool bVectorPrefilter = false; ///< Whether there are few enough FirstChars to compare them as vectors
+};
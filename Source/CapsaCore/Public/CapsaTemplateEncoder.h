@@ -0,0 +1,86 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCapsaLogChunk;
+
+/// Per-session dictionary of message templates. Shared by all async tasks of a session, all functions are thread-safe.
+///
+/// A template is defined by every chunk that uses it until a chunk defining it is uploaded, so a chunk never refers to a definition that was lost
+/// with a failed chunk, whatever order chunks complete in.
+class CAPSACORE_API FCapsaTemplateDictionary
+{
+public:
+	/// Resolves the IDs of a batch of templates, adding those that are not in the dictionary yet.
+	/// @param ChunkID The chunk the templates are used by, see MarkDelivered().
+	/// @param Templates The templates to resolve.
+	/// @param OutIDs Receives the ID of every template, or InvalidID if the dictionary is full.
+	/// @param OutIsNew Receives whether every template was not delivered yet, and must therefore be defined in the chunk.
+	/// @return uint32 The generation the IDs belong to.
+	uint32 ResolveTemplates(uint64 ChunkID, const TArray<FString>& Templates, TArray<uint32>& OutIDs, TBitArray<>& OutIsNew);
+
+	/// Marks the templates defined by a chunk as delivered, so later chunks no longer define them. Call when the chunk was uploaded.
+	/// @param ChunkID The chunk that was uploaded.
+	void MarkDelivered(uint64 ChunkID);
+
+	/// Forgets the templates defined by a chunk that will not be uploaded. They are defined again by the next chunk that uses them.
+	/// @param ChunkID The chunk that failed to upload, and will not be sent again.
+	void MarkFailed(uint64 ChunkID);
+
+	/// Forgets all templates and starts a new generation, so every template is defined again the next time it is used.
+	/// Call when the session starts a new log.
+	void Reset();
+
+	/// The number of templates in the dictionary.
+	/// @return int32 The number of templates.
+	int32 Num() const;
+
+	/// Returned for templates that did not fit in the dictionary. Lines using them are sent as plain text.
+	static constexpr uint32 InvalidID = MAX_uint32;
+
+	/// Upper bound on the number of templates, protecting against messages that the tokenizer does not reduce to a small set of shapes.
+	static constexpr int32 MaxTemplates = 65536;
+
+private:
+	mutable FCriticalSection Lock;
+	TMap<FString, uint32> TemplateIDs;
+	TBitArray<> Delivered; ///< Indexed by template ID
+	TMap<uint64, TArray<uint32>> ChunkDefinitions; ///< The templates every chunk in flight defines, by ChunkID
+	uint32 Generation = 0;
+	uint32 NextID = 0;
+};
+
+/// Encodes log chunks as message templates plus parameters.
+///
+/// Every message is tokenized into a template, in which every token containing a digit is replaced by a wildcard, and the list of those tokens.
+/// Templates are defined until a chunk defining them is uploaded, after which lines only carry the template ID and parameters.
+/// Categories are defined once per chunk, after which lines only carry the category index:
+///   #CapsaTemplate 3 <Generation>
+///   #C<Index> <LogCategory>
+///   #T<ID> <Template>
+///   [Timestamp][LogVerbosity][#<Index>]: @<ID><US><Param><US><Param>
+///   [Timestamp][LogVerbosity][#<Index>]: =<Message>
+/// where <US> is the ASCII unit separator (0x1F). Lines that cannot be tokenized, fe. multi-line messages, are sent as plain text after '=', in
+/// which '\', CR and LF are escaped as "\\", "\r" and "\n" so every line keeps a single line.
+/// Structured lines use their format string as template and their fields, as a JSON object, as the only parameter.
+namespace CapsaTemplateEncoder
+{
+inline constexpr int32 FormatVersion = 3; ///< Sent in the header line of every encoded chunk
+inline const TCHAR* Wildcard = TEXT("<*>"); ///< Replaces every parameter in a template
+inline constexpr TCHAR ParamSeparator = TCHAR(0x1F); ///< Precedes every parameter of an encoded line
+
+/// Splits a message into its template and parameters.
+/// @param Message The message to tokenize.
+/// @param OutTemplate Receives the template.
+/// @param OutParams Receives the parameters, as views into Message.
+/// @return bool False if the message cannot be encoded and must be sent as plain text.
+CAPSACORE_API bool Tokenize(FStringView Message, FString& OutTemplate, TArray<FStringView>& OutParams);
+
+/// Builds the template encoded Log from all lines in the Chunk, in the order they were captured.
+/// @param Chunk The chunk to encode.
+/// @param Dictionary The session dictionary. New templates are added and defined in the returned Log.
+/// @return FString The encoded Log.
+CAPSACORE_API FString MakeLogString(const FCapsaLogChunk& Chunk, FCapsaTemplateDictionary& Dictionary);
+}
@@ -0,0 +1,85 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CapsaCoreStats.h"
+#include "CapsaLogChunk.h"
+#include "CapsaLogSink.h"
+#include "CapsaRedactor.h"
+#include "Containers/Queue.h"
+#include "Tasks/Pipe.h"
+
+#include <atomic>
+
+/// How a chunk is processed by the FCapsaUploadPipeline, captured from UCapsaSettings when the chunk is enqueued.
+struct FCapsaUploadOptions
+{
+	FString LogID; ///< Names the files the chunk is written to
+	FCapsaLogFormatOptions FormatOptions;
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> Redactor; ///< When set, the chunk is redacted before it is formatted
+	TArray<TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>> Sinks; ///< Every sink the chunk is handed to, in order
+};
+
+/// Ordered pipeline that turns log chunks into deliveries to their sinks, in three stages:
+///   Format    Redacts the chunk, and encodes it once into every representation its sinks consume, on a UE::Tasks pipe. Large chunks are
+///             compressed as parallel segments.
+///   Deliver   Hands the encoded chunk to the sinks that run off the game thread, fe. FCapsaFileSink, on a second pipe.
+///   Dispatch  Hands the encoded chunk to the game thread sinks, fe. FCapsaHttpSink, see DispatchGameThreadSinks().
+/// Each pipe runs its tasks one at a time in the order they were launched, so chunks reach every stage, every sink, and the server, in the order
+/// they were enqueued, while the stages overlap: chunk N+1 compresses while chunk N is written and uploaded.
+///
+/// Sinks share the buffers of the FCapsaEncodedChunk, nothing is formatted or compressed twice. Before a chunk waits for the game thread, the
+/// buffers no game thread sink consumes are released.
+///
+/// The number of chunks between Enqueue() and DispatchGameThreadSinks() is bounded by MaxQueuedChunks. Callers check IsFull() and keep their
+/// lines buffered until the pipeline drains. Tasks hold a shared reference to the pipeline, so it stays valid until the last stage finishes.
+class CAPSACORE_API FCapsaUploadPipeline : public TSharedFromThis<FCapsaUploadPipeline, ESPMode::ThreadSafe>
+{
+public:
+	/// @param InMaxQueuedChunks The number of chunks the pipeline accepts before IsFull() returns true, see UCapsaSettings::GetMaxQueuedLogChunks().
+	explicit FCapsaUploadPipeline(int32 InMaxQueuedChunks);
+
+	/// Starts processing the chunk. Always accepts the chunk, callers that can wait should check IsFull() first.
+	/// @param Chunk The chunk to process.
+	/// @param Options How to process the chunk.
+	void Enqueue(FCapsaLogChunk Chunk, FCapsaUploadOptions Options);
+
+	/// Hands every chunk that finished the Deliver stage to its game thread sinks, in order. Must be called on the game thread.
+	/// @param bBlocking Whether sinks must deliver the chunks before returning, should only be used during shutdown.
+	void DispatchGameThreadSinks(bool bBlocking = false);
+
+	/// Blocks until every enqueued chunk has finished the Deliver stage, so the following DispatchGameThreadSinks() dispatches all of them.
+	void WaitUntilDelivered();
+
+	/// Whether the pipeline holds MaxQueuedChunks chunks or more.
+	/// @return bool True if callers should hold on to their lines.
+	bool IsFull() const;
+
+	/// The number of chunks that were enqueued, but not dispatched yet.
+	/// @return int32 The number of queued chunks.
+	int32 GetNumQueued() const;
+
+private:
+	/// A chunk that finished the Deliver stage, with the sinks that still have to consume it on the game thread.
+	struct FDeliveredChunk
+	{
+		TUniquePtr<FCapsaEncodedChunk> Chunk;
+		TArray<TSharedRef<ICapsaLogSink, ESPMode::ThreadSafe>> GameThreadSinks;
+	};
+
+	/// The Format stage, runs on FormatPipe. Redacts the Chunk in place, and moves its lines if a sink consumes them.
+	static TUniquePtr<FCapsaEncodedChunk> Format(FCapsaLogChunk& Chunk, const FCapsaUploadOptions& Options);
+
+	/// The Deliver stage, runs on DeliverPipe.
+	static FDeliveredChunk Deliver(TUniquePtr<FCapsaEncodedChunk> Chunk, const FCapsaUploadOptions& Options);
+
+	const int32 MaxQueuedChunks;
+	std::atomic<int32> NumQueued{0};
+
+	UE::Tasks::FPipe FormatPipe{TEXT("CapsaFormatPipe")};
+	UE::Tasks::FPipe DeliverPipe{TEXT("CapsaDeliverPipe")};
+
+	/// Chunks that finished the Deliver stage, in order. Produced by DeliverPipe, consumed on the game thread.
+	TQueue<FDeliveredChunk, EQueueMode::Mpsc> DeliveredChunks;
+};
@@ -0,0 +1,25 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/// Single pass UTF-16 to UTF-8 transcoding, with a vectorized fast path for runs of ASCII, which is almost all of a typical log.
+/// Replaces FPlatformString::ConvertedLength() plus FPlatformString::Convert(), which walk the whole string twice, one code unit at a time.
+///
+/// Uses SSE2 on x86 and NEON on 64-bit ARM, both part of the baseline instruction set UE targets, and a scalar loop elsewhere.
+/// Invalid UTF-16, fe. unpaired surrogates, is replaced by '?', like FPlatformString::Convert().
+namespace CapsaUtf8
+{
+/// Appends the UTF-8 encoding of Source to Dest.
+/// @param Dest The array to append to.
+/// @param Source The UTF-16 text to convert.
+/// @param SourceLen The number of code units in Source.
+/// @return int32 The number of bytes appended.
+CAPSACORE_API int32 Append(TArray<uint8>& Dest, const TCHAR* Source, int32 SourceLen);
+
+/// Converts Source to UTF-8.
+/// @param Source The text to convert.
+/// @return TArray<uint8> The UTF-8 encoding of Source, without terminator.
+CAPSACORE_API TArray<uint8> Convert(FStringView Source);
+}
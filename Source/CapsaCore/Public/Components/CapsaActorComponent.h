@@ -7,6 +7,21 @@
 
 #include "CapsaActorComponent.generated.h"
 
+/// The kind of instance a log belongs to. Sent instead of its description when a client links its log to the server.
+UENUM(BlueprintType)
+enum class ECapsaHostType : uint8
+{
+	Player,
+	ListenServer,
+	DedicatedServer,
+	Editor,
+};
+
+/// The description of the log of a kind of instance, fe. "DedicatedServer".
+/// @param HostType The kind of instance.
+/// @return FString The description.
+CAPSACORE_API FString LexToString(ECapsaHostType HostType);
+
 /// FCapsaSharedData contains Capsa data that is shared between servers and clients.
 USTRUCT(BlueprintType)
 struct CAPSACORE_API FCapsaSharedData
@@ -52,7 +67,8 @@ public:
 	}
 };
 
-/// UCapsaActorComponent is an actor component that allows zero-setup replication of Capsa data between client and server.
+/// UCapsaActorComponent is an actor component that links the log of a client to the log of the server, added to the PlayerState of every player.
+/// The log of the server is replicated once per connection by the UCapsaGameStateComponent of the GameState instead.
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
 class CAPSACORE_API UCapsaActorComponent : public UActorComponent
 {
@@ -61,20 +77,19 @@ class CAPSACORE_API UCapsaActorComponent : public UActorComponent
 public:
 	UCapsaActorComponent();
 
-	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
-
-	/// Registers the client's Capsa data as a linked log for the server.
+	/// Registers the client's Capsa data as a linked log for the server. Only used for log IDs that are not a GUID, see ServerLinkCapsaLog().
 	UFUNCTION(Server, Reliable)
 	void ServerRegisterLinkedCapsaLog(const FCapsaSharedData& ClientCapsaData);
 
-	/// Replication function for CapsaServerData, which adds the server log ID to linked logs.
-	UFUNCTION()
-	void OnRep_CapsaServerData();
+	/// Registers the client's log as a linked log for the server. Sends the log ID as a 16 byte GUID, and the kind of instance instead of its description.
+	/// The URL is sent as well, as the client's log can be stored on another Capsa instance than the server's.
+	UFUNCTION(Server, Reliable)
+	void ServerLinkCapsaLog(const FGuid& LogID, ECapsaHostType HostType, const FString& LogURL);
 
-	/// If running on a server, the field contains the server's own data.
-	/// If running on a client, the field will contain the data for the connected server.
-	UPROPERTY(ReplicatedUsing = OnRep_CapsaServerData)
-	FCapsaSharedData CapsaServerData;
+	/// The kind of instance this process is, as linked to other logs.
+	/// @param bIsServer Whether the instance is the server of its world, see GetIsServer().
+	/// @return ECapsaHostType The kind of instance.
+	static ECapsaHostType GetHostType(bool bIsServer);
 
 	// TODO: Add way to modify the description for current instance
 
@@ -86,6 +101,21 @@ protected:
 
 	void OnAuthenticationDelegate(const FString& LogId, const FString& LogURL);
 
+	/// Links the client's log to the server through ServerLinkCapsaLog(), once authenticated and once the client owns the Actor.
+	/// Retried every LinkRetryInterval seconds while the Actor has no net connection and may still turn out to be the local player's.
+	void TryLinkCapsaLog();
+
+	/// Whether the Actor belongs, or may still turn out to belong, to a local player. False for the PlayerStates, PlayerControllers and Pawns of
+	/// other players, which never get a net connection on this client.
+	/// @return bool False if the Actor is known to belong to another player.
+	bool MayBeLocallyOwned() const;
+
+	/// How often, in seconds, TryLinkCapsaLog() is retried while the Actor has no net connection.
+	static constexpr float LinkRetryInterval = 1.0f;
+
+	/// The timer retrying TryLinkCapsaLog(), cleared once the log is linked.
+	FTimerHandle LinkRetryTimerHandle;
+
 	/// On server: FCapsaSharedData for player that last joined
 	/// On client: client's own FCapsaSharedData.
 	FCapsaSharedData CapsaData;
@@ -0,0 +1,46 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Components/CapsaActorComponent.h"
+
+#include "CapsaGameStateComponent.generated.h"
+
+/// UCapsaGameStateComponent replicates the Capsa data of the server, added to the GameState. As the GameState is a single actor, the data is sent once
+/// per connection, and only when it changes, however many players joined. Clients link the log of the server to their own.
+/// The data is push-model replicated, which needs WITH_PUSH_MODEL and net.IsPushModelEnabled=1. Without push model it is compared every time the
+/// GameState replicates, like any other property.
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class CAPSACORE_API UCapsaGameStateComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UCapsaGameStateComponent();
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/// Replication function for CapsaServerData, which adds the server log ID to linked logs.
+	UFUNCTION()
+	void OnRep_CapsaServerData();
+
+	/// If running on a server, the field contains the server's own data.
+	/// If running on a client, the field will contain the data for the connected server.
+	/// Push-model replicated, so with push model enabled it is only compared when the server authenticates, not every time the GameState replicates.
+	UPROPERTY(ReplicatedUsing = OnRep_CapsaServerData)
+	FCapsaSharedData CapsaServerData;
+
+protected:
+	// begin UActorComponent
+	virtual void BeginPlay() override;
+	virtual void EndPlay(EEndPlayReason::Type EndPlayReason) override;
+	// end UActorComponent
+
+	void OnAuthenticationDelegate(const FString& LogId, const FString& LogURL);
+
+	///  Whether the game instance on which the actor is running should be considered a server or not.
+	///  @return bool server status.
+	bool GetIsServer() const;
+};
@@ -6,6 +6,27 @@
 
 #include "CapsaSettings.generated.h"
 
+/// When captured log lines are uploaded.
+UENUM()
+enum class ECapsaUploadMode : uint8
+{
+	Stream, ///< Every line is uploaded, in chunks of MaxLogLinesBetweenLogFlushes lines or every MaxTimeBetweenLogFlushes seconds
+	OnTrigger, ///< Lines are kept in a bounded local window, which is only uploaded when a trigger fires, see UCapsaSettings::GetUploadMode()
+};
+
+/// Log verbosities that can be configured, with the same values as ELogVerbosity::Type.
+UENUM()
+enum class ECapsaLogVerbosity : uint8
+{
+	Fatal = 1,
+	Error,
+	Warning,
+	Display,
+	Log,
+	Verbose,
+	VeryVerbose,
+};
+
 /// Contains all Capsa Developer settings and getters to access the configured values.
 UCLASS(Config = Engine, defaultconfig, meta = ( DisplayName = "Capsa Settings" ))
 class CAPSACORE_API UCapsaSettings : public UDeveloperSettings
@@ -73,6 +94,106 @@ public:
 	/// @return bool Write to disk (true) or not (false).
 	UFUNCTION(BlueprintPure, Category = "Capsa|Log")
 	bool GetWriteToDiskCompressed() const;
+
+	/// Get whether structured log records (UE_LOGFMT) are captured as records, deferring rendering their message to the async task.
+	/// @return bool Capture structured records (true) or let the engine render them to text first (false).
+	bool GetCaptureStructuredLogs() const;
+
+	/// Get whether the fields of structured log records are appended to their line as a JSON object.
+	/// @return bool Append the fields (true) or not (false).
+	bool GetIncludeStructuredFields() const;
+
+	/// Get whether uploaded logs are template encoded, see CapsaTemplateEncoder.
+	/// @return bool Template encode uploads (true) or send plain text (false).
+	bool GetUseTemplateEncoding() const;
+
+	/// Get the number of lines above which a log chunk is split into segments that are compressed in parallel.
+	/// @return int32 The CompressionSegmentLines, 0 if chunks are never split.
+	int32 GetCompressionSegmentLines() const;
+
+	/// Get the maximum number of segments compressed at the same time.
+	/// @return int32 The MaxCompressionWorkers, 0 if all task graph workers can be used.
+	int32 GetMaxCompressionWorkers() const;
+
+	/// Get the maximum number of log chunks waiting to be formatted, compressed, written or uploaded.
+	/// @return int32 The MaxQueuedLogChunks.
+	int32 GetMaxQueuedLogChunks() const;
+
+	/// Get whether log chunks are redacted before they are formatted, see FCapsaRedactor.
+	/// @return bool Redact logs (true) or not (false).
+	bool GetRedactLogs() const;
+
+	/// Get the literal and token patterns that are redacted.
+	/// @return const TArray<FString>& The RedactionPatterns.
+	const TArray<FString>& GetRedactionPatterns() const;
+
+	/// Get whether email addresses are redacted.
+	/// @return bool Redact email addresses (true) or not (false).
+	bool GetRedactEmailAddresses() const;
+
+	/// Get whether IPv4 addresses are redacted.
+	/// @return bool Redact IPv4 addresses (true) or not (false).
+	bool GetRedactIPAddresses() const;
+
+	/// Get the size of the in-memory log history.
+	/// @return int32 The HistorySizeMB, 0 if there is no history.
+	int32 GetHistorySizeMB() const;
+
+	/// Get the uncompressed size of a block of the in-memory log history.
+	/// @return int32 The HistoryBlockSizeKB.
+	int32 GetHistoryBlockSizeKB() const;
+
+	/// Get when captured log lines are uploaded.
+	/// @return ECapsaUploadMode The UploadMode.
+	ECapsaUploadMode GetUploadMode() const;
+
+	/// Get the number of lines kept before a trigger, when uploading on trigger.
+	/// @return int32 The TriggerLinesBefore.
+	int32 GetTriggerLinesBefore() const;
+
+	/// Get the number of lines collected after a trigger before uploading, when uploading on trigger.
+	/// @return int32 The TriggerLinesAfter.
+	int32 GetTriggerLinesAfter() const;
+
+	/// Get the maximum time to wait for TriggerLinesAfter lines after a trigger, when uploading on trigger.
+	/// @return float The TriggerMaxDelay in seconds.
+	float GetTriggerMaxDelay() const;
+
+	/// Get whether lines at or above PriorityVerbosity are uploaded through the low-latency priority lane.
+	/// @return bool The bUsePriorityLane.
+	bool GetUsePriorityLane() const;
+
+	/// Get the least severe verbosity that is uploaded through the priority lane.
+	/// @return ELogVerbosity::Type The PriorityVerbosity.
+	ELogVerbosity::Type GetPriorityVerbosity() const;
+
+	/// Get the maximum time a line waits in the priority lane before it is uploaded.
+	/// @return float The PriorityFlushDeadline in seconds.
+	float GetPriorityFlushDeadline() const;
+
+	/// Get whether log chunks are handed to the host agent instead of being compressed and uploaded by this process.
+	/// @return bool The bUseHostAgent.
+	bool GetUseHostAgent() const;
+
+	/// Get the path of the host agent's Unix domain socket.
+	/// @return FString The HostAgentSocketPath.
+	FString GetHostAgentSocketPath() const;
+
+	/// Get whether log chunks are also written to stdout as JSON-lines.
+	/// @return bool The bWriteToStdout.
+	bool GetWriteToStdout() const;
+
+	/// Get whether lines are tagged with the world they were logged from, and uploaded to a session per world.
+	/// @return bool The bUseWorldStreams.
+	bool GetUseWorldStreams() const;
+
+	/// Get how long before the token of a session expires it is refreshed.
+	/// @return float The TokenRefreshMargin.
+	float GetTokenRefreshMargin() const;
+
+	/// Get whether the session is saved to disk and reused by the next process while its token is valid.
+	/// @return bool The bPersistSession.
+	bool GetPersistSession() const;
 #pragma endregion LOG_FUNCTIONS
 
 #pragma region COMPONENT_FUNCTIONS
@@ -134,11 +255,136 @@ protected:
 	/// Whether we should write the compressed Log to disk. This property is ignored if bUseCompression is set to False.
 	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log")
 	bool bWriteToDiskCompressed;
+
+	/// Whether structured log records (UE_LOGFMT) are captured as records, with their format and typed fields, instead of being rendered to text
+	/// on the logging thread. The message is rendered when the log chunk is formatted.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log")
+	bool bCaptureStructuredLogs;
+
+	/// Whether the fields of structured log records are appended to their line as a JSON object, so they can be searched individually.
+	/// This property is ignored if bCaptureStructuredLogs is set to False.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log", Meta=(EditCondition="bCaptureStructuredLogs" ))
+	bool bIncludeStructuredFields;
+
+	/// Whether uploaded logs are encoded as message templates plus parameters, with every template sent once per session.
+	/// Reduces upload size and compression time. Requires a Capsa server that supports template encoded chunks. Logs written to disk stay plain text.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log")
+	bool bUseTemplateEncoding;
+
+	/// Log chunks with more lines than this, fe. a large backlog flushed at shutdown, are split into segments of this many lines, which are
+	/// formatted and compressed in parallel on the task graph and uploaded as separate chunks. Set to 0 to never split chunks.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log", meta=(ClampMin=0))
+	int32 CompressionSegmentLines;
+
+	/// The maximum number of segments compressed at the same time. Set to 0 to use all task graph workers.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log", meta=(ClampMin=0))
+	int32 MaxCompressionWorkers;
+
+	/// The maximum number of log chunks waiting in the upload pipeline to be formatted, compressed, written or uploaded. While the pipeline is full,
+	/// lines stay buffered in the output device and are sent once it has drained.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log", meta=(ClampMin=1))
+	int32 MaxQueuedLogChunks;
+
+	/// Whether personal data is scrubbed from log chunks before they are formatted, so it never leaves the machine, on disk or uploaded.
+	/// Structured log records are rendered to text when redacting, so they are not template encoded by their format string.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Redaction")
+	bool bRedactLogs;
+
+	/// Text that is redacted wherever it appears. A pattern ending in '*' also redacts the token following it, up to the next whitespace, quote or
+	/// separator: "token=*" keeps "token=" and redacts its value, "7656119*" redacts Steam IDs. Patterns need at least 3 characters besides the '*'.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Redaction", Meta=(EditCondition="bRedactLogs"))
+	TArray<FString> RedactionPatterns;
+
+	/// Whether email addresses are redacted.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Redaction", Meta=(EditCondition="bRedactLogs"))
+	bool bRedactEmailAddresses;
+
+	/// Whether IPv4 addresses are redacted.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Redaction", Meta=(EditCondition="bRedactLogs"))
+	bool bRedactIPAddresses;
+
+	/// The most recent log lines are kept in memory as compressed blocks of up to this many MB in total, independent of uploading, so they can be
+	/// attached to bug reports instantly, see UCapsaLogSubsystem::GetHistorySnapshot(). Set to 0 to keep no history.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|History", meta=(ClampMin=0))
+	int32 HistorySizeMB;
+
+	/// The uncompressed size of a block of the log history. Lines are compressed a block at a time, larger blocks compress better but lose more
+	/// history when the oldest block is evicted.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|History", meta=(ClampMin=16))
+	int32 HistoryBlockSizeKB;
+
+	/// When captured log lines are uploaded. With OnTrigger, fe. for shipping clients, only the last TriggerLinesBefore lines are kept, and they are
+	/// uploaded with the following TriggerLinesAfter lines when an Error or Fatal line is logged, an ensure fails, the game crashes, or
+	/// UCapsaLogSubsystem::TriggerLogUpload() is called. The upload is linked to the same session as streamed logs.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Trigger")
+	ECapsaUploadMode UploadMode;
+
+	/// The number of lines kept before a trigger.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Trigger", meta=(ClampMin=1, EditCondition="UploadMode==ECapsaUploadMode::OnTrigger"))
+	int32 TriggerLinesBefore;
+
+	/// The number of lines collected after a trigger before the window is uploaded.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Trigger", meta=(ClampMin=0, EditCondition="UploadMode==ECapsaUploadMode::OnTrigger"))
+	int32 TriggerLinesAfter;
+
+	/// The maximum time in seconds to wait for TriggerLinesAfter lines, after which the window is uploaded with the lines collected so far.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Trigger", meta=(ClampMin=0, EditCondition="UploadMode==ECapsaUploadMode::OnTrigger"))
+	float TriggerMaxDelay;
+
+	/// Upload lines at or above PriorityVerbosity, fe. errors for live-ops alerting, as small chunks within PriorityFlushDeadline seconds,
+	/// instead of waiting up to MaxTimeBetweenLogFlushes with the other lines. Every line carries a sequence number shared by both lanes, so the
+	/// server can merge them back into capture order. Not used when uploading on trigger.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Priority")
+	bool bUsePriorityLane;
+
+	/// The least severe verbosity that is uploaded through the priority lane.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Priority", meta=(EditCondition="bUsePriorityLane"))
+	ECapsaLogVerbosity PriorityVerbosity;
+
+	/// The maximum time in seconds a line waits in the priority lane, lines logged within this time of each other are uploaded together.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Priority", meta=(ClampMin=0, EditCondition="bUsePriorityLane"))
+	float PriorityFlushDeadline;
+
+	/// Hand formatted log chunks to the Capsa host agent over a Unix domain socket, instead of compressing and uploading them from this process.
+	/// Intended for hosts running many dedicated server instances, which then share a single agent, see UCapsaHostAgentCommandlet.
+	/// Chunks are uploaded directly, uncompressed, while the agent is not running. Linux only.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|HostAgent")
+	bool bUseHostAgent;
+
+	/// The path of the host agent's Unix domain socket.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|HostAgent", meta=(EditCondition="bUseHostAgent"))
+	FString HostAgentSocketPath;
+
+	/// Also write the log chunks to stdout as JSON-lines, one object per line, for the log collector of a container cluster.
+	/// Lines are encoded from the captured lines, the engine's own stdout output (-stdout) should be disabled to avoid writing every line twice.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Stdout")
+	bool bWriteToStdout;
+
+	/// Tag every line with the log stream it was logged from, and upload every stream to its own Capsa session, linked to the session of the process.
+	/// Lines logged while a Play In Editor instance is ticking go to a stream per instance. Other worlds, fe. the matches of a multi-match
+	/// dedicated server, use a stream when added with UCapsaCoreSubsystem::AddWorldStream() or logged within a FCapsaLogStreamScope.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Streams")
+	bool bUseWorldStreams;
+
+	/// How long (in seconds) before the token of a session expires it is refreshed, in the background while uploads keep using the current token.
+	/// A log chunk rejected with 401 also refreshes the token, and is sent again once.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Auth", meta=(Units="Seconds", ClampMin="0"))
+	float TokenRefreshMargin;
+
+	/// Save the session to Saved/Capsa, and reuse it on the next launch while its token is valid, instead of authenticating. A server that restarts,
+	/// or crash-loops, keeps logging to one log, as a new segment for every process. Instances sharing a Saved directory must be told apart with
+	/// -CapsaInstance=<Name>.
+	/// The file holds the bearer token of the log in plaintext JSON. Anyone who can read it can upload to the log until the token expires. On Linux
+	/// and Mac it is only readable by the user running the process, elsewhere it relies on the permissions of the Saved directory.
+	UPROPERTY(config, EditAnywhere, Category = "Capsa|Log|Auth")
+	bool bPersistSession;
 #pragma endregion LOG_PROPERTIES
 
 #pragma region COMPONENT_PROPERTIES
 	/// Whether the Core Subsystem should auto-create and add a Capsa Component to the specified class.
 	/// Set to false if you intend to add the component to a replicated actor yourself.
+	/// The UCapsaGameStateComponent, which replicates the log of the server, is added regardless. Its data is push-model replicated, which needs
+	/// an engine built with WITH_PUSH_MODEL and net.IsPushModelEnabled=1, otherwise it is compared every time the GameState replicates.
 	UPROPERTY(config, EditAnywhere, Category = "Capsa|Component")
 	bool bAutoAddCapsaComponent;
 
@@ -25,6 +25,7 @@ public class CapsaLog : ModuleRules
 		PublicDependencyModuleNames.AddRange(
 			new string[]
 			{
+				"CapsaCore", // FCapsaHistorySnapshot is part of the UCapsaLogSubsystem API
 				"Core",
 			}
 			);
@@ -33,7 +34,6 @@ public class CapsaLog : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
-				"CapsaCore",
 				"CoreUObject",
 				"DeveloperSettings",
 				"Engine",
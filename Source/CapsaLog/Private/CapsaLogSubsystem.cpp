@@ -3,6 +3,8 @@
 #include "CapsaLogSubsystem.h"
 
 #include "CapsaLog.h"
+#include "CapsaCoreStats.h"
+#include "CapsaHistoryRing.h"
 #include "Misc/CapsaOutputDevice.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaLogSubsystem)
@@ -12,6 +14,7 @@ void UCapsaLogSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	Super::Initialize(Collection);
 
 #if WITH_CAPSA_LOG_ENABLED
+	LLM_SCOPE_BYTAG(Capsa);
 	CapsaLogOutputDevice = MakePimpl<FCapsaOutputDevice>();
 #endif
 }
@@ -20,3 +23,33 @@ void UCapsaLogSubsystem::Deinitialize()
 {
 	Super::Deinitialize();
 }
+
+FCapsaHistorySnapshot UCapsaLogSubsystem::GetHistorySnapshot() const
+{
+	return CapsaLogOutputDevice.IsValid() ? CapsaLogOutputDevice->GetHistorySnapshot() : FCapsaHistorySnapshot();
+}
+
+FString UCapsaLogSubsystem::GetHistoryAsString() const
+{
+	return GetHistorySnapshot().ToString();
+}
+
+bool UCapsaLogSubsystem::SaveHistoryToFile(const FString& FilePath) const
+{
+	const FCapsaHistorySnapshot Snapshot = GetHistorySnapshot();
+	if (Snapshot.IsEmpty())
+	{
+		UE_LOG(LogCapsaLog, Warning, TEXT("UCapsaLogSubsystem::SaveHistoryToFile | There is no log history to save"));
+		return false;
+	}
+
+	return Snapshot.SaveToFile(FilePath);
+}
+
+void UCapsaLogSubsystem::TriggerLogUpload(const FString& Reason)
+{
+	if (CapsaLogOutputDevice.IsValid())
+	{
+		CapsaLogOutputDevice->Trigger(Reason.IsEmpty() ? TEXT("TriggerLogUpload") : Reason);
+	}
+}
@@ -0,0 +1,621 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#include "Commandlets/CapsaHostAgentCommandlet.h"
+
+#include "CapsaLog.h"
+#include "CapsaHostAgent.h"
+#include "CapsaLogChunk.h"
+#include "Settings/CapsaSettings.h"
+
+#include "Containers/Queue.h"
+#include "Containers/Ticker.h"
+#include "HttpManager.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Misc/Compression.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+
+#if PLATFORM_LINUX
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaHostAgentCommandlet)
+
+#if PLATFORM_LINUX
+namespace CapsaHostAgent
+{
+/// Sessions whose instance has not sent anything for this long are forgotten.
+static constexpr double SessionTimeout = 3600.0;
+
+/// Seconds to wait for the last uploads when exiting.
+static constexpr double DrainTimeout = 30.0;
+
+/// Uploads of a session kept to be sent again once its instance refreshed its token. Older ones are dropped.
+static constexpr int32 MaxRetryUploads = 64;
+
+/// A batch, compressed on the task graph, waiting to be uploaded from the main loop.
+struct FUpload
+{
+	FString LogID;
+	FString Token;
+	FString ChunkEndpoint;
+	uint64 ChunkSequence = 0;
+	ECapsaLogLane Lane = ECapsaLogLane::Bulk;
+	FString LineSequences;
+	TArray<uint8> Compressed;
+	int64 UncompressedSize = 0;
+	bool bFailed = false;
+};
+
+/// The log of an instance. Kept across reconnects of the instance, so uploads rejected with its old token can be sent with the new one.
+struct FSession
+{
+	FString Token;
+	FString ChunkEndpoint;
+	double LastActivityTime = 0.0;
+
+	TArray<uint8> Batch; ///< The bulk chunks received since the last upload, concatenated
+	TArray<FString> BatchSequences; ///< The line sequences of the batched chunks
+	uint64 BatchChunkSequence = 0; ///< The chunk sequence of the first batched chunk, which the batch is uploaded with
+	double BatchStartTime = 0.0;
+
+	TArray<TSharedRef<FUpload>> RetryUploads; ///< Uploads rejected with 401, sent again with the token of the next Session frame
+};
+
+/// A connected instance.
+struct FConnection
+{
+	int32 Socket = -1;
+	TArray<uint8> Received; ///< Bytes of incomplete frames
+	FString LogID; ///< The session the chunks belong to, empty until the instance sent its Session frame
+};
+
+class FAgent
+{
+public:
+	FAgent(const FString& InSocketPath, int32 InBatchBytes, double InBatchDelay) :
+		SocketPath(InSocketPath),
+		BatchBytes(FMath::Max(InBatchBytes, 1024)),
+		BatchDelay(FMath::Max(InBatchDelay, 0.0))
+	{
+	}
+
+	~FAgent()
+	{
+		for (const FConnection& Connection : Connections)
+		{
+			close(Connection.Socket);
+		}
+
+		if (ListenSocket >= 0)
+		{
+			close(ListenSocket);
+			unlink(TCHAR_TO_UTF8(*SocketPath));
+		}
+	}
+
+	/// Creates the listening socket, replacing a stale socket file of a previous agent.
+	bool Listen()
+	{
+		sockaddr_un Address = {};
+		Address.sun_family = AF_UNIX;
+		const FTCHARToUTF8 Path(*SocketPath);
+		if (Path.Length() == 0 || Path.Length() >= static_cast<int32>(sizeof(Address.sun_path)))
+		{
+			UE_LOG(LogCapsaLog, Error, TEXT("FAgent::Listen | Invalid socket path %s"), *SocketPath);
+			return false;
+		}
+		FMemory::Memcpy(Address.sun_path, Path.Get(), Path.Length());
+
+		unlink(Path.Get());
+		ListenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (ListenSocket < 0 || bind(ListenSocket, reinterpret_cast<const sockaddr*>(&Address), sizeof(Address)) != 0
+			|| listen(ListenSocket, SOMAXCONN) != 0)
+		{
+			UE_LOG(LogCapsaLog, Error, TEXT("FAgent::Listen | Failed to listen on %s, errno %d"), *SocketPath, errno);
+			return false;
+		}
+
+		UE_LOG(LogCapsaLog, Display, TEXT("FAgent::Listen | Listening on %s"), *SocketPath);
+		return true;
+	}
+
+	/// Serves instances until the engine is asked to exit, then uploads the remaining batches.
+	void Run(double StatsInterval)
+	{
+		double LastTickTime = FPlatformTime::Seconds();
+		double LastStatsTime = LastTickTime;
+		while (!IsEngineExitRequested())
+		{
+			// Sleeps until an instance writes, or for at most 10 ms so batches are sealed and HTTP is ticked on time
+			Poll(10);
+
+			const double Now = FPlatformTime::Seconds();
+			SealBatches(Now, false);
+			SubmitUploads();
+			Tick(Now, LastTickTime);
+
+			if (StatsInterval > 0.0 && Now - LastStatsTime >= StatsInterval)
+			{
+				LogStats();
+				PruneSessions(Now);
+				LastStatsTime = Now;
+			}
+		}
+
+		UE_LOG(LogCapsaLog, Display, TEXT("FAgent::Run | Exit requested, uploading the remaining batches"));
+		SealBatches(FPlatformTime::Seconds(), true);
+		const double DrainEndTime = FPlatformTime::Seconds() + DrainTimeout;
+		while ((NumCompressing > 0 || !CompressedUploads.IsEmpty() || NumInFlight > 0) && FPlatformTime::Seconds() < DrainEndTime)
+		{
+			SubmitUploads();
+			Tick(FPlatformTime::Seconds(), LastTickTime);
+			FPlatformProcess::Sleep(0.01f);
+		}
+		LogStats();
+	}
+
+private:
+	/// Waits for activity, then accepts new instances and reads from the connected ones.
+	void Poll(int32 TimeoutMs)
+	{
+		TArray<pollfd, TInlineAllocator<64>> PollFds;
+		PollFds.Add({ListenSocket, POLLIN, 0});
+		for (const FConnection& Connection : Connections)
+		{
+			PollFds.Add({Connection.Socket, POLLIN, 0});
+		}
+
+		if (poll(PollFds.GetData(), PollFds.Num(), TimeoutMs) <= 0)
+		{
+			return;
+		}
+
+		// Iterate backwards so closed connections can be removed, PollFds[Index + 1] belongs to Connections[Index]
+		for (int32 Index = Connections.Num() - 1; Index >= 0; --Index)
+		{
+			if (PollFds[Index + 1].revents != 0 && !Receive(Connections[Index]))
+			{
+				Close(Index);
+			}
+		}
+
+		if (PollFds[0].revents & POLLIN)
+		{
+			Accept();
+		}
+	}
+
+	void Accept()
+	{
+		for (;;)
+		{
+			const int32 Socket = accept4(ListenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (Socket < 0)
+			{
+				return;
+			}
+
+			Connections.AddDefaulted_GetRef().Socket = Socket;
+			UE_LOG(LogCapsaLog, Verbose, TEXT("FAgent::Accept | Instance connected, %d connections"), Connections.Num());
+		}
+	}
+
+	/// Reads what the instance wrote and processes every complete frame.
+	/// @return bool False if the connection was closed, or sent an invalid frame.
+	bool Receive(FConnection& Connection)
+	{
+		uint8 Buffer[64 * 1024];
+		for (;;)
+		{
+			const ssize_t Read = recv(Connection.Socket, Buffer, sizeof(Buffer), 0);
+			if (Read > 0)
+			{
+				Connection.Received.Append(Buffer, Read);
+				BytesReceived += Read;
+				continue;
+			}
+			if (Read < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (Read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				break;
+			}
+			// Closed by the instance, frames it completed before closing are still processed
+			ProcessFrames(Connection);
+			return false;
+		}
+
+		return ProcessFrames(Connection);
+	}
+
+	bool ProcessFrames(FConnection& Connection)
+	{
+		const double Now = FPlatformTime::Seconds();
+		int32 Consumed = 0;
+		while (Connection.Received.Num() - Consumed >= FrameHeaderSize)
+		{
+			const uint8* Header = Connection.Received.GetData() + Consumed;
+			uint32 PayloadSize = 0;
+			FMemory::Memcpy(&PayloadSize, Header, sizeof(PayloadSize));
+			const EFrameType Type = static_cast<EFrameType>(Header[sizeof(uint32)]);
+			if (PayloadSize > static_cast<uint32>(MaxFrameSize))
+			{
+				UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::ProcessFrames | Frame of %u bytes is too large, closing the connection"), PayloadSize);
+				return false;
+			}
+			if (Connection.Received.Num() - Consumed < FrameHeaderSize + static_cast<int32>(PayloadSize))
+			{
+				break;
+			}
+
+			const uint8* Payload = Header + FrameHeaderSize;
+			const uint8* PayloadEnd = Payload + PayloadSize;
+			Consumed += FrameHeaderSize + PayloadSize;
+
+			if (Type == EFrameType::Session)
+			{
+				FString LogID;
+				FString Token;
+				FString ChunkEndpoint;
+				if (!ReadString(Payload, PayloadEnd, LogID) || !ReadString(Payload, PayloadEnd, Token) || !ReadString(Payload, PayloadEnd, ChunkEndpoint)
+					|| LogID.IsEmpty())
+				{
+					UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::ProcessFrames | Invalid session frame, closing the connection"));
+					return false;
+				}
+
+				// Every session batches on its own, so instances switch sessions for the chunks of their log streams without sealing the batch of
+				// the previous one, which is sealed by its size or age like any other
+				FSession& Session = Sessions.FindOrAdd(LogID);
+				const bool bNewToken = Session.Token != Token;
+				Session.Token = MoveTemp(Token);
+				Session.ChunkEndpoint = MoveTemp(ChunkEndpoint);
+				Session.LastActivityTime = Now;
+				Connection.LogID = MoveTemp(LogID);
+				UE_LOG(LogCapsaLog, Verbose, TEXT("FAgent::ProcessFrames | Instance uses log %s"), *Connection.LogID);
+
+				if (bNewToken)
+				{
+					RetryUploads(Session);
+				}
+			}
+			else if (Type == EFrameType::Chunk)
+			{
+				FString LineSequences;
+				uint64 ChunkSequence = 0;
+				if (Connection.LogID.IsEmpty() || Payload == PayloadEnd)
+				{
+					UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::ProcessFrames | Chunk without a session, closing the connection"));
+					return false;
+				}
+				const ECapsaLogLane Lane = *Payload++ == static_cast<uint8>(ECapsaLogLane::Priority) ? ECapsaLogLane::Priority : ECapsaLogLane::Bulk;
+				if (PayloadEnd - Payload < static_cast<int64>(sizeof(ChunkSequence)))
+				{
+					UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::ProcessFrames | Invalid chunk frame, closing the connection"));
+					return false;
+				}
+				FMemory::Memcpy(&ChunkSequence, Payload, sizeof(ChunkSequence));
+				Payload += sizeof(ChunkSequence);
+				if (!ReadString(Payload, PayloadEnd, LineSequences))
+				{
+					UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::ProcessFrames | Invalid chunk frame, closing the connection"));
+					return false;
+				}
+
+				AddChunk(Connection.LogID, Lane, ChunkSequence, MoveTemp(LineSequences), Payload, PayloadEnd - Payload, Now);
+			}
+			else
+			{
+				UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::ProcessFrames | Unknown frame type %d, closing the connection"), static_cast<int32>(Type));
+				return false;
+			}
+		}
+
+		Connection.Received.RemoveAt(0, Consumed, false);
+		return true;
+	}
+
+	void AddChunk(const FString& LogID, ECapsaLogLane Lane, uint64 ChunkSequence, FString LineSequences, const uint8* Log, int64 LogSize, double Now)
+	{
+		FSession& Session = Sessions.FindChecked(LogID);
+		Session.LastActivityTime = Now;
+		++ChunksReceived;
+
+		if (Lane == ECapsaLogLane::Priority)
+		{
+			// Not batched, priority chunks are small and must not wait
+			TArray<uint8> Uncompressed(Log, static_cast<int32>(LogSize));
+			LaunchCompress(MakeUpload(LogID, Session, Lane, ChunkSequence, MoveTemp(LineSequences)), MoveTemp(Uncompressed));
+			return;
+		}
+
+		if (Session.Batch.IsEmpty())
+		{
+			Session.BatchStartTime = Now;
+			Session.BatchChunkSequence = ChunkSequence;
+		}
+		Session.Batch.Append(Log, static_cast<int32>(LogSize));
+		if (!LineSequences.IsEmpty())
+		{
+			Session.BatchSequences.Add(MoveTemp(LineSequences));
+		}
+
+		if (Session.Batch.Num() >= BatchBytes)
+		{
+			SealBatch(LogID, Session);
+		}
+	}
+
+	/// Starts uploading the batched bulk chunks of a session as a single chunk.
+	void SealBatch(const FString& LogID, FSession& Session)
+	{
+		if (Session.Batch.IsEmpty())
+		{
+			return;
+		}
+
+		// The ranges of consecutive chunks concatenate like their lines
+		TUniquePtr<FUpload> Upload = MakeUpload(LogID, Session, ECapsaLogLane::Bulk, Session.BatchChunkSequence,
+			FString::Join(Session.BatchSequences, TEXT(",")));
+		LaunchCompress(MoveTemp(Upload), MoveTemp(Session.Batch));
+		Session.Batch.Reset();
+		Session.BatchSequences.Reset();
+	}
+
+	void SealBatches(double Now, bool bAll)
+	{
+		for (TPair<FString, FSession>& Pair : Sessions)
+		{
+			FSession& Session = Pair.Value;
+			if (!Session.Batch.IsEmpty() && (bAll || Now - Session.BatchStartTime >= BatchDelay))
+			{
+				SealBatch(Pair.Key, Session);
+			}
+		}
+	}
+
+	/// The chunk sequence is allocated by the instance, so uploads keep the order of their chunks even if they are compressed out of order, and
+	/// order with the chunks the instance uploaded itself. A batch is uploaded with the sequence of its first chunk, the sequences of the other
+	/// chunks are left as a gap.
+	static TUniquePtr<FUpload> MakeUpload(const FString& LogID, FSession& Session, ECapsaLogLane Lane, uint64 ChunkSequence, FString LineSequences)
+	{
+		TUniquePtr<FUpload> Upload = MakeUnique<FUpload>();
+		Upload->LogID = LogID;
+		Upload->Token = Session.Token;
+		Upload->ChunkEndpoint = Session.ChunkEndpoint;
+		Upload->ChunkSequence = ChunkSequence;
+		Upload->Lane = Lane;
+		Upload->LineSequences = MoveTemp(LineSequences);
+		return Upload;
+	}
+
+	void LaunchCompress(TUniquePtr<FUpload> Upload, TArray<uint8> Uncompressed)
+	{
+		++NumCompressing;
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, Upload = MoveTemp(Upload), Uncompressed = MoveTemp(Uncompressed)]() mutable
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE(FAgent::Compress);
+			int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, Uncompressed.Num());
+			Upload->Compressed.SetNumUninitialized(CompressedSize);
+			Upload->bFailed = !FCompression::CompressMemory(NAME_Zlib, Upload->Compressed.GetData(), CompressedSize, Uncompressed.GetData(), Uncompressed.Num());
+			Upload->Compressed.SetNum(Upload->bFailed ? 0 : CompressedSize);
+			Upload->UncompressedSize = Uncompressed.Num();
+
+			CompressedUploads.Enqueue(MoveTemp(Upload));
+			--NumCompressing;
+		});
+	}
+
+	void SubmitUploads()
+	{
+		TUniquePtr<FUpload> Upload;
+		while (CompressedUploads.Dequeue(Upload))
+		{
+			if (Upload->bFailed)
+			{
+				UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::SubmitUploads | Failed to compress %lld bytes of log %s"), Upload->UncompressedSize, *Upload->LogID);
+				++UploadsFailed;
+				continue;
+			}
+
+			Submit(MakeShareable(Upload.Release()));
+		}
+	}
+
+	void Submit(const TSharedRef<FUpload>& Upload)
+	{
+		FHttpRequestRef Request = FHttpModule::Get().CreateRequest();
+		Request->SetURL(Upload->ChunkEndpoint);
+		Request->SetVerb("POST");
+		Request->SetHeader("Authorization", TEXT("Bearer ") + Upload->Token);
+		Request->SetHeader("Content-Type", "application/zlib");
+		Request->SetHeader("X-Capsa-Chunk-Sequence", LexToString(Upload->ChunkSequence));
+		Request->SetHeader("X-Capsa-Lane", Upload->Lane == ECapsaLogLane::Priority ? TEXT("Priority") : TEXT("Bulk"));
+		if (!Upload->LineSequences.IsEmpty())
+		{
+			Request->SetHeader("X-Capsa-Line-Sequences", Upload->LineSequences);
+		}
+		BytesUploaded += Upload->Compressed.Num();
+		Request->SetContent(MoveTemp(Upload->Compressed));
+
+		Request->OnProcessRequestComplete().BindLambda([this, Upload](FHttpRequestPtr CompletedRequest, FHttpResponsePtr Response, bool bSuccess)
+		{
+			--NumInFlight;
+			const int32 ResponseCode = Response.IsValid() ? Response->GetResponseCode() : 0;
+			if (bSuccess && ResponseCode == EHttpResponseCodes::Denied && CompletedRequest.IsValid())
+			{
+				// The token expired, the instance refreshes it and sends it in a Session frame
+				Upload->Compressed = CompletedRequest->GetContent();
+				RetryWithNewToken(Upload);
+				return;
+			}
+			if (!bSuccess || !Response.IsValid() || ResponseCode > 299)
+			{
+				UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::Submit | Upload for log %s failed with code %d"), *Upload->LogID, ResponseCode);
+				++UploadsFailed;
+				return;
+			}
+			++UploadsSucceeded;
+		});
+		++NumInFlight;
+		Request->ProcessRequest();
+	}
+
+	/// Sends an upload rejected with 401 again with the current token of its session, or keeps it until the instance sends a new one.
+	void RetryWithNewToken(const TSharedRef<FUpload>& Upload)
+	{
+		FSession* Session = Sessions.Find(Upload->LogID);
+		if (Session == nullptr)
+		{
+			UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::RetryWithNewToken | Upload for log %s was denied, and the session is gone"), *Upload->LogID);
+			++UploadsFailed;
+			return;
+		}
+
+		++UploadsRetried;
+		if (Session->Token != Upload->Token)
+		{
+			// The token was refreshed while the upload was in flight
+			Upload->Token = Session->Token;
+			Upload->ChunkEndpoint = Session->ChunkEndpoint;
+			Submit(Upload);
+			return;
+		}
+
+		UE_LOG(LogCapsaLog, Verbose, TEXT("FAgent::RetryWithNewToken | Upload for log %s was denied, waiting for a new token"), *Upload->LogID);
+		if (Session->RetryUploads.Num() >= MaxRetryUploads)
+		{
+			UE_LOG(LogCapsaLog, Warning, TEXT("FAgent::RetryWithNewToken | Too many denied uploads for log %s, dropping the oldest"), *Upload->LogID);
+			Session->RetryUploads.RemoveAt(0);
+			++UploadsFailed;
+		}
+		Session->RetryUploads.Add(Upload);
+	}
+
+	/// Sends the uploads of a session that were rejected with 401 again, with the token the instance just sent.
+	void RetryUploads(FSession& Session)
+	{
+		TArray<TSharedRef<FUpload>> Uploads = MoveTemp(Session.RetryUploads);
+		for (const TSharedRef<FUpload>& Upload : Uploads)
+		{
+			Upload->Token = Session.Token;
+			Upload->ChunkEndpoint = Session.ChunkEndpoint;
+			Submit(Upload);
+		}
+	}
+
+	void Tick(double Now, double& LastTickTime)
+	{
+		const float DeltaTime = static_cast<float>(Now - LastTickTime);
+		LastTickTime = Now;
+
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		FTSTicker::GetCoreTicker().Tick(DeltaTime);
+		FHttpModule::Get().GetHttpManager().Tick(DeltaTime);
+	}
+
+	void Close(int32 Index)
+	{
+		FConnection& Connection = Connections[Index];
+		close(Connection.Socket);
+
+		// Usually the instance is exiting, upload what it batched without waiting for BatchDelay
+		if (FSession* Session = Sessions.Find(Connection.LogID))
+		{
+			SealBatch(Connection.LogID, *Session);
+		}
+
+		UE_LOG(LogCapsaLog, Verbose, TEXT("FAgent::Close | Instance with log %s disconnected"), *Connection.LogID);
+		Connections.RemoveAtSwap(Index);
+	}
+
+	/// Forgets sessions that have been idle for SessionTimeout, and are not used by a connection.
+	void PruneSessions(double Now)
+	{
+		for (auto It = Sessions.CreateIterator(); It; ++It)
+		{
+			const bool bConnected = Connections.ContainsByPredicate([&It](const FConnection& Connection) { return Connection.LogID == It.Key(); });
+			if (!bConnected && It.Value().Batch.IsEmpty() && Now - It.Value().LastActivityTime > SessionTimeout)
+			{
+				UploadsFailed += It.Value().RetryUploads.Num();
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	void LogStats() const
+	{
+		UE_LOG(LogCapsaLog, Display,
+			TEXT("FAgent::LogStats | %d connections, %d sessions | received %.1f MB in %lld chunks | uploaded %.1f MB in %lld requests, %lld failed, %lld retried"),
+			Connections.Num(), Sessions.Num(), BytesReceived / (1024.0 * 1024.0), ChunksReceived, BytesUploaded / (1024.0 * 1024.0),
+			UploadsSucceeded, UploadsFailed, UploadsRetried);
+	}
+
+	const FString SocketPath;
+	const int32 BatchBytes;
+	const double BatchDelay;
+
+	int32 ListenSocket = -1;
+	TArray<FConnection> Connections;
+	TMap<FString, FSession> Sessions;
+
+	/// Produced by the compression tasks, consumed by the main loop.
+	TQueue<TUniquePtr<FUpload>, EQueueMode::Mpsc> CompressedUploads;
+	std::atomic<int32> NumCompressing{0};
+	int32 NumInFlight = 0;
+
+	int64 BytesReceived = 0;
+	int64 ChunksReceived = 0;
+	int64 BytesUploaded = 0;
+	int64 UploadsSucceeded = 0;
+	int64 UploadsFailed = 0;
+	int64 UploadsRetried = 0; ///< Uploads rejected with 401, and sent again with a new token
+};
+}
+#endif
+
+UCapsaHostAgentCommandlet::UCapsaHostAgentCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+	ShowErrorCount = false;
+}
+
+int32 UCapsaHostAgentCommandlet::Main(const FString& Params)
+{
+#if PLATFORM_LINUX
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	FString SocketPath = CapsaSettings != nullptr ? CapsaSettings->GetHostAgentSocketPath() : FString();
+	int32 BatchKB = 1024;
+	double BatchDelay = 2.0;
+	double StatsInterval = 60.0;
+	FParse::Value(*Params, TEXT("Socket="), SocketPath);
+	FParse::Value(*Params, TEXT("BatchKB="), BatchKB);
+	FParse::Value(*Params, TEXT("BatchDelay="), BatchDelay);
+	FParse::Value(*Params, TEXT("StatsInterval="), StatsInterval);
+
+	CapsaHostAgent::FAgent Agent(SocketPath, BatchKB * 1024, BatchDelay);
+	if (!Agent.Listen())
+	{
+		return 1;
+	}
+
+	Agent.Run(StatsInterval);
+	return 0;
+#else
+	UE_LOG(LogCapsaLog, Error, TEXT("UCapsaHostAgentCommandlet::Main | The host agent is only supported on Linux"));
+	return 1;
+#endif
+}
@@ -3,13 +3,121 @@
 #include "Misc/CapsaOutputDevice.h"
 
 #include "Settings/CapsaSettings.h"
+#include "CapsaLog.h"
 #include "CapsaCoreSubsystem.h"
+#include "CapsaCoreStats.h"
+#include "CapsaCoreTrace.h"
+#include "CapsaHistoryRing.h"
+#include "CapsaLogStreams.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+/// Errors of Capsa itself, fe. a failed upload, must not trigger another upload.
+bool IsCapsaCategory(const FName& Category)
+{
+	static const FName CapsaCoreCategory(TEXT("LogCapsaCore"));
+	return Category == CapsaCoreCategory || Category == LogCapsaLog.GetCategoryName();
+}
+
+/// The memory held by a buffered line, which copies its data including the terminator.
+int64 GetLineMemory(int64 LineBytes)
+{
+	return sizeof(FBufferedLine) + LineBytes + sizeof(TCHAR);
+}
+
+/// The directory crash windows are saved to, as CrashWindow-<ProcessID>.log, see FCapsaOutputDevice::OnSystemError().
+FString GetCrashWindowDirectory()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Capsa"));
+}
+
+/// Starts the first line of a crash window, followed by the LogID of the crashed process.
+const TCHAR* CrashWindowLogIDPrefix = TEXT("#CapsaLogID\t");
+
+/// Appends a line of a crash window: the capture time, verbosity and category, and the message with its line breaks escaped, separated by tabs.
+void AppendCrashWindowLine(FString& Content, double Time, ELogVerbosity::Type Verbosity, const FName& Category, FStringView Message)
+{
+	Content.Appendf(TEXT("%.6f\t%d\t%s\t"), Time, static_cast<int32>(Verbosity), *Category.ToString());
+	for (const TCHAR Char : Message)
+	{
+		switch (Char)
+		{
+		case TEXT('\\'):
+			Content += TEXT("\\\\");
+			break;
+		case TEXT('\n'):
+			Content += TEXT("\\n");
+			break;
+		case TEXT('\r'):
+			Content += TEXT("\\r");
+			break;
+		default:
+			Content.AppendChar(Char);
+			break;
+		}
+	}
+	Content.AppendChar(TEXT('\n'));
+}
+
+/// Parses a line written by AppendCrashWindowLine().
+bool ParseCrashWindowLine(const FString& Line, TArray<FBufferedLine>& OutLines)
+{
+	TArray<FString> Fields;
+	if (Line.ParseIntoArray(Fields, TEXT("\t"), false) < 4)
+	{
+		return false;
+	}
+
+	// Tabs in the message were not escaped
+	FString Message = FString::Join(MakeArrayView(Fields).RightChop(3), TEXT("\t"));
+	FString Unescaped;
+	Unescaped.Reserve(Message.Len());
+	for (int32 Index = 0; Index < Message.Len(); ++Index)
+	{
+		if (Message[Index] != TEXT('\\') || Index + 1 == Message.Len())
+		{
+			Unescaped.AppendChar(Message[Index]);
+			continue;
+		}
+
+		const TCHAR Escaped = Message[++Index];
+		Unescaped.AppendChar(Escaped == TEXT('n') ? TEXT('\n') : Escaped == TEXT('r') ? TEXT('\r') : Escaped);
+	}
+
+	const int32 Verbosity = FMath::Clamp(FCString::Atoi(*Fields[1]), static_cast<int32>(ELogVerbosity::Fatal), static_cast<int32>(ELogVerbosity::VeryVerbose));
+	OutLines.Emplace(*Unescaped, FName(*Fields[2]), static_cast<ELogVerbosity::Type>(Verbosity), FCString::Atod(*Fields[0]));
+	return true;
+}
+}
 
 FCapsaOutputDevice::FCapsaOutputDevice() :
 	TickRate(1.f),
 	UpdateRate(0.f),
 	MaxLogLines(100),
-	LastUpdateTime(0)
+	LastUpdateTime(0),
+	PendingChunkID(CapsaTrace::AllocateChunkID()),
+	BufferedBytes(0),
+	bCaptureStructuredLogs(false),
+	bUploadOnTrigger(false),
+	TriggerLinesBefore(2000),
+	TriggerLinesAfter(200),
+	TriggerMaxDelay(5.f),
+	LinesAtTrigger(0),
+	TriggerTime(0),
+	bTriggerAuthRequested(false),
+	bUsePriorityLane(false),
+	PriorityVerbosity(ELogVerbosity::Error),
+	PriorityFlushDeadline(2.f),
+	PriorityBytes(0),
+	PriorityChunkID(CapsaTrace::AllocateChunkID()),
+	NextLineSequence(0),
+	bUseWorldStreams(false),
+	bStartupPending(false),
+	StartupBytes(0),
+	NumIngestedLines(0)
 {
 	// TODO: Make this a config option
 	FilterLevel = ELogVerbosity::All;
@@ -18,11 +126,30 @@ FCapsaOutputDevice::FCapsaOutputDevice() :
 
 FCapsaOutputDevice::~FCapsaOutputDevice()
 {
+	if (StartupTickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(StartupTickerHandle);
+	}
+	if (StartupTask.IsValid())
+	{
+		StartupTask.Wait();
+	}
+
 	if (TickerHandle.IsValid())
 	{
 		GLog->RemoveOutputDevice(this);
 		FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+		FCoreDelegates::OnEnginePreExit.RemoveAll(this);
+		FCoreDelegates::OnHandleSystemEnsure.RemoveAll(this);
+		FCoreDelegates::OnHandleSystemError.RemoveAll(this);
 	}
+
+	if (PriorityTickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(PriorityTickerHandle);
+	}
+
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, -BufferedBytes - PriorityBytes - StartupBytes);
 }
 
 void FCapsaOutputDevice::Serialize(const TCHAR* InData, ELogVerbosity::Type Verbosity, const FName& Category)
@@ -32,12 +159,150 @@ void FCapsaOutputDevice::Serialize(const TCHAR* InData, ELogVerbosity::Type Verb
 		return;
 	}
 
+	SCOPE_CYCLE_COUNTER(STAT_CapsaCapture);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	const int64 LineBytes = FCString::Strlen(InData) * sizeof(TCHAR);
+	FCapsaPipelineStats::Get().RecordCapture(LineBytes);
+
+	const int64 LineMemory = GetLineMemory(LineBytes);
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, LineMemory);
+
+	// Covers waiting for and holding the lock, which is what a game-thread log call pays for when worker threads are logging too
+	FCapsaGameThreadCostScope GameThreadCostScope;
+	const double Time = FDateTime::UtcNow().ToUnixTimestampDecimal();
+	const uint16 Stream = bUseWorldStreams ? CapsaLogStreams::GetCurrent() : CapsaLogStreams::DefaultStream;
+
+	if (bStartupPending.load(std::memory_order_acquire))
+	{
+		FScopeLock ScopeLock(&SynchronizationObject);
+		// Checked again under the lock, the ingestion only clears it once StartupLines is drained
+		if (bStartupPending.load(std::memory_order_relaxed))
+		{
+			StartupLines.Emplace(InData, Category, Verbosity, Time);
+			StartupStreams.Add(Stream);
+			StartupBytes += LineMemory;
+			return;
+		}
+	}
+
+	CaptureLine(InData, Verbosity, Category, Time, Stream, LineBytes);
+}
+
+void FCapsaOutputDevice::CaptureLine(const TCHAR* InData, ELogVerbosity::Type Verbosity, const FName& Category, double Time, uint16 Stream, int64 LineBytes)
+{
+	const int64 LineMemory = GetLineMemory(LineBytes);
+	if (History.IsValid())
+	{
+		History->AddLine(InData, Verbosity, Category, Time);
+	}
+
+	const bool bPriority = IsPriorityLine(Verbosity, Category);
+
+	FScopeLock ScopeLock(&SynchronizationObject);
+	if (bPriority)
+	{
+		PriorityLines.Emplace(InData, Category, Verbosity, Time);
+		PriorityBytes += LineMemory;
+		PrioritySequences.Add(NextLineSequence++);
+		if (bUseWorldStreams)
+		{
+			PriorityStreams.Add(Stream);
+		}
+		SchedulePriorityFlushLocked();
+	}
+	else
+	{
+		BufferedLines.Emplace(InData, Category, Verbosity, Time);
+		BufferedBytes += LineMemory;
+		BufferedSequences.Add(NextLineSequence++);
+		if (bUseWorldStreams)
+		{
+			BufferedStreams.Add(Stream);
+		}
+	}
+	FCapsaPipelineStats::Get().RecordBufferSize(GetNumBufferedLines());
+
+	if (bUploadOnTrigger && Verbosity <= ELogVerbosity::Error && !IsCapsaCategory(Category))
+	{
+		TriggerLocked(Verbosity == ELogVerbosity::Fatal ? TEXT("Fatal") : TEXT("Error"));
+	}
+
+	if (CapsaTrace::IsChannelEnabled())
+	{
+		const uint64 CaptureCycle = FPlatformTime::Cycles64();
+		CapsaTrace::OutputStage(bPriority ? PriorityChunkID : PendingChunkID, ECapsaTraceStage::Capture, CaptureCycle, CaptureCycle, LineBytes, 0, 1);
+	}
+}
+
+void FCapsaOutputDevice::SerializeRecord(const UE::FLogRecord& Record)
+{
+	if (!bCaptureStructuredLogs || Record.GetTextNamespace() != nullptr || bStartupPending.load(std::memory_order_acquire))
+	{
+		// Renders the message and calls Serialize. Localized records are rendered here too, as their text may change before the chunk is formatted.
+		// Records logged while starting up are staged as text
+		FBufferedOutputDevice::SerializeRecord(Record);
+		return;
+	}
+
+	if (Record.GetVerbosity() > FilterLevel)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CapsaCapture);
+	LLM_SCOPE_BYTAG(Capsa);
+
+	const double Time = FDateTime::UtcNow().ToUnixTimestampDecimal();
+
+	FCapsaGameThreadCostScope GameThreadCostScope;
+	if (History.IsValid())
+	{
+		// Rendered once the history block is sealed, like the chunk
+		History->AddRecord(Record, Time);
+	}
+
+	const bool bPriority = IsPriorityLine(Record.GetVerbosity(), Record.GetCategory());
+	const uint16 Stream = bUseWorldStreams ? CapsaLogStreams::GetCurrent() : CapsaLogStreams::DefaultStream;
+
 	FScopeLock ScopeLock(&SynchronizationObject);
-	BufferedLines.Emplace(InData, Category, Verbosity, FDateTime::UtcNow().ToUnixTimestampDecimal());
+	FCapsaStructuredLine& Line = bPriority
+		? PriorityStructuredLines.Emplace_GetRef(Record, PriorityLines.Num(), Time)
+		: StructuredLines.Emplace_GetRef(Record, BufferedLines.Num(), Time);
+	Line.Stream = Stream;
+
+	const int64 LineMemory = sizeof(FCapsaStructuredLine) + Line.GetFieldsSize();
+	if (bPriority)
+	{
+		PriorityBytes += LineMemory;
+		PrioritySequences.Add(NextLineSequence++);
+		SchedulePriorityFlushLocked();
+	}
+	else
+	{
+		BufferedBytes += LineMemory;
+		BufferedSequences.Add(NextLineSequence++);
+	}
+	FCapsaPipelineStats::Get().RecordCapture(Line.GetFieldsSize());
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, LineMemory);
+	FCapsaPipelineStats::Get().RecordBufferSize(GetNumBufferedLines());
+
+	if (bUploadOnTrigger && Record.GetVerbosity() <= ELogVerbosity::Error && !IsCapsaCategory(Record.GetCategory()))
+	{
+		TriggerLocked(Record.GetVerbosity() == ELogVerbosity::Fatal ? TEXT("Fatal") : TEXT("Error"));
+	}
+
+	if (CapsaTrace::IsChannelEnabled())
+	{
+		const uint64 CaptureCycle = FPlatformTime::Cycles64();
+		CapsaTrace::OutputStage(bPriority ? PriorityChunkID : PendingChunkID, ECapsaTraceStage::Capture, CaptureCycle, CaptureCycle, Line.GetFieldsSize(), 0, 1);
+	}
 }
 
 void FCapsaOutputDevice::Initialize()
 {
+	FCapsaStartupScope StartupScope(false);
+
 	UCapsaSettings* CapsaSettings = GetMutableDefault<UCapsaSettings>();
 	if (CapsaSettings == nullptr)
 	{
@@ -47,29 +312,85 @@ void FCapsaOutputDevice::Initialize()
 	TickRate = CapsaSettings->GetLogTickRate();
 	UpdateRate = CapsaSettings->GetMaxTimeBetweenLogFlushes();
 	MaxLogLines = CapsaSettings->GetMaxLogLinesBetweenLogFlushes();
+	bCaptureStructuredLogs = CapsaSettings->GetCaptureStructuredLogs();
+	bUploadOnTrigger = CapsaSettings->GetUploadMode() == ECapsaUploadMode::OnTrigger;
+	TriggerLinesBefore = FMath::Max(CapsaSettings->GetTriggerLinesBefore(), 1);
+	TriggerLinesAfter = FMath::Max(CapsaSettings->GetTriggerLinesAfter(), 0);
+	TriggerMaxDelay = CapsaSettings->GetTriggerMaxDelay();
+	// When uploading on trigger nothing is uploaded before the trigger, errors are a trigger themselves
+	bUsePriorityLane = CapsaSettings->GetUsePriorityLane() && !bUploadOnTrigger;
+	PriorityVerbosity = CapsaSettings->GetPriorityVerbosity();
+	PriorityFlushDeadline = FMath::Max(CapsaSettings->GetPriorityFlushDeadline(), 0.f);
+	bUseWorldStreams = CapsaSettings->GetUseWorldStreams();
+
+	if (CapsaSettings->GetHistorySizeMB() > 0)
+	{
+		LLM_SCOPE_BYTAG(Capsa);
+		History = MakeShared<FCapsaHistoryRing, ESPMode::ThreadSafe>(static_cast<int64>(CapsaSettings->GetHistorySizeMB()) * 1024 * 1024,
+			CapsaSettings->GetHistoryBlockSizeKB() * 1024);
+	}
 
 	LastUpdateTime = FPlatformTime::Seconds();
 
 	if (TickRate > 0.0f)
 	{
+		// The backlog, and every line logged until the first Tick, is only copied while the engine starts, see IngestStartupLines()
+		bStartupPending = true;
 #if ENGINE_MAJOR_VERSION <= 5 && ENGINE_MINOR_VERSION < 7
 		// SerializeBacklog is called within AddOutputDevice from UE5.7 onwards.
 		GLog->SerializeBacklog(this);
 #endif
 		TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FCapsaOutputDevice::Tick), TickRate);
+		StartupTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FCapsaOutputDevice::TickStartup));
 		GLog->AddOutputDevice(this);
 		FCoreDelegates::OnEnginePreExit.AddRaw(this, &FCapsaOutputDevice::OnPreExit);
+		LoadCrashWindows();
+		if (bUploadOnTrigger)
+		{
+			FCoreDelegates::OnHandleSystemEnsure.AddRaw(this, &FCapsaOutputDevice::OnSystemEnsure);
+			FCoreDelegates::OnHandleSystemError.AddRaw(this, &FCapsaOutputDevice::OnSystemError);
+		}
 	}
 }
 
 bool FCapsaOutputDevice::Tick(float Seconds)
 {
-	if (BufferedLines.IsEmpty())
+	SCOPE_CYCLE_COUNTER(STAT_CapsaTick);
+	FCapsaGameThreadCostScope GameThreadCostScope;
+
+	if (bStartupPending.load(std::memory_order_acquire))
+	{
+		// Sent by TickStartup, one slice at a time
+		return true;
+	}
+
+	// Once startup compiled the redaction patterns, so snapshots taken on other threads, and crash windows, are redacted as well
+	UpdateRedactor();
+
+	if (UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>())
+	{
+		UpdateCrashContext(*CapsaCoreSubsystem);
+
+		if (!UnsentChunks.IsEmpty() && CapsaCoreSubsystem->IsAuthenticated())
+		{
+			// The rest of a flush the upload pipeline had no room for, sent as soon as it has
+			SendUnsentChunks(*CapsaCoreSubsystem, false);
+		}
+	}
+
+	const int32 NumBufferedLines = GetNumBufferedLines();
+	if (NumBufferedLines == 0)
 	{
 		return true;
 	}
 
 	double Now = FPlatformTime::Seconds();
+	if (bUploadOnTrigger)
+	{
+		TickTrigger(Now);
+		return true;
+	}
+
 	bool bExceedTime = false;
 	bool bExceedLines = false;
 
@@ -78,7 +399,7 @@ bool FCapsaOutputDevice::Tick(float Seconds)
 		bExceedTime = true;
 	}
 
-	if (BufferedLines.Num() >= MaxLogLines)
+	if (NumBufferedLines >= MaxLogLines)
 	{
 		bExceedLines = true;
 	}
@@ -88,38 +409,653 @@ bool FCapsaOutputDevice::Tick(float Seconds)
 		return true;
 	}
 
+	if (ShouldKeepBufferedLines())
+	{
+		return true;
+	}
+
+	SendBufferedLines();
+	LastUpdateTime = Now;
+
+	return true;
+}
+
+void FCapsaOutputDevice::FlushBufferedLines(bool bBlocking)
+{
+	LLM_SCOPE_BYTAG(Capsa);
+
+	// Possibly before the first Tick, fe. when shutting down, the staged lines are sent with the rest
+	CompleteStartup();
+	SendBufferedLines(bBlocking);
+}
+
+void FCapsaOutputDevice::SendBufferedLines(bool bBlocking)
+{
+	LLM_SCOPE_BYTAG(Capsa);
+
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
 	if (CapsaCoreSubsystem != nullptr && CapsaCoreSubsystem->IsValidLowLevelFast())
 	{
 		if (CapsaCoreSubsystem->IsAuthenticated())
 		{
-			TArray<FBufferedLine> BufferToSend;
-			GetContents(BufferToSend);
-			CapsaCoreSubsystem->SendLog(BufferToSend);
+			// Chunks split off an earlier flush go first, the lines buffered since are newer
+			if (!SendUnsentChunks(*CapsaCoreSubsystem, bBlocking))
+			{
+				return;
+			}
+
+			FCapsaLogChunk PriorityChunk;
+			if (FlushPriorityContents(PriorityChunk))
+			{
+				SendChunk(*CapsaCoreSubsystem, MoveTemp(PriorityChunk), bBlocking);
+			}
+
+			// Callers only checked for one free slot, which the priority chunk may have taken. The bulk lines are sent on a later tick then
+			if (!bBlocking && !CapsaCoreSubsystem->CanSendLog())
+			{
+				return;
+			}
+
+			FCapsaLogChunk ChunkToSend;
+			FlushContents(ChunkToSend);
+			SendChunk(*CapsaCoreSubsystem, MoveTemp(ChunkToSend), bBlocking);
+			return;
 		}
-		else // Trigger authentication attempt
+
+		if (bBlocking)
 		{
-			CapsaCoreSubsystem->RequestClientAuth();
+			// Shutting down, there is no time left to authenticate
+			return;
 		}
+
+		// Trigger authentication attempt
+		CapsaCoreSubsystem->RequestClientAuth();
 	}
 
-	LastUpdateTime = Now;
+	for (const FCapsaLogChunk& UnsentChunk : UnsentChunks)
+	{
+		FCapsaPipelineStats::Get().RecordDropped(UnsentChunk.Num());
+	}
+	UnsentChunks.Empty();
+
 	FScopeLock ScopeLock(&SynchronizationObject);
+	// Without an authenticated subsystem the buffered lines cannot be sent
+	FCapsaPipelineStats::Get().RecordDropped(GetNumBufferedLines());
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, -BufferedBytes - PriorityBytes);
 	BufferedLines.Empty();
+	StructuredLines.Empty();
+	BufferedSequences = FCapsaLineSequences();
+	BufferedStreams.Empty();
+	BufferedBytes = 0;
+
+	PriorityLines.Empty();
+	PriorityStructuredLines.Empty();
+	PrioritySequences = FCapsaLineSequences();
+	PriorityStreams.Empty();
+	PriorityBytes = 0;
+	FTSTicker::GetCoreTicker().RemoveTicker(PriorityTickerHandle);
+	PriorityTickerHandle.Reset();
+}
+
+void FCapsaOutputDevice::SendChunk(UCapsaCoreSubsystem& CapsaCoreSubsystem, FCapsaLogChunk&& Chunk, bool bBlocking)
+{
+	// Lines of other streams than the default go to the session of their stream
+	TArray<FCapsaLogChunk> StreamChunks;
+	Chunk.SplitStreams(StreamChunks);
+
+	if (!Chunk.IsEmpty())
+	{
+		UnsentChunks.Add(MoveTemp(Chunk));
+	}
+	UnsentChunks.Append(MoveTemp(StreamChunks));
+
+	// Callers only checked for one free slot, the chunks the pipeline has no room for are sent on a later tick
+	SendUnsentChunks(CapsaCoreSubsystem, bBlocking);
+}
+
+bool FCapsaOutputDevice::SendUnsentChunks(UCapsaCoreSubsystem& CapsaCoreSubsystem, bool bBlocking)
+{
+	int32 NumSent = 0;
+	for (; NumSent < UnsentChunks.Num(); ++NumSent)
+	{
+		if (!bBlocking && !CapsaCoreSubsystem.CanSendLog())
+		{
+			break;
+		}
+		CapsaCoreSubsystem.SendLogChunk(MoveTemp(UnsentChunks[NumSent]), bBlocking);
+	}
+
+	UnsentChunks.RemoveAt(0, NumSent);
+	return UnsentChunks.IsEmpty();
+}
+
+void FCapsaOutputDevice::IngestStartupLines(int32 MaxLines)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaOutputDevice::IngestStartupLines);
+	LLM_SCOPE_BYTAG(Capsa);
+	FCapsaStartupScope StartupScope(true);
+
+	if (NumIngestedLines == IngestingLines.Num())
+	{
+		// The previous lines are done, release them before taking the lines staged since
+		IngestingLines.Empty();
+		IngestingStreams.Empty();
+		NumIngestedLines = 0;
+
+		FScopeLock ScopeLock(&SynchronizationObject);
+		if (StartupLines.IsEmpty())
+		{
+			// Lines captured from now on are buffered straight away, after the last staged line
+			bStartupPending.store(false, std::memory_order_release);
+			return;
+		}
+
+		IngestingLines = MoveTemp(StartupLines);
+		IngestingStreams = MoveTemp(StartupStreams);
+		StartupLines.Reset();
+		StartupStreams.Reset();
+	}
+
+	const int32 SliceEnd = NumIngestedLines + FMath::Min(FMath::Max(MaxLines, 1), IngestingLines.Num() - NumIngestedLines);
+	FCapsaPipelineStats::Get().StartupLines.fetch_add(SliceEnd - NumIngestedLines, std::memory_order_relaxed);
+
+	int64 IngestedBytes = 0;
+	for (; NumIngestedLines < SliceEnd; ++NumIngestedLines)
+	{
+		const FBufferedLine& Line = IngestingLines[NumIngestedLines];
+		const int64 LineBytes = FCString::Strlen(Line.Data.Get()) * sizeof(TCHAR);
+		CaptureLine(Line.Data.Get(), Line.Verbosity, Line.Category.Resolve(), Line.Time, IngestingStreams[NumIngestedLines], LineBytes);
+		IngestedBytes += GetLineMemory(LineBytes);
+	}
+
+	// The accounting moved to the lanes with the lines
+	FScopeLock ScopeLock(&SynchronizationObject);
+	StartupBytes -= IngestedBytes;
+}
+
+void FCapsaOutputDevice::CompleteStartup()
+{
+	check(IsInGameThread());
+
+	if (StartupTask.IsValid())
+	{
+		StartupTask.Wait();
+	}
+	while (bStartupPending.load(std::memory_order_acquire))
+	{
+		IngestStartupLines(MAX_int32);
+	}
+}
+
+bool FCapsaOutputDevice::TickStartup(float Seconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CapsaTick);
+	FCapsaGameThreadCostScope GameThreadCostScope;
+
+	if (StartupTask.IsValid() && !StartupTask.IsCompleted())
+	{
+		return true;
+	}
+
+	if (bUploadOnTrigger)
+	{
+		// Keeps the ingested lines within the window, or uploads it
+		TickTrigger(FPlatformTime::Seconds());
+	}
+	else if (GetNumBufferedLines() >= MaxLogLines)
+	{
+		// The slice is sent before the next is ingested, so only a slice is buffered while the session is authenticated or the pipeline is full
+		if (ShouldKeepBufferedLines())
+		{
+			return true;
+		}
+		SendBufferedLines();
+		LastUpdateTime = FPlatformTime::Seconds();
+	}
 
+	if (!bStartupPending.load(std::memory_order_acquire))
+	{
+		// The remaining lines are sent by Tick, with the lines logged after them
+		StartupTickerHandle.Reset();
+		return false;
+	}
+
+	StartupTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, MaxLines = MaxLogLines]()
+	{
+		IngestStartupLines(MaxLines);
+	});
 	return true;
 }
 
+bool FCapsaOutputDevice::IsStartupComplete() const
+{
+	return !bStartupPending.load(std::memory_order_acquire);
+}
+
+FCapsaHistorySnapshot FCapsaOutputDevice::GetHistorySnapshot() const
+{
+	if (!History.IsValid())
+	{
+		return FCapsaHistorySnapshot();
+	}
+
+	if (IsInGameThread())
+	{
+		UpdateRedactor();
+	}
+	return History->Snapshot();
+}
+
+void FCapsaOutputDevice::UpdateRedactor() const
+{
+	if (bRedactorSet)
+	{
+		return;
+	}
+
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>() : nullptr;
+	if (CapsaCoreSubsystem == nullptr)
+	{
+		return;
+	}
+
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> Redactor = CapsaCoreSubsystem->GetRedactor();
+	if (History.IsValid())
+	{
+		History->SetRedactor(Redactor);
+	}
+	{
+		FScopeLock ScopeLock(&CrashContextLock);
+		CrashRedactor = MoveTemp(Redactor);
+	}
+	bRedactorSet = true;
+}
+
+void FCapsaOutputDevice::UpdateCrashContext(UCapsaCoreSubsystem& CapsaCoreSubsystem)
+{
+	if (!CrashedLogIDs.IsEmpty() && CapsaCoreSubsystem.IsAuthenticated())
+	{
+		for (const FString& CrashedLogID : CrashedLogIDs)
+		{
+			CapsaCoreSubsystem.RegisterLinkedLogID(CrashedLogID, TEXT("CrashedProcess"));
+		}
+		CrashedLogIDs.Reset();
+	}
+
+	if (!bUploadOnTrigger)
+	{
+		// No crash window is saved
+		return;
+	}
+
+	const FString LogID = CapsaCoreSubsystem.GetLogID();
+	FScopeLock ScopeLock(&CrashContextLock);
+	CrashLogID = LogID;
+}
+
+void FCapsaOutputDevice::Trigger(const FString& Reason)
+{
+	if (!bUploadOnTrigger)
+	{
+		return;
+	}
+
+	FScopeLock ScopeLock(&SynchronizationObject);
+	TriggerLocked(*Reason);
+}
+
 void FCapsaOutputDevice::OnPreExit()
 {
+	if (bUploadOnTrigger)
+	{
+		FScopeLock ScopeLock(&SynchronizationObject);
+		if (PendingTriggerReason.IsEmpty())
+		{
+			// Nothing went wrong, the window is discarded
+			return;
+		}
+	}
+
+	FlushBufferedLines(true);
+}
+
+void FCapsaOutputDevice::TickTrigger(double Now)
+{
+	FString Reason;
+	{
+		FScopeLock ScopeLock(&SynchronizationObject);
+		if (PendingTriggerReason.IsEmpty())
+		{
+			TrimBufferedLines(TriggerLinesBefore);
+			return;
+		}
+
+		const int32 LinesSinceTrigger = BufferedLines.Num() + StructuredLines.Num() - LinesAtTrigger;
+		if (LinesSinceTrigger < TriggerLinesAfter && Now - TriggerTime < TriggerMaxDelay)
+		{
+			// Still collecting the lines after the trigger
+			return;
+		}
+		Reason = PendingTriggerReason;
+	}
+
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
-	if (CapsaCoreSubsystem != nullptr && CapsaCoreSubsystem->IsValidLowLevelFast())
+	if (CapsaCoreSubsystem == nullptr || !CapsaCoreSubsystem->IsValidLowLevelFast())
 	{
-		if (CapsaCoreSubsystem->IsAuthenticated())
+		return;
+	}
+
+	if (!CapsaCoreSubsystem->IsAuthenticated())
+	{
+		// Keep the window until there is a session to upload it to, without letting it grow while waiting
+		{
+			FScopeLock ScopeLock(&SynchronizationObject);
+			LinesAtTrigger = FMath::Max(LinesAtTrigger - TrimBufferedLines(TriggerLinesBefore + TriggerLinesAfter), 0);
+		}
+
+		if (!bTriggerAuthRequested && !CapsaCoreSubsystem->IsAuthenticating())
+		{
+			bTriggerAuthRequested = true;
+			CapsaCoreSubsystem->RequestClientAuth();
+		}
+		return;
+	}
+
+	if (!CapsaCoreSubsystem->CanSendLog())
+	{
+		return;
+	}
+
+	// Logged before flushing, so the reason is part of the uploaded window
+	UE_LOG(LogCapsaLog, Display, TEXT("FCapsaOutputDevice::TickTrigger | Uploading the log window, triggered by %s"), *Reason);
+	bTriggerAuthRequested = false;
+	SendBufferedLines();
+}
+
+void FCapsaOutputDevice::TriggerLocked(const TCHAR* Reason)
+{
+	if (!PendingTriggerReason.IsEmpty())
+	{
+		// Merged into the pending upload
+		return;
+	}
+
+	PendingTriggerReason = Reason;
+	LinesAtTrigger = BufferedLines.Num() + StructuredLines.Num();
+	TriggerTime = FPlatformTime::Seconds();
+}
+
+int32 FCapsaOutputDevice::TrimBufferedLines(int32 MaxLines)
+{
+	const int32 NumToTrim = BufferedLines.Num() + StructuredLines.Num() - MaxLines;
+	if (NumToTrim <= 0)
+	{
+		return 0;
+	}
+
+	// Trim the oldest text lines, and the structured lines captured before them
+	const int32 NumText = FMath::Min(NumToTrim, BufferedLines.Num());
+	int64 TrimmedBytes = 0;
+	for (int32 LineIndex = 0; LineIndex < NumText; ++LineIndex)
+	{
+		TrimmedBytes += sizeof(FBufferedLine) + (FCString::Strlen(BufferedLines[LineIndex].Data.Get()) + 1) * sizeof(TCHAR);
+	}
+
+	int32 NumStructured = 0;
+	for (; NumStructured < StructuredLines.Num(); ++NumStructured)
+	{
+		const bool bBeforeKeptLines = StructuredLines[NumStructured].LineIndex < NumText;
+		const bool bStillTooMany = NumText == BufferedLines.Num() && NumText + NumStructured < NumToTrim;
+		if (!bBeforeKeptLines && !bStillTooMany)
+		{
+			break;
+		}
+		TrimmedBytes += sizeof(FCapsaStructuredLine) + StructuredLines[NumStructured].GetFieldsSize();
+	}
+
+	BufferedLines.RemoveAt(0, NumText);
+	StructuredLines.RemoveAt(0, NumStructured);
+	BufferedSequences.RemoveFirst(NumText + NumStructured);
+	if (!BufferedStreams.IsEmpty())
+	{
+		BufferedStreams.RemoveAt(0, NumText);
+	}
+	for (FCapsaStructuredLine& Line : StructuredLines)
+	{
+		Line.LineIndex -= NumText;
+	}
+
+	BufferedBytes -= TrimmedBytes;
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, -TrimmedBytes);
+
+	return NumText + NumStructured;
+}
+
+void FCapsaOutputDevice::OnSystemEnsure()
+{
+	FScopeLock ScopeLock(&SynchronizationObject);
+	TriggerLocked(TEXT("Ensure"));
+}
+
+void FCapsaOutputDevice::OnSystemError()
+{
+	// The crashing thread may hold the lock, fe. if capturing a line crashed, the window is lost then rather than hanging the crash handler
+	if (!SynchronizationObject.TryLock())
+	{
+		return;
+	}
+
+	// The crashing thread may hold this lock as well, it is only held to copy the context
+	TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> Redactor;
+	FString LogID;
+	if (CrashContextLock.TryLock())
+	{
+		Redactor = CrashRedactor;
+		LogID = CrashLogID;
+		CrashContextLock.Unlock();
+	}
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if (CapsaSettings != nullptr && CapsaSettings->GetRedactLogs() && !Redactor.IsValid())
+	{
+		// Nothing that was not redacted may reach the disk
+		SynchronizationObject.Unlock();
+		return;
+	}
+
+	// Nothing is uploaded while the process crashes, the window is saved and uploaded by the next process, see LoadCrashWindows()
+	FString Content = FString::Printf(TEXT("%s%s\n"), CrashWindowLogIDPrefix, *LogID);
+	const int32 HeaderLength = Content.Len();
+	FString Message;
+	const auto AppendText = [&Content, &Message, &Redactor](const FBufferedLine& Line)
+	{
+		Message = Line.Data.Get();
+		if (Redactor.IsValid())
+		{
+			Redactor->Redact(Message);
+		}
+		AppendCrashWindowLine(Content, Line.Time, Line.Verbosity, Line.Category.Resolve(), Message);
+	};
+	const auto AppendStructured = [&Content, &Message, &Redactor](const FCapsaStructuredLine& Line)
+	{
+		TStringBuilder<512> Builder;
+		Line.Record.FormatMessageTo(Builder);
+		Message = Builder.ToView();
+		if (Redactor.IsValid())
+		{
+			Redactor->Redact(Message);
+		}
+		AppendCrashWindowLine(Content, Line.Time, Line.Record.GetVerbosity(), Line.Record.GetCategory(), Message);
+	};
+
+	FCapsaLogChunk Window;
+	Window.Lines = MoveTemp(BufferedLines);
+	Window.StructuredLines = MoveTemp(StructuredLines);
+	Window.ForEachLine(AppendText, AppendStructured);
+	Window.Lines = MoveTemp(PriorityLines);
+	Window.StructuredLines = MoveTemp(PriorityStructuredLines);
+	Window.ForEachLine(AppendText, AppendStructured);
+	SynchronizationObject.Unlock();
+
+	if (Content.Len() > HeaderLength)
+	{
+		const FString Path = FPaths::Combine(GetCrashWindowDirectory(), FString::Printf(TEXT("CrashWindow-%u.log"), FPlatformProcess::GetCurrentProcessId()));
+		FFileHelper::SaveStringToFile(Content, *Path, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+	}
+}
+
+void FCapsaOutputDevice::LoadCrashWindows()
+{
+	TArray<FString> FileNames;
+	IFileManager::Get().FindFiles(FileNames, *FPaths::Combine(GetCrashWindowDirectory(), TEXT("CrashWindow-*.log")), true, false);
+
+	for (const FString& FileName : FileNames)
+	{
+		const FString Path = FPaths::Combine(GetCrashWindowDirectory(), FileName);
+		FString Content;
+		// Only the process that deletes the file uploads it, when several are started at once
+		if (!FFileHelper::LoadFileToString(Content, *Path) || !IFileManager::Get().Delete(*Path))
+		{
+			continue;
+		}
+
+		TArray<FString> Lines;
+		Content.ParseIntoArray(Lines, TEXT("\n"));
+
+		// Linked once this process is authenticated, the window itself is uploaded to this process' log
+		FString CrashedLogID;
+		if (!Lines.IsEmpty() && Lines[0].StartsWith(CrashWindowLogIDPrefix, ESearchCase::CaseSensitive))
+		{
+			CrashedLogID = Lines[0].RightChop(FCString::Strlen(CrashWindowLogIDPrefix));
+			Lines.RemoveAt(0);
+		}
+		if (!CrashedLogID.IsEmpty())
 		{
-			TArray<FBufferedLine> BufferToSend;
-			GetContents(BufferToSend);
-			CapsaCoreSubsystem->SendLog(BufferToSend, true);
+			CrashedLogIDs.AddUnique(CrashedLogID);
 		}
+
+		FCapsaLogChunk Window;
+		Window.ChunkID = CapsaTrace::AllocateChunkID();
+		Window.Lines.Emplace(*FString::Printf(TEXT("Log window of a previous process that crashed, from %s, log %s"), *FileName,
+			CrashedLogID.IsEmpty() ? TEXT("unknown") : *CrashedLogID), LogCapsaLog.GetCategoryName(), ELogVerbosity::Warning,
+			FDateTime::UtcNow().ToUnixTimestampDecimal());
+
+		for (const FString& Line : Lines)
+		{
+			ParseCrashWindowLine(Line, Window.Lines);
+		}
+
+		// Uploaded with the chunks the pipeline had no room for, once there is a session
+		UnsentChunks.Add(MoveTemp(Window));
+	}
+}
+
+void FCapsaOutputDevice::FlushContents(FCapsaLogChunk& OutChunk)
+{
+	FScopeLock ScopeLock(&SynchronizationObject);
+	FCapsaTraceStageScope TraceScope(PendingChunkID, ECapsaTraceStage::Flush, 0, BufferedLines.Num() + StructuredLines.Num());
+
+	// The chunk includes every line a pending trigger was waiting for
+	PendingTriggerReason.Reset();
+	LinesAtTrigger = 0;
+
+	OutChunk.ChunkID = PendingChunkID;
+	OutChunk.Lane = ECapsaLogLane::Bulk;
+	OutChunk.Lines = MoveTemp(BufferedLines);
+	OutChunk.StructuredLines = MoveTemp(StructuredLines);
+	OutChunk.LineSequences = MoveTemp(BufferedSequences);
+	OutChunk.LineStreams = MoveTemp(BufferedStreams);
+	BufferedLines.Reset();
+	StructuredLines.Reset();
+	BufferedSequences = FCapsaLineSequences();
+	BufferedStreams.Reset();
+
+	// Hand the accounting over with the lines, the receiver releases it once they are processed
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, -BufferedBytes);
+	OutChunk.Bytes = FCapsaLiveBytes(ECapsaMemoryStage::Queued, BufferedBytes);
+	BufferedBytes = 0;
+
+	PendingChunkID = CapsaTrace::AllocateChunkID();
+}
+
+bool FCapsaOutputDevice::FlushPriorityContents(FCapsaLogChunk& OutChunk)
+{
+	FScopeLock ScopeLock(&SynchronizationObject);
+	if (PriorityLines.IsEmpty() && PriorityStructuredLines.IsEmpty())
+	{
+		return false;
+	}
+
+	FCapsaTraceStageScope TraceScope(PriorityChunkID, ECapsaTraceStage::Flush, 0, PriorityLines.Num() + PriorityStructuredLines.Num());
+
+	OutChunk.ChunkID = PriorityChunkID;
+	OutChunk.Lane = ECapsaLogLane::Priority;
+	OutChunk.Lines = MoveTemp(PriorityLines);
+	OutChunk.StructuredLines = MoveTemp(PriorityStructuredLines);
+	OutChunk.LineSequences = MoveTemp(PrioritySequences);
+	OutChunk.LineStreams = MoveTemp(PriorityStreams);
+	PriorityLines.Reset();
+	PriorityStructuredLines.Reset();
+	PrioritySequences = FCapsaLineSequences();
+	PriorityStreams.Reset();
+
+	FCapsaPipelineStats::Get().AddLiveBytes(ECapsaMemoryStage::Buffered, -PriorityBytes);
+	OutChunk.Bytes = FCapsaLiveBytes(ECapsaMemoryStage::Queued, PriorityBytes);
+	PriorityBytes = 0;
+
+	// The next priority line schedules a new deadline. Removing the ticker from its own callback is fine, see OnPriorityDeadline()
+	FTSTicker::GetCoreTicker().RemoveTicker(PriorityTickerHandle);
+	PriorityTickerHandle.Reset();
+	PriorityChunkID = CapsaTrace::AllocateChunkID();
+	return true;
+}
+
+void FCapsaOutputDevice::SchedulePriorityFlushLocked()
+{
+	if (!PriorityTickerHandle.IsValid())
+	{
+		PriorityTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FCapsaOutputDevice::OnPriorityDeadline),
+			PriorityFlushDeadline);
+	}
+}
+
+bool FCapsaOutputDevice::OnPriorityDeadline(float Seconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CapsaTick);
+	LLM_SCOPE_BYTAG(Capsa);
+	FCapsaGameThreadCostScope GameThreadCostScope;
+
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+	if (CapsaCoreSubsystem == nullptr || !CapsaCoreSubsystem->IsValidLowLevelFast() || !CapsaCoreSubsystem->IsAuthenticated()
+		|| !CapsaCoreSubsystem->CanSendLog())
+	{
+		// Without a session the lines are dropped with the bulk lane, see FlushBufferedLines()
+		return true;
 	}
+
+	FCapsaLogChunk PriorityChunk;
+	if (FlushPriorityContents(PriorityChunk))
+	{
+		SendChunk(*CapsaCoreSubsystem, MoveTemp(PriorityChunk), false);
+	}
+	return false;
+}
+
+bool FCapsaOutputDevice::IsPriorityLine(ELogVerbosity::Type Verbosity, const FName& Category) const
+{
+	// Errors of Capsa itself, fe. a failed upload, would otherwise make the priority lane upload again, and fail again
+	return bUsePriorityLane && Verbosity <= PriorityVerbosity && !IsCapsaCategory(Category);
+}
+
+bool FCapsaOutputDevice::ShouldKeepBufferedLines() const
+{
+	const UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+	return CapsaCoreSubsystem != nullptr
+		&& (CapsaCoreSubsystem->IsAuthenticating() || (CapsaCoreSubsystem->IsAuthenticated() && !CapsaCoreSubsystem->CanSendLog()));
+}
+
+int32 FCapsaOutputDevice::GetNumBufferedLines() const
+{
+	// Read without the lock, like the rest of Tick, the count only decides whether to flush
+	return BufferedLines.Num() + StructuredLines.Num() + PriorityLines.Num() + PriorityStructuredLines.Num();
 }
@@ -12,6 +12,7 @@
 #endif
 
 // Forward Declarations
+struct FCapsaHistorySnapshot;
 struct FCapsaOutputDevice;
 
 /// UCapsaLogSubsystem is responsible for attaching the FCapsaOutputDevice.
@@ -26,6 +27,28 @@ public:
 	virtual void Deinitialize() override;
 	// End USubsystem
 
+	/// Takes a snapshot of the in-memory log history, see UCapsaSettings::GetHistorySizeMB(). The compressed blocks are shared with the history,
+	/// only the lines captured since the last block was sealed are copied, so this is cheap enough to call from ensure and crash handlers.
+	/// @return FCapsaHistorySnapshot The snapshot, empty if there is no history.
+	FCapsaHistorySnapshot GetHistorySnapshot() const;
+
+	/// Returns the in-memory log history as text, fe. to show or attach it in an in-game bug reporter.
+	/// @return FString The lines in the history, empty if there is no history.
+	UFUNCTION(BlueprintCallable, Category = "Capsa|Log")
+	FString GetHistoryAsString() const;
+
+	/// Writes the in-memory log history to a gzip file, without decompressing it.
+	/// @param FilePath The file to write, conventionally ending in .log.gz.
+	/// @return bool True if the file was written, false if it could not be written or there is no history.
+	UFUNCTION(BlueprintCallable, Category = "Capsa|Log")
+	bool SaveHistoryToFile(const FString& FilePath) const;
+
+	/// Uploads the window of lines around this call, when UCapsaSettings::GetUploadMode() is OnTrigger, fe. when the player files a bug report.
+	/// Does nothing when every line is streamed.
+	/// @param Reason Why the upload was triggered, logged with the upload.
+	UFUNCTION(BlueprintCallable, Category = "Capsa|Log")
+	void TriggerLogUpload(const FString& Reason);
+
 protected:
 	/// The collector for Logs that registers itself with Log/Output Redirector and handles compressing/uploading logs to the remote service.
 	TPimplPtr<FCapsaOutputDevice> CapsaLogOutputDevice;
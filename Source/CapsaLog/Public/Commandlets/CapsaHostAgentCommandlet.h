@@ -0,0 +1,35 @@
+// Copyright capsa.gg. Made available under the MIT license
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "CapsaHostAgentCommandlet.generated.h"
+
+/// Host agent that batches, compresses and uploads the log chunks of every game instance on the host, so dedicated server instances only format
+/// their lines and write them to a Unix domain socket, see UCapsaSettings::GetUseHostAgent() and FCapsaHostAgentClient.
+///
+/// Every instance authenticates itself and tells the agent its LogID, token and endpoint, so its lines are uploaded to its own log. The bulk chunks
+/// of an instance are concatenated until they reach -BatchKB or are -BatchDelay seconds old, then compressed on the task graph and uploaded with
+/// the chunk sequence the instance allocated for their first chunk, their lane and line sequences. Priority chunks are uploaded as they arrive.
+/// Uploads rejected with 401 are sent again with the token of the next Session frame of their instance, which refreshes its token itself.
+///
+/// Runs until the process is asked to exit, fe. with SIGTERM, then uploads what it has batched. Linux only.
+///
+/// Usage: UnrealEditor-Cmd <Project> -run=CapsaHostAgent [options]
+///  -Socket=<path>                The Unix domain socket to listen on. Default UCapsaSettings::GetHostAgentSocketPath().
+///  -BatchKB=<n>                  Uncompressed size at which the chunks of an instance are uploaded. Default 1024.
+///  -BatchDelay=<seconds>         Maximum time chunks wait for their batch to fill. Default 2.
+///  -StatsInterval=<seconds>      How often to log throughput. Default 60, 0 disables.
+UCLASS()
+class CAPSALOG_API UCapsaHostAgentCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UCapsaHostAgentCommandlet();
+
+	// Begin UCommandlet
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet
+};
@@ -3,10 +3,19 @@
 #pragma once
 
 #include "Engine.h"
+#include "CapsaLogChunk.h"
 #include "Misc/BufferedOutputDevice.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+
+class FCapsaHistoryRing;
+class FCapsaRedactor;
+class UCapsaCoreSubsystem;
+struct FCapsaHistorySnapshot;
 
 /// Output device that Capsa uses to collect logs
-struct FCapsaOutputDevice : public FBufferedOutputDevice
+struct CAPSALOG_API FCapsaOutputDevice : public FBufferedOutputDevice
 {
 public:
 	FCapsaOutputDevice();
@@ -14,8 +23,32 @@ public:
 
 	// FBufferedOutputDevice
 	virtual void Serialize(const TCHAR* InData, ELogVerbosity::Type Verbosity, const FName& Category) override;
+	virtual void SerializeRecord(const UE::FLogRecord& Record) override;
 	// ~FBufferedOutputDevice
 
+	/// Hands all buffered lines of both lanes to the UCapsaCoreSubsystem, regardless of UpdateRate and MaxLogLines. The priority lane is sent first,
+	/// the bulk lane stays buffered if the priority chunk filled the upload pipeline, unless blocking.
+	/// If there is no authenticated session, an authentication attempt is made instead and the buffered lines are dropped.
+	/// Lines still staged from startup are ingested first, see IsStartupComplete(). Game thread only.
+	/// Not an overload of FOutputDevice::Flush(), which the engine calls on every output device, fe. through GLog->Flush(), and which does not upload.
+	/// @param bBlocking Make sending the log a blocking operation, should only be used during shutdown, default=false
+	void FlushBufferedLines(bool bBlocking = false);
+
+	/// Takes a snapshot of the in-memory log history, which is empty if UCapsaSettings::GetHistorySizeMB() is 0. The snapshot redacts its lines as
+	/// they are exported, when UCapsaSettings::GetRedactLogs() is enabled.
+	/// @return FCapsaHistorySnapshot The snapshot, sharing the compressed blocks of the history.
+	FCapsaHistorySnapshot GetHistorySnapshot() const;
+
+	/// Uploads the buffered window of lines, when uploading on trigger, see UCapsaSettings::GetUploadMode(). The upload waits for
+	/// UCapsaSettings::GetTriggerLinesAfter() more lines, or UCapsaSettings::GetTriggerMaxDelay() seconds. Triggers while one is pending are merged.
+	/// Does nothing when streaming, as every line is uploaded anyway.
+	/// @param Reason Why the upload was triggered, logged with the upload.
+	void Trigger(const FString& Reason);
+
+	/// Whether the lines captured while starting up, fe. the engine startup backlog, have been ingested, see IngestStartupLines().
+	/// @return bool False while lines are only staged.
+	bool IsStartupComplete() const;
+
 protected:
 	/// Perform any specific Initialization.
 	virtual void Initialize();
@@ -25,9 +58,117 @@ protected:
 	/// @return bool True if Tick was handled correctly, otherwise false.
 	bool Tick(float Seconds);
 
+	/// Ingests a slice of the lines staged while starting up. Every captured line is staged until the staging buffer is drained, so the startup
+	/// lines keep their order with the lines logged meanwhile. Runs on a background task launched by TickStartup(), one slice at a time.
+	/// @param MaxLines The maximum number of lines to ingest.
+	void IngestStartupLines(int32 MaxLines);
+
+	/// Ingests every staged line on the calling thread, after waiting for the slice in flight. Game thread only.
+	void CompleteStartup();
+
+	/// Ingests the staged lines in slices of MaxLogLines, and sends every slice as a chunk of its own before ingesting the next, so a large startup
+	/// backlog neither stalls the game thread nor lands in one chunk. Bound to the core ticker, every frame, until the staged lines are drained.
+	/// @param Seconds The number of seconds since the last tick.
+	/// @return bool False once startup is complete, Tick takes over.
+	bool TickStartup(float Seconds);
+
+	/// Buffers a captured line in its lane, adds it to the history and evaluates triggers.
+	/// @param InData The text of the line.
+	/// @param Verbosity The verbosity of the line.
+	/// @param Category The category of the line.
+	/// @param Time The capture time, as a Unix timestamp.
+	/// @param Stream The log stream of the line.
+	/// @param LineBytes The size of the text in bytes. The line is already recorded in FCapsaPipelineStats.
+	void CaptureLine(const TCHAR* InData, ELogVerbosity::Type Verbosity, const FName& Category, double Time, uint16 Stream, int64 LineBytes);
+
+	/// Hands the buffered lines of both lanes to the UCapsaCoreSubsystem, see FlushBufferedLines(), without ingesting the staged lines first.
+	/// @param bBlocking Make sending the log a blocking operation, should only be used during shutdown, default=false
+	void SendBufferedLines(bool bBlocking = false);
+
+	/// Whether buffered lines are kept rather than sent: while the session is being authenticated, or the upload pipeline is full.
+	/// @return bool True if the lines should be sent on a later tick.
+	bool ShouldKeepBufferedLines() const;
+
 	/// Callback fired when the application is about to be shutdown. Bound to FCoreDelegates::OnEnginePreExit.
 	void OnPreExit();
 
+	/// Tick when uploading on trigger: keeps the buffered lines within the window, and flushes them once a pending trigger has collected its lines.
+	/// @param Now The current time, in FPlatformTime::Seconds().
+	void TickTrigger(double Now);
+
+	/// Sets the pending trigger, unless one is pending already. Must be called with SynchronizationObject held.
+	/// @param Reason Why the upload was triggered.
+	void TriggerLocked(const TCHAR* Reason);
+
+	/// Discards the oldest buffered lines, text and structured, until at most MaxLines remain. Must be called with SynchronizationObject held.
+	/// @param MaxLines The number of lines to keep.
+	/// @return int32 The number of discarded lines.
+	int32 TrimBufferedLines(int32 MaxLines);
+
+	/// Callback fired when an ensure fails. Bound to FCoreDelegates::OnHandleSystemEnsure when uploading on trigger.
+	void OnSystemEnsure();
+
+	/// Callback fired when the game crashes. Bound to FCoreDelegates::OnHandleSystemError when uploading on trigger. Saves the buffered window to
+	/// Saved/Capsa/CrashWindow-<ProcessID>.log rather than uploading it, as an upload could hang the crashing process. The file starts with the
+	/// LogID of the process. With UCapsaSettings::GetRedactLogs() the lines are redacted, and no file is written until the redactor is compiled.
+	void OnSystemError();
+
+	/// Queues the windows saved by crashed processes, see OnSystemError(), to be uploaded to the session of this process once it is authenticated,
+	/// and links the logs of the crashed processes to it. The files are deleted once loaded.
+	void LoadCrashWindows();
+
+	/// Keeps the LogID and redactor OnSystemError() needs up to date, and links the logs of crashed processes. Game thread only.
+	/// @param CapsaCoreSubsystem The subsystem.
+	void UpdateCrashContext(UCapsaCoreSubsystem& CapsaCoreSubsystem);
+
+	/// The LogID of this process and the redactor, copied for OnSystemError(), which may run on any thread. Guarded by CrashContextLock.
+	FString CrashLogID;
+	mutable TSharedPtr<const FCapsaRedactor, ESPMode::ThreadSafe> CrashRedactor;
+	mutable FCriticalSection CrashContextLock;
+
+	/// The LogIDs of the crashed processes LoadCrashWindows() found, linked by UpdateCrashContext(). Game thread only.
+	TArray<FString> CrashedLogIDs;
+
+	/// Moves all buffered lines, text and structured, out of the device and starts a new chunk.
+	/// @param OutChunk The chunk to move the buffered lines into. Its memory accounting is attributed to ECapsaMemoryStage::Queued.
+	void FlushContents(FCapsaLogChunk& OutChunk);
+
+	/// Moves all lines of the priority lane out of the device and starts a new priority chunk.
+	/// @param OutChunk The chunk to move the lines into. Its memory accounting is attributed to ECapsaMemoryStage::Queued.
+	/// @return bool False if the priority lane was empty.
+	bool FlushPriorityContents(FCapsaLogChunk& OutChunk);
+
+	/// Sends a flushed chunk, split into a chunk per log stream when world streams are used, see FCapsaLogChunk::SplitStreams(). Chunks the upload
+	/// pipeline has no room for are kept in UnsentChunks.
+	/// @param CapsaCoreSubsystem The subsystem to send the chunks with.
+	/// @param Chunk The flushed chunk, skipped if it has no lines.
+	/// @param bBlocking Make sending the log a blocking operation, should only be used during shutdown.
+	void SendChunk(UCapsaCoreSubsystem& CapsaCoreSubsystem, FCapsaLogChunk&& Chunk, bool bBlocking);
+
+	/// Sends the chunks in UnsentChunks, in order, while the upload pipeline has room for them.
+	/// @param CapsaCoreSubsystem The subsystem to send the chunks with.
+	/// @param bBlocking Make sending the log a blocking operation, sends every chunk. Should only be used during shutdown.
+	/// @return bool True if every chunk was sent.
+	bool SendUnsentChunks(UCapsaCoreSubsystem& CapsaCoreSubsystem, bool bBlocking);
+
+	/// Schedules OnPriorityDeadline() for the first line of the priority lane. Must be called with SynchronizationObject held.
+	void SchedulePriorityFlushLocked();
+
+	/// Sends the priority lane, PriorityFlushDeadline seconds after its first line was captured. Bound to the core ticker while the lane has lines.
+	/// @param Seconds The number of seconds since the ticker was added or last fired.
+	/// @return bool True to try again after another PriorityFlushDeadline, while there is no session or the upload pipeline is full.
+	bool OnPriorityDeadline(float Seconds);
+
+	/// Whether a line is captured into the priority lane.
+	/// @param Verbosity The verbosity of the line.
+	/// @param Category The category of the line.
+	/// @return bool True if the priority lane is used and the line is severe enough.
+	bool IsPriorityLine(ELogVerbosity::Type Verbosity, const FName& Category) const;
+
+	/// Total number of buffered lines of both lanes, text and structured.
+	/// @return int32 The number of buffered lines.
+	int32 GetNumBufferedLines() const;
+
 	/// How fast, in seconds, to update this Output Device.
 	float TickRate;
 
@@ -40,4 +181,94 @@ protected:
 private:
 	FTSTicker::FDelegateHandle TickerHandle;
 	double LastUpdateTime;
+
+	/// The chunk ID the currently buffered lines will be sent as. Used to follow lines from capture to upload in Capsa trace events.
+	/// Guarded by SynchronizationObject.
+	uint64 PendingChunkID;
+
+	/// Memory held by BufferedLines and StructuredLines, see Capsa.MemReport. Guarded by SynchronizationObject.
+	int64 BufferedBytes;
+
+	/// Chunks that were flushed, but not sent as the upload pipeline was full, fe. the chunks split by log stream after the first. Sent before the
+	/// next flush. Game thread only.
+	TArray<FCapsaLogChunk> UnsentChunks;
+
+	/// Whether structured records are captured into StructuredLines, see UCapsaSettings::GetCaptureStructuredLogs().
+	bool bCaptureStructuredLogs;
+
+	/// Structured records captured since the last flush, rendered when the chunk is formatted. Guarded by SynchronizationObject.
+	TArray<FCapsaStructuredLine> StructuredLines;
+
+	/// Whether lines are only uploaded when a trigger fires, see UCapsaSettings::GetUploadMode().
+	bool bUploadOnTrigger;
+
+	/// The window kept around a trigger, see UCapsaSettings.
+	int32 TriggerLinesBefore;
+	int32 TriggerLinesAfter;
+	float TriggerMaxDelay;
+
+	/// Why the pending upload was triggered, empty if no trigger is pending. Guarded by SynchronizationObject.
+	FString PendingTriggerReason;
+
+	/// The number of buffered lines when the pending trigger fired, and when, in FPlatformTime::Seconds(). Guarded by SynchronizationObject.
+	int32 LinesAtTrigger;
+	double TriggerTime;
+
+	/// Whether authentication was requested for the pending trigger, so it is only requested once. Game thread only.
+	bool bTriggerAuthRequested;
+
+	/// Whether lines at or above PriorityVerbosity are captured into the priority lane, see UCapsaSettings::GetUsePriorityLane().
+	bool bUsePriorityLane;
+	ELogVerbosity::Type PriorityVerbosity;
+	float PriorityFlushDeadline;
+
+	/// The priority lane, flushed as its own chunks. Guarded by SynchronizationObject.
+	TArray<FBufferedLine> PriorityLines;
+	TArray<FCapsaStructuredLine> PriorityStructuredLines;
+	int64 PriorityBytes;
+	uint64 PriorityChunkID;
+
+	/// Fires OnPriorityDeadline(), valid while the priority lane has lines. Guarded by SynchronizationObject.
+	FTSTicker::FDelegateHandle PriorityTickerHandle;
+
+	/// The capture sequence number of the next line, shared by both lanes, and those of the lines buffered in each lane. Guarded by SynchronizationObject.
+	uint64 NextLineSequence;
+	FCapsaLineSequences BufferedSequences;
+	FCapsaLineSequences PrioritySequences;
+
+	/// Whether lines are tagged with their log stream, see UCapsaSettings::GetUseWorldStreams().
+	bool bUseWorldStreams;
+
+	/// The log stream of every buffered text line of each lane, empty unless bUseWorldStreams. Guarded by SynchronizationObject.
+	TArray<uint16> BufferedStreams;
+	TArray<uint16> PriorityStreams;
+
+	/// Whether captured lines are staged rather than buffered, until IngestStartupLines() has drained StartupLines. Never set again once cleared.
+	std::atomic<bool> bStartupPending;
+
+	/// Lines captured while starting up, with their log streams, and the memory they hold. Guarded by SynchronizationObject.
+	TArray<FBufferedLine> StartupLines;
+	TArray<uint16> StartupStreams;
+	int64 StartupBytes;
+
+	/// The staged lines taken by the ingestion, and how many of them are ingested. Only accessed by the slice in flight, see StartupTask.
+	TArray<FBufferedLine> IngestingLines;
+	TArray<uint16> IngestingStreams;
+	int32 NumIngestedLines;
+
+	/// Runs IngestStartupLines() for the last slice, valid once TickStartup() has launched one.
+	UE::Tasks::FTask StartupTask;
+
+	/// Fires TickStartup(), valid while startup lines are staged.
+	FTSTicker::FDelegateHandle StartupTickerHandle;
+
+	/// The most recent lines, kept independent of uploading. Only set if UCapsaSettings::GetHistorySizeMB() is above 0.
+	TSharedPtr<FCapsaHistoryRing, ESPMode::ThreadSafe> History;
+
+	/// Hands the redactor of the UCapsaCoreSubsystem to History and to OnSystemError(), once. Game thread only, snapshots taken on other threads before
+	/// it was handed over, fe. by an ensure early during startup, are not redacted.
+	void UpdateRedactor() const;
+
+	/// Whether UpdateRedactor() handed the redactor over. Game thread only.
+	mutable bool bRedactorSet = false;
 };